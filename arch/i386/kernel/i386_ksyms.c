@@ -141,6 +141,7 @@ EXPORT_SYMBOL(__read_lock_failed);
 
 /* Global SMP stuff */
 EXPORT_SYMBOL(smp_call_function);
+EXPORT_SYMBOL(smp_call_function_single);
 
 /* TLB flushing */
 EXPORT_SYMBOL(flush_tlb_page);
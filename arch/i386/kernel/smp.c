@@ -533,7 +533,11 @@ int smp_call_function (void (*func) (void *info), void *info, int nonatomic,
 	if (wait)
 		atomic_set(&data.finished, 0);
 
-	spin_lock(&call_lock);
+	/*
+	 * BHs stay off while the lock is held, so that
+	 * smp_call_function_single() can be used from softirqs.
+	 */
+	spin_lock_bh(&call_lock);
 	call_data = &data;
 	mb();
 	
@@ -547,7 +551,58 @@ int smp_call_function (void (*func) (void *info), void *info, int nonatomic,
 	if (wait)
 		while (atomic_read(&data.finished) != cpus)
 			cpu_relax();
-	spin_unlock(&call_lock);
+	spin_unlock_bh(&call_lock);
+
+	return 0;
+}
+
+/*
+ * smp_call_function_single - run a function on one other CPU.
+ * @cpu: The target CPU, must be online and not the calling one.
+ * @func: The function to run. This must be fast and non-blocking.
+ * @info: An arbitrary pointer to pass to the function.
+ * @nonatomic: currently unused.
+ * @wait: If true, wait until function has completed on the other CPU.
+ *
+ * Returns 0 on success, else a negative status code.  Like
+ * smp_call_function() it must be called with interrupts enabled, but
+ * unlike it, it may be called from a bottom half handler.
+ */
+int smp_call_function_single(int cpu, void (*func) (void *info), void *info,
+			     int nonatomic, int wait)
+{
+	struct call_data_struct data;
+	int me = get_cpu();
+
+	if (cpu == me || !cpu_online(cpu)) {
+		put_cpu();
+		return -EINVAL;
+	}
+
+	/* Can deadlock when called with interrupts disabled */
+	WARN_ON(irqs_disabled());
+
+	data.func = func;
+	data.info = info;
+	atomic_set(&data.started, 0);
+	data.wait = wait;
+	if (wait)
+		atomic_set(&data.finished, 0);
+
+	spin_lock_bh(&call_lock);
+	call_data = &data;
+	mb();
+
+	send_IPI_mask(cpumask_of_cpu(cpu), CALL_FUNCTION_VECTOR);
+
+	while (!atomic_read(&data.started))
+		cpu_relax();
+
+	if (wait)
+		while (!atomic_read(&data.finished))
+			cpu_relax();
+	spin_unlock_bh(&call_lock);
+	put_cpu();
 
 	return 0;
 }
@@ -0,0 +1,535 @@
+/*
+ * Socket filter JIT compiler for i386 and x86_64.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ *
+ * Turns a filter that has passed sk_chk_filter() into a native function
+ * which returns what sk_run_filter() would.  A lives in eax and X in
+ * ebx; the scratch memory, the skb and its linear data are kept in the
+ * stack frame.  Loads within the linear data are done inline, all
+ * others by sk_filter_load(), so the odd cases behave exactly as in the
+ * interpreter.
+ *
+ * Every instruction is encoded with a fixed size, 32 bit displacements
+ * for all jumps included, so a first pass over the filter finds the
+ * address of every instruction and the second emits the code.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleloader.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/skbuff.h>
+#include <linux/filter.h>
+
+/* Stack frame, below the saved frame pointer */
+#define W		((int)sizeof(long))
+#define FRAME_RBX	(-W)			/* saved X register */
+#define FRAME_MEM	(FRAME_RBX - 4 * BPF_MEMWORDS)
+#define FRAME_SKB	(FRAME_MEM - W)
+#define FRAME_DATA	(FRAME_SKB - W)		/* skb->data */
+#define FRAME_HLEN	(FRAME_DATA - 4)	/* skb_headlen(skb) */
+#define FRAME_VAL	(FRAME_HLEN - 4)	/* sk_filter_load() result */
+#define FRAME_LOCALS	(-FRAME_VAL - W)	/* below the saved rbx */
+
+#define MEM(k)		((u8)(FRAME_MEM + 4 * (k)))
+#define DISP(off)	((u8)(off))
+
+/* Condition codes, for 0x0f 0x80+cc */
+#define X86_JB		0x2
+#define X86_JAE		0x3
+#define X86_JE		0x4
+#define X86_JNE		0x5
+#define X86_JBE		0x6
+#define X86_JA		0x7
+#define X86_JS		0x8
+
+struct bpf_jit_insn {
+	unsigned int addr;	/* start of the instruction's code */
+	unsigned int slow;	/* loads: call to sk_filter_load() */
+	unsigned int done;	/* loads: end of the instruction */
+};
+
+struct bpf_jit {
+	u8 *image;		/* NULL in the first pass */
+	unsigned int len;
+	struct bpf_jit_insn *insn;
+	unsigned int ret0;	/* return 0 */
+	unsigned int exit;	/* return A */
+};
+
+/* The code is preceded by what is needed to free it */
+struct bpf_jit_image {
+	struct work_struct work;
+	u8 code[0];
+};
+
+static inline void emit(struct bpf_jit *j, u32 bytes, unsigned int n)
+{
+	if (j->image)
+		memcpy(j->image + j->len, &bytes, n);
+	j->len += n;
+}
+
+#define EMIT1(b1)		emit(j, (b1), 1)
+#define EMIT2(b1, b2)		emit(j, (b1) | ((b2) << 8), 2)
+#define EMIT3(b1, b2, b3)	emit(j, (b1) | ((b2) << 8) | ((b3) << 16), 3)
+#define EMIT4(b1, b2, b3, b4)	\
+	emit(j, (b1) | ((b2) << 8) | ((b3) << 16) | ((u32)(b4) << 24), 4)
+#define EMIT_IMM32(v)		emit(j, (u32)(v), 4)
+
+/* Prefix for pointer sized operations */
+#ifdef CONFIG_X86_64
+#define EMIT_PTR()		EMIT1(0x48)
+#else
+#define EMIT_PTR()		do { } while (0)
+#endif
+
+static void emit_jmp(struct bpf_jit *j, unsigned int target)
+{
+	EMIT1(0xe9);
+	EMIT_IMM32(target - (j->len + 4));
+}
+
+static void emit_jcc(struct bpf_jit *j, int cc, unsigned int target)
+{
+	EMIT2(0x0f, 0x80 | cc);
+	EMIT_IMM32(target - (j->len + 4));
+}
+
+/* A = sk_filter_load(skb, ecx, size), or return 0 */
+static void emit_load_call(struct bpf_jit *j, unsigned int size)
+{
+#ifdef CONFIG_X86_64
+	EMIT4(0x48, 0x8b, 0x7d, DISP(FRAME_SKB));	/* mov rdi,[rbp+skb] */
+	EMIT2(0x89, 0xce);				/* mov esi,ecx */
+	EMIT1(0xba);					/* mov edx,size */
+	EMIT_IMM32(size);
+	EMIT4(0x48, 0x8d, 0x4d, DISP(FRAME_VAL));	/* lea rcx,[rbp+val] */
+	EMIT2(0x48, 0xb8);				/* mov rax,func */
+	EMIT_IMM32((unsigned long)sk_filter_load);
+	EMIT_IMM32((unsigned long)sk_filter_load >> 32);
+	EMIT2(0xff, 0xd0);				/* call rax */
+#else
+	EMIT3(0x8d, 0x55, DISP(FRAME_VAL));		/* lea edx,[ebp+val] */
+	EMIT1(0x52);					/* push edx */
+	EMIT1(0x68);					/* push size */
+	EMIT_IMM32(size);
+	EMIT1(0x51);					/* push ecx */
+	EMIT3(0xff, 0x75, DISP(FRAME_SKB));		/* push [ebp+skb] */
+	EMIT1(0xb8);					/* mov eax,func */
+	EMIT_IMM32((unsigned long)sk_filter_load);
+	EMIT2(0xff, 0xd0);				/* call eax */
+	EMIT3(0x83, 0xc4, 0x10);			/* add esp,16 */
+#endif
+	EMIT2(0x85, 0xc0);				/* test eax,eax */
+	emit_jcc(j, X86_JE, j->ret0);
+	EMIT3(0x8b, 0x45, DISP(FRAME_VAL));		/* mov eax,[rbp+val] */
+}
+
+/* The load itself, from [rcx+k] (abs) or [rdx+rcx] (ind) */
+static void emit_load_linear(struct bpf_jit *j, unsigned int size, int abs,
+			     u32 k)
+{
+	u8 modrm = abs ? 0x81 : 0x04;
+
+	switch (size) {
+	case 4:
+		EMIT2(0x8b, modrm);			/* mov eax,[...] */
+		break;
+	case 2:
+		EMIT3(0x0f, 0xb7, modrm);		/* movzx eax,word [...] */
+		break;
+	default:
+		EMIT3(0x0f, 0xb6, modrm);		/* movzx eax,byte [...] */
+		break;
+	}
+	if (abs)
+		EMIT_IMM32(k);
+	else
+		EMIT1(0x0a);				/* SIB: rdx+rcx */
+
+	if (size == 4)
+		EMIT2(0x0f, 0xc8);			/* bswap eax */
+	else if (size == 2)
+		EMIT4(0x66, 0xc1, 0xc0, 0x08);		/* rol ax,8 */
+}
+
+/* BPF_LD|BPF_ABS: A = ntoh(packet[k]) */
+static void emit_load_abs(struct bpf_jit *j, struct bpf_jit_insn *in,
+			  int k, unsigned int size)
+{
+	if (k >= 0) {
+		/* cmp dword [rbp+hlen],k+size; jb slow */
+		EMIT3(0x81, 0x7d, DISP(FRAME_HLEN));
+		EMIT_IMM32(k + size);
+		emit_jcc(j, X86_JB, in->slow);
+		EMIT_PTR();
+		EMIT3(0x8b, 0x4d, DISP(FRAME_DATA));	/* mov rcx,[rbp+data] */
+		emit_load_linear(j, size, 1, k);
+		emit_jmp(j, in->done);
+	}
+
+	in->slow = j->len;
+	EMIT1(0xb9);					/* mov ecx,k */
+	EMIT_IMM32(k);
+	emit_load_call(j, size);
+	in->done = j->len;
+}
+
+/* BPF_LD|BPF_IND: A = ntoh(packet[X + k]) */
+static void emit_load_ind(struct bpf_jit *j, struct bpf_jit_insn *in,
+			  u32 k, unsigned int size)
+{
+	EMIT2(0x89, 0xd9);				/* mov ecx,ebx */
+	EMIT2(0x81, 0xc1);				/* add ecx,k */
+	EMIT_IMM32(k);
+	EMIT2(0x85, 0xc9);				/* test ecx,ecx */
+	emit_jcc(j, X86_JS, in->slow);
+	EMIT3(0x8d, 0x51, size);			/* lea edx,[rcx+size] */
+	EMIT3(0x3b, 0x55, DISP(FRAME_HLEN));		/* cmp edx,[rbp+hlen] */
+	emit_jcc(j, X86_JA, in->slow);
+	EMIT_PTR();
+	EMIT3(0x8b, 0x55, DISP(FRAME_DATA));		/* mov rdx,[rbp+data] */
+	emit_load_linear(j, size, 0, 0);
+	emit_jmp(j, in->done);
+
+	in->slow = j->len;
+	emit_load_call(j, size);
+	in->done = j->len;
+}
+
+/* Conditional jump on the flags just set: jt if cc holds, else jf */
+static void emit_cond(struct bpf_jit *j, int cc, int pc,
+		      const struct sock_filter *f)
+{
+	unsigned int t = j->insn[pc + 1 + f->jt].addr;
+	unsigned int e = j->insn[pc + 1 + f->jf].addr;
+
+	if (f->jt == f->jf) {
+		if (f->jt)
+			emit_jmp(j, t);
+	} else if (f->jt == 0) {
+		emit_jcc(j, cc ^ 1, e);
+	} else {
+		emit_jcc(j, cc, t);
+		if (f->jf)
+			emit_jmp(j, e);
+	}
+}
+
+static void emit_prologue(struct bpf_jit *j)
+{
+	EMIT1(0x55);					/* push rbp */
+	EMIT_PTR();
+	EMIT2(0x89, 0xe5);				/* mov rbp,rsp */
+	EMIT1(0x53);					/* push rbx */
+	EMIT_PTR();
+	EMIT3(0x83, 0xec, FRAME_LOCALS);			/* sub rsp,frame */
+
+	EMIT2(0x31, 0xc0);				/* xor eax,eax */
+	EMIT2(0x31, 0xdb);				/* xor ebx,ebx */
+
+#ifdef CONFIG_X86_64
+	EMIT4(0x48, 0x89, 0x7d, DISP(FRAME_SKB));	/* mov [rbp+skb],rdi */
+#else
+	EMIT3(0x8b, 0x4d, 0x08);			/* mov ecx,[ebp+8] */
+	EMIT3(0x89, 0x4d, DISP(FRAME_SKB));		/* mov [ebp+skb],ecx */
+#endif
+	EMIT_PTR();
+	EMIT3(0x8b, 0x4d, DISP(FRAME_SKB));		/* mov rcx,[rbp+skb] */
+	EMIT2(0x8b, 0x91);				/* mov edx,[rcx+len] */
+	EMIT_IMM32(offsetof(struct sk_buff, len));
+	EMIT2(0x2b, 0x91);				/* sub edx,[rcx+data_len] */
+	EMIT_IMM32(offsetof(struct sk_buff, data_len));
+	EMIT3(0x89, 0x55, DISP(FRAME_HLEN));		/* mov [rbp+hlen],edx */
+	EMIT_PTR();
+	EMIT2(0x8b, 0x91);				/* mov rdx,[rcx+data] */
+	EMIT_IMM32(offsetof(struct sk_buff, data));
+	EMIT_PTR();
+	EMIT3(0x89, 0x55, DISP(FRAME_DATA));		/* mov [rbp+data],rdx */
+}
+
+static void emit_epilogue(struct bpf_jit *j)
+{
+	j->ret0 = j->len;
+	EMIT2(0x31, 0xc0);				/* xor eax,eax */
+	j->exit = j->len;
+	EMIT_PTR();
+	EMIT3(0x8b, 0x5d, DISP(FRAME_RBX));		/* mov rbx,[rbp-8] */
+	EMIT1(0xc9);					/* leave */
+	EMIT1(0xc3);					/* ret */
+}
+
+static void bpf_jit_emit(struct bpf_jit *j, const struct sock_filter *filter,
+			 int flen)
+{
+	const struct sock_filter *f;
+	struct bpf_jit_insn *in;
+	int pc;
+
+	j->len = 0;
+	emit_prologue(j);
+
+	for (pc = 0; pc < flen; pc++) {
+		f = &filter[pc];
+		in = &j->insn[pc];
+		in->addr = j->len;
+
+		switch (f->code) {
+		case BPF_ALU|BPF_ADD|BPF_X:
+			EMIT2(0x01, 0xd8);		/* add eax,ebx */
+			break;
+		case BPF_ALU|BPF_ADD|BPF_K:
+			EMIT1(0x05);			/* add eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_ALU|BPF_SUB|BPF_X:
+			EMIT2(0x29, 0xd8);		/* sub eax,ebx */
+			break;
+		case BPF_ALU|BPF_SUB|BPF_K:
+			EMIT1(0x2d);			/* sub eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_ALU|BPF_MUL|BPF_X:
+			EMIT3(0x0f, 0xaf, 0xc3);	/* imul eax,ebx */
+			break;
+		case BPF_ALU|BPF_MUL|BPF_K:
+			EMIT2(0x69, 0xc0);		/* imul eax,eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_ALU|BPF_DIV|BPF_X:
+			EMIT2(0x85, 0xdb);		/* test ebx,ebx */
+			emit_jcc(j, X86_JE, j->ret0);
+			EMIT2(0x31, 0xd2);		/* xor edx,edx */
+			EMIT2(0xf7, 0xf3);		/* div ebx */
+			break;
+		case BPF_ALU|BPF_DIV|BPF_K:
+			if (f->k == 0) {
+				emit_jmp(j, j->ret0);
+				break;
+			}
+			EMIT1(0xb9);			/* mov ecx,k */
+			EMIT_IMM32(f->k);
+			EMIT2(0x31, 0xd2);		/* xor edx,edx */
+			EMIT2(0xf7, 0xf1);		/* div ecx */
+			break;
+		case BPF_ALU|BPF_AND|BPF_X:
+			EMIT2(0x21, 0xd8);		/* and eax,ebx */
+			break;
+		case BPF_ALU|BPF_AND|BPF_K:
+			EMIT1(0x25);			/* and eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_ALU|BPF_OR|BPF_X:
+			EMIT2(0x09, 0xd8);		/* or eax,ebx */
+			break;
+		case BPF_ALU|BPF_OR|BPF_K:
+			EMIT1(0x0d);			/* or eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		/* Shift counts go mod 32, as for the interpreter's C
+		   shifts on this CPU */
+		case BPF_ALU|BPF_LSH|BPF_X:
+			EMIT2(0x89, 0xd9);		/* mov ecx,ebx */
+			EMIT2(0xd3, 0xe0);		/* shl eax,cl */
+			break;
+		case BPF_ALU|BPF_LSH|BPF_K:
+			EMIT3(0xc1, 0xe0, f->k & 31);	/* shl eax,k */
+			break;
+		case BPF_ALU|BPF_RSH|BPF_X:
+			EMIT2(0x89, 0xd9);		/* mov ecx,ebx */
+			EMIT2(0xd3, 0xe8);		/* shr eax,cl */
+			break;
+		case BPF_ALU|BPF_RSH|BPF_K:
+			EMIT3(0xc1, 0xe8, f->k & 31);	/* shr eax,k */
+			break;
+		case BPF_ALU|BPF_NEG:
+			EMIT2(0xf7, 0xd8);		/* neg eax */
+			break;
+		case BPF_JMP|BPF_JA:
+			if (f->k)
+				emit_jmp(j, j->insn[pc + 1 + f->k].addr);
+			break;
+		case BPF_JMP|BPF_JGT|BPF_K:
+		case BPF_JMP|BPF_JGE|BPF_K:
+		case BPF_JMP|BPF_JEQ|BPF_K:
+			EMIT1(0x3d);			/* cmp eax,k */
+			EMIT_IMM32(f->k);
+			goto cond;
+		case BPF_JMP|BPF_JSET|BPF_K:
+			EMIT1(0xa9);			/* test eax,k */
+			EMIT_IMM32(f->k);
+			goto cond;
+		case BPF_JMP|BPF_JGT|BPF_X:
+		case BPF_JMP|BPF_JGE|BPF_X:
+		case BPF_JMP|BPF_JEQ|BPF_X:
+			EMIT2(0x39, 0xd8);		/* cmp eax,ebx */
+			goto cond;
+		case BPF_JMP|BPF_JSET|BPF_X:
+			EMIT2(0x85, 0xd8);		/* test eax,ebx */
+		cond:
+			switch (BPF_OP(f->code)) {
+			case BPF_JGT:
+				emit_cond(j, X86_JA, pc, f);
+				break;
+			case BPF_JGE:
+				emit_cond(j, X86_JAE, pc, f);
+				break;
+			case BPF_JEQ:
+				emit_cond(j, X86_JE, pc, f);
+				break;
+			default:
+				emit_cond(j, X86_JNE, pc, f);
+				break;
+			}
+			break;
+		case BPF_LD|BPF_W|BPF_ABS:
+			emit_load_abs(j, in, f->k, 4);
+			break;
+		case BPF_LD|BPF_H|BPF_ABS:
+			emit_load_abs(j, in, f->k, 2);
+			break;
+		case BPF_LD|BPF_B|BPF_ABS:
+			emit_load_abs(j, in, f->k, 1);
+			break;
+		case BPF_LD|BPF_W|BPF_IND:
+			emit_load_ind(j, in, f->k, 4);
+			break;
+		case BPF_LD|BPF_H|BPF_IND:
+			emit_load_ind(j, in, f->k, 2);
+			break;
+		case BPF_LD|BPF_B|BPF_IND:
+			emit_load_ind(j, in, f->k, 1);
+			break;
+		case BPF_LD|BPF_W|BPF_LEN:
+			EMIT3(0x8b, 0x45, DISP(FRAME_HLEN)); /* mov eax,[hlen] */
+			break;
+		case BPF_LDX|BPF_W|BPF_LEN:
+			EMIT3(0x8b, 0x5d, DISP(FRAME_HLEN)); /* mov ebx,[hlen] */
+			break;
+		case BPF_LDX|BPF_B|BPF_MSH:
+			/* cmp dword [rbp+hlen],k; jbe ret0 */
+			EMIT3(0x81, 0x7d, DISP(FRAME_HLEN));
+			EMIT_IMM32(f->k);
+			emit_jcc(j, X86_JBE, j->ret0);
+			EMIT_PTR();
+			EMIT3(0x8b, 0x4d, DISP(FRAME_DATA)); /* mov rcx,[data] */
+			EMIT3(0x0f, 0xb6, 0x99);	/* movzx ebx,byte [rcx+k] */
+			EMIT_IMM32(f->k);
+			EMIT3(0x83, 0xe3, 0x0f);	/* and ebx,0xf */
+			EMIT3(0xc1, 0xe3, 0x02);	/* shl ebx,2 */
+			break;
+		case BPF_LD|BPF_IMM:
+			EMIT1(0xb8);			/* mov eax,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_LDX|BPF_IMM:
+			EMIT1(0xbb);			/* mov ebx,k */
+			EMIT_IMM32(f->k);
+			break;
+		case BPF_LD|BPF_MEM:
+			EMIT3(0x8b, 0x45, MEM(f->k));	/* mov eax,mem[k] */
+			break;
+		case BPF_LDX|BPF_MEM:
+			EMIT3(0x8b, 0x5d, MEM(f->k));	/* mov ebx,mem[k] */
+			break;
+		case BPF_ST:
+			EMIT3(0x89, 0x45, MEM(f->k));	/* mov mem[k],eax */
+			break;
+		case BPF_STX:
+			EMIT3(0x89, 0x5d, MEM(f->k));	/* mov mem[k],ebx */
+			break;
+		case BPF_MISC|BPF_TAX:
+			EMIT2(0x89, 0xc3);		/* mov ebx,eax */
+			break;
+		case BPF_MISC|BPF_TXA:
+			EMIT2(0x89, 0xd8);		/* mov eax,ebx */
+			break;
+		case BPF_RET|BPF_K:
+			EMIT1(0xb8);			/* mov eax,k */
+			EMIT_IMM32(f->k);
+			emit_jmp(j, j->exit);
+			break;
+		case BPF_RET|BPF_A:
+			emit_jmp(j, j->exit);
+			break;
+		default:
+			/* Invalid instruction counts as RET */
+			emit_jmp(j, j->ret0);
+			break;
+		}
+	}
+
+	emit_epilogue(j);
+}
+
+/**
+ *	bpf_jit_compile - compile a socket filter to native code
+ *	@fp: filter, checked by sk_chk_filter()
+ *
+ * Sets fp->bpf_func on success; if memory runs short the filter is
+ * left to the interpreter.
+ */
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct bpf_jit_image *image;
+	struct bpf_jit j;
+	unsigned int size;
+
+	memset(&j, 0, sizeof(j));
+	j.insn = kmalloc(fp->len * sizeof(*j.insn), GFP_KERNEL);
+	if (!j.insn)
+		return;
+	memset(j.insn, 0, fp->len * sizeof(*j.insn));
+
+	/* Find where everything goes... */
+	bpf_jit_emit(&j, fp->insns, fp->len);
+	size = j.len;
+
+	/* ... and write the code */
+	image = module_alloc(sizeof(*image) + size);
+	if (image) {
+		j.image = image->code;
+		bpf_jit_emit(&j, fp->insns, fp->len);
+		if (j.len == size)
+			fp->bpf_func = (void *)image->code;
+		else
+			module_free(NULL, image);
+	}
+	kfree(j.insn);
+}
+
+static void bpf_jit_free_image(void *image)
+{
+	module_free(NULL, image);
+}
+
+/**
+ *	bpf_jit_free - free a filter's native code
+ *	@fp: filter
+ *
+ * The last reference to a filter can go in softirq context, where
+ * module_free() can't be called, so that is left to keventd.
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	struct bpf_jit_image *image;
+
+	if (!fp->bpf_func)
+		return;
+
+	image = (void *)((u8 *)fp->bpf_func
+			 - offsetof(struct bpf_jit_image, code));
+	INIT_WORK(&image->work, bpf_jit_free_image, image);
+	schedule_work(&image->work);
+	fp->bpf_func = NULL;
+}
+
+EXPORT_SYMBOL(bpf_jit_compile);
+EXPORT_SYMBOL(bpf_jit_free);
@@ -335,9 +335,60 @@ static void __smp_call_function (void (*func) (void *info), void *info,
 int smp_call_function (void (*func) (void *info), void *info, int nonatomic,
 			int wait)
 {
-	spin_lock(&call_lock);
+	/*
+	 * BHs stay off while the lock is held, so that
+	 * smp_call_function_single() can be used from softirqs.
+	 */
+	spin_lock_bh(&call_lock);
 	__smp_call_function(func,info,nonatomic,wait);
-	spin_unlock(&call_lock);
+	spin_unlock_bh(&call_lock);
+	return 0;
+}
+
+/*
+ * smp_call_function_single - run a function on one other CPU.
+ * @cpu: The target CPU, must be online and not the calling one.
+ * @func: The function to run. This must be fast and non-blocking.
+ * @info: An arbitrary pointer to pass to the function.
+ * @nonatomic: currently unused.
+ * @wait: If true, wait until function has completed on the other CPU.
+ *
+ * Returns 0 on success, else a negative status code.  Like
+ * smp_call_function() it must be called with interrupts enabled, but
+ * unlike it, it may be called from a bottom half handler.
+ */
+int smp_call_function_single (int cpu, void (*func) (void *info), void *info,
+			      int nonatomic, int wait)
+{
+	struct call_data_struct data;
+	int me = get_cpu();
+
+	if (cpu == me || !cpu_online(cpu)) {
+		put_cpu();
+		return -EINVAL;
+	}
+
+	data.func = func;
+	data.info = info;
+	atomic_set(&data.started, 0);
+	data.wait = wait;
+	if (wait)
+		atomic_set(&data.finished, 0);
+
+	spin_lock_bh(&call_lock);
+	call_data = &data;
+	wmb();
+	send_IPI_mask(cpumask_of_cpu(cpu), CALL_FUNCTION_VECTOR);
+
+	while (!atomic_read(&data.started))
+		cpu_relax();
+
+	if (wait)
+		while (!atomic_read(&data.finished))
+			cpu_relax();
+	spin_unlock_bh(&call_lock);
+	put_cpu();
+
 	return 0;
 }
 
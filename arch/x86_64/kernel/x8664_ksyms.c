@@ -119,6 +119,7 @@ EXPORT_SYMBOL(__read_lock_failed);
 
 EXPORT_SYMBOL(synchronize_irq);
 EXPORT_SYMBOL(smp_call_function);
+EXPORT_SYMBOL(smp_call_function_single);
 EXPORT_SYMBOL(cpu_callout_map);
 #endif
 
@@ -37,6 +37,22 @@
 #include <linux/moduleparam.h>
 
 static int numdummies = 1;
+static int numtxqs = 1;
+
+/*
+ * Counters are kept per transmit queue, so that senders on different
+ * queues never write to the same cache line; dummy_get_stats() adds
+ * them up.
+ */
+struct dummy_txq_stats {
+	unsigned long		packets;
+	unsigned long		bytes;
+} ____cacheline_aligned_in_smp;
+
+struct dummy_priv {
+	struct net_device_stats	stats;
+	struct dummy_txq_stats	txq[0];
+};
 
 static int dummy_xmit(struct sk_buff *skb, struct net_device *dev);
 static struct net_device_stats *dummy_get_stats(struct net_device *dev);
@@ -68,6 +84,7 @@ static void __init dummy_setup(struct net_device *dev)
 	/* Fill in device structure with ethernet-generic values. */
 	ether_setup(dev);
 	dev->tx_queue_len = 0;
+	dev->num_tx_queues = numtxqs;
 	dev->change_mtu = NULL;
 	dev->flags |= IFF_NOARP;
 	dev->flags &= ~IFF_MULTICAST;
@@ -77,10 +94,11 @@ static void __init dummy_setup(struct net_device *dev)
 
 static int dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 {
-	struct net_device_stats *stats = netdev_priv(dev);
+	struct dummy_priv *priv = netdev_priv(dev);
+	struct dummy_txq_stats *txs = &priv->txq[skb->queue_mapping];
 
-	stats->tx_packets++;
-	stats->tx_bytes+=skb->len;
+	txs->packets++;
+	txs->bytes += skb->len;
 
 	dev_kfree_skb(skb);
 	return 0;
@@ -88,7 +106,16 @@ static int dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 
 static struct net_device_stats *dummy_get_stats(struct net_device *dev)
 {
-	return netdev_priv(dev);
+	struct dummy_priv *priv = netdev_priv(dev);
+	int i;
+
+	priv->stats.tx_packets = 0;
+	priv->stats.tx_bytes = 0;
+	for (i = 0; i < numtxqs; i++) {
+		priv->stats.tx_packets += priv->txq[i].packets;
+		priv->stats.tx_bytes += priv->txq[i].bytes;
+	}
+	return &priv->stats;
 }
 
 static struct net_device **dummies;
@@ -96,13 +123,16 @@ static struct net_device **dummies;
 /* Number of dummy devices to be set up by this module. */
 module_param(numdummies, int, 0);
 MODULE_PARM_DESC(numdummies, "Number of dummy pseudo devices");
+module_param(numtxqs, int, 0);
+MODULE_PARM_DESC(numtxqs, "Number of transmit queues per dummy device");
 
 static int __init dummy_init_one(int index)
 {
 	struct net_device *dev_dummy;
 	int err;
 
-	dev_dummy = alloc_netdev(sizeof(struct net_device_stats),
+	dev_dummy = alloc_netdev(sizeof(struct dummy_priv) +
+				 numtxqs * sizeof(struct dummy_txq_stats),
 				 "dummy%d", dummy_setup);
 
 	if (!dev_dummy)
@@ -127,6 +157,9 @@ static void dummy_free_one(int index)
 static int __init dummy_init_module(void)
 { 
 	int i, err = 0;
+
+	if (numtxqs < 1)
+		numtxqs = 1;
 	dummies = kmalloc(numdummies * sizeof(void *), GFP_KERNEL); 
 	if (!dummies)
 		return -ENOMEM; 
@@ -520,6 +520,9 @@ e1000_probe(struct pci_dev *pdev,
 	if(pci_using_dac)
 		netdev->features |= NETIF_F_HIGHDMA;
 
+	/* e1000_clean_rx_irq() hands frames to netif_gro_receive() */
+	netdev->features |= NETIF_F_GRO;
+
  	/* hard_start_xmit is safe against parallel locking */
  	netdev->features |= NETIF_F_LLTX; 
  
@@ -2364,7 +2367,7 @@ e1000_clean_rx_irq(struct e1000_adapter *adapter)
 					le16_to_cpu(rx_desc->special) &
 					E1000_RXD_SPC_VLAN_MASK);
 		} else {
-			netif_receive_skb(skb);
+			netif_gro_receive(skb);
 		}
 #else /* CONFIG_E1000_NAPI */
 		if(unlikely(adapter->vlgrp &&
@@ -158,6 +158,15 @@ static int loopback_xmit(struct sk_buff *skb, struct net_device *dev)
 	return(0);
 }
 
+/*
+ * One transmit queue per CPU: a sender always stays on the queue of its
+ * own CPU, so loopback traffic from different CPUs never shares a lock.
+ */
+static u16 loopback_select_queue(struct net_device *dev, struct sk_buff *skb)
+{
+	return smp_processor_id() % dev->num_tx_queues;
+}
+
 static struct net_device_stats *get_stats(struct net_device *dev)
 {
 	struct net_device_stats *stats = dev->priv;
@@ -199,6 +208,7 @@ struct net_device loopback_dev = {
 	.name	 		= "lo",
 	.mtu			= (16 * 1024) + 20 + 20 + 12,
 	.hard_start_xmit	= loopback_xmit,
+	.select_queue		= loopback_select_queue,
 	.hard_header		= eth_header,
 	.hard_header_cache	= eth_header_cache,
 	.header_cache_update	= eth_header_cache_update,
@@ -226,6 +236,8 @@ int __init loopback_init(void)
 		loopback_dev.priv = stats;
 		loopback_dev.get_stats = &get_stats;
 	}
+
+	loopback_dev.num_tx_queues = num_possible_cpus();
 	
 	return register_netdev(&loopback_dev);
 };
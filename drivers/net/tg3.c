@@ -2767,7 +2767,7 @@ static int tg3_rx(struct tg3 *tp, int budget)
 				    desc->err_vlan & RXD_VLAN_MASK);
 		} else
 #endif
-			netif_receive_skb(skb);
+			netif_gro_receive(skb);
 
 		tp->dev->last_rx = jiffies;
 		received++;
@@ -8698,6 +8698,8 @@ static int __devinit tg3_init_one(struct pci_dev *pdev,
 	if (pci_using_dac)
 		dev->features |= NETIF_F_HIGHDMA;
 	dev->features |= NETIF_F_LLTX;
+	/* tg3_rx() hands frames to netif_gro_receive() */
+	dev->features |= NETIF_F_GRO;
 #if TG3_VLAN_TAG_USED
 	dev->features |= NETIF_F_HW_VLAN_TX | NETIF_F_HW_VLAN_RX;
 	dev->vlan_rx_register = tg3_vlan_rx_register;
@@ -29,6 +29,8 @@
 #include <linux/highmem.h>
 #include <linux/workqueue.h>
 #include <linux/security.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -52,6 +54,7 @@ static kmem_cache_t	*kiocb_cachep;
 static kmem_cache_t	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_fsync_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(void *);
@@ -61,6 +64,7 @@ static DEFINE_SPINLOCK(fput_lock);
 LIST_HEAD(fput_head);
 
 static void aio_kick_handler(void *);
+static int aio_poll_cancel(struct kiocb *, struct io_event *);
 
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
@@ -74,6 +78,8 @@ static int __init aio_setup(void)
 				0, SLAB_HWCACHE_ALIGN|SLAB_PANIC, NULL, NULL);
 
 	aio_wq = create_workqueue("aio");
+	/* fsync can take seconds, keep it off the queue that runs retries */
+	aio_fsync_wq = create_workqueue("aio_fsync");
 
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
@@ -100,10 +106,21 @@ static void aio_free_ring(struct kioctx *ctx)
 	info->nr = 0;
 }
 
+#ifdef __HAVE_ARCH_CMPXCHG
+/* user space reapers race with us on ring->head, see <linux/aio.h> */
+#define aio_ring_cmpxchg_head(ring, old, new)	cmpxchg(&(ring)->head, old, new)
+#define AIO_RING_USER_REAP			AIO_RING_F_USER_REAP
+#else
+/* ring_lock serializes the kernel reapers; user space must not reap */
+#define aio_ring_cmpxchg_head(ring, old, new)	({ (ring)->head = (new); (old); })
+#define AIO_RING_USER_REAP			0
+#endif
+
 static int aio_setup_ring(struct kioctx *ctx)
 {
 	struct aio_ring *ring;
 	struct aio_ring_info *info = &ctx->ring_info;
+	unsigned long def_flags;
 	unsigned nr_events = ctx->max_reqs;
 	unsigned long size;
 	int nr_pages;
@@ -132,9 +149,19 @@ static int aio_setup_ring(struct kioctx *ctx)
 	info->mmap_size = nr_pages * PAGE_SIZE;
 	dprintk("attempting mmap of %lu bytes\n", info->mmap_size);
 	down_write(&ctx->mm->mmap_sem);
+	/*
+	 * The pages are pinned below and user space reaps events straight
+	 * out of them; a fork must not turn them copy-on-write under us.
+	 * Create the area with VM_DONTCOPY already set, through the mm's
+	 * default flags that mmap_sem protects: such areas never merge,
+	 * so the ring gets one of its own.
+	 */
+	def_flags = ctx->mm->def_flags;
+	ctx->mm->def_flags |= VM_DONTCOPY;
 	info->mmap_base = do_mmap(NULL, 0, info->mmap_size, 
 				  PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE,
 				  0);
+	ctx->mm->def_flags = def_flags;
 	if (IS_ERR((void *)info->mmap_base)) {
 		up_write(&ctx->mm->mmap_sem);
 		printk("mmap err: %ld\n", -info->mmap_base);
@@ -160,10 +187,10 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
 	ring->nr = nr_events;	/* user copy */
-	ring->id = ctx->user_id;
+	ring->id = ~0U;		/* set by ioctx_add_table() */
 	ring->head = ring->tail = 0;
 	ring->magic = AIO_RING_MAGIC;
-	ring->compat_features = AIO_RING_COMPAT_FEATURES;
+	ring->compat_features = AIO_RING_COMPAT_FEATURES | AIO_RING_USER_REAP;
 	ring->incompat_features = AIO_RING_INCOMPAT_FEATURES;
 	ring->header_length = sizeof(struct aio_ring);
 	kunmap_atomic(ring, KM_USER0);
@@ -194,6 +221,62 @@ static int aio_setup_ring(struct kioctx *ctx)
 	kunmap_atomic((void *)((unsigned long)__event & PAGE_MASK), km); \
 } while(0)
 
+static void ioctx_table_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct kioctx_table, rcu_head));
+}
+
+/* ioctx_add_table
+ *	Gives the ioctx a slot in mm->ioctx_table, growing the table when
+ *	it is full, and records the slot in the ring for lookup_ioctx().
+ */
+static int ioctx_add_table(struct kioctx *ctx, struct mm_struct *mm)
+{
+	struct kioctx_table *table, *new;
+	struct aio_ring *ring;
+	unsigned i, nr;
+
+	for (;;) {
+		write_lock(&mm->ioctx_list_lock);
+		table = mm->ioctx_table;
+		nr = table ? table->nr : 0;
+		for (i = 0; i < nr; i++) {
+			if (table->table[i])
+				continue;
+			ctx->id = i;
+			ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_USER0);
+			ring->id = i;
+			kunmap_atomic(ring, KM_USER0);
+			table->table[i] = ctx;
+			write_unlock(&mm->ioctx_list_lock);
+			return 0;
+		}
+		write_unlock(&mm->ioctx_list_lock);
+
+		/* full: double it and go round again */
+		new = kmalloc(sizeof(*new) + 2 * (nr + 2) * sizeof(ctx), GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+		new->nr = 2 * (nr + 2);
+		memset(new->table, 0, new->nr * sizeof(ctx));
+
+		write_lock(&mm->ioctx_list_lock);
+		table = mm->ioctx_table;
+		if ((table ? table->nr : 0) != nr) {
+			/* somebody else grew it meanwhile */
+			write_unlock(&mm->ioctx_list_lock);
+			kfree(new);
+			continue;
+		}
+		if (table)
+			memcpy(new->table, table->table, nr * sizeof(ctx));
+		rcu_assign_pointer(mm->ioctx_table, new);
+		write_unlock(&mm->ioctx_list_lock);
+		if (table)
+			call_rcu(&table->rcu_head, ioctx_table_free_rcu);
+	}
+}
+
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
@@ -238,11 +321,9 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (unlikely(atomic_read(&aio_nr) > aio_max_nr))
 		goto out_cleanup;
 
-	/* now link into global list.  kludge.  FIXME */
-	write_lock(&mm->ioctx_list_lock);
-	ctx->next = mm->ioctx_list;
-	mm->ioctx_list = ctx;
-	write_unlock(&mm->ioctx_list_lock);
+	/* now make it visible to lookup_ioctx() */
+	if (ioctx_add_table(ctx, mm))
+		goto out_cleanup;
 
 	dprintk("aio: allocated ioctx %p[%ld]: mm=%p mask=0x%x\n",
 		ctx, ctx->user_id, current->mm, ctx->ring_info.nr);
@@ -332,11 +413,17 @@ ssize_t fastcall wait_on_sync_kiocb(struct kiocb *iocb)
  */
 void fastcall exit_aio(struct mm_struct *mm)
 {
-	struct kioctx *ctx = mm->ioctx_list;
-	mm->ioctx_list = NULL;
-	while (ctx) {
-		struct kioctx *next = ctx->next;
-		ctx->next = NULL;
+	struct kioctx_table *table = mm->ioctx_table;
+	struct kioctx *ctx;
+	unsigned i;
+
+	/* the mm is going away, nobody can be looking the table up */
+	mm->ioctx_table = NULL;
+	for (i = 0; table && i < table->nr; i++) {
+		ctx = table->table[i];
+		if (!ctx)
+			continue;
+		table->table[i] = NULL;
 		aio_cancel_all(ctx);
 
 		wait_for_all_aios(ctx);
@@ -352,8 +439,13 @@ void fastcall exit_aio(struct mm_struct *mm)
 				atomic_read(&ctx->users), ctx->dead,
 				ctx->reqs_active);
 		put_ioctx(ctx);
-		ctx = next;
 	}
+	kfree(table);
+}
+
+static void kioctx_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(kioctx_cachep, container_of(head, struct kioctx, rcu_head));
 }
 
 /* __put_ioctx
@@ -373,7 +465,8 @@ void fastcall __put_ioctx(struct kioctx *ctx)
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
-	kmem_cache_free(kioctx_cachep, ctx);
+	/* lookup_ioctx() may still be peeking at it under rcu_read_lock() */
+	call_rcu(&ctx->rcu_head, kioctx_free_rcu);
 
 	atomic_sub(nr_events, &aio_nr);
 }
@@ -408,6 +501,7 @@ static struct kiocb fastcall *__aio_get_req(struct kioctx *ctx)
 	req->ki_obj.user = NULL;
 	req->ki_dtor = NULL;
 	req->private = NULL;
+	req->ki_eventfd = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 
 	/* Check if the completion queue has enough free space to
@@ -473,8 +567,12 @@ static void aio_fput_routine(void *data)
 		list_del(&req->ki_list);
 		spin_unlock_irq(&fput_lock);
 
-		/* Complete the fput */
-		__fput(req->ki_filp);
+		/* Complete the fput(s) */
+		if (req->ki_eventfd != NULL) {
+			fput(req->ki_filp);
+			fput(req->ki_eventfd);
+		} else
+			__fput(req->ki_filp);
 
 		/* Link the iocb into the context's free list */
 		spin_lock_irq(&ctx->ctx_lock);
@@ -506,8 +604,11 @@ static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
 
 	/* Must be done under the lock to serialise against cancellation.
 	 * Call this aio_fput as it duplicates fput via the fput_work.
+	 * We may be in interrupt context, so a request holding an eventfd
+	 * is always handed to the fput_work, which drops both files.
 	 */
-	if (unlikely(atomic_dec_and_test(&req->ki_filp->f_count))) {
+	if (unlikely(req->ki_eventfd != NULL) ||
+	    unlikely(atomic_dec_and_test(&req->ki_filp->f_count))) {
 		get_ioctx(ctx);
 		spin_lock(&fput_lock);
 		list_add(&req->ki_list, &fput_head);
@@ -534,24 +635,60 @@ int fastcall aio_put_req(struct kiocb *req)
 	return ret;
 }
 
-/*	Lookup an ioctx id.  ioctx_list is lockless for reads.
- *	FIXME: this is O(n) and is only suitable for development.
+/*
+ * The table keeps its reference until io_destroy() has cleared the slot,
+ * and the ioctx is freed only an RCU grace period after its last put,
+ * so under rcu_read_lock() a cmpxchg on users that refuses to move off
+ * zero is enough to pin it.  Without one we fall back to ctx_lock.
+ */
+#ifdef __HAVE_ARCH_ATOMIC_INC_NOT_ZERO
+#define ioctx_tryget(ioctx)	atomic_inc_not_zero(&(ioctx)->users)
+#else
+static inline int ioctx_tryget(struct kioctx *ioctx)
+{
+	int ok = 0;
+
+	spin_lock_irq(&ioctx->ctx_lock);
+	if (likely(!ioctx->dead)) {
+		get_ioctx(ioctx);
+		ok = 1;
+	}
+	spin_unlock_irq(&ioctx->ctx_lock);
+	return ok;
+}
+#endif
+
+/*	Lookup an ioctx id.
+ *	The id is the address of the ring, whose header tells the slot in
+ *	mm->ioctx_table; the table is read under RCU, without any lock.
  */
 struct kioctx *lookup_ioctx(unsigned long ctx_id)
 {
-	struct kioctx *ioctx;
-	struct mm_struct *mm;
+	struct aio_ring __user *ring = (struct aio_ring __user *)ctx_id;
+	struct mm_struct *mm = current->mm;
+	struct kioctx_table *table;
+	struct kioctx *ioctx, *ret = NULL;
+	unsigned id;
 
-	mm = current->mm;
-	read_lock(&mm->ioctx_list_lock);
-	for (ioctx = mm->ioctx_list; ioctx; ioctx = ioctx->next)
-		if (likely(ioctx->user_id == ctx_id && !ioctx->dead)) {
-			get_ioctx(ioctx);
-			break;
-		}
-	read_unlock(&mm->ioctx_list_lock);
+	if (unlikely(get_user(id, &ring->id)))
+		return NULL;
 
-	return ioctx;
+	rcu_read_lock();
+	table = rcu_dereference(mm->ioctx_table);
+	if (unlikely(!table || id >= table->nr))
+		goto out;
+	ioctx = table->table[id];
+	if (likely(ioctx && ioctx->user_id == ctx_id && ioctx_tryget(ioctx)))
+		ret = ioctx;
+out:
+	rcu_read_unlock();
+
+	/* lost the race with io_destroy(); outside RCU, as the put may sleep */
+	if (ret && unlikely(ret->dead)) {
+		put_ioctx(ret);
+		ret = NULL;
+	}
+	return ret;
 }
 
 /*
@@ -709,15 +846,21 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 	 * queue this on the run list yet)
 	 */
 	iocb->ki_run_list.next = iocb->ki_run_list.prev = NULL;
-	spin_unlock_irq(&ctx->ctx_lock);
 
-	/* Quit retrying if the i/o has been cancelled */
+	/*
+	 * Quit retrying if the i/o has been cancelled.  Clearing
+	 * ki_cancel under ctx_lock tells a racing aio_poll_cancel()
+	 * that the cancel has gone through here.
+	 */
 	if (kiocbIsCancelled(iocb)) {
+		iocb->ki_cancel = NULL;
+		spin_unlock_irq(&ctx->ctx_lock);
 		ret = -EINTR;
 		aio_complete(iocb, ret, 0);
 		/* must not access the iocb after this */
 		goto out;
 	}
+	spin_unlock_irq(&ctx->ctx_lock);
 
 	/*
 	 * Now we are all set to call the retry method in async
@@ -984,10 +1127,15 @@ int fastcall aio_complete(struct kiocb *iocb, long res, long res2)
 
 	/*
 	 * cancelled requests don't get events, userland was given one
-	 * when the event got cancelled.
+	 * when the event got cancelled.  A poll cancel that is still
+	 * pending when the request completes on its own is bound to
+	 * fail, so the request keeps its event and the flag goes.
 	 */
-	if (kiocbIsCancelled(iocb))
-		goto put_rq;
+	if (kiocbIsCancelled(iocb)) {
+		if (iocb->ki_cancel != aio_poll_cancel)
+			goto put_rq;
+		kiocbClearCancelled(iocb);
+	}
 
 	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
 
@@ -1021,6 +1169,14 @@ int fastcall aio_complete(struct kiocb *iocb, long res, long res2)
 		iocb->ki_retried,
 		iocb->ki_nbytes - iocb->ki_left, iocb->ki_nbytes,
 		iocb->ki_kicked, iocb->ki_queued, aio_run, aio_wakeups);
+
+	/*
+	 * Check if the user asked us to deliver the result through an
+	 * eventfd. The eventfd_signal() function is safe to be called
+	 * from IRQ context.
+	 */
+	if (iocb->ki_eventfd != NULL)
+		eventfd_signal(iocb->ki_eventfd, 1);
 put_rq:
 	/* everything turned out well, dispose of the aiocb. */
 	ret = __aio_put_req(ctx, iocb);
@@ -1039,14 +1195,15 @@ put_rq:
 /* aio_read_evt
  *	Pull an event off of the ioctx's event ring.  Returns the number of 
  *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+ *	head is advanced with cmpxchg, as user space reapers do, so the
+ *	two can share the ring (see <linux/aio.h>).
  */
 static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
+	struct io_event *evp;
+	unsigned old, head;
 	int ret = 0;
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
@@ -1059,16 +1216,21 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 
 	spin_lock(&info->ring_lock);
 
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
+	do {
+		old = ring->head;
+		if (old == ring->tail)
+			goto out_unlock;
+		smp_rmb();	/* read tail before the event it covers */
+		/* user space may scribble on head, never trust it */
+		head = old % info->nr;
+		evp = aio_ring_event(info, head, KM_USER1);
 		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
-		ring->head = head;
-		ret = 1;
 		put_aio_ring_event(evp, KM_USER1);
-	}
+		smp_mb(); /* finish reading the event before updating the head */
+	} while (aio_ring_cmpxchg_head(ring, old, (head + 1) % info->nr) != old);
+	ret = 1;
+
+out_unlock:
 	spin_unlock(&info->ring_lock);
 
 out:
@@ -1235,18 +1397,18 @@ out:
 static void io_destroy(struct kioctx *ioctx)
 {
 	struct mm_struct *mm = current->mm;
-	struct kioctx **tmp;
+	struct kioctx_table *table;
 	int was_dead;
 
-	/* delete the entry from the list is someone else hasn't already */
+	/* delete the entry from the table if someone else hasn't already */
 	write_lock(&mm->ioctx_list_lock);
+	spin_lock_irq(&ioctx->ctx_lock);
 	was_dead = ioctx->dead;
 	ioctx->dead = 1;
-	for (tmp = &mm->ioctx_list; *tmp && *tmp != ioctx;
-	     tmp = &(*tmp)->next)
-		;
-	if (*tmp)
-		*tmp = ioctx->next;
+	spin_unlock_irq(&ioctx->ctx_lock);
+	table = mm->ioctx_table;
+	if (table && ioctx->id < table->nr && table->table[ioctx->id] == ioctx)
+		table->table[ioctx->id] = NULL;
 	write_unlock(&mm->ioctx_list_lock);
 
 	dprintk("aio_release(%p)\n", ioctx);
@@ -1319,6 +1481,126 @@ asmlinkage long sys_io_destroy(aio_context_t ctx)
 	return -EINVAL;
 }
 
+/*
+ * Pipes and sockets never block an async iocb: their aio methods return
+ * -EAGAIN instead, and we park ki_wait on the file's poll wait queue so
+ * that the next wakeup kicks a retry through aio_wake_function().
+ */
+struct aio_poll_table {
+	poll_table	pt;
+	struct kiocb	*iocb;
+};
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct kiocb *iocb = container_of(pt, struct aio_poll_table, pt)->iocb;
+
+	/* ki_wait can only sit on one queue; the first one is enough */
+	if (list_empty(&iocb->ki_wait.task_list)) {
+		iocb->ki_wait_head = head;
+		add_wait_queue(head, &iocb->ki_wait);
+	}
+}
+
+/*
+ * Take ki_wait off the poll wait queue.  Returns 1 if it was still
+ * queued, 0 if a wakeup (or nobody) got there first.
+ */
+static int aio_poll_dequeue(struct kiocb *iocb)
+{
+	wait_queue_head_t *head = iocb->ki_wait_head;
+	unsigned long flags;
+	int queued = 0;
+
+	if (!head)
+		return 0;
+	spin_lock_irqsave(&head->lock, flags);
+	if (!list_empty(&iocb->ki_wait.task_list)) {
+		list_del_init(&iocb->ki_wait.task_list);
+		queued = 1;
+	}
+	spin_unlock_irqrestore(&head->lock, flags);
+	return queued;
+}
+
+/*
+ * Cancelling a request parked on a poll wait queue: unhook it and kick
+ * it, aio_run_iocb() then notices the cancellation and completes it.
+ * A request that is not parked has been woken already and is running
+ * or about to run.  If the retry side saw KIF_CANCELLED first it has
+ * cleared ki_cancel and the cancel stands; otherwise the request
+ * completes on its own, with whatever result it gets, so we take the
+ * flag back and say -EAGAIN.
+ */
+static int aio_poll_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	struct kioctx *ctx = iocb->ki_ctx;
+	int ret = -EAGAIN;
+
+	if (aio_poll_dequeue(iocb)) {
+		kick_iocb(iocb);
+		ret = 0;
+	} else {
+		spin_lock_irq(&ctx->ctx_lock);
+		if (kiocbIsCancelled(iocb)) {
+			if (!iocb->ki_cancel)
+				ret = 0;
+			else
+				kiocbClearCancelled(iocb);
+		}
+		spin_unlock_irq(&ctx->ctx_lock);
+	}
+	if (!ret) {
+		res->res = -EINTR;
+		res->res2 = 0;
+	}
+	aio_put_req(iocb);	/* drop the reference taken for cancel */
+	return ret;
+}
+
+static ssize_t aio_wait_on_poll(struct kiocb *iocb, unsigned int events)
+{
+	struct file *file = iocb->ki_filp;
+	struct kioctx *ctx = iocb->ki_ctx;
+	struct aio_poll_table apt;
+	unsigned int mask;
+	int cancelled;
+
+	/* O_NONBLOCK users asked for -EAGAIN, and they get it */
+	if (!file->f_op->poll || (file->f_flags & O_NONBLOCK))
+		return -EAGAIN;
+
+	if (!iocb->ki_cancel) {
+		spin_lock_irq(&ctx->ctx_lock);
+		iocb->ki_cancel = aio_poll_cancel;
+		spin_unlock_irq(&ctx->ctx_lock);
+	}
+
+	apt.iocb = iocb;
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	mask = file->f_op->poll(file, &apt.pt);
+
+	/* pairs with aio_poll_cancel(): one of us sees the other */
+	spin_lock_irq(&ctx->ctx_lock);
+	cancelled = kiocbIsCancelled(iocb);
+	if (cancelled)
+		iocb->ki_cancel = NULL;
+	spin_unlock_irq(&ctx->ctx_lock);
+	if (cancelled) {
+		aio_poll_dequeue(iocb);
+		return -EINTR;
+	}
+
+	/*
+	 * Ready already: with ki_wait off the queue aio_run_iocb()
+	 * retries straight away.
+	 */
+	if (mask & (events | POLLERR | POLLHUP))
+		aio_poll_dequeue(iocb);
+	return -EIOCBRETRY;
+}
+
 /*
  * Default retry method for aio_read (also used for first time submit)
  * Responsible for updating iocb state as retries progress
@@ -1336,6 +1618,8 @@ static ssize_t aio_pread(struct kiocb *iocb)
 
 	ret = file->f_op->aio_read(iocb, iocb->ki_buf,
 		iocb->ki_left, iocb->ki_pos);
+	if (ret == -EAGAIN)
+		return aio_wait_on_poll(iocb, POLLIN);
 
 	/*
 	 * Can't just depend on iocb->ki_left to determine
@@ -1377,6 +1661,8 @@ static ssize_t aio_pwrite(struct kiocb *iocb)
 
 	ret = file->f_op->aio_write(iocb, iocb->ki_buf,
 		iocb->ki_left, iocb->ki_pos);
+	if (ret == -EAGAIN)
+		return aio_wait_on_poll(iocb, POLLOUT);
 
 	if (ret > 0) {
 		iocb->ki_buf += ret;
@@ -1393,6 +1679,41 @@ static ssize_t aio_pwrite(struct kiocb *iocb)
 	return ret;
 }
 
+/*
+ * Hardly any filesystem has ->aio_fsync.  For the others, rather than
+ * making io_submit() wait for the disk, run the plain ->fsync from a
+ * workqueue and complete the iocb from there.
+ */
+struct aio_fsync_work {
+	struct work_struct	work;
+	struct kiocb		*iocb;
+	int			datasync;
+};
+
+static void aio_fsync_work_fn(void *data)
+{
+	struct aio_fsync_work *fw = data;
+	struct kiocb *iocb = fw->iocb;
+	int datasync = fw->datasync;
+
+	kfree(fw);
+	aio_complete(iocb, do_fsync(iocb->ki_filp, datasync), 0);
+}
+
+static ssize_t aio_queue_fsync(struct kiocb *iocb, int datasync)
+{
+	struct aio_fsync_work *fw;
+
+	fw = kmalloc(sizeof(*fw), GFP_KERNEL);
+	if (!fw)
+		return -ENOMEM;
+	INIT_WORK(&fw->work, aio_fsync_work_fn, fw);
+	fw->iocb = iocb;
+	fw->datasync = datasync;
+	queue_work(aio_fsync_wq, &fw->work);
+	return -EIOCBQUEUED;
+}
+
 static ssize_t aio_fdsync(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1400,6 +1721,8 @@ static ssize_t aio_fdsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 1);
+	else if (file->f_op->fsync)
+		ret = aio_queue_fsync(iocb, 1);
 	return ret;
 }
 
@@ -1410,6 +1733,8 @@ static ssize_t aio_fsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 0);
+	else if (file->f_op->fsync)
+		ret = aio_queue_fsync(iocb, 0);
 	return ret;
 }
 
@@ -1450,12 +1775,12 @@ ssize_t aio_setup_iocb(struct kiocb *kiocb)
 		break;
 	case IOCB_CMD_FDSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fdsync;
 		break;
 	case IOCB_CMD_FSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
 	default:
@@ -1504,11 +1829,14 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	ssize_t ret;
 
 	/* enforce forwards compatibility on users */
-	if (unlikely(iocb->aio_reserved1 || iocb->aio_reserved2 ||
-		     iocb->aio_reserved3)) {
+	if (unlikely(iocb->aio_reserved1 || iocb->aio_reserved2)) {
 		pr_debug("EINVAL: io_submit: reserve field set\n");
 		return -EINVAL;
 	}
+	if (unlikely(iocb->aio_flags & ~IOCB_FLAG_RESFD)) {
+		pr_debug("EINVAL: io_submit: unknown flags\n");
+		return -EINVAL;
+	}
 
 	/* prevent overflows */
 	if (unlikely(
@@ -1531,6 +1859,21 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	}
 
 	req->ki_filp = file;
+	if (iocb->aio_flags & IOCB_FLAG_RESFD) {
+		/*
+		 * If the IOCB_FLAG_RESFD flag of aio_flags is set, get an
+		 * instance of the file* now. The file descriptor must be
+		 * an eventfd() fd, and will be signaled for each completed
+		 * event using the eventfd_signal() function.
+		 */
+		req->ki_eventfd = eventfd_fget((int) iocb->aio_resfd);
+		if (IS_ERR(req->ki_eventfd)) {
+			ret = PTR_ERR(req->ki_eventfd);
+			req->ki_eventfd = NULL;
+			goto out_put_req;
+		}
+	}
+
 	iocb->aio_key = req->ki_key;
 	ret = put_user(iocb->aio_key, &user_iocb->aio_key);
 	if (unlikely(ret)) {
@@ -1547,6 +1890,7 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_opcode = iocb->aio_lio_opcode;
 	init_waitqueue_func_entry(&req->ki_wait, aio_wake_function);
 	INIT_LIST_HEAD(&req->ki_wait.task_list);
+	req->ki_wait_head = NULL;
 	req->ki_run_list.next = req->ki_run_list.prev = NULL;
 	req->ki_retry = NULL;
 	req->ki_retried = 0;
@@ -1587,12 +1931,15 @@ out_put_req:
  *	are available to queue any iocbs.  Will return 0 if nr is 0.  Will
  *	fail with -ENOSYS if not implemented.
  */
+#define AIO_SUBMIT_BATCH	32
+
 asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
 			      struct iocb __user * __user *iocbpp)
 {
+	struct iocb __user *batch[AIO_SUBMIT_BATCH];
 	struct kioctx *ctx;
 	long ret = 0;
-	int i;
+	long i, n;
 
 	if (unlikely(nr < 0))
 		return -EINVAL;
@@ -1614,10 +1961,16 @@ asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
 		struct iocb __user *user_iocb;
 		struct iocb tmp;
 
-		if (unlikely(__get_user(user_iocb, iocbpp + i))) {
-			ret = -EFAULT;
-			break;
+		/* fetch the iocb pointers a batch at a time */
+		if (!(i % AIO_SUBMIT_BATCH)) {
+			n = min_t(long, nr - i, AIO_SUBMIT_BATCH);
+			if (unlikely(__copy_from_user(batch, iocbpp + i,
+						      n * sizeof(*batch)))) {
+				ret = -EFAULT;
+				break;
+			}
 		}
+		user_iocb = batch[i % AIO_SUBMIT_BATCH];
 
 		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
 			ret = -EFAULT;
@@ -360,30 +360,19 @@ int file_fsync(struct file *filp, struct dentry *dentry, int datasync)
 	return ret;
 }
 
-/**
- * 系统调用fsync的实现。
- * 将fd对应的所有脏缓冲区写到磁盘中，如果需要，还包括存有索引节点的缓冲区。
+/*
+ * Write out and wait upon all dirty data associated with this file, and
+ * let the filesystem commit its metadata.  Shared by fsync(), fdatasync()
+ * and the AIO fsync commands.
  */
-asmlinkage long sys_fsync(unsigned int fd)
+int do_fsync(struct file *file, int datasync)
 {
-	struct file * file;
-	struct address_space *mapping;
+	struct address_space *mapping = file->f_mapping;
 	int ret, err;
 
-	ret = -EBADF;
-	/**
-	 * 获得文件对象的地址。
-	 */
-	file = fget(fd);
-	if (!file)
-		goto out;
-
-	mapping = file->f_mapping;
-
-	ret = -EINVAL;
 	if (!file->f_op || !file->f_op->fsync) {
 		/* Why?  We can still call filemap_fdatawrite */
-		goto out_putf;
+		return -EINVAL;
 	}
 
 	current->flags |= PF_SYNCWRITE;
@@ -398,7 +387,7 @@ asmlinkage long sys_fsync(unsigned int fd)
 	 * 调用文件对象的fsync方法进行数据同步。
 	 * 该回调函数通常是__writeback_single_inode。
 	 */
-	err = file->f_op->fsync(file, file->f_dentry, 0);
+	err = file->f_op->fsync(file, file->f_dentry, datasync);
 	if (!ret)
 		ret = err;
 	up(&mapping->host->i_sem);
@@ -406,45 +395,41 @@ asmlinkage long sys_fsync(unsigned int fd)
 	if (!ret)
 		ret = err;
 	current->flags &= ~PF_SYNCWRITE;
-
-out_putf:
-	fput(file);
-out:
 	return ret;
 }
 
-asmlinkage long sys_fdatasync(unsigned int fd)
+/**
+ * 系统调用fsync的实现。
+ * 将fd对应的所有脏缓冲区写到磁盘中，如果需要，还包括存有索引节点的缓冲区。
+ */
+asmlinkage long sys_fsync(unsigned int fd)
 {
 	struct file * file;
-	struct address_space *mapping;
-	int ret, err;
+	int ret;
 
 	ret = -EBADF;
+	/**
+	 * 获得文件对象的地址。
+	 */
 	file = fget(fd);
-	if (!file)
-		goto out;
-
-	ret = -EINVAL;
-	if (!file->f_op || !file->f_op->fsync)
-		goto out_putf;
-
-	mapping = file->f_mapping;
+	if (file) {
+		ret = do_fsync(file, 0);
+		fput(file);
+	}
+	return ret;
+}
 
-	current->flags |= PF_SYNCWRITE;
-	ret = filemap_fdatawrite(mapping);
-	down(&mapping->host->i_sem);
-	err = file->f_op->fsync(file, file->f_dentry, 1);
-	if (!ret)
-		ret = err;
-	up(&mapping->host->i_sem);
-	err = filemap_fdatawait(mapping);
-	if (!ret)
-		ret = err;
-	current->flags &= ~PF_SYNCWRITE;
+asmlinkage long sys_fdatasync(unsigned int fd)
+{
+	struct file * file;
+	int ret;
 
-out_putf:
-	fput(file);
-out:
+	ret = -EBADF;
+	file = fget(fd);
+	if (file) {
+		ret = do_fsync(file, 1);
+		fput(file);
+	}
 	return ret;
 }
 
@@ -0,0 +1,369 @@
+/*
+ *  fs/eventfd.c
+ *
+ *  A file descriptor wrapped around a 64 bit counter.  write(2) adds to
+ *  the counter, read(2) returns it and resets it to zero, and poll(2)
+ *  reports POLLIN while it is non-zero.  The kernel can bump the counter
+ *  too (see eventfd_signal()), which lets AIO completions be waited for
+ *  with epoll alongside sockets and pipes.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mount.h>
+#include <linux/string.h>
+#include <linux/syscalls.h>
+#include <linux/eventfd.h>
+#include <asm/uaccess.h>
+
+#define EVENTFDFS_MAGIC 0x45564644	/* "EVFD" */
+
+/* The counter saturates one below this value */
+#define EVENTFD_COUNT_MAX (~0ULL)
+
+struct eventfd_ctx {
+	/*
+	 * Readers and writers sleep here, and the lock of the wait queue
+	 * head protects "count" as well.  eventfd_signal() may be called
+	 * from interrupt context, hence the irq-safe locking throughout.
+	 */
+	wait_queue_head_t wqh;
+	/*
+	 * Every write(2) adds to the counter and every read(2) returns it
+	 * and resets it.  The all-ones value is never reached: a write
+	 * that would get there blocks until the counter is read.
+	 */
+	__u64 count;
+};
+
+static struct vfsmount *eventfd_mnt;
+
+static int eventfd_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static unsigned int eventfd_poll(struct file *file, poll_table *wait)
+{
+	struct eventfd_ctx *ctx = file->private_data;
+	unsigned int events = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ctx->wqh, wait);
+
+	spin_lock_irqsave(&ctx->wqh.lock, flags);
+	if (ctx->count > 0)
+		events |= POLLIN | POLLRDNORM;
+	if (EVENTFD_COUNT_MAX - 1 > ctx->count)
+		events |= POLLOUT | POLLWRNORM;
+	spin_unlock_irqrestore(&ctx->wqh.lock, flags);
+
+	return events;
+}
+
+static ssize_t eventfd_read(struct file *file, char __user *buf, size_t count,
+			    loff_t *ppos)
+{
+	struct eventfd_ctx *ctx = file->private_data;
+	ssize_t res;
+	__u64 ucnt = 0;
+	DECLARE_WAITQUEUE(wait, current);
+
+	if (count < sizeof(ucnt))
+		return -EINVAL;
+
+	spin_lock_irq(&ctx->wqh.lock);
+	res = -EAGAIN;
+	if (ctx->count > 0)
+		res = sizeof(ucnt);
+	else if (!(file->f_flags & O_NONBLOCK)) {
+		__add_wait_queue(&ctx->wqh, &wait);
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (ctx->count > 0) {
+				res = sizeof(ucnt);
+				break;
+			}
+			if (signal_pending(current)) {
+				res = -ERESTARTSYS;
+				break;
+			}
+			spin_unlock_irq(&ctx->wqh.lock);
+			schedule();
+			spin_lock_irq(&ctx->wqh.lock);
+		}
+		__remove_wait_queue(&ctx->wqh, &wait);
+		__set_current_state(TASK_RUNNING);
+	}
+	if (res > 0) {
+		ucnt = ctx->count;
+		ctx->count = 0;
+		if (waitqueue_active(&ctx->wqh))
+			wake_up_locked(&ctx->wqh);
+	}
+	spin_unlock_irq(&ctx->wqh.lock);
+
+	if (res > 0 && put_user(ucnt, (__u64 __user *) buf))
+		return -EFAULT;
+
+	return res;
+}
+
+static ssize_t eventfd_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct eventfd_ctx *ctx = file->private_data;
+	ssize_t res;
+	__u64 ucnt;
+	DECLARE_WAITQUEUE(wait, current);
+
+	if (count < sizeof(ucnt))
+		return -EINVAL;
+	if (copy_from_user(&ucnt, buf, sizeof(ucnt)))
+		return -EFAULT;
+	if (ucnt == EVENTFD_COUNT_MAX)
+		return -EINVAL;
+
+	spin_lock_irq(&ctx->wqh.lock);
+	res = -EAGAIN;
+	if (EVENTFD_COUNT_MAX - ctx->count > ucnt)
+		res = sizeof(ucnt);
+	else if (!(file->f_flags & O_NONBLOCK)) {
+		__add_wait_queue(&ctx->wqh, &wait);
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (EVENTFD_COUNT_MAX - ctx->count > ucnt) {
+				res = sizeof(ucnt);
+				break;
+			}
+			if (signal_pending(current)) {
+				res = -ERESTARTSYS;
+				break;
+			}
+			spin_unlock_irq(&ctx->wqh.lock);
+			schedule();
+			spin_lock_irq(&ctx->wqh.lock);
+		}
+		__remove_wait_queue(&ctx->wqh, &wait);
+		__set_current_state(TASK_RUNNING);
+	}
+	if (res > 0) {
+		ctx->count += ucnt;
+		if (waitqueue_active(&ctx->wqh))
+			wake_up_locked(&ctx->wqh);
+	}
+	spin_unlock_irq(&ctx->wqh.lock);
+
+	return res;
+}
+
+static struct file_operations eventfd_fops = {
+	.release	= eventfd_release,
+	.poll		= eventfd_poll,
+	.read		= eventfd_read,
+	.write		= eventfd_write,
+};
+
+/*
+ * Add @n to the counter of the eventfd behind @file and wake up anyone
+ * waiting on it.  Safe to call from interrupt context; aio_complete()
+ * uses it to announce finished iocbs.  The counter saturates instead of
+ * overflowing, so the number actually added is returned.
+ */
+int eventfd_signal(struct file *file, int n)
+{
+	struct eventfd_ctx *ctx = file->private_data;
+	unsigned long flags;
+
+	if (n < 0)
+		return -EINVAL;
+	spin_lock_irqsave(&ctx->wqh.lock, flags);
+	if (EVENTFD_COUNT_MAX - ctx->count - 1 < n)
+		n = (int) (EVENTFD_COUNT_MAX - ctx->count - 1);
+	ctx->count += n;
+	if (waitqueue_active(&ctx->wqh))
+		wake_up_locked(&ctx->wqh);
+	spin_unlock_irqrestore(&ctx->wqh.lock, flags);
+
+	return n;
+}
+EXPORT_SYMBOL(eventfd_signal);
+
+/*
+ * Look up @fd and make sure it is an eventfd.  Returns the file with a
+ * reference held, or an ERR_PTR().
+ */
+struct file *eventfd_fget(int fd)
+{
+	struct file *file;
+
+	file = fget(fd);
+	if (!file)
+		return ERR_PTR(-EBADF);
+	if (file->f_op != &eventfd_fops) {
+		fput(file);
+		return ERR_PTR(-EINVAL);
+	}
+
+	return file;
+}
+EXPORT_SYMBOL(eventfd_fget);
+
+static int eventfdfs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static struct dentry_operations eventfdfs_dentry_operations = {
+	.d_delete	= eventfdfs_delete_dentry,
+};
+
+static struct inode *eventfd_inode(void)
+{
+	struct inode *inode = new_inode(eventfd_mnt->mnt_sb);
+
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	inode->i_fop = &eventfd_fops;
+
+	/*
+	 * Mark the inode dirty from the very beginning,
+	 * that way it will never be moved to the dirty
+	 * list because mark_inode_dirty() will think
+	 * that it already _is_ on the dirty list.
+	 */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+	return inode;
+}
+
+asmlinkage long sys_eventfd(unsigned int count)
+{
+	struct eventfd_ctx *ctx;
+	struct qstr this;
+	char name[32];
+	struct dentry *dentry;
+	struct inode *inode;
+	struct file *file;
+	int error, fd;
+
+	error = -ENOMEM;
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		goto eexit_1;
+	init_waitqueue_head(&ctx->wqh);
+	ctx->count = count;
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto eexit_2;
+
+	inode = eventfd_inode();
+	error = PTR_ERR(inode);
+	if (IS_ERR(inode))
+		goto eexit_3;
+
+	error = get_unused_fd();
+	if (error < 0)
+		goto eexit_4;
+	fd = error;
+
+	error = -ENOMEM;
+	sprintf(name, "[%lu]", inode->i_ino);
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = inode->i_ino;
+	dentry = d_alloc(eventfd_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto eexit_5;
+	dentry->d_op = &eventfdfs_dentry_operations;
+	d_add(dentry, inode);
+	file->f_vfsmnt = mntget(eventfd_mnt);
+	file->f_dentry = dentry;
+	file->f_mapping = inode->i_mapping;
+
+	file->f_pos = 0;
+	file->f_flags = O_RDWR;
+	file->f_op = &eventfd_fops;
+	file->f_mode = FMODE_READ | FMODE_WRITE;
+	file->f_version = 0;
+	file->private_data = ctx;
+
+	fd_install(fd, file);
+
+	return fd;
+
+eexit_5:
+	put_unused_fd(fd);
+eexit_4:
+	iput(inode);
+eexit_3:
+	put_filp(file);
+eexit_2:
+	kfree(ctx);
+eexit_1:
+	return error;
+}
+
+static struct super_block *
+eventfdfs_get_sb(struct file_system_type *fs_type, int flags,
+		 const char *dev_name, void *data)
+{
+	return get_sb_pseudo(fs_type, "eventfd:", NULL, EVENTFDFS_MAGIC);
+}
+
+static struct file_system_type eventfd_fs_type = {
+	.name		= "eventfdfs",
+	.get_sb		= eventfdfs_get_sb,
+	.kill_sb	= kill_anon_super,
+};
+
+static int __init eventfd_init(void)
+{
+	int error;
+
+	error = register_filesystem(&eventfd_fs_type);
+	if (error)
+		goto epanic;
+
+	eventfd_mnt = kern_mount(&eventfd_fs_type);
+	error = PTR_ERR(eventfd_mnt);
+	if (IS_ERR(eventfd_mnt))
+		goto epanic;
+
+	return 0;
+
+epanic:
+	panic("eventfd_init() failed\n");
+}
+
+static void __exit eventfd_exit(void)
+{
+	unregister_filesystem(&eventfd_fs_type);
+	mntput(eventfd_mnt);
+}
+
+module_init(eventfd_init);
+module_exit(eventfd_exit);
+
+MODULE_LICENSE("GPL");
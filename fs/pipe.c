@@ -15,6 +15,7 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/uio.h>
 #include <linux/highmem.h>
+#include <linux/aio.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -90,23 +91,37 @@ static void anon_pipe_buf_release(struct pipe_inode_info *info, struct pipe_buff
 {
 	struct page *page = buf->page;
 
-	if (info->tmp_page) {
-		__free_page(page);
+	/*
+	 * If nobody else uses this page (tee() may have handed it to
+	 * another pipe), and we don't already have a temporary page,
+	 * keep it as a one-deep allocation cache.
+	 */
+	if (page_count(page) == 1 && !info->tmp_page) {
+		info->tmp_page = page;
 		return;
 	}
-	info->tmp_page = page;
+	put_page(page);
 }
 
-static void *anon_pipe_buf_map(struct file *file, struct pipe_inode_info *info, struct pipe_buffer *buf)
+void *generic_pipe_buf_map(struct file *file, struct pipe_inode_info *info, struct pipe_buffer *buf)
 {
 	return kmap(buf->page);
 }
 
-static void anon_pipe_buf_unmap(struct pipe_inode_info *info, struct pipe_buffer *buf)
+void generic_pipe_buf_unmap(struct pipe_inode_info *info, struct pipe_buffer *buf)
 {
 	kunmap(buf->page);
 }
 
+/*
+ * Take an extra reference on the buffer page, used when the same page
+ * ends up in more than one pipe.
+ */
+void generic_pipe_buf_get(struct pipe_inode_info *info, struct pipe_buffer *buf)
+{
+	get_page(buf->page);
+}
+
 /**
  * anon_pipe_buf_ops由pipe_buffer对象的ops指向
  */
@@ -115,20 +130,24 @@ static struct pipe_buf_operations anon_pipe_buf_ops = {
 	/**
 	 * 在访问缓冲区数据之前调用。它只在管理缓冲区在高端内存时对管理缓冲区页框调用kmap
 	 */
-	.map = anon_pipe_buf_map,
+	.map = generic_pipe_buf_map,
 	/**
 	 * 与map对应,对管理缓冲区页框调用kunmap
 	 */
-	.unmap = anon_pipe_buf_unmap,
+	.unmap = generic_pipe_buf_unmap,
 	/**
 	 * 当释放管理缓冲区时调用，该方法实现了一个单页内存高速缓存。
 	 */
 	.release = anon_pipe_buf_release,
+	/**
+	 * tee()在两个管道间共享页框时调用，增加页框的引用计数。
+	 */
+	.get = generic_pipe_buf_get,
 };
 
 static ssize_t
-pipe_readv(struct file *filp, const struct iovec *_iov,
-	   unsigned long nr_segs, loff_t *ppos)
+do_pipe_readv(struct file *filp, const struct iovec *_iov,
+	      unsigned long nr_segs, int nonblock)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
 	struct pipe_inode_info *info;
@@ -193,7 +212,7 @@ pipe_readv(struct file *filp, const struct iovec *_iov,
 			 */
 			if (ret)
 				break;
-			if (filp->f_flags & O_NONBLOCK) {
+			if (nonblock) {
 				ret = -EAGAIN;
 				break;
 			}
@@ -219,6 +238,13 @@ pipe_readv(struct file *filp, const struct iovec *_iov,
 	return ret;
 }
 
+static ssize_t
+pipe_readv(struct file *filp, const struct iovec *iov,
+	   unsigned long nr_segs, loff_t *ppos)
+{
+	return do_pipe_readv(filp, iov, nr_segs, filp->f_flags & O_NONBLOCK);
+}
+
 static ssize_t
 pipe_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 {
@@ -226,9 +252,23 @@ pipe_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 	return pipe_readv(filp, &iov, 1, ppos);
 }
 
+/*
+ * Asynchronous iocbs must not sleep on the pipe: they get -EAGAIN, and
+ * fs/aio.c waits for the pipe through ->poll before retrying.
+ */
 static ssize_t
-pipe_writev(struct file *filp, const struct iovec *_iov,
-	    unsigned long nr_segs, loff_t *ppos)
+pipe_aio_read(struct kiocb *iocb, char __user *buf, size_t count, loff_t pos)
+{
+	struct file *filp = iocb->ki_filp;
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+
+	return do_pipe_readv(filp, &iov, 1, (filp->f_flags & O_NONBLOCK) ||
+			     !is_sync_kiocb(iocb));
+}
+
+static ssize_t
+do_pipe_writev(struct file *filp, const struct iovec *_iov,
+	       unsigned long nr_segs, int nonblock)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
 	struct pipe_inode_info *info;
@@ -259,7 +299,8 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		struct pipe_buffer *buf = info->bufs + lastbuf;
 		struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
-		if (ops->can_merge && offset + total_len <= PAGE_SIZE) {
+		if (ops->can_merge && !(buf->flags & PIPE_BUF_FLAG_NOMERGE) &&
+		    offset + total_len <= PAGE_SIZE) {
 			void *addr = ops->map(filp, info, buf);
 			int error = pipe_iov_copy_from_user(offset + addr, iov, total_len);
 			ops->unmap(info, buf);
@@ -320,6 +361,7 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 			buf->ops = &anon_pipe_buf_ops;
 			buf->offset = 0;
 			buf->len = chars;
+			buf->flags = 0;
 			info->nrbufs = ++bufs;
 			info->tmp_page = NULL;
 
@@ -329,7 +371,7 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		}
 		if (bufs < PIPE_BUFFERS)
 			continue;
-		if (filp->f_flags & O_NONBLOCK) {
+		if (nonblock) {
 			if (!ret) ret = -EAGAIN;
 			break;
 		}
@@ -357,6 +399,13 @@ out:
 	return ret;
 }
 
+static ssize_t
+pipe_writev(struct file *filp, const struct iovec *iov,
+	    unsigned long nr_segs, loff_t *ppos)
+{
+	return do_pipe_writev(filp, iov, nr_segs, filp->f_flags & O_NONBLOCK);
+}
+
 static ssize_t
 pipe_write(struct file *filp, const char __user *buf,
 	   size_t count, loff_t *ppos)
@@ -365,6 +414,17 @@ pipe_write(struct file *filp, const char __user *buf,
 	return pipe_writev(filp, &iov, 1, ppos);
 }
 
+static ssize_t
+pipe_aio_write(struct kiocb *iocb, const char __user *buf, size_t count,
+	       loff_t pos)
+{
+	struct file *filp = iocb->ki_filp;
+	struct iovec iov = { .iov_base = (void __user *)buf, .iov_len = count };
+
+	return do_pipe_writev(filp, &iov, 1, (filp->f_flags & O_NONBLOCK) ||
+			      !is_sync_kiocb(iocb));
+}
+
 /**
  * 当FIFO只写时,其文件操作表的f_op字段的读方法
  * 因此时文件只写,所以读方法只是简单的返回一个错误
@@ -585,6 +645,7 @@ struct file_operations read_fifo_fops = {
 	.llseek		= no_llseek,
 	.read		= pipe_read,
 	.readv		= pipe_readv,
+	.aio_read	= pipe_aio_read,
 	.write		= bad_pipe_w,
 	.poll		= fifo_poll,
 	.ioctl		= pipe_ioctl,
@@ -598,6 +659,7 @@ struct file_operations write_fifo_fops = {
 	.read		= bad_pipe_r,
 	.write		= pipe_write,
 	.writev		= pipe_writev,
+	.aio_write	= pipe_aio_write,
 	.poll		= fifo_poll,
 	.ioctl		= pipe_ioctl,
 	.open		= pipe_write_open,
@@ -609,8 +671,10 @@ struct file_operations rdwr_fifo_fops = {
 	.llseek		= no_llseek,
 	.read		= pipe_read,
 	.readv		= pipe_readv,
+	.aio_read	= pipe_aio_read,
 	.write		= pipe_write,
 	.writev		= pipe_writev,
+	.aio_write	= pipe_aio_write,
 	.poll		= fifo_poll,
 	.ioctl		= pipe_ioctl,
 	.open		= pipe_rdwr_open,
@@ -622,6 +686,7 @@ struct file_operations read_pipe_fops = {
 	.llseek		= no_llseek,
 	.read		= pipe_read,
 	.readv		= pipe_readv,
+	.aio_read	= pipe_aio_read,
 	.write		= bad_pipe_w,
 	.poll		= pipe_poll,
 	.ioctl		= pipe_ioctl,
@@ -635,6 +700,7 @@ struct file_operations write_pipe_fops = {
 	.read		= bad_pipe_r,
 	.write		= pipe_write,
 	.writev		= pipe_writev,
+	.aio_write	= pipe_aio_write,
 	.poll		= pipe_poll,
 	.ioctl		= pipe_ioctl,
 	.open		= pipe_write_open,
@@ -646,8 +712,10 @@ struct file_operations rdwr_pipe_fops = {
 	.llseek		= no_llseek,
 	.read		= pipe_read,
 	.readv		= pipe_readv,
+	.aio_read	= pipe_aio_read,
 	.write		= pipe_write,
 	.writev		= pipe_writev,
+	.aio_write	= pipe_aio_write,
 	.poll		= pipe_poll,
 	.ioctl		= pipe_ioctl,
 	.open		= pipe_rdwr_open,
@@ -698,7 +766,7 @@ static struct dentry_operations pipefs_dentry_operations = {
 	.d_delete	= pipefs_delete_dentry,
 };
 
-static struct inode * get_pipe_inode(void)
+struct inode * get_pipe_inode(void)
 {
 	/**
 	 * 在pipe_fs文件系统中分配一个新的索引结点。
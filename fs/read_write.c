@@ -642,7 +642,7 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 	in_inode = in_file->f_dentry->d_inode;
 	if (!in_inode)
 		goto fput_in;
-	if (!in_file->f_op || !in_file->f_op->sendfile)
+	if (!in_file->f_op)
 		goto fput_in;
 	retval = -ESPIPE;
 	if (!ppos)
@@ -668,7 +668,7 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 	if (!(out_file->f_mode & FMODE_WRITE))
 		goto fput_out;
 	retval = -EINVAL;
-	if (!out_file->f_op || !out_file->f_op->sendpage)
+	if (!out_file->f_op)
 		goto fput_out;
 	out_inode = out_file->f_dentry->d_inode;
 	retval = rw_verify_area(WRITE, out_file, &out_file->f_pos, count);
@@ -693,14 +693,25 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 		count = max - pos;
 	}
 
-	retval = in_file->f_op->sendfile(in_file, ppos, count, file_send_actor, out_file);
-
-	if (retval > 0) {
-		current->rchar += retval;
-		current->wchar += retval;
-	}
-	current->syscr++;
-	current->syscw++;
+	/*
+	 * The old page cache to ->sendpage() path is only used when the
+	 * source can't splice. Everything else goes through a private
+	 * pipe, which handles any pair of files and batches the pages
+	 * handed to sockets.
+	 */
+	if (in_file->f_op->sendfile && out_file->f_op->sendpage &&
+	    !in_file->f_op->splice_read) {
+		retval = in_file->f_op->sendfile(in_file, ppos, count,
+						 file_send_actor, out_file);
+
+		if (retval > 0) {
+			current->rchar += retval;
+			current->wchar += retval;
+		}
+		current->syscr++;
+		current->syscw++;
+	} else
+		retval = do_splice_direct(in_file, ppos, out_file, count, 0);
 
 	if (*ppos > max)
 		retval = -EOVERFLOW;
@@ -0,0 +1,1440 @@
+/*
+ * "splice": joining two ropes together by interweaving their strands.
+ *
+ * This is the "extended pipe" functionality, where a pipe is used as
+ * an arbitrary in-memory buffer. Think of a pipe as a small kernel
+ * buffer that you can use to transfer data from one end to the other.
+ *
+ * The traditional unix read/write is extended with a "splice()" operation
+ * that transfers data buffers to or from a pipe buffer, plus "tee()" which
+ * duplicates the buffers of one pipe into another and "vmsplice()" which
+ * maps user pages into a pipe.
+ *
+ * Only page references are moved around: a file read into a pipe shares
+ * the page cache pages, and a pipe written to a socket hands the very
+ * same pages to ->sendpage(). Nothing is ever copied through user space.
+ */
+#include <linux/config.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/swap.h>
+#include <linux/writeback.h>
+#include <linux/buffer_head.h>
+#include <linux/module.h>
+#include <linux/uio.h>
+#include <linux/security.h>
+#include <linux/dnotify.h>
+#include <linux/syscalls.h>
+#include <linux/poll.h>
+
+#include <asm/uaccess.h>
+
+/*
+ * Passed to the actors that move data out of a pipe
+ */
+struct splice_desc {
+	unsigned int len, total_len;	/* current and remaining length */
+	unsigned int flags;		/* splice flags */
+	struct file *file;		/* file to write to */
+	loff_t pos;			/* file position */
+};
+
+typedef int (splice_actor)(struct pipe_inode_info *, struct pipe_buffer *,
+			   struct splice_desc *);
+
+static void page_cache_pipe_buf_release(struct pipe_inode_info *info,
+					struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+/*
+ * Used for page cache pages spliced in from a file, for user pages
+ * mapped in by vmsplice() and for the private pages filled by
+ * default_file_splice_read(). The pipe only holds a reference, so
+ * writers must never append to these pages.
+ */
+static struct pipe_buf_operations page_cache_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.release = page_cache_pipe_buf_release,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Pipe input worker. Most of this logic works like a regular pipe, the
+ * key here is the 'bufs' array that holds the page references to insert
+ * into the pipe. Any buffer that doesn't fit is released here, so the
+ * caller must not touch 'bufs' afterwards.
+ */
+static ssize_t splice_to_pipe(struct inode *inode, struct pipe_buffer *bufs,
+			      int nr_bufs, unsigned int flags)
+{
+	struct pipe_inode_info *info;
+	int ret, do_wakeup, i;
+
+	ret = 0;
+	do_wakeup = 0;
+	i = 0;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+
+	for (;;) {
+		int nrbufs;
+
+		if (!PIPE_READERS(*inode)) {
+			send_sig(SIGPIPE, current, 0);
+			if (!ret)
+				ret = -EPIPE;
+			break;
+		}
+
+		nrbufs = info->nrbufs;
+		if (nrbufs < PIPE_BUFFERS) {
+			int newbuf = (info->curbuf + nrbufs) & (PIPE_BUFFERS - 1);
+			struct pipe_buffer *buf = info->bufs + newbuf;
+
+			*buf = bufs[i];
+			info->nrbufs = ++nrbufs;
+			do_wakeup = 1;
+
+			ret += buf->len;
+			if (++i == nr_bufs)
+				break;
+		}
+		if (nrbufs < PIPE_BUFFERS)
+			continue;
+
+		if (flags & SPLICE_F_NONBLOCK) {
+			if (!ret)
+				ret = -EAGAIN;
+			break;
+		}
+
+		if (signal_pending(current)) {
+			if (!ret)
+				ret = -ERESTARTSYS;
+			break;
+		}
+
+		if (do_wakeup) {
+			wake_up_interruptible_sync(PIPE_WAIT(*inode));
+			kill_fasync(PIPE_FASYNC_READERS(*inode), SIGIO, POLL_IN);
+			do_wakeup = 0;
+		}
+
+		PIPE_WAITING_WRITERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_WRITERS(*inode)--;
+	}
+
+	up(PIPE_SEM(*inode));
+
+	if (do_wakeup) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		kill_fasync(PIPE_FASYNC_READERS(*inode), SIGIO, POLL_IN);
+	}
+
+	while (i < nr_bufs) {
+		bufs[i].ops->release(info, bufs + i);
+		i++;
+	}
+
+	return ret;
+}
+
+/*
+ * Look up (or read in) the page cache page at 'index' and make sure it
+ * is uptodate before it is handed to the pipe.
+ */
+static struct page *splice_get_page(struct file *in,
+				    struct address_space *mapping,
+				    unsigned long index, int *error)
+{
+	struct page *page;
+
+find_page:
+	page = find_get_page(mapping, index);
+	if (!page) {
+		page = page_cache_alloc_cold(mapping);
+		if (!page) {
+			*error = -ENOMEM;
+			return NULL;
+		}
+
+		*error = add_to_page_cache_lru(page, mapping, index, GFP_KERNEL);
+		if (unlikely(*error)) {
+			page_cache_release(page);
+			if (*error == -EEXIST)
+				goto find_page;
+			return NULL;
+		}
+
+		/* the page is locked and not uptodate, start the read */
+		goto readpage;
+	}
+
+	if (PageUptodate(page))
+		return page;
+
+	lock_page(page);
+
+	/* truncated while we waited for the lock? */
+	if (!page->mapping) {
+		unlock_page(page);
+		page_cache_release(page);
+		goto find_page;
+	}
+
+	if (PageUptodate(page)) {
+		unlock_page(page);
+		return page;
+	}
+
+readpage:
+	*error = mapping->a_ops->readpage(in, page);
+	if (unlikely(*error)) {
+		page_cache_release(page);
+		return NULL;
+	}
+
+	wait_on_page_locked(page);
+	if (!PageUptodate(page)) {
+		page_cache_release(page);
+		*error = -EIO;
+		return NULL;
+	}
+
+	return page;
+}
+
+/**
+ * generic_file_splice_read - splice data from file to a pipe
+ * @in:		file to splice from
+ * @ppos:	position in @in
+ * @pipe:	pipe to splice to
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Will read pages from given file and fill them into a pipe. The pipe
+ * gets references to the page cache pages, the data is not copied.
+ */
+ssize_t generic_file_splice_read(struct file *in, loff_t *ppos,
+				 struct inode *pipe, size_t len,
+				 unsigned int flags)
+{
+	struct address_space *mapping = in->f_mapping;
+	struct inode *inode = mapping->host;
+	struct pipe_buffer bufs[PIPE_BUFFERS];
+	unsigned long index, offset;
+	unsigned int nr_pages, i;
+	loff_t isize;
+	int error = 0;
+	ssize_t ret;
+
+	isize = i_size_read(inode);
+	if (unlikely(*ppos >= isize))
+		return 0;
+	if (len > isize - *ppos)
+		len = isize - *ppos;
+
+	index = *ppos >> PAGE_CACHE_SHIFT;
+	offset = *ppos & ~PAGE_CACHE_MASK;
+	nr_pages = (len + offset + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	if (nr_pages > PIPE_BUFFERS)
+		nr_pages = PIPE_BUFFERS;
+
+	/*
+	 * Initiate read-ahead on this page range, then wait for the pages
+	 * one by one below.
+	 */
+	do_page_cache_readahead(mapping, in, index, nr_pages);
+
+	for (i = 0; i < nr_pages && len; i++) {
+		struct page *page;
+		unsigned int this_len;
+
+		page = splice_get_page(in, mapping, index + i, &error);
+		if (!page)
+			break;
+
+		mark_page_accessed(page);
+
+		this_len = PAGE_CACHE_SIZE - offset;
+		if (this_len > len)
+			this_len = len;
+
+		bufs[i].page = page;
+		bufs[i].offset = offset;
+		bufs[i].len = this_len;
+		bufs[i].ops = &page_cache_pipe_buf_ops;
+		bufs[i].flags = 0;
+
+		len -= this_len;
+		offset = 0;
+	}
+
+	if (!i)
+		return error;
+
+	ret = splice_to_pipe(pipe, bufs, i, flags);
+	if (ret > 0) {
+		*ppos += ret;
+		file_accessed(in);
+	}
+
+	return ret;
+}
+
+EXPORT_SYMBOL(generic_file_splice_read);
+
+/**
+ * default_file_splice_read - splice data from any readable file to a pipe
+ * @in:		file to splice from
+ * @ppos:	position in @in
+ * @pipe:	pipe to splice to
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Fallback for files without a page cache, sockets in particular. The
+ * data is read into private kernel pages which are then handed to the
+ * pipe, so it is copied once but never crosses into user space. Only
+ * the first read may block, the rest is taken only if already readable.
+ *
+ * Whatever is read from a non-seekable file can't be given back, so
+ * nothing is read until the pipe has room and a reader, and the pipe
+ * stays locked across the reads: each page goes straight into a free
+ * slot and neither another writer nor the last reader can get in
+ * between.
+ */
+ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
+				 struct inode *pipe, size_t len,
+				 unsigned int flags)
+{
+	struct pipe_inode_info *info;
+	mm_segment_t old_fs;
+	ssize_t ret = 0, res = 0;
+	int do_wakeup = 0;
+
+	down(PIPE_SEM(*pipe));
+	info = pipe->i_pipe;
+
+	for (;;) {
+		if (!PIPE_READERS(*pipe)) {
+			send_sig(SIGPIPE, current, 0);
+			ret = -EPIPE;
+			goto out;
+		}
+		if (info->nrbufs < PIPE_BUFFERS)
+			break;
+		if (flags & SPLICE_F_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			goto out;
+		}
+		PIPE_WAITING_WRITERS(*pipe)++;
+		pipe_wait(pipe);
+		PIPE_WAITING_WRITERS(*pipe)--;
+	}
+
+	old_fs = get_fs();
+	set_fs(get_ds());
+
+	while (len && info->nrbufs < PIPE_BUFFERS) {
+		size_t this_len = min_t(size_t, len, PAGE_SIZE);
+		int newbuf = (info->curbuf + info->nrbufs) & (PIPE_BUFFERS - 1);
+		struct pipe_buffer *buf = info->bufs + newbuf;
+		struct page *page;
+		char *addr;
+
+		if (ret && in->f_op->poll &&
+		    !(in->f_op->poll(in, NULL) & POLLIN))
+			break;
+
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			res = -ENOMEM;
+			break;
+		}
+
+		addr = page_address(page);
+		if (in->f_op->read)
+			res = in->f_op->read(in, (char __user *)addr,
+					     this_len, ppos);
+		else
+			res = do_sync_read(in, (char __user *)addr,
+					   this_len, ppos);
+		if (res <= 0) {
+			__free_page(page);
+			break;
+		}
+
+		buf->page = page;
+		buf->offset = 0;
+		buf->len = res;
+		buf->ops = &page_cache_pipe_buf_ops;
+		buf->flags = 0;
+		info->nrbufs++;
+		do_wakeup = 1;
+
+		ret += res;
+		len -= res;
+		if (res < this_len)
+			break;
+	}
+
+	set_fs(old_fs);
+
+	if (!ret)
+		ret = res;
+out:
+	up(PIPE_SEM(*pipe));
+
+	if (do_wakeup) {
+		wake_up_interruptible(PIPE_WAIT(*pipe));
+		kill_fasync(PIPE_FASYNC_READERS(*pipe), SIGIO, POLL_IN);
+	}
+
+	return ret;
+}
+
+EXPORT_SYMBOL(default_file_splice_read);
+
+/*
+ * Send 'sd->len' bytes of the buffer to the socket, using the page
+ * reference directly.
+ */
+static int pipe_to_sendpage(struct pipe_inode_info *info,
+			    struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct file *file = sd->file;
+	loff_t pos = sd->pos;
+	int more;
+
+	more = (sd->flags & SPLICE_F_MORE) || sd->len < sd->total_len;
+
+	return file->f_op->sendpage(file, buf->page, buf->offset, sd->len,
+				    &pos, more);
+}
+
+/*
+ * Copy the buffer into the page cache of the target file. This is the
+ * only copy made on the whole file -> pipe -> file path, and it never
+ * goes through user space.
+ */
+static int pipe_to_file(struct pipe_inode_info *info, struct pipe_buffer *buf,
+			struct splice_desc *sd)
+{
+	struct file *file = sd->file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	unsigned int offset, this_len;
+	struct page *page;
+	unsigned long index;
+	char *src, *dst;
+	int ret;
+
+	index = sd->pos >> PAGE_CACHE_SHIFT;
+	offset = sd->pos & ~PAGE_CACHE_MASK;
+
+	this_len = sd->len;
+	if (this_len + offset > PAGE_CACHE_SIZE)
+		this_len = PAGE_CACHE_SIZE - offset;
+
+	page = find_or_create_page(mapping, index, mapping_gfp_mask(mapping));
+	if (!page)
+		return -ENOMEM;
+
+	ret = mapping->a_ops->prepare_write(file, page, offset, offset + this_len);
+	if (unlikely(ret)) {
+		loff_t isize = i_size_read(inode);
+
+		/*
+		 * prepare_write() may have instantiated a few blocks
+		 * outside i_size.  Trim these off again.
+		 */
+		unlock_page(page);
+		page_cache_release(page);
+		if (sd->pos + this_len > isize)
+			vmtruncate(inode, isize);
+		return ret;
+	}
+
+	src = buf->ops->map(file, info, buf);
+	dst = kmap_atomic(page, KM_USER0);
+	memcpy(dst + offset, src + buf->offset, this_len);
+	flush_dcache_page(page);
+	kunmap_atomic(dst, KM_USER0);
+	buf->ops->unmap(info, buf);
+
+	ret = mapping->a_ops->commit_write(file, page, offset, offset + this_len);
+	if (!ret)
+		ret = this_len;
+
+	unlock_page(page);
+	mark_page_accessed(page);
+	page_cache_release(page);
+
+	if (ret > 0)
+		balance_dirty_pages_ratelimited(mapping);
+
+	return ret;
+}
+
+/*
+ * Consume 'bytes' from the head of the pipe, releasing the buffers that
+ * are emptied. Returns the number of buffers released. Called with the
+ * pipe semaphore held.
+ */
+static int pipe_advance(struct pipe_inode_info *info, size_t bytes)
+{
+	int released = 0;
+
+	while (bytes) {
+		struct pipe_buffer *buf = info->bufs + info->curbuf;
+		struct pipe_buf_operations *ops = buf->ops;
+		unsigned int n = buf->len;
+
+		if (n > bytes)
+			n = bytes;
+		buf->offset += n;
+		buf->len -= n;
+		bytes -= n;
+		if (buf->len)
+			break;
+
+		buf->ops = NULL;
+		ops->release(info, buf);
+		info->curbuf = (info->curbuf + 1) & (PIPE_BUFFERS - 1);
+		info->nrbufs--;
+		released++;
+	}
+
+	return released;
+}
+
+/*
+ * Pipe output worker. This works like pipe_readv(), except that the
+ * data is handed to 'actor' instead of being copied to user space. The
+ * actor returns the number of bytes it consumed from the buffer, or a
+ * negative error.
+ */
+static ssize_t move_from_pipe(struct inode *inode, struct file *out,
+			      loff_t *ppos, size_t len, unsigned int flags,
+			      splice_actor *actor)
+{
+	struct pipe_inode_info *info;
+	struct splice_desc sd;
+	int do_wakeup;
+	ssize_t ret;
+
+	ret = 0;
+	do_wakeup = 0;
+
+	sd.total_len = len;
+	sd.flags = flags;
+	sd.file = out;
+	sd.pos = *ppos;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+
+	for (;;) {
+		int bufs = info->nrbufs;
+
+		if (bufs) {
+			struct pipe_buffer *buf = info->bufs + info->curbuf;
+			int done;
+
+			sd.len = buf->len;
+			if (sd.len > sd.total_len)
+				sd.len = sd.total_len;
+
+			done = actor(info, buf, &sd);
+			if (done <= 0) {
+				if (!ret)
+					ret = done;
+				break;
+			}
+
+			ret += done;
+			if (pipe_advance(info, done)) {
+				bufs = info->nrbufs;
+				do_wakeup = 1;
+			}
+
+			sd.pos += done;
+			sd.total_len -= done;
+			if (!sd.total_len)
+				break;
+		}
+
+		if (bufs)
+			continue;
+		if (!PIPE_WRITERS(*inode))
+			break;
+		if (!PIPE_WAITING_WRITERS(*inode)) {
+			if (ret)
+				break;
+			if (flags & SPLICE_F_NONBLOCK) {
+				ret = -EAGAIN;
+				break;
+			}
+		}
+
+		if (signal_pending(current)) {
+			if (!ret)
+				ret = -ERESTARTSYS;
+			break;
+		}
+
+		if (do_wakeup) {
+			wake_up_interruptible_sync(PIPE_WAIT(*inode));
+			kill_fasync(PIPE_FASYNC_WRITERS(*inode), SIGIO, POLL_OUT);
+			do_wakeup = 0;
+		}
+
+		pipe_wait(inode);
+	}
+
+	up(PIPE_SEM(*inode));
+
+	if (do_wakeup) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		kill_fasync(PIPE_FASYNC_WRITERS(*inode), SIGIO, POLL_OUT);
+	}
+
+	if (ret > 0)
+		*ppos = sd.pos;
+
+	return ret;
+}
+
+/**
+ * generic_file_splice_write - splice data from a pipe to a file
+ * @pipe:	pipe to splice from
+ * @out:	file to write to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Will either move or copy pages (determined by @flags options) from
+ * the given pipe inode to the given file. The file i_sem is taken
+ * before the pipe semaphore.
+ */
+ssize_t generic_file_splice_write(struct inode *pipe, struct file *out,
+				  loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct address_space *mapping = out->f_mapping;
+	struct inode *inode = mapping->host;
+	size_t count = len;
+	loff_t pos = *ppos;
+	ssize_t ret;
+
+	down(&inode->i_sem);
+
+	current->backing_dev_info = mapping->backing_dev_info;
+
+	ret = generic_write_checks(out, &pos, &count, S_ISBLK(inode->i_mode));
+	if (ret || !count)
+		goto out;
+
+	ret = remove_suid(out->f_dentry);
+	if (ret)
+		goto out;
+
+	inode_update_time(inode, 1);
+
+	ret = move_from_pipe(pipe, out, &pos, count, flags, pipe_to_file);
+	if (ret > 0) {
+		*ppos = pos;
+
+		/*
+		 * If file or inode is SYNC and we actually wrote some data,
+		 * sync it.
+		 */
+		if (unlikely((out->f_flags & O_SYNC) || IS_SYNC(inode))) {
+			int err = generic_osync_inode(inode, mapping,
+						OSYNC_METADATA|OSYNC_DATA);
+			if (err)
+				ret = err;
+		}
+	}
+out:
+	current->backing_dev_info = NULL;
+	up(&inode->i_sem);
+	return ret;
+}
+
+EXPORT_SYMBOL(generic_file_splice_write);
+
+/**
+ * generic_splice_sendpage - splice data from a pipe to a socket
+ * @pipe:	pipe to splice from
+ * @out:	socket to write to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Will send @len bytes from the pipe to a network socket. No data copying
+ * is involved, the pipe pages are handed to ->sendpage().
+ */
+ssize_t generic_splice_sendpage(struct inode *pipe, struct file *out,
+				loff_t *ppos, size_t len, unsigned int flags)
+{
+	return move_from_pipe(pipe, out, ppos, len, flags, pipe_to_sendpage);
+}
+
+EXPORT_SYMBOL(generic_splice_sendpage);
+
+/**
+ * splice_from_pipe_pages - splice data from a pipe in page vector batches
+ * @inode:	pipe to splice from
+ * @out:	file to write to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ * @actor:	handler that sends a run of pages
+ *
+ * Like generic_splice_sendpage(), but gathers each run of pipe buffers
+ * that forms one contiguous byte stream into a page vector and hands it
+ * to @actor in one call, so a socket is locked once per batch instead of
+ * once per page. The 'more' hint is only passed while further data is
+ * already queued (or the caller set SPLICE_F_MORE), so the last batch
+ * flushes.
+ */
+ssize_t splice_from_pipe_pages(struct inode *inode, struct file *out,
+			       loff_t *ppos, size_t len, unsigned int flags,
+			       splice_pages_actor *actor)
+{
+	struct pipe_inode_info *info;
+	size_t total_len = len;
+	int do_wakeup;
+	ssize_t ret;
+
+	ret = 0;
+	do_wakeup = 0;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+
+	for (;;) {
+		int bufs = info->nrbufs;
+
+		if (bufs) {
+			struct page *pages[PIPE_BUFFERS];
+			unsigned int offset;
+			size_t size = 0;
+			int nr = 0, more, done;
+
+			offset = info->bufs[info->curbuf].offset;
+			while (nr < bufs && size < total_len) {
+				struct pipe_buffer *buf;
+
+				buf = info->bufs + ((info->curbuf + nr) & (PIPE_BUFFERS - 1));
+				if (nr && buf->offset)
+					break;
+				pages[nr++] = buf->page;
+				size += buf->len;
+				if (buf->offset + buf->len != PAGE_SIZE)
+					break;
+			}
+			if (size > total_len)
+				size = total_len;
+
+			more = (flags & SPLICE_F_MORE) ||
+			       (size < total_len && nr < bufs);
+
+			done = actor(out, pages, offset, size, more);
+			if (done <= 0) {
+				if (!ret)
+					ret = done;
+				break;
+			}
+
+			ret += done;
+			if (pipe_advance(info, done)) {
+				bufs = info->nrbufs;
+				do_wakeup = 1;
+			}
+
+			total_len -= done;
+			if (!total_len)
+				break;
+		}
+
+		if (bufs)
+			continue;
+		if (!PIPE_WRITERS(*inode))
+			break;
+		if (!PIPE_WAITING_WRITERS(*inode)) {
+			if (ret)
+				break;
+			if (flags & SPLICE_F_NONBLOCK) {
+				ret = -EAGAIN;
+				break;
+			}
+		}
+
+		if (signal_pending(current)) {
+			if (!ret)
+				ret = -ERESTARTSYS;
+			break;
+		}
+
+		if (do_wakeup) {
+			wake_up_interruptible_sync(PIPE_WAIT(*inode));
+			kill_fasync(PIPE_FASYNC_WRITERS(*inode), SIGIO, POLL_OUT);
+			do_wakeup = 0;
+		}
+
+		pipe_wait(inode);
+	}
+
+	up(PIPE_SEM(*inode));
+
+	if (do_wakeup) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		kill_fasync(PIPE_FASYNC_WRITERS(*inode), SIGIO, POLL_OUT);
+	}
+
+	if (ret > 0)
+		*ppos += ret;
+
+	return ret;
+}
+
+EXPORT_SYMBOL(splice_from_pipe_pages);
+
+/*
+ * Hand the buffer to the file's ordinary ->write() method, from kernel
+ * space.
+ */
+static int pipe_to_write(struct pipe_inode_info *info, struct pipe_buffer *buf,
+			 struct splice_desc *sd)
+{
+	struct file *file = sd->file;
+	loff_t pos = sd->pos;
+	mm_segment_t old_fs;
+	char *src;
+	int ret;
+
+	src = buf->ops->map(file, info, buf);
+
+	old_fs = get_fs();
+	set_fs(get_ds());
+	if (file->f_op->write)
+		ret = file->f_op->write(file, (const char __user *)src + buf->offset,
+					sd->len, &pos);
+	else
+		ret = do_sync_write(file, (const char __user *)src + buf->offset,
+				    sd->len, &pos);
+	set_fs(old_fs);
+
+	buf->ops->unmap(info, buf);
+
+	return ret;
+}
+
+/**
+ * default_file_splice_write - splice data from a pipe to any writable file
+ * @pipe:	pipe to splice from
+ * @out:	file to write to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Fallback for files that have no ->splice_write(): the buffers are
+ * passed to ->write() one at a time.
+ */
+ssize_t default_file_splice_write(struct inode *pipe, struct file *out,
+				  loff_t *ppos, size_t len, unsigned int flags)
+{
+	return move_from_pipe(pipe, out, ppos, len, flags, pipe_to_write);
+}
+
+EXPORT_SYMBOL(default_file_splice_write);
+
+/*
+ * Attempt to initiate a splice from pipe to file.
+ */
+static long do_splice_from(struct inode *pipe, struct file *out, loff_t *ppos,
+			   size_t len, unsigned int flags)
+{
+	ssize_t (*splice_write)(struct inode *, struct file *, loff_t *,
+				size_t, unsigned int);
+	long ret;
+
+	if (unlikely(!out->f_op))
+		return -EINVAL;
+
+	splice_write = out->f_op->splice_write;
+	if (!splice_write) {
+		if (!out->f_op->write && !out->f_op->aio_write)
+			return -EINVAL;
+		splice_write = default_file_splice_write;
+	}
+
+	if (unlikely(!(out->f_mode & FMODE_WRITE)))
+		return -EBADF;
+
+	ret = rw_verify_area(WRITE, out, ppos, len);
+	if (unlikely(ret))
+		return ret;
+
+	ret = security_file_permission(out, MAY_WRITE);
+	if (unlikely(ret))
+		return ret;
+
+	ret = splice_write(pipe, out, ppos, len, flags);
+	if (ret > 0) {
+		current->wchar += ret;
+		dnotify_parent(out->f_dentry, DN_MODIFY);
+	}
+	current->syscw++;
+
+	return ret;
+}
+
+/*
+ * Attempt to initiate a splice from a file to a pipe.
+ */
+static long do_splice_to(struct file *in, loff_t *ppos, struct inode *pipe,
+			 size_t len, unsigned int flags)
+{
+	ssize_t (*splice_read)(struct file *, loff_t *, struct inode *,
+			       size_t, unsigned int);
+	long ret;
+
+	if (unlikely(!in->f_op))
+		return -EINVAL;
+
+	splice_read = in->f_op->splice_read;
+	if (!splice_read) {
+		if (!in->f_op->read && !in->f_op->aio_read)
+			return -EINVAL;
+		splice_read = default_file_splice_read;
+	}
+
+	if (unlikely(!(in->f_mode & FMODE_READ)))
+		return -EBADF;
+
+	ret = rw_verify_area(READ, in, ppos, len);
+	if (unlikely(ret))
+		return ret;
+
+	ret = security_file_permission(in, MAY_READ);
+	if (unlikely(ret))
+		return ret;
+
+	ret = splice_read(in, ppos, pipe, len, flags);
+	if (ret > 0) {
+		current->rchar += ret;
+		dnotify_parent(in->f_dentry, DN_ACCESS);
+	}
+	current->syscr++;
+
+	return ret;
+}
+
+/**
+ * do_splice_direct - splice data between two non-pipe files
+ * @in:		file to splice from
+ * @ppos:	input file offset
+ * @out:	file to splice to
+ * @len:	number of bytes to splice
+ * @flags:	splice modifier flags
+ *
+ * Moves the data through a private pipe, one pipe full at a time. This
+ * is what lets sendfile() work between any pair of files. Every batch
+ * but the last is sent with SPLICE_F_MORE, so a socket only flushes its
+ * partial frame at the end.
+ */
+ssize_t do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
+			 size_t len, unsigned int flags)
+{
+	struct inode *pipe;
+	ssize_t ret = 0;
+
+	pipe = get_pipe_inode();
+	if (unlikely(!pipe))
+		return -ENOMEM;
+
+	while (len) {
+		size_t read_len = min_t(size_t, len, PIPE_BUFFERS << PAGE_SHIFT);
+		unsigned int more;
+		long bytes, written;
+
+		bytes = do_splice_to(in, ppos, pipe, read_len, flags);
+		if (bytes <= 0) {
+			if (!ret)
+				ret = bytes;
+			break;
+		}
+
+		more = bytes < len ? SPLICE_F_MORE : 0;
+		written = do_splice_from(pipe, out, &out->f_pos, bytes,
+					 flags | more);
+		/*
+		 * A non-seekable input can't take data back, so keep the
+		 * output going for as long as it accepts any of it.
+		 */
+		while (written > 0 && written < bytes &&
+		       !(in->f_mode & FMODE_PREAD)) {
+			long n = do_splice_from(pipe, out, &out->f_pos,
+						bytes - written, flags | more);
+			if (n <= 0)
+				break;
+			written += n;
+		}
+		if (written < bytes) {
+			/*
+			 * The output stalled, give what it didn't take back
+			 * to a seekable input. From anything else it is lost,
+			 * just as when a write() after a read() fails.
+			 */
+			if (in->f_mode & FMODE_PREAD)
+				*ppos -= bytes - max(written, 0L);
+			if (written > 0)
+				ret += written;
+			else if (!ret)
+				ret = written;
+			break;
+		}
+
+		ret += written;
+		len -= written;
+
+		/* short read, don't wait for more */
+		if (bytes < read_len)
+			break;
+	}
+
+	free_pipe_info(pipe);
+	iput(pipe);
+
+	return ret;
+}
+
+/*
+ * Determine where to splice to/from. Exactly one of the two files must
+ * be a pipe, the offset is only meaningful for the other one.
+ */
+static long do_splice(struct file *in, loff_t __user *off_in,
+		      struct file *out, loff_t __user *off_out,
+		      size_t len, unsigned int flags)
+{
+	struct inode *pipe;
+	loff_t offset, *off;
+	long ret;
+
+	pipe = in->f_dentry->d_inode;
+	if (pipe->i_pipe) {
+		if (off_in)
+			return -ESPIPE;
+		/* pipe to pipe would nest the two pipe semaphores, use tee() */
+		if (out->f_dentry->d_inode->i_pipe)
+			return -EINVAL;
+		if (off_out) {
+			if (!(out->f_mode & FMODE_PWRITE))
+				return -EINVAL;
+			if (copy_from_user(&offset, off_out, sizeof(loff_t)))
+				return -EFAULT;
+			off = &offset;
+		} else
+			off = &out->f_pos;
+
+		ret = do_splice_from(pipe, out, off, len, flags);
+
+		if (off_out && copy_to_user(off_out, off, sizeof(loff_t)))
+			ret = -EFAULT;
+
+		return ret;
+	}
+
+	pipe = out->f_dentry->d_inode;
+	if (pipe->i_pipe) {
+		if (off_out)
+			return -ESPIPE;
+		if (off_in) {
+			if (!(in->f_mode & FMODE_PREAD))
+				return -EINVAL;
+			if (copy_from_user(&offset, off_in, sizeof(loff_t)))
+				return -EFAULT;
+			off = &offset;
+		} else
+			off = &in->f_pos;
+
+		ret = do_splice_to(in, off, pipe, len, flags);
+
+		if (off_in && copy_to_user(off_in, off, sizeof(loff_t)))
+			ret = -EFAULT;
+
+		return ret;
+	}
+
+	return -EINVAL;
+}
+
+asmlinkage long sys_splice(int fd_in, loff_t __user *off_in,
+			   int fd_out, loff_t __user *off_out,
+			   size_t len, unsigned int flags)
+{
+	long error;
+	struct file *in, *out;
+	int fput_in, fput_out;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fd_in, &fput_in);
+	if (in) {
+		if (in->f_mode & FMODE_READ) {
+			out = fget_light(fd_out, &fput_out);
+			if (out) {
+				if (out->f_mode & FMODE_WRITE)
+					error = do_splice(in, off_in,
+							  out, off_out,
+							  len, flags);
+				fput_light(out, fput_out);
+			}
+		}
+
+		fput_light(in, fput_in);
+	}
+
+	return error;
+}
+
+/*
+ * Make sure there's data to read. Wait for input if we can, otherwise
+ * return an appropriate error. Returns 1 if the pipe is at EOF.
+ */
+static int link_ipipe_prep(struct inode *inode, unsigned int flags)
+{
+	int ret = 0;
+
+	if (inode->i_pipe->nrbufs)
+		return 0;
+
+	down(PIPE_SEM(*inode));
+
+	while (!inode->i_pipe->nrbufs) {
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		if (!PIPE_WRITERS(*inode)) {
+			ret = 1;
+			break;
+		}
+		if (!PIPE_WAITING_WRITERS(*inode)) {
+			if (flags & SPLICE_F_NONBLOCK) {
+				ret = -EAGAIN;
+				break;
+			}
+		}
+		pipe_wait(inode);
+	}
+
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
+/*
+ * Make sure there's writeable room. Wait for room if we can, otherwise
+ * return an appropriate error.
+ */
+static int link_opipe_prep(struct inode *inode, unsigned int flags)
+{
+	int ret = 0;
+
+	if (inode->i_pipe->nrbufs < PIPE_BUFFERS)
+		return 0;
+
+	down(PIPE_SEM(*inode));
+
+	while (inode->i_pipe->nrbufs >= PIPE_BUFFERS) {
+		if (!PIPE_READERS(*inode)) {
+			send_sig(SIGPIPE, current, 0);
+			ret = -EPIPE;
+			break;
+		}
+		if (flags & SPLICE_F_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		PIPE_WAITING_WRITERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_WRITERS(*inode)--;
+	}
+
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
+/*
+ * Link buffers from 'ipipe' into 'opipe' without consuming them. Both
+ * pipe semaphores are held, taken in inode address order so that two
+ * concurrent tee() calls in opposite directions can't deadlock.
+ */
+static long link_pipe(struct inode *ipipe, struct inode *opipe,
+		      size_t len, unsigned int flags)
+{
+	struct pipe_inode_info *ipi, *opi;
+	struct inode *first, *second;
+	long ret;
+	int i;
+
+	if (ipipe < opipe) {
+		first = ipipe;
+		second = opipe;
+	} else {
+		first = opipe;
+		second = ipipe;
+	}
+
+	for (;;) {
+		ret = link_ipipe_prep(ipipe, flags);
+		if (ret)
+			return ret > 0 ? 0 : ret;
+
+		ret = link_opipe_prep(opipe, flags);
+		if (ret)
+			return ret;
+
+		down(PIPE_SEM(*first));
+		down(PIPE_SEM(*second));
+
+		ipi = ipipe->i_pipe;
+		opi = opipe->i_pipe;
+
+		if (!PIPE_READERS(*opipe)) {
+			send_sig(SIGPIPE, current, 0);
+			ret = -EPIPE;
+			goto out_unlock;
+		}
+
+		for (i = 0; len && i < ipi->nrbufs &&
+			    opi->nrbufs < PIPE_BUFFERS; i++) {
+			struct pipe_buffer *ibuf, *obuf;
+			int nbuf;
+
+			ibuf = ipi->bufs + ((ipi->curbuf + i) & (PIPE_BUFFERS - 1));
+			nbuf = (opi->curbuf + opi->nrbufs) & (PIPE_BUFFERS - 1);
+			obuf = opi->bufs + nbuf;
+
+			/*
+			 * Get a reference to this pipe buffer, so we can
+			 * copy the contents over. Neither pipe may append
+			 * to the shared page from now on.
+			 */
+			ibuf->ops->get(ipi, ibuf);
+			ibuf->flags |= PIPE_BUF_FLAG_NOMERGE;
+			*obuf = *ibuf;
+
+			if (obuf->len > len)
+				obuf->len = len;
+
+			opi->nrbufs++;
+			ret += obuf->len;
+			len -= obuf->len;
+		}
+
+out_unlock:
+		up(PIPE_SEM(*second));
+		up(PIPE_SEM(*first));
+
+		/*
+		 * Somebody raced with us between the prep and the locking,
+		 * go round again rather than report a bogus EOF.
+		 */
+		if (ret)
+			break;
+	}
+
+	if (ret > 0) {
+		wake_up_interruptible(PIPE_WAIT(*opipe));
+		kill_fasync(PIPE_FASYNC_READERS(*opipe), SIGIO, POLL_IN);
+	}
+
+	return ret;
+}
+
+/*
+ * tee(): duplicate up to 'len' bytes of the data in 'in' into 'out'.
+ * Both must be pipes. The data in 'in' is not consumed, so it can
+ * still be spliced elsewhere afterwards.
+ */
+asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	struct inode *ipipe, *opipe;
+	int fput_in, fput_out;
+	long error;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fdin, &fput_in);
+	if (in) {
+		if (in->f_mode & FMODE_READ) {
+			out = fget_light(fdout, &fput_out);
+			if (out) {
+				error = -EINVAL;
+				ipipe = in->f_dentry->d_inode;
+				opipe = out->f_dentry->d_inode;
+				if (!(out->f_mode & FMODE_WRITE))
+					error = -EBADF;
+				else if (ipipe->i_pipe && opipe->i_pipe &&
+					 ipipe != opipe)
+					error = link_pipe(ipipe, opipe,
+							  len, flags);
+				fput_light(out, fput_out);
+			}
+		}
+		fput_light(in, fput_in);
+	}
+
+	return error;
+}
+
+/*
+ * Map the user pages described by 'iov' into the pipe, at most
+ * PIPE_BUFFERS pages per call. The pages are referenced, not copied,
+ * so the caller must not modify them until they have been consumed
+ * (SPLICE_F_GIFT).
+ */
+static long do_vmsplice(struct inode *pipe, const struct iovec __user *iov,
+			unsigned long nr_segs, unsigned int flags)
+{
+	struct pipe_buffer bufs[PIPE_BUFFERS];
+	struct page *pages[PIPE_BUFFERS];
+	int buffers = 0, error = 0;
+
+	down_read(&current->mm->mmap_sem);
+
+	while (nr_segs && buffers < PIPE_BUFFERS) {
+		unsigned long off, npages;
+		struct iovec entry;
+		void __user *base;
+		size_t len;
+		int i;
+
+		error = -EFAULT;
+		if (copy_from_user(&entry, iov, sizeof(entry)))
+			break;
+
+		base = entry.iov_base;
+		len = entry.iov_len;
+
+		/*
+		 * Sanity check this iovec. 0 read succeeds.
+		 */
+		error = 0;
+		if (unlikely(!len))
+			goto next;
+		error = -EFAULT;
+		if (unlikely(!base))
+			break;
+		if (unlikely(!access_ok(VERIFY_READ, base, len)))
+			break;
+
+		/*
+		 * Get this base offset and number of pages, then map
+		 * in the user pages.
+		 */
+		off = (unsigned long) base & ~PAGE_MASK;
+		npages = (off + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		if (npages > PIPE_BUFFERS - buffers)
+			npages = PIPE_BUFFERS - buffers;
+
+		error = get_user_pages(current, current->mm,
+				       (unsigned long) base & PAGE_MASK, npages,
+				       0, 0, &pages[buffers], NULL);
+		if (unlikely(error <= 0))
+			break;
+
+		/*
+		 * Fill this contiguous range into the bufs array.
+		 */
+		for (i = 0; i < error; i++) {
+			const int plen = min_t(size_t, len, PAGE_SIZE - off);
+
+			bufs[buffers].page = pages[buffers];
+			bufs[buffers].offset = off;
+			bufs[buffers].len = plen;
+			bufs[buffers].ops = &page_cache_pipe_buf_ops;
+			bufs[buffers].flags = 0;
+
+			off = 0;
+			len -= plen;
+			buffers++;
+		}
+
+		/*
+		 * We didn't complete this iov, stop here since it probably
+		 * means we have to move some of this into a pipe to be able
+		 * to continue.
+		 */
+		if (len)
+			break;
+next:
+		nr_segs--;
+		iov++;
+	}
+
+	up_read(&current->mm->mmap_sem);
+
+	if (buffers)
+		return splice_to_pipe(pipe, bufs, buffers, flags);
+
+	return error;
+}
+
+/*
+ * vmsplice(): map user memory into a pipe. 'fd' must be the write side
+ * of a pipe.
+ */
+asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
+			     unsigned long nr_segs, unsigned int flags)
+{
+	struct file *file;
+	struct inode *pipe;
+	long error;
+	int fput;
+
+	if (unlikely(nr_segs > UIO_MAXIOV))
+		return -EINVAL;
+	if (unlikely(!nr_segs))
+		return 0;
+
+	error = -EBADF;
+	file = fget_light(fd, &fput);
+	if (file) {
+		pipe = file->f_dentry->d_inode;
+		if (!(file->f_mode & FMODE_WRITE))
+			error = -EBADF;
+		else if (!pipe->i_pipe)
+			error = -EINVAL;
+		else
+			error = do_vmsplice(pipe, iov, nr_segs, flags);
+
+		fput_light(file, fput);
+	}
+
+	return error;
+}
@@ -22,7 +22,7 @@
 #define SO_PRIORITY	12
 #define SO_LINGER	13
 #define SO_BSDCOMPAT	14
-/* To add :#define SO_REUSEPORT 15 */
+#define SO_REUSEPORT	15
 #define SO_PASSCRED	16
 #define SO_PEERCRED	17
 #define SO_RCVLOWAT	18
@@ -49,6 +49,8 @@
 
 #define SO_PEERSEC             31
 
+#define SO_BUSY_POLL		32
+
 #endif /* _ASM_SOCKET_H */
 
 
@@ -264,6 +264,40 @@ static __inline__ int atomic_sub_return(int i, atomic_t *v)
  */
 #define atomic_dec_return(v)  (atomic_sub_return(1,v))
 
+#ifdef CONFIG_X86_CMPXCHG
+#define __HAVE_ARCH_ATOMIC_INC_NOT_ZERO 1
+
+/**
+ * atomic_inc_not_zero - increment unless the number is zero
+ * @v: pointer of type atomic_t
+ *
+ * Atomically increments @v by 1, so long as it was not 0.
+ * Returns non-zero if @v was not 0, and 0 otherwise.
+ */
+/**
+ * 如果*v不为0，则原子加1并返回非0值。用于在无锁查找中获取可能正在被释放的对象的引用。
+ */
+static __inline__ int atomic_inc_not_zero(atomic_t *v)
+{
+	int c, old;
+
+	c = atomic_read(v);
+	for (;;) {
+		if (unlikely(c == 0))
+			break;
+		__asm__ __volatile__(
+			LOCK "cmpxchgl %2,%1"
+			:"=a"(old), "+m"(v->counter)
+			:"r"(c + 1), "0"(c)
+			:"memory");
+		if (likely(old == c))
+			break;
+		c = old;
+	}
+	return c != 0;
+}
+#endif
+
 /* These are x86-specific, used by some header files */
 /**
  * 清mask指定的*addr的所有位
@@ -41,6 +41,8 @@ extern void smp_message_irq(int cpl, void *dev_id, struct pt_regs *regs);
 extern void smp_invalidate_rcv(void);		/* Process an NMI */
 extern void (*mtrr_hook) (void);
 extern void zap_low_mappings (void);
+extern int smp_call_function_single(int cpu, void (*func) (void *info),
+				    void *info, int nonatomic, int wait);
 
 #define MAX_APICID 256
 extern u8 x86_cpu_to_apicid[];
@@ -68,7 +68,11 @@
  * 已经废弃
  */
 #define SO_BSDCOMPAT	14
-/* To add :#define SO_REUSEPORT 15 */
+/**
+ * 同一用户的多个套接口可以绑定相同的地址和端口，查找时按流哈希在它们之间分配连接和报文。
+ * 要求所有套接口都设置此选项。
+ */
+#define SO_REUSEPORT	15
 /**
  * 主要用于PF_UNIX协议族
  */
@@ -132,4 +136,9 @@
  */
 #define SO_PEERSEC		31
 
+/**
+ * 阻塞接收在睡眠前忙轮询网卡的微秒数。
+ */
+#define SO_BUSY_POLL		32
+
 #endif /* _ASM_SOCKET_H */
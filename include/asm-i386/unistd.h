@@ -294,8 +294,16 @@
 #define __NR_add_key		286
 #define __NR_request_key	287
 #define __NR_keyctl		288
+#define __NR_splice		289
+#define __NR_tee		290
+#define __NR_vmsplice		291
+#define __NR_eventfd		292
+#define __NR_recvmmsg		293
+#define __NR_sendmmsg		294
+#define __NR_accept4		295
+#define __NR_acceptv		296
 
-#define NR_syscalls 289
+#define NR_syscalls 297
 
 /*
  * user-visible error numbers are in the range -1 - -128: see
@@ -27,7 +27,7 @@
 #define SO_PRIORITY	12
 #define SO_LINGER	13
 #define SO_BSDCOMPAT	14
-/* To add :#define SO_REUSEPORT 15 */
+#define SO_REUSEPORT	15
 #define SO_RCVLOWAT	16
 #define SO_SNDLOWAT	17
 #define SO_RCVTIMEO	18
@@ -54,4 +54,6 @@
 
 #define SO_PEERSEC             31
 
+#define SO_BUSY_POLL		32
+
 #endif /* _ASM_SOCKET_H */
@@ -2,6 +2,7 @@
 #define __ARCH_X86_64_ATOMIC__
 
 #include <linux/config.h>
+#include <linux/compiler.h>
 
 /* atomic_t should be 32 bit signed type */
 
@@ -363,6 +364,35 @@ static __inline__ int atomic_sub_return(int i, atomic_t *v)
 #define atomic_inc_return(v)  (atomic_add_return(1,v))
 #define atomic_dec_return(v)  (atomic_sub_return(1,v))
 
+#define __HAVE_ARCH_ATOMIC_INC_NOT_ZERO 1
+
+/**
+ * atomic_inc_not_zero - increment unless the number is zero
+ * @v: pointer of type atomic_t
+ *
+ * Atomically increments @v by 1, so long as it was not 0.
+ * Returns non-zero if @v was not 0, and 0 otherwise.
+ */
+static __inline__ int atomic_inc_not_zero(atomic_t *v)
+{
+	int c, old;
+
+	c = atomic_read(v);
+	for (;;) {
+		if (unlikely(c == 0))
+			break;
+		__asm__ __volatile__(
+			LOCK "cmpxchgl %2,%1"
+			:"=a"(old), "+m"(v->counter)
+			:"r"(c + 1), "0"(c)
+			:"memory");
+		if (likely(old == c))
+			break;
+		c = old;
+	}
+	return c != 0;
+}
+
 /* These are x86-specific, used by some header files */
 #define atomic_clear_mask(mask, addr) \
 __asm__ __volatile__(LOCK "andl %0,%1" \
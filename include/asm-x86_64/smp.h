@@ -46,6 +46,8 @@ extern void smp_send_reschedule(int cpu);
 extern void smp_invalidate_rcv(void);		/* Process an NMI */
 extern void (*mtrr_hook) (void);
 extern void zap_low_mappings(void);
+extern int smp_call_function_single(int cpu, void (*func) (void *info),
+				    void *info, int nonatomic, int wait);
 void smp_stop_cpu(void);
 extern cpumask_t cpu_sibling_map[NR_CPUS];
 extern u8 phys_proc_id[NR_CPUS];
@@ -563,8 +563,24 @@ __SYSCALL(__NR_add_key, sys_add_key)
 __SYSCALL(__NR_request_key, sys_request_key)
 #define __NR_keyctl		250
 __SYSCALL(__NR_keyctl, sys_keyctl)
-
-#define __NR_syscall_max __NR_keyctl
+#define __NR_splice		251
+__SYSCALL(__NR_splice, sys_splice)
+#define __NR_tee		252
+__SYSCALL(__NR_tee, sys_tee)
+#define __NR_vmsplice		253
+__SYSCALL(__NR_vmsplice, sys_vmsplice)
+#define __NR_eventfd		254
+__SYSCALL(__NR_eventfd, sys_eventfd)
+#define __NR_recvmmsg		255
+__SYSCALL(__NR_recvmmsg, sys_recvmmsg)
+#define __NR_sendmmsg		256
+__SYSCALL(__NR_sendmmsg, sys_sendmmsg)
+#define __NR_accept4		257
+__SYSCALL(__NR_accept4, sys_accept4)
+#define __NR_acceptv		258
+__SYSCALL(__NR_acceptv, sys_acceptv)
+
+#define __NR_syscall_max __NR_acceptv
 #ifndef __NO_STUBS
 
 /* user-visible error numbers are in the range -1 - -4095 */
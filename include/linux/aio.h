@@ -3,6 +3,7 @@
 
 #include <linux/list.h>
 #include <linux/workqueue.h>
+#include <linux/rcupdate.h>
 #include <linux/aio_abi.h>
 
 #include <asm/atomic.h>
@@ -127,6 +128,10 @@ struct kiocb {
 	 * 异步IO操作等待队列。
 	 */
 	wait_queue_t		ki_wait;
+	/**
+	 * 管道和套接字上的请求在poll等待队列上等待时，ki_wait所在的等待队列头。
+	 */
+	wait_queue_head_t	*ki_wait_head;
 	long			ki_retried; 	/* just for testing */
 	long			ki_kicked; 	/* just for testing */
 	long			ki_queued; 	/* just for testing */
@@ -135,6 +140,11 @@ struct kiocb {
 	 * 由文件系统层自由使用。
 	 */
 	void			*private;
+
+	/**
+	 * 请求完成时需要通知的eventfd文件，没有则为NULL。
+	 */
+	struct file		*ki_eventfd;
 };
 
 /**
@@ -157,11 +167,31 @@ struct kiocb {
 		init_wait((&(x)->ki_wait));             \
 	} while (0)
 
+/*
+ * The completion ring lives in user memory at the address returned by
+ * io_setup(), so events can be reaped without entering the kernel.
+ * When compat_features has AIO_RING_F_USER_REAP set, a reaper does:
+ *
+ *	head = ring->head;
+ *	tail = ring->tail;
+ *	rmb();			(read tail before the events it covers)
+ *	if (head == tail)
+ *		the ring is empty: io_getevents() to sleep, or try again;
+ *	ev = ring->io_events[head];
+ *	if (cmpxchg(&ring->head, head, (head + 1) % ring->nr) != head)
+ *		somebody else took this event: start over;
+ *
+ * The kernel publishes an event before moving tail past it, and its
+ * own reaper (io_getevents) advances head with the same cmpxchg, so
+ * threads reaping from user space may be mixed freely with threads
+ * sleeping in io_getevents().  Only head may be written by user space.
+ */
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
+#define AIO_RING_F_USER_REAP		2	/* compat: head may move in user space */
 #define AIO_RING_INCOMPAT_FEATURES	0
 struct aio_ring {
-	unsigned	id;	/* kernel internal index number */
+	unsigned	id;	/* index in mm->ioctx_table */
 	unsigned	nr;	/* number of io_events */
 	unsigned	head;
 	unsigned	tail;
@@ -196,9 +226,8 @@ struct kioctx {
 	int			dead;
 	struct mm_struct	*mm;
 
-	/* This needs improving */
-	unsigned long		user_id;
-	struct kioctx		*next;
+	unsigned long		user_id;	/* aio_context_t handed to user */
+	unsigned		id;		/* slot in mm->ioctx_table */
 
 	wait_queue_head_t	wait;
 
@@ -213,6 +242,19 @@ struct kioctx {
 	struct aio_ring_info	ring_info;
 
 	struct work_struct	wq;
+
+	struct rcu_head		rcu_head;
+};
+
+/*
+ * Per-mm table of aio contexts, indexed by aio_ring->id, so that
+ * lookup_ioctx() needs neither a list walk nor a lock.  Readers use
+ * RCU; changes are made under mm->ioctx_list_lock.
+ */
+struct kioctx_table {
+	struct rcu_head		rcu_head;
+	unsigned		nr;
+	struct kioctx		*table[0];
 };
 
 /* prototypes */
@@ -9,6 +9,8 @@
 #include <linux/types.h>
 
 #ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/linkage.h>
 #include <asm/atomic.h>
 #endif
 
@@ -38,10 +40,15 @@ struct sock_fprog	/* Required for SO_ATTACH_FILTER. */
 };
 
 #ifdef __KERNEL__
+struct sk_buff;
+
 struct sk_filter
 {
 	atomic_t		refcnt;
         unsigned int         	len;	/* Number of filter blocks */
+	/* Native code for insns, or NULL to interpret them */
+	unsigned int		(asmlinkage *bpf_func)(const struct sk_buff *skb,
+						       const struct sock_filter *filter);
         struct sock_filter     	insns[0];
 };
 
@@ -140,12 +147,38 @@ static inline unsigned int sk_filter_len(struct sk_filter *fp)
 #define SKF_LL_OFF    (-0x200000)
 
 #ifdef __KERNEL__
-struct sk_buff;
 struct sock;
 
 extern int sk_run_filter(struct sk_buff *skb, struct sock_filter *filter, int flen);
 extern int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 extern int sk_chk_filter(struct sock_filter *filter, int flen);
+
+/* Runs an attached filter, natively if it was compiled */
+static inline int sk_filter_run(struct sk_filter *fp, struct sk_buff *skb)
+{
+	if (fp->bpf_func)
+		return fp->bpf_func(skb, fp->insns);
+	return sk_run_filter(skb, fp->insns, fp->len);
+}
+
+#ifdef CONFIG_BPF_JIT
+/* net.core.bpf_jit_enable: compile filters as they are attached */
+extern int bpf_jit_enable;
+
+/* Sets fp->bpf_func if it can; fp must have passed sk_chk_filter() */
+extern void bpf_jit_compile(struct sk_filter *fp);
+extern void bpf_jit_free(struct sk_filter *fp);
+
+/* Loads the JIT leaves to C: what sk_run_filter() does for a load of
+   size bytes at k which is not within the linear data.  Returns 0 if
+   the filter must return 0. */
+extern asmlinkage int sk_filter_load(const struct sk_buff *skb, int k,
+				     unsigned int size, u32 *val);
+#else
+static inline void bpf_jit_free(struct sk_filter *fp)
+{
+}
+#endif
 #endif /* __KERNEL__ */
 
 #endif /* __LINUX_FILTER_H__ */
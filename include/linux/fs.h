@@ -1369,6 +1369,12 @@ struct file_operations {
 	 * 设备驱动程序通常也不需要实现sendfile。
 	 */
 	ssize_t (*sendpage) (struct file *, struct page *, int, size_t, loff_t *, int);
+	/**
+	 * splice系统调用的实现。splice_write把管道(第一个参数是管道的索引节点)中的页框交给文件，
+	 * splice_read则把文件的页框以引用的方式放入管道，两者都不需要把数据拷贝到用户态。
+	 */
+	ssize_t (*splice_write)(struct inode *, struct file *, loff_t *, size_t, unsigned int);
+	ssize_t (*splice_read)(struct file *, loff_t *, struct inode *, size_t, unsigned int);
 	/**
 	 * 在进程的地址空间中找到一个合适的位置，以便将底层设备中的内存段映射到该位置。
 	 * 该任务通常由内存管理代码完成，但该方法的存在可允许驱动程序强制满足特定设备需要的任何对齐要求。大部分驱动程序可设置该方法为NULL。
@@ -1935,6 +1941,7 @@ extern int filemap_fdatawrite(struct address_space *);
 extern int filemap_flush(struct address_space *);
 extern int filemap_fdatawait(struct address_space *);
 extern int filemap_write_and_wait(struct address_space *mapping);
+extern int do_fsync(struct file *file, int datasync);
 extern void sync_supers(void);
 extern void sync_filesystems(int wait);
 extern void emergency_sync(void);
@@ -2050,6 +2057,22 @@ extern ssize_t do_sync_write(struct file *filp, const char __user *buf, size_t l
 ssize_t generic_file_write_nolock(struct file *file, const struct iovec *iov,
 				unsigned long nr_segs, loff_t *ppos);
 extern ssize_t generic_file_sendfile(struct file *, loff_t *, size_t, read_actor_t, void *);
+extern ssize_t generic_file_splice_read(struct file *, loff_t *,
+		struct inode *, size_t, unsigned int);
+extern ssize_t generic_file_splice_write(struct inode *, struct file *,
+		loff_t *, size_t, unsigned int);
+extern ssize_t generic_splice_sendpage(struct inode *, struct file *,
+		loff_t *, size_t, unsigned int);
+extern ssize_t default_file_splice_read(struct file *, loff_t *,
+		struct inode *, size_t, unsigned int);
+extern ssize_t default_file_splice_write(struct inode *, struct file *,
+		loff_t *, size_t, unsigned int);
+typedef int (splice_pages_actor)(struct file *, struct page **,
+		unsigned int, size_t, int);
+extern ssize_t splice_from_pipe_pages(struct inode *, struct file *,
+		loff_t *, size_t, unsigned int, splice_pages_actor *);
+extern ssize_t do_splice_direct(struct file *, loff_t *, struct file *,
+		size_t, unsigned int);
 extern void do_generic_mapping_read(struct address_space *mapping,
 				    struct file_ra_state *, struct file *,
 				    loff_t *, read_descriptor_t *, read_actor_t);
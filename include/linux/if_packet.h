@@ -63,6 +63,18 @@ struct sockaddr_ll
 #define PACKET_RX_RING			5
 #define PACKET_STATISTICS		6
 #define PACKET_COPY_THRESH		7
+#define PACKET_VERSION			10
+#define PACKET_TX_RING			13
+#define PACKET_FANOUT			18
+
+/* PACKET_FANOUT takes the group id in the low 16 bits, the mode above */
+#define PACKET_FANOUT_HASH		0	/* by flow */
+#define PACKET_FANOUT_LB		1	/* round robin */
+#define PACKET_FANOUT_CPU		2	/* by receiving CPU */
+
+/* PACKET_VERSION values, numbered as elsewhere; there is no V2 here */
+#define TPACKET_V1			0	/* a frame per packet */
+#define TPACKET_V3			2	/* packets packed in blocks */
 
 struct tpacket_stats
 {
@@ -78,6 +90,13 @@ struct tpacket_hdr
 #define TP_STATUS_COPY		2
 #define TP_STATUS_LOSING	4
 #define TP_STATUS_CSUMNOTREADY	8
+/* Tx ring */
+#define TP_STATUS_AVAILABLE	0
+#define TP_STATUS_SEND_REQUEST	1
+#define TP_STATUS_SENDING	2
+#define TP_STATUS_WRONG_FORMAT	4
+/* Rx ring blocks (TPACKET_V3) */
+#define TP_STATUS_BLK_TMO	32	/* retired by timeout, not full */
 	unsigned int	tp_len;
 	unsigned int	tp_snaplen;
 	unsigned short	tp_mac;
@@ -101,8 +120,71 @@ struct tpacket_hdr
    - Start+tp_mac: [ Optional MAC header ]
    - Start+tp_net: Packet data, aligned to TPACKET_ALIGNMENT=16.
    - Pad to align to TPACKET_ALIGNMENT=16
+
+   Tx ring frames hold tp_len bytes of packet data (starting with the
+   MAC header for SOCK_RAW) at Start+TPACKET_ALIGN(sizeof(struct
+   tpacket_hdr)).  The user sets tp_status to TP_STATUS_SEND_REQUEST and
+   calls send(); the kernel sends the frame without copying it and sets
+   tp_status back to TP_STATUS_AVAILABLE once the device is done with
+   it, or to TP_STATUS_WRONG_FORMAT if it could not be sent.
+ */
+
+/*
+   TPACKET_V3 rx ring.  Each block starts with a struct tpacket_block_desc,
+   then tp_sizeof_priv bytes for the user, then packets back to back, each
+   a struct tpacket3_hdr, a struct sockaddr_ll and the data laid out as in
+   a V1 frame but only TPACKET_ALIGN(tp_mac + tp_snaplen) bytes long.
+   Readers must walk the block by tp_next_offset rather than compute the
+   size themselves; it is 0 on the last packet.
+
+   The kernel fills one block at a time.  It hands the block to the user
+   (block_status TP_STATUS_USER) when the next packet does not fit or when
+   tp_retire_blk_tov milliseconds have passed since the block was opened,
+   and wakes the reader once per block.  The user gives a block back by
+   setting block_status to TP_STATUS_KERNEL.  The tx ring always uses V1
+   frames.
  */
 
+struct tpacket3_hdr
+{
+	unsigned int	tp_next_offset;
+	unsigned int	tp_sec;
+	unsigned int	tp_usec;
+	unsigned int	tp_snaplen;
+	unsigned int	tp_len;
+	unsigned int	tp_status;
+	unsigned short	tp_mac;
+	unsigned short	tp_net;
+};
+
+#define TPACKET3_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + sizeof(struct sockaddr_ll))
+
+struct tpacket_bd_ts
+{
+	unsigned int	ts_sec;
+	unsigned int	ts_usec;
+};
+
+struct tpacket_hdr_v1
+{
+	unsigned int	block_status;
+	unsigned int	num_pkts;
+	unsigned int	offset_to_first_pkt;
+	unsigned int	blk_len;		/* bytes used, from block start */
+	unsigned long long	seq_num;
+	struct tpacket_bd_ts	ts_first_pkt;
+	struct tpacket_bd_ts	ts_last_pkt;
+};
+
+struct tpacket_block_desc
+{
+	unsigned int	version;
+	unsigned int	offset_to_priv;
+	union {
+		struct tpacket_hdr_v1	bh1;
+	} hdr;
+};
+
 struct tpacket_req
 {
 	unsigned int	tp_block_size;	/* Minimal size of contiguous block */
@@ -111,6 +193,24 @@ struct tpacket_req
 	unsigned int	tp_frame_nr;	/* Total number of frames */
 };
 
+/* PACKET_RX_RING argument for TPACKET_V3; tp_frame_size caps one packet */
+struct tpacket_req3
+{
+	unsigned int	tp_block_size;
+	unsigned int	tp_block_nr;
+	unsigned int	tp_frame_size;
+	unsigned int	tp_frame_nr;
+	unsigned int	tp_retire_blk_tov;	/* timeout in msecs */
+	unsigned int	tp_sizeof_priv;		/* per-block user area */
+	unsigned int	tp_feature_req_word;	/* must be 0 */
+};
+
+union tpacket_req_u
+{
+	struct tpacket_req	req;
+	struct tpacket_req3	req3;
+};
+
 struct packet_mreq
 {
 	int		mr_ifindex;
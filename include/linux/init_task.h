@@ -24,7 +24,6 @@
 	.dead		= 0,				\
 	.mm		= &which_mm,			\
 	.user_id	= 0,				\
-	.next		= NULL,				\
 	.wait		= __WAIT_QUEUE_HEAD_INITIALIZER(name.wait), \
 	.ctx_lock	= SPIN_LOCK_UNLOCKED,		\
 	.reqs_active	= 0U,				\
@@ -0,0 +1,150 @@
+#ifndef _LINUX_LIST_NULLS_H
+#define _LINUX_LIST_NULLS_H
+
+#ifdef __KERNEL__
+
+#include <linux/stddef.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <asm/system.h>
+
+/*
+ * Special version of hlists, where the end of a chain is not a NULL
+ * pointer but a 'nulls' marker, which can carry many different values
+ * (at least 2^31 on all platforms).
+ *
+ * Objects stored on such a chain are at least word aligned, so the low
+ * bit of a 'next' pointer is free:
+ *	set to 1 : this is a 'nulls' end-of-chain marker (value is ptr >> 1)
+ *	set to 0 : this is a pointer to the next object
+ *
+ * Hash tables usually store the bucket index in the marker.  A lockless
+ * reader whose object was moved to another chain under it (possible
+ * with SLAB_DESTROY_BY_RCU caches, where memory is reused for a new
+ * object of the same type before the grace period ends) then finds the
+ * wrong marker at the end of its walk and knows it has to restart.
+ */
+/**
+ * 以nulls标记结尾的哈希链表头
+ */
+struct hlist_nulls_head {
+	struct hlist_nulls_node *first;
+};
+
+/**
+ * 以nulls标记结尾的哈希链表节点
+ */
+struct hlist_nulls_node {
+	struct hlist_nulls_node *next, **pprev;
+};
+
+#define INIT_HLIST_NULLS_HEAD(ptr, nulls) \
+	((ptr)->first = (struct hlist_nulls_node *) (1UL | (((long)nulls) << 1)))
+
+#define hlist_nulls_entry(ptr, type, member) container_of(ptr,type,member)
+
+/**
+ * is_a_nulls - test whether a ptr is a nulls end-of-chain marker
+ * @ptr: ptr to be tested
+ */
+static inline int is_a_nulls(const struct hlist_nulls_node *ptr)
+{
+	return ((unsigned long)ptr & 1);
+}
+
+/**
+ * get_nulls_value - get the value stored in a nulls marker
+ * @ptr: nulls marker
+ */
+static inline unsigned long get_nulls_value(const struct hlist_nulls_node *ptr)
+{
+	return ((unsigned long)ptr) >> 1;
+}
+
+static inline int hlist_nulls_unhashed(const struct hlist_nulls_node *h)
+{
+	return !h->pprev;
+}
+
+static inline int hlist_nulls_empty(const struct hlist_nulls_head *h)
+{
+	return is_a_nulls(h->first);
+}
+
+static inline void __hlist_nulls_del(struct hlist_nulls_node *n)
+{
+	struct hlist_nulls_node *next = n->next;
+	struct hlist_nulls_node **pprev = n->pprev;
+
+	*pprev = next;
+	if (!is_a_nulls(next))
+		next->pprev = pprev;
+}
+
+/**
+ * hlist_nulls_add_head_rcu - add a node to a nulls chain, RCU safe
+ * @n: the node to add
+ * @h: the chain to add it to
+ *
+ * The caller must hold whatever lock serializes writers of the chain.
+ * Lockless readers may run concurrently with this.
+ */
+static inline void hlist_nulls_add_head_rcu(struct hlist_nulls_node *n,
+					    struct hlist_nulls_head *h)
+{
+	struct hlist_nulls_node *first = h->first;
+
+	n->next = first;
+	n->pprev = &h->first;
+	smp_wmb();
+	h->first = n;
+	if (!is_a_nulls(first))
+		first->pprev = &n->next;
+}
+
+/**
+ * hlist_nulls_del_init_rcu - unlink a node from a nulls chain, RCU safe
+ * @n: the node to unlink
+ *
+ * n->next is left untouched, so a lockless reader standing on @n can
+ * still finish its walk.  hlist_nulls_unhashed() is true afterwards.
+ */
+static inline void hlist_nulls_del_init_rcu(struct hlist_nulls_node *n)
+{
+	if (!hlist_nulls_unhashed(n)) {
+		__hlist_nulls_del(n);
+		n->pprev = NULL;
+	}
+}
+
+/**
+ * hlist_nulls_for_each_entry - iterate over a nulls chain of given type
+ * @tpos:	the type * to use as a loop counter.
+ * @pos:	the &struct hlist_nulls_node to use as a loop counter.
+ * @head:	the head for your chain.
+ * @member:	the name of the hlist_nulls_node within the struct.
+ */
+#define hlist_nulls_for_each_entry(tpos, pos, head, member)		   \
+	for (pos = (head)->first;					   \
+	     (!is_a_nulls(pos)) &&					   \
+		({ tpos = hlist_nulls_entry(pos, typeof(*tpos), member); 1;}); \
+	     pos = pos->next)
+
+/**
+ * hlist_nulls_for_each_entry_rcu - iterate over a nulls chain under RCU
+ * @tpos:	the type * to use as a loop counter.
+ * @pos:	the &struct hlist_nulls_node to use as a loop counter.
+ * @head:	the head for your chain.
+ * @member:	the name of the hlist_nulls_node within the struct.
+ *
+ * On exit @pos holds the nulls marker that ended the walk; compare
+ * get_nulls_value(pos) with the expected one before trusting a miss.
+ */
+#define hlist_nulls_for_each_entry_rcu(tpos, pos, head, member)		   \
+	for (pos = rcu_dereference((head)->first);			   \
+	     (!is_a_nulls(pos)) &&					   \
+		({ tpos = hlist_nulls_entry(pos, typeof(*tpos), member); 1;}); \
+	     pos = rcu_dereference(pos->next))
+
+#endif /* __KERNEL__ */
+#endif
@@ -21,6 +21,7 @@
 #include <linux/config.h>
 #include <linux/wait.h>
 #include <linux/stringify.h>
+#include <linux/fcntl.h>
 #include <asm/socket.h>
 
 struct poll_table_struct;
@@ -45,6 +46,10 @@ struct inode;
 #define SYS_GETSOCKOPT	15		/* sys_getsockopt(2)		*/
 #define SYS_SENDMSG	16		/* sys_sendmsg(2)		*/
 #define SYS_RECVMSG	17		/* sys_recvmsg(2)		*/
+#define SYS_ACCEPT4	18		/* sys_accept4(2)		*/
+#define SYS_RECVMMSG	19		/* sys_recvmmsg(2)		*/
+#define SYS_SENDMMSG	20		/* sys_sendmmsg(2)		*/
+#define SYS_ACCEPTV	21		/* sys_acceptv(2)		*/
 
 /**
  * 套口状态
@@ -120,6 +125,21 @@ enum sock_type {
 
 #endif /* ARCH_HAS_SOCKET_TYPES */
 
+/*
+ * Flags that socket(), socketpair() and accept4() take on top of the
+ * socket type, to set up the new descriptors without extra fcntl()s.
+ */
+#define SOCK_TYPE_MASK	0xf
+/* 新文件描述符在exec时关闭 */
+#define SOCK_CLOEXEC	02000000
+/*
+ * 新文件以非阻塞方式打开。O_NONBLOCK与套接口类型位冲突的体系结构
+ * (alpha、parisc)在asm/socket.h中定义自己的值。
+ */
+#ifndef SOCK_NONBLOCK
+#define SOCK_NONBLOCK	O_NONBLOCK
+#endif
+
 /**
  *  struct socket - general BSD socket
  *  @state - socket state (%SS_CONNECTED, etc)
@@ -226,6 +246,12 @@ struct proto_ops {
 				      struct vm_area_struct * vma);
 	ssize_t		(*sendpage)  (struct socket *sock, struct page *page,
 				      int offset, size_t size, int flags);
+	/**
+	 * 一次发送一组连续的页框(第一页从offset开始)，只需锁一次套接口。
+	 * 由splice和sendfile使用，为NULL时退回到逐页调用sendpage。
+	 */
+	ssize_t		(*sendpages) (struct socket *sock, struct page **pages,
+				      int offset, size_t size, int flags);
 };
 
 struct net_proto_family {
@@ -256,7 +282,7 @@ extern int   	     sock_sendmsg(struct socket *sock, struct msghdr *msg,
 				  size_t len);
 extern int	     sock_recvmsg(struct socket *sock, struct msghdr *msg,
 				  size_t size, int flags);
-extern int 	     sock_map_fd(struct socket *sock);
+extern int 	     sock_map_fd(struct socket *sock, int flags);
 extern struct socket *sockfd_lookup(int fd, int *err);
 #define		     sockfd_put(sock) fput(sock->file)
 extern int	     net_ratelimit(void);
@@ -166,6 +166,7 @@ enum {
 
 #include <linux/cache.h>
 #include <linux/skbuff.h>
+#include <linux/rcupdate.h>
 
 struct neighbour;
 struct neigh_parms;
@@ -205,6 +206,22 @@ struct netif_rx_stats
 	 * 不能获得设备驱动锁的次数。不能获得锁是由于另外一个CPU已经获得了这个锁。这个计数值由qdisc_restart更新。它仅在帧发送，而不会在接收时处理。
 	 */
 	unsigned cpu_collision;
+	/**
+	 * GRO合并到其他包中的包的个数，以及GRO送往协议栈的（可能是合并后的）包的个数。
+	 */
+	unsigned gro_merged;
+	unsigned gro_flushed;
+	/**
+	 * RPS转到其他CPU处理的包的个数，以及为唤醒其他CPU而发送的IPI个数。
+	 */
+	unsigned rps_steered;
+	unsigned rps_ipi;
+	/**
+	 * 进入忙轮询的次数，忙轮询等到了数据的次数，以及忙轮询从设备中收取的包的个数。
+	 */
+	unsigned busy_poll;
+	unsigned busy_poll_hit;
+	unsigned busy_poll_packets;
 };
 
 DECLARE_PER_CPU(struct netif_rx_stats, netdev_rx_stat);
@@ -343,6 +360,60 @@ struct netdev_boot_setup {
  */
 #define NETDEV_BOOT_SETUP_MAX 8
 
+#ifdef CONFIG_RPS
+/*
+ * The CPUs packets received on a device are spread over, set through
+ * /sys/class/net/<dev>/rps_cpus.  A new map replaces the old one
+ * as a whole, readers only need rcu_read_lock().
+ */
+struct rps_map {
+	unsigned int	len;
+	struct rcu_head	rcu;
+	u16		cpus[0];
+};
+#define RPS_MAP_SIZE(_num) (sizeof(struct rps_map) + ((_num) * sizeof(u16)))
+#endif
+
+/*
+ * One transmit queue of a device with several hardware TX rings.  Each
+ * queue has its own qdisc and its own locks, so CPUs sending on different
+ * queues never touch the same cache lines.  The queues are only used
+ * while the device runs its default multiqueue root (see dev_activate());
+ * with a tc root qdisc everything goes through dev->qdisc and queue 0.
+ */
+struct netdev_queue {
+	/**
+	 * 保护qdisc和gso_skb，作用与dev->queue_lock相同。
+	 */
+	spinlock_t		lock;
+	struct Qdisc		*qdisc;
+	struct Qdisc		*qdisc_sleeping;
+	/**
+	 * 软件GSO切分后只发送了一部分的大包，下次qdisc_restart_queue时先发送它。
+	 */
+	struct sk_buff		*gso_skb;
+	/**
+	 * __QUEUE_STATE_XOFF和__QUEUE_STATE_SCHED。
+	 */
+	unsigned long		state;
+	/**
+	 * 链入softnet_data->output_txq。
+	 */
+	struct netdev_queue	*next_sched;
+	/**
+	 * 序列化对本队列的hard_start_xmit调用，作用与dev->xmit_lock相同。
+	 */
+	spinlock_t		xmit_lock;
+	int			xmit_lock_owner;
+	struct net_device	*dev;
+	u16			index;
+} ____cacheline_aligned_in_smp;
+
+enum netdev_queue_state_t
+{
+	__QUEUE_STATE_XOFF,
+	__QUEUE_STATE_SCHED,
+};
 
 /*
  *	The DEVICE structure.
@@ -597,6 +668,12 @@ struct net_device
 	 */
 	int			quota;
 	int			weight;
+#ifdef CONFIG_RPS
+	/**
+	 * 接收包可以转交处理的CPU集合。为NULL时不做RPS，包在收包的CPU上处理。
+	 */
+	struct rps_map		*rps_map;
+#endif
 
 	/**
 	 * 这些变量用于流量管理，管理设备的接收，发送队列，并且可以被不同的cpu访问。
@@ -605,6 +682,11 @@ struct net_device
 	struct Qdisc		*qdisc_sleeping;
 	struct Qdisc		*qdisc_ingress;
 	struct list_head	qdisc_list;
+	/**
+	 * 软件GSO切分后只发送了一部分的大包。它不再放回排队规则，下次qdisc_restart时先发送它。
+	 * 由queue_lock保护。
+	 */
+	struct sk_buff		*gso_skb;
 	/**
 	 * 设备发送队列的长度。
 	 * 如果内核中包含了流量控制子系统，这个变量可能没有什么用（只有几个排队策略会使用它）。
@@ -639,6 +721,12 @@ struct net_device
 	 * queue_lock用于避免并发的访问。
 	 */
 	spinlock_t		queue_lock;
+	/**
+	 * 多队列发送。驱动在注册前把num_tx_queues设为硬件发送环的个数，
+	 * 大于1时register_netdevice分配tx_queues，否则tx_queues为NULL，设备只有上面这一组队列和锁。
+	 */
+	unsigned int		num_tx_queues;
+	struct netdev_queue	*tx_queues;
 	/* Number of references to this device */
 	/**
 	 * 引用计数。如果计数不为0，设备就不能被卸载.
@@ -720,11 +808,25 @@ struct net_device
 #define NETIF_F_HW_VLAN_RX	256	/* Receive VLAN hw acceleration */
 #define NETIF_F_HW_VLAN_FILTER	512	/* Receive filtering on VLAN */
 #define NETIF_F_VLAN_CHALLENGED	1024	/* Device cannot handle VLAN packets */
-#define NETIF_F_TSO		2048	/* Can offload TCP/IP segmentation */
+/**
+ * 由协议栈把大包一直传到dev_hard_start_xmit，再在软件中切分成线上大小的包。
+ */
+#define NETIF_F_GSO		2048	/* Enable software GSO. */
 /**
  * 是否由驱动自己实现发送锁。
  */
 #define NETIF_F_LLTX		4096	/* LockLess TX */
+/**
+ * 接收时把同一个流中连续的TCP段合并成一个大包再交给协议栈。
+ */
+#define NETIF_F_GRO		8192	/* Generic receive offload */
+
+	/* Segmentation offload features */
+#define NETIF_F_GSO_SHIFT	16
+#define NETIF_F_GSO_MASK	0xffff0000
+#define NETIF_F_TSO		(SKB_GSO_TCPV4 << NETIF_F_GSO_SHIFT)
+#define NETIF_F_UFO		(SKB_GSO_UDPV4 << NETIF_F_GSO_SHIFT)
+#define NETIF_F_TSO_ECN		(SKB_GSO_TCP_ECN << NETIF_F_GSO_SHIFT)
 
 	/* Called after device is detached from network. */
 	/**
@@ -742,6 +844,11 @@ struct net_device
 	 */
 	int			(*hard_start_xmit) (struct sk_buff *skb,
 						    struct net_device *dev);
+	/**
+	 * 多队列设备选择发送队列。为NULL时按流哈希选择。返回值大于等于num_tx_queues时使用队列0。
+	 */
+	u16			(*select_queue)(struct net_device *dev,
+						struct sk_buff *skb);
 #define HAVE_NETDEV_POLL
 	/**
 	 * 用于NAPI，一个虚函数。用于从入队列中取出缓冲区。对每个设备来说，入队列是私有的。
@@ -912,6 +1019,18 @@ struct packet_type {
 	 */
 	int			(*func) (struct sk_buff *, struct net_device *,
 					 struct packet_type *);
+	/**
+	 * 在dev_hard_start_xmit中把协议栈传下来的大包切分成线上大小的包。
+	 */
+	struct sk_buff		*(*gso_segment)(struct sk_buff *skb,
+						int features);
+	/**
+	 * GRO：在held链表中查找可以与skb合并的包并合并，返回需要立即送往协议栈的包在链表中的位置。
+	 * gro_complete在合并后的包送往协议栈前修正其报头。
+	 */
+	struct sk_buff		**(*gro_receive)(struct sk_buff **head,
+						 struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb);
 	/**
 	 * 用于PF_SOCKET类型的socket。它指向相关的sock数据结构。
 	 */
@@ -1005,11 +1124,28 @@ struct softnet_data
 	 * output_queue是需要发包的设备列表。
 	 */
 	struct net_device	*output_queue;
+	/**
+	 * 需要发包的多队列设备的发送队列，由netdev_queue->next_sched链接。
+	 */
+	struct netdev_queue	*output_txq;
 	/**
 	 * completion_queue是已经成功发送，因而可以释放的缓冲区。
 	 */
 	struct sk_buff		*completion_queue;
 
+	/**
+	 * GRO暂存的包，每个流一个，通过next链接。在net_rx_action结束时全部送往协议栈。
+	 */
+	struct sk_buff		*gro_list;
+	int			gro_count;
+
+#ifdef CONFIG_RPS
+	/**
+	 * 本CPU转交了包、需要用IPI唤醒的其他CPU。在net_rx_action结束时发送IPI。
+	 */
+	cpumask_t		rps_ipi_mask;
+#endif
+
 	/**
 	 * 这完全是一个嵌入的数据结构，类型为net_device。表示与CPU相关的的设备。
 	 * 这个字段被非NAPI驱动使用。设备名字为"backlog device"。
@@ -1019,6 +1155,71 @@ struct softnet_data
 
 DECLARE_PER_CPU(struct softnet_data,softnet_data);
 
+/*
+ * Scratch state of GRO, kept in skb->cb while an skb sits on the
+ * gro_list of its CPU or is being matched against it.
+ */
+struct napi_gro_cb {
+	/* Number of segments merged into this skb, itself included */
+	int count;
+
+	/* Set by the protocol handlers while the held skb may still be
+	 * of the same flow as the one being received */
+	int same_flow;
+
+	/* The held skb must not be merged with any more, or the one
+	 * being received must not be held */
+	int flush;
+
+	/* Last skb on the frag_list of a held skb */
+	struct sk_buff *last;
+};
+
+#define NAPI_GRO_CB(skb) ((struct napi_gro_cb *)(skb)->cb)
+
+/* No more than this many flows are held per CPU */
+#define MAX_GRO_SKBS 8
+
+#ifdef CONFIG_RPS
+#include <linux/jhash.h>
+
+extern u32 rps_hashrnd;
+
+/* The flow hash RPS steers by, for IPv4 addresses and ports */
+static inline u32 rps_flow_hash(u32 saddr, u32 daddr, u16 sport, u16 dport)
+{
+	return jhash_3words(saddr, daddr, ((u32)sport << 16) | dport,
+			    rps_hashrnd);
+}
+
+/*
+ * The CPU each flow was last consumed on, indexed by flow hash.  Sized
+ * by the net.core.rps_sock_flow_entries sysctl, NULL while that is 0.
+ */
+struct rps_sock_flow_table {
+	unsigned int	mask;
+	u16		ents[0];
+};
+#define RPS_SOCK_FLOW_TABLE_SIZE(_num) \
+	(sizeof(struct rps_sock_flow_table) + ((_num) * sizeof(u16)))
+
+#define RPS_NO_CPU 0xffff
+
+extern struct rps_sock_flow_table *rps_sock_flow_table;
+
+/* Note that the flow with @hash is being consumed on this CPU */
+static inline void rps_record_sock_flow(struct rps_sock_flow_table *table,
+					u32 hash)
+{
+	unsigned int index = hash & table->mask;
+	u16 cpu = _smp_processor_id();
+
+	/* Avoid dirtying the cache line if nothing changed */
+	if (table->ents[index] != cpu)
+		table->ents[index] = cpu;
+}
+#endif
+
 #define HAVE_NETIF_QUEUE
 /**
  * 调度设备发包。
@@ -1054,6 +1255,24 @@ static inline void __netif_schedule(struct net_device *dev)
 	}
 }
 
+/**
+ * 调度多队列设备的一个发送队列发包，与__netif_schedule相同，只是挂到output_txq链表上。
+ */
+static inline void __netif_schedule_queue(struct netdev_queue *txq)
+{
+	if (!test_and_set_bit(__QUEUE_STATE_SCHED, &txq->state)) {
+		unsigned long flags;
+		struct softnet_data *sd;
+
+		local_irq_save(flags);
+		sd = &__get_cpu_var(softnet_data);
+		txq->next_sched = sd->output_txq;
+		sd->output_txq = txq;
+		raise_softirq_irqoff(NET_TX_SOFTIRQ);
+		local_irq_restore(flags);
+	}
+}
+
 /**
  * 仅当设备允许发送时，才调度设备。
  */
@@ -1081,8 +1300,18 @@ static inline void netif_wake_queue(struct net_device *dev)
 	if (netpoll_trap())
 		return;
 #endif
-	if (test_and_clear_bit(__LINK_STATE_XOFF, &dev->state))
+	if (test_and_clear_bit(__LINK_STATE_XOFF, &dev->state)) {
 		__netif_schedule(dev);
+		/**
+		 * 整个设备被停止时，各发送队列也都不能发包，现在逐个重新调度它们。
+		 */
+		if (dev->tx_queues) {
+			unsigned int i;
+
+			for (i = 0; i < dev->num_tx_queues; i++)
+				__netif_schedule_queue(&dev->tx_queues[i]);
+		}
+	}
 }
 
 /**
@@ -1105,6 +1334,76 @@ static inline int netif_queue_stopped(const struct net_device *dev)
 	return test_bit(__LINK_STATE_XOFF, &dev->state);
 }
 
+/*
+ * Flow control of a single transmit queue, for drivers with several
+ * hardware rings.  The skb to send on ring i arrives with queue_mapping
+ * set to i.  On a device without tx_queues these act on the device queue,
+ * so drivers can use them unconditionally, and netif_stop_queue() still
+ * stops every subqueue at once.
+ */
+static inline void netif_start_subqueue(struct net_device *dev, u16 index)
+{
+	if (!dev->tx_queues) {
+		netif_start_queue(dev);
+		return;
+	}
+	clear_bit(__QUEUE_STATE_XOFF, &dev->tx_queues[index].state);
+}
+
+static inline void netif_stop_subqueue(struct net_device *dev, u16 index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	if (!dev->tx_queues) {
+		netif_stop_queue(dev);
+		return;
+	}
+	set_bit(__QUEUE_STATE_XOFF, &dev->tx_queues[index].state);
+}
+
+static inline int netif_subqueue_stopped(const struct net_device *dev,
+					 u16 index)
+{
+	if (netif_queue_stopped(dev))
+		return 1;
+	return dev->tx_queues &&
+	       test_bit(__QUEUE_STATE_XOFF, &dev->tx_queues[index].state);
+}
+
+/**
+ * 仅当发送队列允许发送时，才调度它。
+ */
+static inline void netif_schedule_queue(struct netdev_queue *txq)
+{
+	if (!netif_subqueue_stopped(txq->dev, txq->index))
+		__netif_schedule_queue(txq);
+}
+
+/*
+ * While a tc root qdisc is attached everything is sent on queue 0 from
+ * dev->qdisc, so waking queue 0 kicks the device as well.
+ */
+static inline void netif_wake_subqueue(struct net_device *dev, u16 index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	if (!dev->tx_queues) {
+		netif_wake_queue(dev);
+		return;
+	}
+	if (test_and_clear_bit(__QUEUE_STATE_XOFF,
+			       &dev->tx_queues[index].state) &&
+	    !netif_queue_stopped(dev)) {
+		__netif_schedule_queue(&dev->tx_queues[index]);
+		if (index == 0)
+			__netif_schedule(dev);
+	}
+}
+
 static inline int netif_running(const struct net_device *dev)
 {
 	return test_bit(__LINK_STATE_START, &dev->state);
@@ -1474,6 +1773,24 @@ extern unsigned long	netdev_fc_xoff;
 extern atomic_t netdev_dropping;
 extern int		netdev_set_master(struct net_device *dev, struct net_device *master);
 extern int skb_checksum_help(struct sk_buff *skb, int inward);
+extern struct sk_buff *skb_gso_segment(struct sk_buff *skb, int features);
+extern int		dev_hard_start_xmit(struct sk_buff *skb,
+					    struct net_device *dev);
+extern int		netif_gro_receive(struct sk_buff *skb);
+extern int		skb_gro_receive(struct sk_buff *p, struct sk_buff *skb);
+
+/* Can a device with @features transmit @skb as it is, without software GSO? */
+static inline int skb_gso_ok(struct sk_buff *skb, int features)
+{
+	int feature = skb_shinfo(skb)->gso_type << NETIF_F_GSO_SHIFT;
+	return (features & feature) == feature;
+}
+
+static inline int netif_needs_gso(struct net_device *dev, struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->tso_size &&
+	       !skb_gso_ok(skb, dev->features);
+}
 /* rx skb timestamps */
 extern void		net_enable_timestamp(void);
 extern void		net_disable_timestamp(void);
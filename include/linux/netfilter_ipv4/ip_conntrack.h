@@ -65,6 +65,10 @@ enum ip_conntrack_status {
 
 	/* Both together */
 	IPS_NAT_DONE_MASK = (IPS_DST_NAT_DONE | IPS_SRC_NAT_DONE),
+
+	/* Connection is being torn down (or must never be confirmed). */
+	IPS_DYING_BIT = 9,
+	IPS_DYING = (1 << IPS_DYING_BIT),
 };
 
 #ifdef __KERNEL__
@@ -72,6 +76,8 @@ enum ip_conntrack_status {
 #include <linux/netfilter_ipv4/ip_conntrack_tuple.h>
 #include <linux/bitops.h>
 #include <linux/compiler.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
 #include <asm/atomic.h>
 
 #include <linux/netfilter_ipv4/ip_conntrack_tcp.h>
@@ -132,20 +138,26 @@ struct ip_conntrack_helper;
 
 struct ip_conntrack
 {
-	/* Usage count in here is 1 for hash table/destruct timer, 1 per skb,
+	/* Usage count in here is 1 for hash table, 1 per skb,
            plus 1 for any connection(s) we are `master' for */
 	struct nf_conntrack ct_general;
 
 	/* Have we seen traffic both ways yet? (bitset) */
 	unsigned long status;
 
-	/* Timer function; drops refcnt when it goes off. */
-	struct timer_list timeout;
+	/* Expiry in jiffies (relative until confirmed); the garbage
+	   collector drops the hash table's refcnt once it has passed. */
+	unsigned long timeout;
 
 #ifdef CONFIG_IP_NF_CT_ACCT
+	/* Protects counters: both directions may be seen at once */
+	spinlock_t counters_lock;
 	/* Accounting Information (same cache line as other written members) */
 	struct ip_conntrack_counter counters[IP_CT_DIR_MAX];
 #endif
+	/* CPU whose unconfirmed list we sit on until confirmed */
+	unsigned int cpu;
+
 	/* If we were expected by an expectation, this will be it */
 	struct ip_conntrack *master;
 
@@ -244,6 +256,10 @@ extern void need_ip_conntrack(void);
 extern int invert_tuplepr(struct ip_conntrack_tuple *inverse,
 			  const struct ip_conntrack_tuple *orig);
 
+/* Unhash a confirmed conntrack now rather than when it times out:
+   returns 0 if someone else got there first. */
+extern int ip_ct_kill(struct ip_conntrack *ct);
+
 /* Refresh conntrack for this many jiffies */
 extern void ip_ct_refresh_acct(struct ip_conntrack *ct,
 			       enum ip_conntrack_info ctinfo,
@@ -277,6 +293,12 @@ static inline int is_confirmed(struct ip_conntrack *ct)
 	return test_bit(IPS_CONFIRMED_BIT, &ct->status);
 }
 
+/* Has a confirmed conntrack outlived its timeout? */
+static inline int ip_ct_expired(const struct ip_conntrack *ct)
+{
+	return time_after_eq(jiffies, ct->timeout);
+}
+
 extern unsigned int ip_conntrack_htable_size;
  
 struct ip_conntrack_stat
@@ -296,6 +318,7 @@ struct ip_conntrack_stat
 	unsigned int expect_new;
 	unsigned int expect_create;
 	unsigned int expect_delete;
+	unsigned int search_restart;
 };
 
 #define CONNTRACK_STAT_INC(count) (__get_cpu_var(ip_conntrack_stat).count++)
@@ -1,6 +1,7 @@
 #ifndef _IP_CONNTRACK_CORE_H
 #define _IP_CONNTRACK_CORE_H
 #include <linux/netfilter.h>
+#include <linux/seqlock.h>
 #include <linux/netfilter_ipv4/lockhelp.h>
 
 /* This header is used to share core functionality between the
@@ -45,7 +46,15 @@ static inline int ip_conntrack_confirm(struct sk_buff **pskb)
 	return NF_ACCEPT;
 }
 
-extern struct list_head *ip_conntrack_hash;
+/* Hash chains are walked under RCU and written under a bucket lock.
+   The locks are striped: few enough that a resize can take them all. */
+#define IP_CT_LOCKS	128
+#define IP_CT_BUCKET_LOCK(bucket) (&ip_conntrack_locks[(bucket) % IP_CT_LOCKS])
+
+extern struct hlist_nulls_head *ip_conntrack_hash;
+extern spinlock_t ip_conntrack_locks[IP_CT_LOCKS];
+/* Bumped around a resize, which moves every entry to a new table */
+extern seqcount_t ip_conntrack_hash_seq;
 extern struct list_head ip_conntrack_expect_list;
 DECLARE_RWLOCK_EXTERN(ip_conntrack_lock);
 #endif /* _IP_CONNTRACK_CORE_H */
@@ -87,6 +87,7 @@ enum ip_conntrack_dir
 };
 
 #ifdef __KERNEL__
+#include <linux/list_nulls.h>
 
 #define DUMP_TUPLE(tp)						\
 DEBUGP("tuple %p: %u %u.%u.%u.%u:%hu -> %u.%u.%u.%u:%hu\n",	\
@@ -102,7 +103,8 @@ DEBUGP("tuple %p: %u %u.%u.%u.%u:%hu -> %u.%u.%u.%u:%hu\n",	\
 /* Connections have two entries in the hash table: one for each way */
 struct ip_conntrack_tuple_hash
 {
-	struct list_head list;
+	/* Hash chain; the chain's nulls marker is its bucket index */
+	struct hlist_nulls_node hnnode;
 
 	struct ip_conntrack_tuple tuple;
 };
@@ -0,0 +1,185 @@
+#ifndef _IP_SET_H
+#define _IP_SET_H
+
+/*
+ * IP sets: named sets of IPv4 addresses, networks or ports which
+ * iptables rules can look a packet up in with the `set' match, and
+ * fill from the packet path with the SET target.
+ *
+ * Sets are managed from user space through {get,set}sockopt(SO_IP_SET)
+ * on a raw IPv4 socket.  Every request starts with the operation and
+ * the protocol version.  A ruleset refers to a set by name; its
+ * contents can be rebuilt under a scratch name and swapped in with
+ * IP_SET_OP_SWAP, atomically and without touching the ruleset.
+ */
+
+#define SO_IP_SET		83
+#define IP_SET_PROTOCOL_VERSION	1
+
+#define IP_SET_MAXNAMELEN	32
+
+/* setsockopt() operations */
+#define IP_SET_OP_CREATE	0x01	/* struct ip_set_req_create */
+#define IP_SET_OP_DESTROY	0x02	/* struct ip_set_req_std */
+#define IP_SET_OP_FLUSH		0x03	/* struct ip_set_req_std */
+#define IP_SET_OP_RENAME	0x04	/* struct ip_set_req_swap */
+#define IP_SET_OP_SWAP		0x05	/* struct ip_set_req_swap */
+#define IP_SET_OP_ADD		0x10	/* struct ip_set_req_adt */
+#define IP_SET_OP_DEL		0x11	/* struct ip_set_req_adt */
+
+/* getsockopt() operations */
+#define IP_SET_OP_VERSION	0x100	/* struct ip_set_req_std */
+#define IP_SET_OP_TEST		0x101	/* struct ip_set_req_adt */
+#define IP_SET_OP_LIST		0x102	/* struct ip_set_req_list */
+
+/* What the elements of a set are (ip_set_req_create.flags) */
+#define IP_SET_ADDR		0x00	/* IPv4 addresses or networks */
+#define IP_SET_PORT		0x01	/* TCP/UDP ports */
+#define IP_SET_KIND_MASK	0x01
+
+struct ip_set_req_std {
+	unsigned int op;
+	unsigned int version;
+	char name[IP_SET_MAXNAMELEN];
+};
+
+/* The set type's own parameters follow this */
+struct ip_set_req_create {
+	unsigned int op;
+	unsigned int version;
+	char name[IP_SET_MAXNAMELEN];
+	char typename[IP_SET_MAXNAMELEN];
+	u_int32_t flags;
+};
+
+struct ip_set_req_swap {
+	unsigned int op;
+	unsigned int version;
+	char name[IP_SET_MAXNAMELEN];
+	char name2[IP_SET_MAXNAMELEN];
+};
+
+struct ip_set_elem {
+	u_int32_t key;		/* address or port, host order */
+	u_int8_t cidr;		/* prefix length for addresses, else 32 */
+};
+
+/* `count' elements follow.  IP_SET_OP_TEST takes one and returns
+   whether it is in the set in `count'. */
+struct ip_set_req_adt {
+	unsigned int op;
+	unsigned int version;
+	char name[IP_SET_MAXNAMELEN];
+	u_int32_t count;
+	struct ip_set_elem elem[0];
+};
+
+/* Filled in by the kernel; as many elements as fit follow, and `count'
+   says how many there are in total, so a short buffer can be retried
+   with the right size. */
+struct ip_set_req_list {
+	unsigned int op;
+	unsigned int version;
+	char name[IP_SET_MAXNAMELEN];
+	char typename[IP_SET_MAXNAMELEN];
+	u_int32_t flags;
+	u_int32_t count;
+	struct ip_set_elem elem[0];
+};
+
+/* Parameters of the set types */
+
+/* "hash": addresses or ports, hashed */
+struct ip_set_req_hash_create {
+	u_int32_t hashsize;	/* initial slots, 0 for the default */
+	u_int16_t probes;	/* slots tried per element, 0 for the default */
+	u_int8_t netmask;	/* addresses are stored masked to this */
+};
+
+/* "bitmap": addresses or ports from a range */
+struct ip_set_req_bitmap_create {
+	u_int32_t from, to;	/* inclusive, host order */
+};
+
+/* "nettree": networks of any prefix length; no parameters */
+
+#ifdef __KERNEL__
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <asm/atomic.h>
+
+struct sk_buff;
+
+typedef u_int16_t ip_set_id_t;
+#define IP_SET_INVALID_ID	((ip_set_id_t)~0)
+
+struct ip_set;
+
+struct ip_set_type {
+	struct list_head list;
+	char typename[IP_SET_MAXNAMELEN];
+	/* Kinds of element (1 << IP_SET_ADDR etc.) the type can hold */
+	unsigned int kinds;
+	/* Size of the type's create parameters */
+	size_t create_size;
+
+	/* Process context, set not yet visible */
+	int (*create)(struct ip_set *set, const void *data);
+	void (*destroy)(struct ip_set *set);
+
+	/* Under the set's write lock.  add/del return -EEXIST/-ENOENT
+	   for elements already in/not in the set; add may return
+	   -EAGAIN if the set is full and grow() would help. */
+	void (*flush)(struct ip_set *set);
+	int (*add)(struct ip_set *set, u_int32_t key, u_int8_t cidr);
+	int (*del)(struct ip_set *set, u_int32_t key, u_int8_t cidr);
+
+	/* Under the set's read lock */
+	int (*test)(const struct ip_set *set, u_int32_t key);
+	/* Copies up to max elements to elem; returns how many there are */
+	unsigned int (*dump)(const struct ip_set *set,
+			     struct ip_set_elem *elem, unsigned int max);
+
+	/* Process context, no locks: make room for more elements */
+	int (*grow)(struct ip_set *set);
+
+	struct module *me;
+};
+
+struct ip_set {
+	char name[IP_SET_MAXNAMELEN];
+	ip_set_id_t id;
+	/* Protects the contents, i.e. everything below */
+	rwlock_t lock;
+	/* Rules referring to the set; it can't go away while they exist */
+	atomic_t ref;
+	u_int32_t flags;
+	struct ip_set_type *type;
+	void *data;
+};
+
+extern int ip_set_register_type(struct ip_set_type *type);
+extern void ip_set_unregister_type(struct ip_set_type *type);
+
+/* For the match and target: look up a set by name and hold it */
+extern ip_set_id_t ip_set_get_byname(const char *name);
+extern void ip_set_put(ip_set_id_t id);
+
+/* Packet path.  dst selects the destination address or port.
+   ip_set_test_skb() returns 1 or 0, or a negative errno (as
+   ip_set_skb_key() in ip_set.c) if the packet has no element to test. */
+extern int ip_set_test_skb(ip_set_id_t id, const struct sk_buff *skb,
+			   int dst);
+extern int ip_set_add_skb(ip_set_id_t id, const struct sk_buff *skb,
+			  int dst);
+extern int ip_set_del_skb(ip_set_id_t id, const struct sk_buff *skb,
+			  int dst);
+
+static inline u_int32_t ip_set_netmask(u_int8_t cidr)
+{
+	return cidr ? 0xFFFFFFFF << (32 - cidr) : 0;
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* _IP_SET_H */
@@ -154,7 +154,8 @@ struct ipt_entry
 
 #define IPT_SO_SET_REPLACE	(IPT_BASE_CTL)
 #define IPT_SO_SET_ADD_COUNTERS	(IPT_BASE_CTL + 1)
-#define IPT_SO_SET_MAX		IPT_SO_SET_ADD_COUNTERS
+#define IPT_SO_SET_UPDATE	(IPT_BASE_CTL + 2)
+#define IPT_SO_SET_MAX		IPT_SO_SET_UPDATE
 
 #define IPT_SO_GET_INFO			(IPT_BASE_CTL)
 #define IPT_SO_GET_ENTRIES		(IPT_BASE_CTL + 1)
@@ -265,6 +266,59 @@ struct ipt_replace
 	struct ipt_entry entries[0];
 };
 
+/* The argument to IPT_SO_SET_UPDATE: changes to a table, which are
+   made all together or not at all.  Unlike IPT_SO_SET_REPLACE only the
+   rules being added are passed in and checked, and the other rules
+   keep their counters. */
+struct ipt_update
+{
+	/* Which table. */
+	char name[IPT_TABLE_MAXNAMELEN];
+
+	/* Number of entries the table must have now, or 0 for any. */
+	unsigned int num_entries;
+
+	/* Number of operations, and their total size. */
+	unsigned int num_ops;
+	unsigned int size;
+
+	/* The operations (struct ipt_update_op), back to back. */
+	unsigned char ops[0];
+};
+
+/* What an operation does. */
+#define IPT_UPDATE_INSERT	1	/* Put entry at rulenum in chain */
+#define IPT_UPDATE_DELETE	2	/* Remove rule rulenum of chain */
+#define IPT_UPDATE_NEW_CHAIN	3	/* Create empty user chain */
+#define IPT_UPDATE_DEL_CHAIN	4	/* Remove empty, unused user chain */
+
+/* rulenum which puts a rule at the end of its chain. */
+#define IPT_UPDATE_APPEND	0xFFFFFFFF
+
+struct ipt_update_op
+{
+	/* IPT_UPDATE_*. */
+	unsigned int op;
+
+	/* Size of this operation, including the entry. */
+	unsigned int size;
+
+	/* Built-in chains are named after their hook: "INPUT" etc. */
+	char chain[IPT_FUNCTION_MAXNAMELEN];
+
+	/* Position in the chain, counting from 0. */
+	unsigned int rulenum;
+
+	/* For IPT_UPDATE_INSERT: the user chain the entry jumps to, if
+	   any.  The entry's target must then be the standard one; its
+	   verdict is filled in.  Otherwise a standard verdict >= 0 means
+	   carry on with the next rule. */
+	char jump[IPT_FUNCTION_MAXNAMELEN];
+
+	/* For IPT_UPDATE_INSERT: the entry. */
+	struct ipt_entry entry[0];
+};
+
 /* The argument to IPT_SO_ADD_COUNTERS. */
 struct ipt_counters_info
 {
@@ -376,7 +430,10 @@ struct ipt_match
 		     int *hotdrop);
 
 	/* Called when user tries to insert an entry of this type. */
-	/* Should return true or false. */
+	/* Should return true or false.  IPT_SO_SET_UPDATE moves kept
+	   rules to a new table byte for byte without calling this
+	   again, so matchinfo must not end up pointing into itself:
+	   state goes in a separate allocation, freed by destroy. */
 	int (*checkentry)(const char *tablename,
 			  const struct ipt_ip *ip,
 			  void *matchinfo,
@@ -402,7 +459,9 @@ struct ipt_target
 	/* Called when user tries to insert an entry of this type:
            hook_mask is a bitmask of hooks from which it can be
            called. */
-	/* Should return true or false. */
+	/* Should return true or false.  As for matches, targinfo may
+	   be moved without being checked again, so it must not point
+	   into itself. */
 	int (*checkentry)(const char *tablename,
 			  const struct ipt_entry *e,
 			  void *targinfo,
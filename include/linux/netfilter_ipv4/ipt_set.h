@@ -0,0 +1,29 @@
+#ifndef _IPT_SET_H
+#define _IPT_SET_H
+
+#include <linux/netfilter_ipv4/ip_set.h>
+
+#define IPT_SET_DST		0x01	/* Use the destination, not the source */
+#define IPT_SET_INV		0x02	/* Negate the condition (match only) */
+
+struct ipt_set_info {
+	char name[IP_SET_MAXNAMELEN];	/* empty: none (target only) */
+	u_int8_t flags;
+
+	/* Used internally by the kernel */
+	u_int16_t id;
+};
+
+/* The `set' match */
+struct ipt_set_match_info {
+	struct ipt_set_info match_set;
+};
+
+/* The SET target: adds the packet to one set and/or deletes it from
+   another, and lets it continue */
+struct ipt_set_target_info {
+	struct ipt_set_info add_set;
+	struct ipt_set_info del_set;
+};
+
+#endif /*_IPT_SET_H*/
@@ -160,6 +160,7 @@ static inline pgoff_t linear_page_index(struct vm_area_struct *vma,
 }
 
 extern void FASTCALL(__lock_page(struct page *page));
+extern int FASTCALL(__lock_page_wq(struct page *page, wait_queue_t *wait));
 extern void FASTCALL(unlock_page(struct page *page));
 
 static inline void lock_page(struct page *page)
@@ -168,12 +169,26 @@ static inline void lock_page(struct page *page)
 	if (TestSetPageLocked(page))
 		__lock_page(page);
 }
+
+/*
+ * Lock the page on behalf of 'wait'. Returns -EIOCBRETRY instead of
+ * sleeping if 'wait' is an AIO wait entry (current->io_wait).
+ */
+static inline int lock_page_wq(struct page *page, wait_queue_t *wait)
+{
+	might_sleep();
+	if (TestSetPageLocked(page))
+		return __lock_page_wq(page, wait);
+	return 0;
+}
 	
 /*
  * This is exported only for wait_on_page_locked/wait_on_page_writeback.
  * Never use this directly!
  */
 extern void FASTCALL(wait_on_page_bit(struct page *page, int bit_nr));
+extern int FASTCALL(wait_on_page_bit_wq(struct page *page, int bit_nr,
+					wait_queue_t *wait));
 
 /* 
  * Wait for a page to be unlocked.
@@ -188,6 +203,13 @@ static inline void wait_on_page_locked(struct page *page)
 		wait_on_page_bit(page, PG_locked);
 }
 
+static inline int wait_on_page_locked_wq(struct page *page, wait_queue_t *wait)
+{
+	if (PageLocked(page))
+		return wait_on_page_bit_wq(page, PG_locked, wait);
+	return 0;
+}
+
 /* 
  * Wait for a page to complete writeback
  */
@@ -9,13 +9,21 @@ struct pipe_buffer {
 	struct page *page;
 	unsigned int offset, len;
 	struct pipe_buf_operations *ops;
+	unsigned int flags;
 };
 
+/*
+ * The page of this buffer is also referenced from another pipe (see
+ * sys_tee()), so writers must not append to it.
+ */
+#define PIPE_BUF_FLAG_NOMERGE	0x01
+
 struct pipe_buf_operations {
 	int can_merge;
 	void * (*map)(struct file *, struct pipe_inode_info *, struct pipe_buffer *);
 	void (*unmap)(struct pipe_inode_info *, struct pipe_buffer *);
 	void (*release)(struct pipe_inode_info *, struct pipe_buffer *);
+	void (*get)(struct pipe_inode_info *, struct pipe_buffer *);
 };
 
 struct pipe_inode_info {
@@ -54,6 +62,22 @@ struct pipe_inode_info {
 void pipe_wait(struct inode * inode);
 
 struct inode* pipe_new(struct inode* inode);
+struct inode* get_pipe_inode(void);
 void free_pipe_info(struct inode* inode);
 
+/* Generic pipe buffer ops, usable for any page backed buffer */
+void *generic_pipe_buf_map(struct file *, struct pipe_inode_info *, struct pipe_buffer *);
+void generic_pipe_buf_unmap(struct pipe_inode_info *, struct pipe_buffer *);
+void generic_pipe_buf_get(struct pipe_inode_info *, struct pipe_buffer *);
+
+/*
+ * splice(), tee() and vmsplice() flags
+ */
+#define SPLICE_F_MOVE		(0x01)	/* move pages instead of copying */
+#define SPLICE_F_NONBLOCK	(0x02)	/* don't block on the pipe splicing (but */
+					/* we may still block on the fd we splice */
+					/* from/to, of course) */
+#define SPLICE_F_MORE		(0x04)	/* expect more data */
+#define SPLICE_F_GIFT		(0x08)	/* pages passed in are a gift */
+
 #endif
@@ -451,4 +451,38 @@ struct tc_netem_corr
 
 #define NETEM_DIST_SCALE	8192
 
+/* FQ_CODEL section */
+
+enum
+{
+	TCA_FQ_CODEL_UNSPEC,
+	TCA_FQ_CODEL_TARGET,		/* u32, us */
+	TCA_FQ_CODEL_LIMIT,		/* u32, packets */
+	TCA_FQ_CODEL_INTERVAL,		/* u32, us */
+	TCA_FQ_CODEL_ECN,		/* u32, 0 or 1 */
+	TCA_FQ_CODEL_FLOWS,		/* u32, only when creating */
+	TCA_FQ_CODEL_QUANTUM,		/* u32, bytes */
+	__TCA_FQ_CODEL_MAX
+};
+
+#define TCA_FQ_CODEL_MAX (__TCA_FQ_CODEL_MAX - 1)
+
+#define TCA_FQ_CODEL_XSTATS_QDISC	0
+
+struct tc_fq_codel_qd_stats
+{
+	__u32	maxpacket;	/* largest packet seen so far */
+	__u32	drop_overlimit;	/* dropped because the qdisc was full */
+	__u32	ecn_mark;	/* marked instead of dropped */
+	__u32	new_flow_count;	/* flows that became active */
+	__u32	new_flows_len;	/* flows on the new list now */
+	__u32	old_flows_len;	/* flows on the old list now */
+};
+
+struct tc_fq_codel_xstats
+{
+	__u32	type;		/* TCA_FQ_CODEL_XSTATS_QDISC */
+	struct tc_fq_codel_qd_stats qdisc_stats;
+};
+
 #endif
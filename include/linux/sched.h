@@ -447,9 +447,9 @@ struct mm_struct {
 	 */
 	rwlock_t		ioctx_list_lock;
 	/**
-	 * 异步IO上下文链表。
+	 * 异步IO上下文表，以aio_ring中的id为下标，读者通过RCU无锁访问。
 	 */
-	struct kioctx		*ioctx_list;
+	struct kioctx_table	*ioctx_table;
 
 	/**
 	 * 默认的异步IO上下文。
@@ -197,16 +197,37 @@ struct skb_shared_info {
 	 */
 	unsigned short	tso_size;
 	unsigned short	tso_segs;
+	/**
+	 * 大包的类型（SKB_GSO_*），决定由哪一层、以何种方式切分它。
+	 */
+	unsigned short	gso_type;
 	/**
 	 * 存储IP分片
 	 */
 	struct sk_buff	*frag_list;
+	/**
+	 * 给 skb->destructor 用的参数，比如 AF_PACKET 发送环中数据所在的帧。
+	 */
+	void		*destructor_arg;
 	/**
 	 * 分散/聚集IO启用时，指向所有页面。
 	 */
 	skb_frag_t	frags[MAX_SKB_FRAGS];
 };
 
+/*
+ * What a super-sized skb (tso_size != 0) needs done to it to become wire
+ * sized packets.  Shifted left by NETIF_F_GSO_SHIFT these double as the
+ * matching device feature bits, see netif_needs_gso().
+ */
+enum {
+	SKB_GSO_TCPV4 = 1 << 0,
+	SKB_GSO_UDPV4 = 1 << 1,
+
+	/* This indicates the tcp segment has CWR set. */
+	SKB_GSO_TCP_ECN = 1 << 2,
+};
+
 /** 
  *	struct sk_buff - socket buffer
  *	@next: Next buffer in list
@@ -234,6 +255,7 @@ struct skb_shared_info {
  *	@users: User count - see {datagram,tcp}.c
  *	@protocol: Packet protocol from driver
  *	@security: Security level of packet
+ *	@queue_mapping: Transmit queue of a multiqueue device
  *	@truesize: Buffer size 
  *	@head: Head of buffer
  *	@data: Data head pointer
@@ -407,6 +429,10 @@ struct sk_buff {
 	 * 这是包的安全级别。这个变量最初由IPSec子系统使用，但现在已经作废了。
 	 */
 				security;
+	/**
+	 * 多队列设备上发送本包的队列号，由dev_queue_xmit选择，驱动据此选择硬件发送环。
+	 */
+	__u16			queue_mapping;
 
 	/**
 	 * 这个函数指针可以初始化成一个在缓冲区释放时完成某些动作的函数。
@@ -1373,6 +1399,11 @@ extern unsigned int    skb_copy_and_csum_bits(const struct sk_buff *skb,
 extern void	       skb_copy_and_csum_dev(const struct sk_buff *skb, u8 *to);
 extern void	       skb_split(struct sk_buff *skb,
 				 struct sk_buff *skb1, const u32 len);
+extern struct sk_buff *skb_segment(struct sk_buff *skb, int features);
+extern int	       skb_append_datato_frags(struct sock *sk, struct sk_buff *skb,
+			int (*getfrag)(void *from, char *to, int offset,
+				       int len, int odd, struct sk_buff *skb),
+			void *from, int length);
 
 static inline void *skb_header_pointer(const struct sk_buff *skb, int offset,
 				       int len, void *buffer)
@@ -67,6 +67,27 @@ struct msghdr {
 	unsigned	msg_flags;
 };
 
+/**
+ * recvmmsg/sendmmsg批量收发时，每个报文的描述。
+ */
+struct mmsghdr {
+	struct msghdr	msg_hdr;
+	/* 本报文实际收发的字节数，由内核填写 */
+	unsigned	msg_len;
+};
+
+/**
+ * acceptv批量接受连接时，每个新连接的描述。
+ */
+struct acceptvec {
+	/* 存放对端地址的用户缓冲区，为NULL时不获取地址 */
+	struct sockaddr __user	*av_addr;
+	/* 缓冲区长度，内核将其更新为地址的实际长度 */
+	int			av_addrlen;
+	/* 新连接的文件描述符，由内核填写 */
+	int			av_fd;
+};
+
 /*
  *	POSIX 1003.1g - ancillary data object information
  *	Ancillary data consits of a sequence of pairs of
@@ -261,6 +282,8 @@ struct ucred {
 #define MSG_NOSIGNAL	0x4000	/* Do not generate SIGPIPE */
 /* 后续还有数据要发送 */
 #define MSG_MORE	0x8000	/* Sender will send more */
+/* recvmmsg()在收到第一个报文后不再阻塞 */
+#define MSG_WAITFORONE	0x10000	/* recvmmsg(): block until 1+ packets avail */
 
 #define MSG_EOF         MSG_FIN
 
@@ -241,6 +241,9 @@ enum
 	NET_CORE_MOD_CONG=16,
 	NET_CORE_DEV_WEIGHT=17,
 	NET_CORE_SOMAXCONN=18,
+	NET_CORE_RPS_SOCK_FLOW_ENTRIES=19,
+	NET_CORE_BUSY_READ=20,
+	NET_CORE_BPF_JIT_ENABLE=21,
 };
 
 /* /proc/sys/net/ethernet */
@@ -345,6 +348,7 @@ enum
 	NET_TCP_MODERATE_RCVBUF=106,
 	NET_TCP_TSO_WIN_DIVISOR=107,
 	NET_TCP_BIC_BETA=108,
+	NET_TCP_CONG_CONTROL=109,
 };
 
 enum {
@@ -367,6 +371,7 @@ enum {
 	NET_IPV4_ROUTE_MIN_ADVMSS=17,
 	NET_IPV4_ROUTE_SECRET_INTERVAL=18,
 	NET_IPV4_ROUTE_GC_MIN_INTERVAL_MS=19,
+	NET_IPV4_ROUTE_INPUT_NOCACHE=20,
 };
 
 enum
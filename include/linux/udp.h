@@ -65,6 +65,10 @@ struct udp_sock {
 	 */
 	/* 标识待发送数据的长度 */
 	__u16		 len;		/* total length of pending frames */
+	/**
+	 * 按(本地地址, 端口)计算的散列值，据此将控制块链入udp_hash2。
+	 */
+	unsigned int	 udp_portaddr_hash;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
@@ -0,0 +1,54 @@
+/*
+ * Low latency busy poll receive.
+ *
+ * A socket with SO_BUSY_POLL set remembers the device its packets come
+ * in on, and a reader about to sleep on it polls that device for up to
+ * sk_ll_usec microseconds first.  See sk_busy_loop() in net/core/dev.c.
+ */
+#ifndef _NET_BUSY_POLL_H
+#define _NET_BUSY_POLL_H
+
+#include <linux/config.h>
+#include <linux/netdevice.h>
+#include <linux/sched.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+/* Default SO_BUSY_POLL value of new sockets, in microseconds */
+extern unsigned int sysctl_net_busy_read;
+
+extern int sk_busy_loop(struct sock *sk, int nonblock);
+
+static inline int sk_can_busy_loop(struct sock *sk)
+{
+	return sk->sk_ll_usec && sk->sk_napi_ifindex &&
+	       !signal_pending(current);
+}
+
+/* Note the device @skb came in on as the one to poll for @sk */
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+	/* Avoid dirtying the cache line if nothing changed */
+	if (sk->sk_napi_ifindex != skb->dev->ifindex)
+		sk->sk_napi_ifindex = skb->dev->ifindex;
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline int sk_can_busy_loop(struct sock *sk)
+{
+	return 0;
+}
+
+static inline int sk_busy_loop(struct sock *sk, int nonblock)
+{
+	return 0;
+}
+
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+#endif /* _NET_BUSY_POLL_H */
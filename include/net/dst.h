@@ -78,6 +78,10 @@ struct dst_entry
  * 当DST用于IPSEC时，child链表中非最后一个元素，并不是实际的路由缓存，因此设置此标志，表示DST对象不在HASH中。
  */
 #define DST_NOHASH		8
+/**
+ * 不在任何缓存中的路由（如关闭路由缓存时的输入路由），由引用它的报文单独持有，最后一个引用被释放时立即删除。
+ */
+#define DST_NOCACHE		16
 	/**
 	 * 用于记录该表项上次被使用的时间戳。
 	 * 当缓存查找成功时更新该时间戳，垃圾回收程序使用该时间戳来选择最合适的应当被释放的结构。
@@ -258,6 +262,10 @@ dst_metric_locked(struct dst_entry *dst, int metric)
 	return dst_metric(dst, RTAX_LOCK) & (1<<metric);
 }
 
+extern void * dst_alloc(struct dst_ops * ops);
+extern void __dst_free(struct dst_entry * dst);
+extern struct dst_entry *dst_destroy(struct dst_entry * dst);
+
 /**
  * 递增或递减一个dst_entry的引用计数。
  */
@@ -285,8 +293,11 @@ void dst_release(struct dst_entry * dst)
 		smp_mb__before_atomic_dec();
 		/**
 		 * 当调用dst_release释放最后一个引用时，该表项并不被自动删除。
+		 * DST_NOCACHE表项例外：没有缓存再引用它，因此立即删除。
 		 */
-		atomic_dec(&dst->__refcnt);
+		if (atomic_dec_and_test(&dst->__refcnt) &&
+		    (dst->flags & DST_NOCACHE))
+			dst_destroy(dst);
 	}
 }
 
@@ -302,10 +313,6 @@ static inline struct dst_entry *dst_pop(struct dst_entry *dst)
 	return child;
 }
 
-extern void * dst_alloc(struct dst_ops * ops);
-extern void __dst_free(struct dst_entry * dst);
-extern struct dst_entry *dst_destroy(struct dst_entry * dst);
-
 /**
  * dst_entry结构并不总是嵌入在rtable结构内。孤立的dst_entry实例可通过调用dst_free来直接删除。
  */
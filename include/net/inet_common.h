@@ -24,6 +24,10 @@ extern int			inet_sendmsg(struct kiocb *iocb,
 					     struct socket *sock, 
 					     struct msghdr *msg, 
 					     size_t size);
+extern int			inet_recvmsg(struct kiocb *iocb,
+					     struct socket *sock,
+					     struct msghdr *msg,
+					     size_t size, int flags);
 extern int			inet_shutdown(struct socket *sock, int how);
 extern unsigned int		inet_poll(struct file * file, struct socket *sock, struct poll_table_struct *wait);
 extern int			inet_listen(struct socket *sock, int backlog);
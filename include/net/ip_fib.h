@@ -43,6 +43,7 @@ struct kern_rta {
 };
 
 struct fib_info;
+struct rtable;
 
 /**
  * 下一跳。
@@ -99,6 +100,11 @@ struct fib_nh {
 	 * 下一跳网关的IP地址，它是利用关键字via来设置的。
 	 */
 	u32			nh_gw;
+	/**
+	 * 关闭输入路由缓存（route/input_nocache）时，经该下一跳转发的报文所共用的路由。
+	 * 由route.c创建和替换，在下一跳失效或fib_info被释放时由rt_nexthop_flush释放。
+	 */
+	struct rtable		*nh_rth_input;
 };
 
 /*
@@ -394,7 +400,7 @@ extern int fib_convert_rtentry(int cmd, struct nlmsghdr *nl, struct rtmsg *rtm,
 			       struct kern_rta *rta, struct rtentry *r);
 extern u32  __fib_res_prefsrc(struct fib_result *res);
 
-/* Exported by fib_hash.c */
+/* Exported by fib_hash.c or fib_trie.c */
 extern struct fib_table *fib_hash_init(int id);
 
 #ifdef CONFIG_IP_MULTIPLE_TABLES
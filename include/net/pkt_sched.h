@@ -235,7 +235,22 @@ extern int qdisc_restart(struct net_device *dev);
  */
 static inline void qdisc_run(struct net_device *dev)
 {
-	while (!netif_queue_stopped(dev) && qdisc_restart(dev) < 0)
+	/**
+	 * 多队列设备挂有tc根队列规则时，所有包都从发送队列0发出。
+	 */
+	while (!netif_subqueue_stopped(dev, 0) && qdisc_restart(dev) < 0)
+		/* NOTHING */;
+}
+
+extern int qdisc_restart_queue(struct netdev_queue *txq);
+
+/**
+ * 多队列设备的一个发送队列上的qdisc_run，在txq->lock下调用。
+ */
+static inline void qdisc_run_queue(struct netdev_queue *txq)
+{
+	while (!netif_subqueue_stopped(txq->dev, txq->index) &&
+	       qdisc_restart_queue(txq) < 0)
 		/* NOTHING */;
 }
 
@@ -46,6 +46,17 @@ struct net_protocol {
 	 * 由ICMP协议处理函数所用的函数，用于通知L4协议有关接收到ICMP UNRESCHABLE消息的事情。
 	 */
 	void			(*err_handler)(struct sk_buff *skb, u32 info);
+	/**
+	 * 软件GSO时，由inet_gso_segment调用，把L4的大包切分成线上大小的段。
+	 */
+	struct sk_buff	       *(*gso_segment)(struct sk_buff *skb,
+					       int features);
+	/**
+	 * GRO时，由inet_gro_receive和inet_gro_complete调用，合并同一个流中连续的段。
+	 */
+	struct sk_buff	      **(*gro_receive)(struct sk_buff **head,
+					       struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb);
 	/**
 	 * 此字段在网络协议栈中的某些关键点都会被查询。用于使协议免于Ipsec策略检查。
 	 */
@@ -117,6 +117,10 @@ struct rtable
 	 * 该缓存路由项的目的IP地址对应的主机。与本地主机在最近一段时间通信的每个远端IP地址都有一个inet_peer结构。
 	 */
 	struct inet_peer	*peer; /* long-living peer info */
+	/**
+	 * 创建该路由时路由缓存的刷新代数。只用于保存在fib_nh中的转发路由，路由缓存被刷新后这些路由即失效。
+	 */
+	unsigned		rt_genid;
 };
 
 /**
@@ -201,11 +205,13 @@ extern struct rt_cache_stat *rt_cache_stat;
 extern struct ip_rt_acct *ip_rt_acct;
 
 struct in_device;
+struct fib_nh;
 extern int		ip_rt_init(void);
 extern void		ip_rt_redirect(u32 old_gw, u32 dst, u32 new_gw,
 				       u32 src, u8 tos, struct net_device *dev);
 extern void		ip_rt_advice(struct rtable **rp, int advice);
 extern void		rt_cache_flush(int how);
+extern void		rt_nexthop_flush(struct fib_nh *nh);
 extern int		__ip_route_output_key(struct rtable **, const struct flowi *flp);
 extern int		ip_route_output_key(struct rtable **, struct flowi *flp);
 extern int		ip_route_output_flow(struct rtable **rp, struct flowi *flp, struct sock *sk, int flags);
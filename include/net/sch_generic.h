@@ -41,6 +41,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN	1
 #define TCQ_F_THROTTLED	2
 #define TCQ_F_INGRESS	4
+#define TCQ_F_MQ	8
 	int			padded;
 	struct Qdisc_ops	*ops;
 	u32			handle;
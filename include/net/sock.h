@@ -42,6 +42,7 @@
 
 #include <linux/config.h>
 #include <linux/list.h>
+#include <linux/list_nulls.h>
 #include <linux/timer.h>
 #include <linux/cache.h>
 #include <linux/module.h>
@@ -50,6 +51,7 @@
 #include <linux/security.h>
 
 #include <linux/filter.h>
+#include <linux/jhash.h>
 
 #include <asm/atomic.h>
 #include <net/dst.h>
@@ -98,8 +100,10 @@ struct sock;
   *	@skc_family - network address family
   *	@skc_state - Connection state
   *	@skc_reuse - %SO_REUSEADDR setting
+  *	@skc_reuseport - %SO_REUSEPORT setting
   *	@skc_bound_dev_if - bound device index if != 0
   *	@skc_node - main hash linkage for various protocol lookup tables
+  *	@skc_nulls_node - main hash linkage for lookup tables walked under RCU
   *	@skc_bind_node - bind hash linkage for various protocol lookup tables
   *	@skc_refcnt - reference count
   *
@@ -115,11 +119,19 @@ struct sock_common {
 	/* 连接状态，对UDP来说，存在TCP_CLOSE状态 */
 	volatile unsigned char	skc_state;
 	/* 是否可以重用地址和端口 */
-	unsigned char		skc_reuse;
+	unsigned char		skc_reuse:4;
+	/* 是否与同一用户的其他套接口共享地址和端口，并在它们之间分担负载 */
+	unsigned char		skc_reuseport:4;
 	/* 如果不为0，则为绑定的网络接口索引，使用此接口输出报文 */
 	int			skc_bound_dev_if;
-	/* 通过此节点，将控制块加入到散列表中 */
-	struct hlist_node	skc_node;
+	/**
+	 * 通过此节点，将控制块加入到散列表中。
+	 * TCP的established散列表在RCU下无锁查找，使用以nulls标记结尾的节点。
+	 */
+	union {
+		struct hlist_node	skc_node;
+		struct hlist_nulls_node skc_nulls_node;
+	};
 	/* 如果已经绑定端口，则通过此节点将控制块加入到绑定散列表中 */
 	struct hlist_node	skc_bind_node;
 	/* 引用计数 */
@@ -171,6 +183,8 @@ struct sock_common {
   *	@sk_peercred - %SO_PEERCRED setting
   *	@sk_rcvlowat - %SO_RCVLOWAT setting
   *	@sk_rcvtimeo - %SO_RCVTIMEO setting
+  *	@sk_ll_usec - %SO_BUSY_POLL setting, usecs to busy poll before sleeping
+  *	@sk_napi_ifindex - NAPI device that last fed the receive queue
   *	@sk_sndtimeo - %SO_SNDTIMEO setting
   *	@sk_filter - socket filtering instructions
   *	@sk_protinfo - private area, net family specific, when not using slab
@@ -208,8 +222,10 @@ struct sock {
 #define sk_family		__sk_common.skc_family
 #define sk_state		__sk_common.skc_state
 #define sk_reuse		__sk_common.skc_reuse
+#define sk_reuseport		__sk_common.skc_reuseport
 #define sk_bound_dev_if		__sk_common.skc_bound_dev_if
 #define sk_node			__sk_common.skc_node
+#define sk_nulls_node		__sk_common.skc_nulls_node
 #define sk_bind_node		__sk_common.skc_bind_node
 #define sk_refcnt		__sk_common.skc_refcnt
 	volatile unsigned char	sk_zapped;
@@ -352,6 +368,16 @@ struct sock {
 	struct ucred		sk_peercred;
 	/* 接收缓存下限值 */
 	int			sk_rcvlowat;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	/**
+	 * 阻塞接收在睡眠前忙轮询网卡的时间（微秒）。参见SO_BUSY_POLL选项。
+	 */
+	unsigned int		sk_ll_usec;
+	/**
+	 * 最近一次向本套接口送来数据包的设备索引，忙轮询时轮询此设备。
+	 */
+	int			sk_napi_ifindex;
+#endif
 	/**
 	 * 套接口层接收超时时间。参见SO_RCVTIMEO选项。
 	 */
@@ -453,6 +479,23 @@ static inline struct sock *sk_next(struct sock *sk)
 		hlist_entry(sk->sk_node.next, struct sock, sk_node) : NULL;
 }
 
+static inline struct sock *__sk_nulls_head(struct hlist_nulls_head *head)
+{
+	return hlist_nulls_entry(head->first, struct sock, sk_nulls_node);
+}
+
+static inline struct sock *sk_nulls_head(struct hlist_nulls_head *head)
+{
+	return hlist_nulls_empty(head) ? NULL : __sk_nulls_head(head);
+}
+
+static inline struct sock *sk_nulls_next(struct sock *sk)
+{
+	return !is_a_nulls(sk->sk_nulls_node.next) ?
+		hlist_nulls_entry(sk->sk_nulls_node.next,
+				  struct sock, sk_nulls_node) : NULL;
+}
+
 static inline int sk_unhashed(struct sock *sk)
 {
 	return hlist_unhashed(&sk->sk_node);
@@ -525,6 +568,21 @@ static __inline__ void sk_add_node(struct sock *sk, struct hlist_head *list)
 	__sk_add_node(sk, list);
 }
 
+static __inline__ int __sk_nulls_del_node_init_rcu(struct sock *sk)
+{
+	if (sk_hashed(sk)) {
+		hlist_nulls_del_init_rcu(&sk->sk_nulls_node);
+		return 1;
+	}
+	return 0;
+}
+
+static __inline__ void __sk_nulls_add_node_rcu(struct sock *sk,
+					       struct hlist_nulls_head *list)
+{
+	hlist_nulls_add_head_rcu(&sk->sk_nulls_node, list);
+}
+
 static __inline__ void __sk_del_bind_node(struct sock *sk)
 {
 	__hlist_del(&sk->sk_bind_node);
@@ -548,6 +606,10 @@ static __inline__ void sk_add_bind_node(struct sock *sk,
 	hlist_for_each_entry_safe(__sk, node, tmp, list, sk_node)
 #define sk_for_each_bound(__sk, node, list) \
 	hlist_for_each_entry(__sk, node, list, sk_bind_node)
+#define sk_nulls_for_each(__sk, node, list) \
+	hlist_nulls_for_each_entry(__sk, node, list, sk_nulls_node)
+#define sk_nulls_for_each_rcu(__sk, node, list) \
+	hlist_nulls_for_each_entry_rcu(__sk, node, list, sk_nulls_node)
 
 /* Sock flags */
 enum sock_flags {
@@ -733,6 +795,10 @@ struct proto {
 	 * 将套接口从散列表中移除。如tcp_unhash
 	 */
 	void			(*unhash)(struct sock *sk);
+	/**
+	 * 绑定的本地地址在connect时发生变化后，重新计算散列位置。如udp_rehash，可以为空。
+	 */
+	void			(*rehash)(struct sock *sk);
 	/**
 	 * 将套接口与端口进行绑定。如果snum为0，表示可以选择任意端口。
 	 */
@@ -787,6 +853,11 @@ struct proto {
 	 * 传输控制块大小。如果创建kmem_cache_t失败，则通过kmalloc来分配内存，需要此参数。
 	 */
 	int			slab_obj_size;
+	/**
+	 * 创建slab高速缓存时附加的标志。TCP使用SLAB_DESTROY_BY_RCU，
+	 * 使得在RCU下无锁查找的控制块在宽限期内总是同一类型的对象。
+	 */
+	unsigned long		slab_flags;
 
 	struct module		*owner;
 
@@ -954,6 +1025,26 @@ extern void FASTCALL(release_sock(struct sock *sk));
 
 extern struct sock *		sk_alloc(int family, int priority, int zero_it,
 					 kmem_cache_t *slab);
+
+/*
+ * Copy a socket, but leave sk_node.next and sk_refcnt of the destination
+ * alone: a lockless reader of an RCU hash chain may be standing on @nsk
+ * right now. It must see either the old link or a nulls marker, and a
+ * zero refcount until the caller has made the copy valid and publishes
+ * it (see tcp_publish_child()).
+ */
+static inline void sock_copy(struct sock *nsk, const struct sock *osk,
+			     int size)
+{
+	memcpy(nsk, osk, offsetof(struct sock, sk_node.next));
+	memcpy(&nsk->sk_node.pprev, &osk->sk_node.pprev,
+	       offsetof(struct sock, sk_refcnt) -
+	       offsetof(struct sock, sk_node.pprev));
+	memcpy((char *)&nsk->sk_refcnt + sizeof(nsk->sk_refcnt),
+	       (char *)&osk->sk_refcnt + sizeof(osk->sk_refcnt),
+	       size - offsetof(struct sock, sk_refcnt) -
+	       sizeof(osk->sk_refcnt));
+}
 extern void			sk_free(struct sock *sk);
 
 extern struct sk_buff		*sock_wmalloc(struct sock *sk,
@@ -1066,8 +1157,7 @@ static inline int sk_filter(struct sock *sk, struct sk_buff *skb, int needlock)
 		
 		filter = sk->sk_filter;
 		if (filter) {
-			int pkt_len = sk_run_filter(skb, filter->insns,
-						    filter->len);
+			int pkt_len = sk_filter_run(filter, skb);
 			if (!pkt_len)
 				err = -EPERM;
 			else
@@ -1094,8 +1184,10 @@ static inline void sk_filter_release(struct sock *sk, struct sk_filter *fp)
 
 	atomic_sub(size, &sk->sk_omem_alloc);
 
-	if (atomic_dec_and_test(&fp->refcnt))
+	if (atomic_dec_and_test(&fp->refcnt)) {
+		bpf_jit_free(fp);
 		kfree(fp);
+	}
 }
 
 static inline void sk_filter_charge(struct sock *sk, struct sk_filter *fp)
@@ -1163,6 +1255,30 @@ static inline void sock_graft(struct sock *sk, struct socket *parent)
 }
 
 extern int sock_i_uid(struct sock *sk);
+
+/*
+ * Sockets of one user bound to the same address and port with
+ * SO_REUSEPORT form a group, and lookups spread flows over it.  The
+ * n-th equally good match replaces the pick so far with probability
+ * 1/n, decided by the flow hash: one pass over the chain, and a flow
+ * keeps landing on the same socket while the group doesn't change.
+ */
+extern u32 sk_reuseport_hashrnd;
+
+static inline u32 sk_reuseport_hash(u32 saddr, u16 sport, u32 daddr, u16 dport)
+{
+	return jhash_3words(saddr, daddr, ((u32) sport << 16) | dport,
+			    sk_reuseport_hashrnd);
+}
+
+static inline int sk_reuseport_pick(u32 *hash, int matches)
+{
+	int pick = (((u64) *hash * matches) >> 32) == 0;
+
+	/* Step to the next value for the next match */
+	*hash = *hash * 1664525 + 1013904223;
+	return pick;
+}
 extern unsigned long sock_i_ino(struct sock *sk);
 
 static inline struct dst_entry *
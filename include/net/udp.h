@@ -25,32 +25,77 @@
 #include <linux/udp.h>
 #include <linux/ip.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
 #include <net/sock.h>
 #include <net/snmp.h>
 #include <linux/seq_file.h>
 
 #define UDP_HTABLE_SIZE		128
 
+/* Above this many sockets on a port, unicast lookups use udp_hash2. */
+#define UDP_HSLOT_LONGWAY	10
+
+/**
+ * UDP散列表的一个桶，每个桶有自己的锁。
+ */
+struct udp_hslot {
+	/* 桶内的传输控制块链表 */
+	struct hlist_head	head;
+	/* 链表中传输控制块的数量 */
+	int			count;
+	/* 保护本桶的读写锁 */
+	rwlock_t		lock;
+} __attribute__((aligned(2 * sizeof(long))));
+
 /* udp.c: This needs to be shared by v4 and v6 because the lookup
  *        and hashing code needs to work with different AF's yet
  *        the port space is shared.
+ *
+ * Every bound socket is on two chains.  udp_hash is keyed on the local
+ * port only, sockets are linked through sk_node; binding, multicast and
+ * IPv6 lookups walk it.  udp_hash2 is keyed on (local IPv4 address,
+ * port), linked through sk_bind_node which UDP has no other use for;
+ * unicast IPv4 lookups go there once a port gets crowded.  Writers hold
+ * the udp_hash slot lock and take the udp_hash2 slot lock inside it.
  */
-extern struct hlist_head udp_hash[UDP_HTABLE_SIZE];
-extern rwlock_t udp_hash_lock;
+extern struct udp_hslot udp_hash[UDP_HTABLE_SIZE];
+extern struct udp_hslot udp_hash2[UDP_HTABLE_SIZE];
 
 extern int udp_port_rover;
 
+static inline struct udp_hslot *udp_hashslot(u16 num)
+{
+	return &udp_hash[num & (UDP_HTABLE_SIZE - 1)];
+}
+
+static inline unsigned int udp_portaddr_hash(u32 addr, u16 num)
+{
+	return jhash_1word(addr, 0) ^ num;
+}
+
+static inline struct udp_hslot *udp_hashslot2(unsigned int hash)
+{
+	return &udp_hash2[hash & (UDP_HTABLE_SIZE - 1)];
+}
+
+/* Caller holds the lock of udp_hashslot(num). */
 static inline int udp_lport_inuse(u16 num)
 {
 	struct sock *sk;
 	struct hlist_node *node;
 
-	sk_for_each(sk, node, &udp_hash[num & (UDP_HTABLE_SIZE - 1)])
+	sk_for_each(sk, node, &udp_hashslot(num)->head)
 		if (inet_sk(sk)->num == num)
 			return 1;
 	return 0;
 }
 
+extern void	__udp_hash_add(struct sock *sk, struct udp_hslot *hslot);
+extern int	__udp_hash_del(struct sock *sk, struct udp_hslot *hslot);
+extern void	udp_init(void);
+extern struct udp_hslot *udp_pick_port(unsigned short *snum);
+extern void	udp_rehash(struct sock *sk);
+
 /* Note: this must match 'valbool' in sock_setsockopt */
 #define UDP_CSUM_NOXMIT		1
 
@@ -69,6 +114,7 @@ extern int	udp_sendmsg(struct kiocb *iocb, struct sock *sk,
 			    struct msghdr *msg, size_t len);
 
 extern int	udp_rcv(struct sk_buff *skb);
+extern struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features);
 extern int	udp_ioctl(struct sock *sk, int cmd, unsigned long arg);
 extern int	udp_disconnect(struct sock *sk, int flags);
 extern unsigned int udp_poll(struct file *file, struct socket *sock,
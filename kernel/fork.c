@@ -336,7 +336,7 @@ static struct mm_struct * mm_init(struct mm_struct * mm)
 	mm->nr_ptes = 0;
 	spin_lock_init(&mm->page_table_lock);
 	rwlock_init(&mm->ioctx_list_lock);
-	mm->ioctx_list = NULL;
+	mm->ioctx_table = NULL;
 	mm->default_kioctx = (struct kioctx)INIT_KIOCTX(mm->default_kioctx, *mm);
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
 
@@ -24,6 +24,8 @@ cond_syscall(sys_socketpair)
 cond_syscall(sys_bind)
 cond_syscall(sys_listen)
 cond_syscall(sys_accept)
+cond_syscall(sys_accept4)
+cond_syscall(sys_acceptv)
 cond_syscall(sys_connect)
 cond_syscall(sys_getsockname)
 cond_syscall(sys_getpeername)
@@ -36,13 +38,16 @@ cond_syscall(sys_setsockopt)
 cond_syscall(sys_getsockopt)
 cond_syscall(sys_shutdown)
 cond_syscall(sys_sendmsg)
+cond_syscall(sys_sendmmsg)
 cond_syscall(sys_recvmsg)
+cond_syscall(sys_recvmmsg)
 cond_syscall(sys_socketcall)
 cond_syscall(sys_futex)
 cond_syscall(compat_sys_futex)
 cond_syscall(sys_epoll_create)
 cond_syscall(sys_epoll_ctl)
 cond_syscall(sys_epoll_wait)
+cond_syscall(sys_eventfd)
 cond_syscall(sys_semget)
 cond_syscall(sys_semop)
 cond_syscall(sys_semtimedop)
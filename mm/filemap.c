@@ -480,6 +480,41 @@ void fastcall wait_on_page_bit(struct page *page, int bit_nr)
 }
 EXPORT_SYMBOL(wait_on_page_bit);
 
+/*
+ * Asynchronous counterpart of wait_on_page_bit(). If 'wait' belongs to
+ * an AIO request (see current->io_wait), it is queued on the page
+ * waitqueue and -EIOCBRETRY is returned instead of sleeping; clearing
+ * the bit kicks the request for a retry. Synchronous waiters sleep as
+ * usual and get 0.
+ */
+int fastcall wait_on_page_bit_wq(struct page *page, int bit_nr,
+				 wait_queue_t *wait)
+{
+	wait_queue_head_t *wq = page_waitqueue(page);
+
+	if (is_sync_wait(wait)) {
+		wait_on_page_bit(page, bit_nr);
+		return 0;
+	}
+
+	if (!test_bit(bit_nr, &page->flags))
+		return 0;
+
+	/*
+	 * Queue first, then recheck, so that a wakeup in between is not
+	 * lost. prepare_to_wait() leaves the task state alone for an
+	 * async wait entry.
+	 */
+	prepare_to_wait(wq, wait, TASK_UNINTERRUPTIBLE);
+	if (test_bit(bit_nr, &page->flags)) {
+		sync_page(&page->flags);
+		return -EIOCBRETRY;
+	}
+	finish_wait(wq, wait);
+	return 0;
+}
+EXPORT_SYMBOL(wait_on_page_bit_wq);
+
 /**
  * unlock_page() - unlock a locked page
  *
@@ -536,6 +571,25 @@ void fastcall __lock_page(struct page *page)
 }
 EXPORT_SYMBOL(__lock_page);
 
+/*
+ * Get a lock on the page on behalf of 'wait'. For an AIO wait entry this
+ * returns -EIOCBRETRY instead of blocking when the page is locked.
+ */
+int fastcall __lock_page_wq(struct page *page, wait_queue_t *wait)
+{
+	if (is_sync_wait(wait)) {
+		__lock_page(page);
+		return 0;
+	}
+
+	while (TestSetPageLocked(page)) {
+		if (wait_on_page_bit_wq(page, PG_locked, wait))
+			return -EIOCBRETRY;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(__lock_page_wq);
+
 /*
  * a rather lightweight function, finding and getting a reference to a
  * hashed page atomically.
@@ -957,7 +1011,15 @@ page_not_up_to_date:
 		/**
 		 * lock_page获取对页的互斥访问.如果PG_locked已经置位,则lock_page会阻塞进程,直到标志被清0.
 		 */
-		lock_page(page);
+		/*
+		 * For AIO the request is queued on the page instead, and
+		 * we return what was read so far. The retry picks up here.
+		 */
+		if (lock_page_wq(page, current->io_wait)) {
+			desc->error = -EIOCBRETRY;
+			page_cache_release(page);
+			goto out;
+		}
 
 		/* Did it get unhashed before we got the lock? */
 		/**
@@ -993,6 +1055,13 @@ readpage:
 		 * 如果PG_uptodate没有被置位,则调用lock_page,等待页被有效读入.
 		 */
 		if (!PageUptodate(page)) {
+			/* Don't hold up AIO on the read we just started */
+			if (in_aio() &&
+			    wait_on_page_locked_wq(page, current->io_wait)) {
+				desc->error = -EIOCBRETRY;
+				page_cache_release(page);
+				goto out;
+			}
 			lock_page(page);
 			if (!PageUptodate(page)) {
 				if (page->mapping == NULL) {
@@ -1256,6 +1325,9 @@ __generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 				retval = desc.error;
 				break;
 			}
+			/* AIO retry pending: don't start on the next segment */
+			if (desc.error == -EIOCBRETRY)
+				break;
 		}
 	}
 out:
@@ -1991,8 +2063,20 @@ __grab_cache_page(struct address_space *mapping, unsigned long index,
 	int err;
 	struct page *page;
 repeat:
-	page = find_lock_page(mapping, index);
-	if (!page) {
+	page = find_get_page(mapping, index);
+	if (page) {
+		/* AIO writers are queued on a locked page, not blocked */
+		if (lock_page_wq(page, current->io_wait)) {
+			page_cache_release(page);
+			return ERR_PTR(-EIOCBRETRY);
+		}
+		/* Has the page been truncated while we slept? */
+		if (page->mapping != mapping) {
+			unlock_page(page);
+			page_cache_release(page);
+			goto repeat;
+		}
+	} else {
 		if (!*cached_page) {
 			*cached_page = page_cache_alloc(mapping);
 			if (!*cached_page)
@@ -2342,6 +2426,10 @@ generic_file_buffered_write(struct kiocb *iocb, const struct iovec *iov,
 			status = -ENOMEM;
 			break;
 		}
+		if (IS_ERR(page)) {
+			status = PTR_ERR(page);
+			break;
+		}
 
 		/**
 		 * 调用索引节点的prepare_write。对应的函数会为该页分配和初始化缓冲区首部。
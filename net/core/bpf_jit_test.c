@@ -0,0 +1,398 @@
+/*
+ * Socket filter JIT tests.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Runs filters covering every instruction, and loads from every kind of
+ * place in linear and paged buffers, both through sk_run_filter() and
+ * compiled by bpf_jit_compile(), and checks that the two agree:
+ *
+ *	modprobe bpf_jit_test
+ *
+ * The results go to the kernel log; loading fails if any filter could
+ * not be compiled or returned something else than the interpreter.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/random.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/skbuff.h>
+#include <linux/filter.h>
+
+#define BPF_TEST_PKTS	5
+
+static struct sk_buff *pkts[BPF_TEST_PKTS];
+static struct net_device bpf_test_dev;
+static unsigned int tests, failures;
+
+/* Linear length and paged length of each test packet */
+static const unsigned int pkt_len[BPF_TEST_PKTS][2] = {
+	{ 64, 0 }, { 64, 0 }, { 14, 0 }, { 0, 0 }, { 40, 100 },
+};
+
+static struct sk_buff *bpf_test_skb(unsigned int len, unsigned int paged)
+{
+	struct sk_buff *skb;
+	struct page *page;
+
+	skb = alloc_skb(len + 16, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	skb_reserve(skb, 16);
+	get_random_bytes(skb_put(skb, len), len);
+
+	if (paged) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		get_random_bytes(page_address(page), paged);
+		skb_fill_page_desc(skb, 0, page, 0, paged);
+		skb->len += paged;
+		skb->data_len += paged;
+	}
+
+	skb->protocol = htons(ETH_P_IP);
+	skb->pkt_type = PACKET_HOST;
+	skb->dev = &bpf_test_dev;
+	skb->mac.raw = skb->data;
+	skb->nh.raw = skb->data + min(len, (unsigned int)ETH_HLEN);
+	return skb;
+}
+
+/* Runs one filter over every test packet */
+static void bpf_test(const char *name, const struct sock_filter *insns,
+		     unsigned int len)
+{
+	struct sk_filter *fp;
+	unsigned int interp, jit;
+	int i;
+
+	tests++;
+	fp = kmalloc(sizeof(*fp) + len * sizeof(*insns), GFP_KERNEL);
+	if (!fp) {
+		failures++;
+		return;
+	}
+	memcpy(fp->insns, insns, len * sizeof(*insns));
+	fp->len = len;
+	fp->bpf_func = NULL;
+
+	if (sk_chk_filter(fp->insns, fp->len)) {
+		printk(KERN_ERR "bpf_jit_test: %s: rejected\n", name);
+		failures++;
+		goto out;
+	}
+	bpf_jit_compile(fp);
+	if (!fp->bpf_func) {
+		printk(KERN_ERR "bpf_jit_test: %s: not compiled\n", name);
+		failures++;
+		goto out;
+	}
+
+	for (i = 0; i < BPF_TEST_PKTS; i++) {
+		interp = sk_run_filter(pkts[i], fp->insns, fp->len);
+		jit = fp->bpf_func(pkts[i], fp->insns);
+		if (interp != jit) {
+			printk(KERN_ERR "bpf_jit_test: %s: packet %d: "
+			       "interpreter %#x, jit %#x\n",
+			       name, i, interp, jit);
+			failures++;
+			break;
+		}
+	}
+	bpf_jit_free(fp);
+out:
+	kfree(fp);
+}
+
+static const u32 alu_k[] = {
+	0, 1, 3, 31, 32, 0x1234, 0x80000000, 0xffffffff,
+};
+
+static const u16 alu_ops[] = {
+	BPF_ADD, BPF_SUB, BPF_MUL, BPF_DIV,
+	BPF_AND, BPF_OR, BPF_LSH, BPF_RSH,
+};
+
+static void bpf_test_alu(void)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(alu_ops); i++) {
+		for (j = 0; j < ARRAY_SIZE(alu_k); j++) {
+			struct sock_filter k[] = {
+				BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0),
+				BPF_STMT(BPF_ALU|alu_ops[i]|BPF_K, alu_k[j]),
+				BPF_STMT(BPF_RET|BPF_A, 0),
+			};
+			struct sock_filter x[] = {
+				BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0),
+				BPF_STMT(BPF_LDX|BPF_IMM, alu_k[j]),
+				BPF_STMT(BPF_ALU|alu_ops[i]|BPF_X, 0),
+				BPF_STMT(BPF_RET|BPF_A, 0),
+			};
+
+			bpf_test("alu k", k, ARRAY_SIZE(k));
+			bpf_test("alu x", x, ARRAY_SIZE(x));
+		}
+	}
+
+	{
+		struct sock_filter neg[] = {
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0),
+			BPF_STMT(BPF_ALU|BPF_NEG, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+		/* X from the packet, zero for some packets */
+		struct sock_filter div[] = {
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 1),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 1),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 4),
+			BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 1),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		bpf_test("neg", neg, ARRAY_SIZE(neg));
+		bpf_test("div x", div, ARRAY_SIZE(div));
+	}
+}
+
+static const u16 jmp_ops[] = {
+	BPF_JEQ, BPF_JGT, BPF_JGE, BPF_JSET,
+};
+
+static const u32 jmp_k[] = {
+	0, 0x7f, 0x80, 0xff,
+};
+
+static void bpf_test_jmp(void)
+{
+	int i, j, jt, jf;
+
+	for (i = 0; i < ARRAY_SIZE(jmp_ops); i++)
+	for (j = 0; j < ARRAY_SIZE(jmp_k); j++)
+	for (jt = 0; jt < 3; jt++)
+	for (jf = 0; jf < 3; jf++) {
+		struct sock_filter k[] = {
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|jmp_ops[i]|BPF_K, jmp_k[j], jt, jf),
+			BPF_STMT(BPF_RET|BPF_K, 10),
+			BPF_STMT(BPF_RET|BPF_K, 11),
+			BPF_STMT(BPF_RET|BPF_K, 12),
+		};
+		struct sock_filter x[] = {
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_STMT(BPF_LDX|BPF_IMM, jmp_k[j]),
+			BPF_JUMP(BPF_JMP|jmp_ops[i]|BPF_X, 0, jt, jf),
+			BPF_STMT(BPF_RET|BPF_K, 10),
+			BPF_STMT(BPF_RET|BPF_K, 11),
+			BPF_STMT(BPF_RET|BPF_K, 12),
+		};
+
+		bpf_test("jmp k", k, ARRAY_SIZE(k));
+		bpf_test("jmp x", x, ARRAY_SIZE(x));
+	}
+
+	{
+		struct sock_filter ja[] = {
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_JMP|BPF_JA, 1),
+			BPF_STMT(BPF_RET|BPF_K, 2),
+			BPF_STMT(BPF_JMP|BPF_JA, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		bpf_test("ja", ja, ARRAY_SIZE(ja));
+	}
+}
+
+/* Within, at the end of and past the linear data and the page */
+static const int ld_off[] = {
+	0, 1, 10, 13, 14, 36, 38, 39, 40, 60, 62, 63, 64, 100,
+	137, 139, 140, 1000, 0x10000000,
+	SKF_NET_OFF, SKF_NET_OFF + 10, SKF_NET_OFF + 60,
+	SKF_LL_OFF, SKF_LL_OFF + 12, SKF_LL_OFF + 100, SKF_LL_OFF - 1,
+	SKF_AD_OFF + SKF_AD_PROTOCOL, SKF_AD_OFF + SKF_AD_PKTTYPE,
+	SKF_AD_OFF + SKF_AD_IFINDEX, SKF_AD_OFF + SKF_AD_MAX, -1,
+};
+
+static const u16 ld_size[] = {
+	BPF_W, BPF_H, BPF_B,
+};
+
+static const u32 ind_x[] = {
+	0, 1, 39, 0x10000000, 0xfffffff0,
+};
+
+static void bpf_test_ld(void)
+{
+	int i, j, s;
+
+	for (s = 0; s < ARRAY_SIZE(ld_size); s++) {
+		for (i = 0; i < ARRAY_SIZE(ld_off); i++) {
+			struct sock_filter abs[] = {
+				BPF_STMT(BPF_LD|ld_size[s]|BPF_ABS, ld_off[i]),
+				BPF_STMT(BPF_RET|BPF_A, 0),
+			};
+
+			bpf_test("ld abs", abs, ARRAY_SIZE(abs));
+		}
+
+		/* Also checks that X survives the slow path */
+		for (i = 0; i < ARRAY_SIZE(ld_off); i++)
+		for (j = 0; j < ARRAY_SIZE(ind_x); j++) {
+			struct sock_filter ind[] = {
+				BPF_STMT(BPF_LDX|BPF_IMM, ind_x[j]),
+				BPF_STMT(BPF_LD|ld_size[s]|BPF_IND, ld_off[i]),
+				BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+				BPF_STMT(BPF_RET|BPF_A, 0),
+			};
+
+			bpf_test("ld ind", ind, ARRAY_SIZE(ind));
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ld_off); i++) {
+		struct sock_filter msh[] = {
+			BPF_STMT(BPF_LD|BPF_IMM, 7),
+			BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, ld_off[i]),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		bpf_test("ldx msh", msh, ARRAY_SIZE(msh));
+	}
+
+	{
+		struct sock_filter len[] = {
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+		struct sock_filter xlen[] = {
+			BPF_STMT(BPF_LDX|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_MISC|BPF_TXA, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		bpf_test("ld len", len, ARRAY_SIZE(len));
+		bpf_test("ldx len", xlen, ARRAY_SIZE(xlen));
+	}
+}
+
+static void bpf_test_misc(void)
+{
+	struct sock_filter mem[7 * BPF_MEMWORDS + 4];
+	int i, n = 0;
+
+	/* Fill every word, from A and X in turn... */
+	for (i = 0; i < BPF_MEMWORDS; i++) {
+		struct sock_filter st[] = {
+			BPF_STMT(BPF_LD|BPF_IMM, 3 * i + 1),
+			BPF_STMT(BPF_ST, i),
+			BPF_STMT(BPF_LDX|BPF_IMM, 5 * i + 2),
+			BPF_STMT(BPF_STX, i),
+		};
+
+		mem[n++] = st[i & 1 ? 0 : 2];
+		mem[n++] = st[i & 1 ? 1 : 3];
+	}
+	/* ... and add them up, loading into both */
+	mem[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_IMM, 0);
+	for (i = 0; i < BPF_MEMWORDS; i++) {
+		struct sock_filter ld[] = {
+			BPF_STMT(BPF_LDX|BPF_MEM, i),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_MEM, BPF_MEMWORDS - 1 - i),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+		};
+
+		memcpy(&mem[n], ld, sizeof(ld));
+		n += ARRAY_SIZE(ld);
+	}
+	mem[n++] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_A, 0);
+	bpf_test("mem", mem, n);
+
+	{
+		struct sock_filter ret_k[] = {
+			BPF_STMT(BPF_RET|BPF_K, 0x12345678),
+		};
+		struct sock_filter ret_a[] = {
+			BPF_STMT(BPF_LD|BPF_IMM, 0xfedcba98),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 0),
+			BPF_STMT(BPF_MISC|BPF_TXA, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+		/* Counts as returning 0 */
+		struct sock_filter invalid[] = {
+			BPF_STMT(BPF_LD|BPF_IMM, 5),
+			BPF_STMT(0xffff, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		bpf_test("ret k", ret_k, ARRAY_SIZE(ret_k));
+		bpf_test("ret a", ret_a, ARRAY_SIZE(ret_a));
+		bpf_test("invalid", invalid, ARRAY_SIZE(invalid));
+	}
+}
+
+static int __init bpf_jit_test_init(void)
+{
+	int i, err = 0;
+
+	bpf_test_dev.ifindex = 3;
+	for (i = 0; i < BPF_TEST_PKTS; i++) {
+		pkts[i] = bpf_test_skb(pkt_len[i][0], pkt_len[i][1]);
+		if (!pkts[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+	/* Make the jumps see equal values and divisions by zero happen */
+	pkts[0]->data[0] = 0x80;
+	pkts[1]->data[0] = 0x7f;
+	pkts[2]->data[0] = 0;
+	pkts[0]->data[1] = 0;
+	pkts[1]->data[1] = 1;
+
+	bpf_test_alu();
+	bpf_test_jmp();
+	bpf_test_ld();
+	bpf_test_misc();
+
+	printk(KERN_INFO "bpf_jit_test: %u filters, %u failed\n",
+	       tests, failures);
+	if (failures)
+		err = -EINVAL;
+out:
+	for (i = 0; i < BPF_TEST_PKTS; i++)
+		if (pkts[i])
+			kfree_skb(pkts[i]);
+	return err;
+}
+
+/*
+ * If an init function is provided, an exit function must also be provided
+ * to allow module unload.
+ */
+static void __exit bpf_jit_test_exit(void) { }
+
+module_init(bpf_jit_test_init);
+module_exit(bpf_jit_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Socket filter JIT tests");
@@ -52,6 +52,7 @@
 #include <net/protocol.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
+#include <net/busy_poll.h>
 #include <net/checksum.h>
 
 
@@ -180,6 +181,10 @@ struct sk_buff *skb_recv_datagram(struct sock *sk, unsigned flags,
 		if (skb)
 			return skb;
 
+		/* Spin for a packet first if the socket asked for it */
+		if (sk_can_busy_loop(sk) && sk_busy_loop(sk, !timeo))
+			continue;
+
 		/* User doesn't want to wait */
 		error = -EAGAIN;
 		if (!timeo)
@@ -92,6 +92,7 @@
 #include <linux/notifier.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
+#include <net/busy_poll.h>
 #include <linux/rtnetlink.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
@@ -109,6 +110,9 @@
 #include <linux/netpoll.h>
 #include <linux/rcupdate.h>
 #include <linux/delay.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
+#include <net/ip.h>
 #ifdef CONFIG_NET_RADIO
 #include <linux/wireless.h>		/* Note : will define WIRELESS_EXT */
 #include <net/iw_handler.h>
@@ -1268,8 +1272,10 @@ int __skb_linearize(struct sk_buff *skb, int gfp_mask)
 	atomic_set(&ninfo->dataref, 1);
 	ninfo->tso_size = skb_shinfo(skb)->tso_size;
 	ninfo->tso_segs = skb_shinfo(skb)->tso_segs;
+	ninfo->gso_type = skb_shinfo(skb)->gso_type;
 	ninfo->nr_frags = 0;
 	ninfo->frag_list = NULL;
+	ninfo->destructor_arg = skb_shinfo(skb)->destructor_arg;
 
 	/* Offset between the two in bytes */
 	offset = data - skb->head;
@@ -1309,6 +1315,237 @@ int __skb_linearize(struct sk_buff *skb, int gfp_mask)
 	}						\
 }
 
+/**
+ *	skb_gso_segment - Perform segmentation on skb.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	This function segments the given skb and returns a list of segments.
+ *	The protocol handler registered for skb->protocol does the work, so
+ *	the network header must already be set up.  skb->data is expected
+ *	to point at the link layer header on entry and does so on return.
+ */
+struct sk_buff *skb_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
+	struct packet_type *ptype;
+	int type = skb->protocol;
+
+	skb->mac.raw = skb->data;
+	skb->mac_len = skb->nh.raw - skb->data;
+	__skb_pull(skb, skb->mac_len);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type) & 15], list) {
+		if (ptype->type == type && !ptype->dev && ptype->gso_segment) {
+			segs = ptype->gso_segment(skb, features);
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	__skb_push(skb, skb->data - skb->mac.raw);
+
+	return segs;
+}
+
+/*
+ * While the segments of a super-sized skb are handed to the driver they
+ * hang off skb->next of the original, which keeps the socket charged until
+ * the last of them is gone.  Its own destructor is parked in the cb.
+ */
+struct dev_gso_cb {
+	void (*destructor)(struct sk_buff *skb);
+};
+
+#define DEV_GSO_CB(skb) ((struct dev_gso_cb *)(skb)->cb)
+
+static void dev_gso_skb_destructor(struct sk_buff *skb)
+{
+	struct dev_gso_cb *cb;
+
+	while (skb->next) {
+		struct sk_buff *nskb = skb->next;
+
+		skb->next = nskb->next;
+		nskb->next = NULL;
+		kfree_skb(nskb);
+	}
+
+	cb = DEV_GSO_CB(skb);
+	if (cb->destructor)
+		cb->destructor(skb);
+}
+
+/**
+ *	dev_gso_segment - Perform emulated hardware segmentation on skb.
+ *	@skb: buffer to segment
+ *
+ *	This function segments the given skb and stores the list of segments
+ *	in skb->next.
+ */
+static int dev_gso_segment(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	struct sk_buff *segs;
+	int features = dev->features & ~(illegal_highdma(dev, skb) ?
+					 NETIF_F_SG : 0);
+
+	segs = skb_gso_segment(skb, features);
+	if (unlikely(IS_ERR(segs)))
+		return PTR_ERR(segs);
+
+	skb->next = segs;
+	DEV_GSO_CB(skb)->destructor = skb->destructor;
+	skb->destructor = dev_gso_skb_destructor;
+
+	return 0;
+}
+
+/**
+ *	dev_hard_start_xmit - hand a buffer to the driver
+ *	@skb: buffer to transmit
+ *	@dev: device to transmit on
+ *
+ *	Called with the driver's xmit_lock held (unless the device is LLTX).
+ *	Packets the device can't take as they are (see netif_needs_gso()) are
+ *	segmented here, and the segments are fed to the driver one by one.
+ *	If the driver or the queue stops part way through, NETDEV_TX_BUSY is
+ *	returned and skb keeps the unsent segments on skb->next; calling again
+ *	with the same skb continues where it left off.
+ */
+int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	if (likely(!skb->next)) {
+		if (netdev_nit)
+			dev_queue_xmit_nit(skb, dev);
+
+		if (!netif_needs_gso(dev, skb))
+			return dev->hard_start_xmit(skb, dev);
+
+		if (unlikely(dev_gso_segment(skb)))
+			goto out_kfree_skb;
+	}
+
+	do {
+		struct sk_buff *nskb = skb->next;
+		int rc;
+
+		skb->next = nskb->next;
+		nskb->next = NULL;
+		rc = dev->hard_start_xmit(nskb, dev);
+		if (unlikely(rc)) {
+			nskb->next = skb->next;
+			skb->next = nskb;
+			return rc;
+		}
+		if (unlikely(netif_subqueue_stopped(dev, skb->queue_mapping) &&
+			     skb->next))
+			return NETDEV_TX_BUSY;
+	} while (skb->next);
+
+	skb->destructor = DEV_GSO_CB(skb)->destructor;
+
+out_kfree_skb:
+	kfree_skb(skb);
+	return NETDEV_TX_OK;
+}
+
+static u32 dev_tx_hashrnd;
+
+/*
+ * Spread flows over the transmit queues of a multiqueue device.  All
+ * packets of a TCP or UDP flow hash to the same queue, so a flow is
+ * never reordered.
+ */
+static u16 dev_tx_hash(struct net_device *dev, struct sk_buff *skb)
+{
+	u32 addr1 = 0, addr2 = 0, ports = 0, proto;
+	struct iphdr *iph = skb->nh.iph;
+
+	proto = skb->protocol;
+	if (skb->protocol == htons(ETH_P_IP) && iph &&
+	    skb->nh.raw + sizeof(struct iphdr) <= skb->tail) {
+		addr1 = iph->saddr;
+		addr2 = iph->daddr;
+		proto = iph->protocol;
+		if (!(iph->frag_off & htons(IP_MF | IP_OFFSET)) &&
+		    (proto == IPPROTO_TCP || proto == IPPROTO_UDP ||
+		     proto == IPPROTO_SCTP) &&
+		    skb->nh.raw + iph->ihl * 4 + 4 <= skb->tail)
+			ports = *(u32 *)(skb->nh.raw + iph->ihl * 4);
+	}
+
+	return ((u64) jhash_3words(addr1, addr2 ^ proto, ports,
+				   dev_tx_hashrnd) * dev->num_tx_queues) >> 32;
+}
+
+static struct netdev_queue *dev_pick_tx(struct net_device *dev,
+					struct sk_buff *skb)
+{
+	u16 index;
+
+	if (dev->select_queue)
+		index = dev->select_queue(dev, skb);
+	else
+		index = dev_tx_hash(dev, skb);
+	if (index >= dev->num_tx_queues)
+		index = 0;
+
+	skb->queue_mapping = index;
+	return &dev->tx_queues[index];
+}
+
+/*
+ * Transmit on one queue of a multiqueue device that runs its default
+ * per-queue qdiscs.  This is the body of dev_queue_xmit() with the
+ * queue's locks instead of the device's.  Called with BHs disabled.
+ */
+static int dev_queue_xmit_mq(struct sk_buff *skb, struct net_device *dev)
+{
+	struct netdev_queue *txq = dev_pick_tx(dev, skb);
+	struct Qdisc *q;
+	int cpu, rc;
+
+	spin_lock(&txq->lock);
+	q = txq->qdisc;
+	if (q->enqueue) {
+		rc = q->enqueue(skb, q);
+		qdisc_run_queue(txq);
+		spin_unlock(&txq->lock);
+		return rc == NET_XMIT_BYPASS ? NET_XMIT_SUCCESS : rc;
+	}
+	spin_unlock(&txq->lock);
+
+	/* No queue (txqueuelen 0): straight to the driver */
+	if (dev->flags & IFF_UP) {
+		cpu = smp_processor_id();
+		if (txq->xmit_lock_owner != cpu) {
+			if ((dev->features & NETIF_F_LLTX) == 0) {
+				spin_lock(&txq->xmit_lock);
+				txq->xmit_lock_owner = cpu;
+			}
+			rc = NETDEV_TX_BUSY;
+			if (!netif_subqueue_stopped(dev, txq->index))
+				rc = dev_hard_start_xmit(skb, dev);
+			if ((dev->features & NETIF_F_LLTX) == 0) {
+				txq->xmit_lock_owner = -1;
+				spin_unlock(&txq->xmit_lock);
+			}
+			if (!rc)
+				return 0;
+			if (net_ratelimit())
+				printk(KERN_CRIT "Virtual device %s asks to "
+				       "queue packet!\n", dev->name);
+		} else if (net_ratelimit())
+			printk(KERN_CRIT "Dead loop on virtual device "
+			       "%s, fix it urgently!\n", dev->name);
+	}
+
+	kfree_skb(skb);
+	return -ENETDOWN;
+}
+
 /**
  *	dev_queue_xmit - transmit a buffer
  *	@skb: buffer to transmit
@@ -1336,6 +1573,13 @@ int dev_queue_xmit(struct sk_buff *skb)
 	 * 当skb_shinfo(skb)->frag_list非空时，有效数据是一个分片列表；
 	 * 其他情况下，有效数据是单一的块。
 	 */
+	/**
+	 * 需要软件GSO的大包在dev_hard_start_xmit中切分，切分时会按设备的能力
+	 * 拷贝数据和计算校验和，这里不必先把它合并成单一缓冲区。
+	 */
+	if (netif_needs_gso(dev, skb))
+		goto gso;
+
 	if (skb_shinfo(skb)->frag_list &&
 		/**
 		 * 如果分片了，代码检查设备是否支持分散/聚集DMA功能。如果不支持，就自行将分片合并到单一缓冲区。
@@ -1381,6 +1625,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 	      	if (skb_checksum_help(skb, 0))
 	      		goto out_kfree_skb;
 
+gso:
 	/* Disable soft irqs for various locks below. Also 
 	 * stops preemption for RCU. 
 	 */
@@ -1409,6 +1654,16 @@ int dev_queue_xmit(struct sk_buff *skb)
 	skb->tc_verd = SET_TC_AT(skb->tc_verd,AT_EGRESS);
 #endif
 
+	/**
+	 * 多队列设备使用默认队列规则时，选择一个发送队列，在该队列自己的锁下入队和发送。
+	 * 否则所有包都从发送队列0发出。
+	 */
+	if (q->flags & TCQ_F_MQ) {
+		rc = dev_queue_xmit_mq(skb, dev);
+		goto out;
+	}
+	skb->queue_mapping = 0;
+
 	/**
      * 如果存在队列惩罚，那么设备受到dev->qdisc的影响。输入帧由enqueue虚函数进行排队，并且由qdisc_run进行出队和传送
  	 */
@@ -1456,18 +1711,12 @@ int dev_queue_xmit(struct sk_buff *skb)
 			 */
 			HARD_TX_LOCK(dev, cpu);
 
-			if (!netif_queue_stopped(dev)) {/* 会被停止吗? */
-				/**
-				 * 回送包。AF_PACKET协议。
-				 */
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
-
+			if (!netif_subqueue_stopped(dev, 0)) {/* 会被停止吗? */
 				rc = 0;
 				/**
-				 * 由虚拟设备发送。
+				 * 由虚拟设备发送。回送包（AF_PACKET协议）和软件GSO都在dev_hard_start_xmit中处理。
 				 */
-				if (!dev->hard_start_xmit(skb, dev)) {
+				if (!dev_hard_start_xmit(skb, dev)) {
 					HARD_TX_UNLOCK(dev);
 					goto out;
 				}
@@ -1584,53 +1833,128 @@ static void sample_queue(unsigned long dummy)
 #endif
 
 
-/**
- *	netif_rx	-	post buffer to the network code
- *	@skb: buffer to post
- *
- *	This function receives a packet from a device driver and queues it for
- *	the upper (protocol) levels to process.  It always succeeds. The buffer
- *	may be dropped during processing for congestion control or by the
- *	protocol layers.
- *
- *	return values:
- *	NET_RX_SUCCESS	(no congestion)
- *	NET_RX_CN_LOW   (low congestion)
- *	NET_RX_CN_MOD   (moderate congestion)
- *	NET_RX_CN_HIGH  (high congestion)
- *	NET_RX_DROP     (packet was dropped)
- *
+#ifdef CONFIG_RPS
+/*
+ * With RPS other CPUs queue packets on our backlog too, so it needs the
+ * lock of its queue.  Without it only the owning CPU touches it, with
+ * interrupts disabled.
  */
-/**
- * 在中断中处理多个帧的方法。用于非NAPI驱动。一般运行在中断上下文。
- * 		skb:	接收到的缓冲区。
- * 返回值:		拥塞级别。
+#define rps_lock(sd)	spin_lock(&(sd)->input_pkt_queue.lock)
+#define rps_unlock(sd)	spin_unlock(&(sd)->input_pkt_queue.lock)
+
+u32 rps_hashrnd;
+struct rps_sock_flow_table *rps_sock_flow_table;
+
+/*
+ * Choose the CPU that should process @skb: where its socket was last
+ * read, if that is known, else one from the device's map picked by flow
+ * hash.  Only IPv4 is steered.  Returns -1 to process @skb on this CPU,
+ * which also keeps a packet that was already steered where it is.
  */
-int netif_rx(struct sk_buff *skb)
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb)
 {
-	int this_cpu;
-	struct softnet_data *queue;
-	unsigned long flags;
+	struct rps_sock_flow_table *sock_table;
+	struct rps_map *map;
+	struct iphdr *iph;
+	u16 sport = 0, dport = 0;
+	u32 hash;
+	int cpu = -1;
+	int ihl;
 
-#ifdef CONFIG_NETPOLL
-	/**
-	 * 如果netpoll截获此包，则退出。
-	 */
-	if (skb->dev->netpoll_rx && netpoll_rx(skb)) {
-		kfree_skb(skb);
-		return NET_RX_DROP;
+	rcu_read_lock();
+	map = rcu_dereference(dev->rps_map);
+	if (!map)
+		goto out;
+
+	if (skb->protocol != htons(ETH_P_IP) ||
+	    !pskb_may_pull(skb, sizeof(*iph)))
+		goto out;
+
+	iph = (struct iphdr *)skb->data;
+	ihl = iph->ihl * 4;
+	if (ihl < sizeof(*iph))
+		goto out;
+
+	if (!(iph->frag_off & htons(IP_MF | IP_OFFSET))) {
+		switch (iph->protocol) {
+		case IPPROTO_TCP:
+		case IPPROTO_UDP:
+		case IPPROTO_SCTP:
+			if (pskb_may_pull(skb, ihl + 4)) {
+				u16 *ports = (u16 *)(skb->data + ihl);
+
+				sport = ports[0];
+				dport = ports[1];
+			}
+			iph = (struct iphdr *)skb->data;
+			break;
+		}
+	}
+
+	hash = rps_flow_hash(iph->saddr, iph->daddr, sport, dport);
+
+	sock_table = rcu_dereference(rps_sock_flow_table);
+	if (sock_table) {
+		u16 tcpu = sock_table->ents[hash & sock_table->mask];
+
+		if (tcpu != RPS_NO_CPU && cpu_online(tcpu)) {
+			cpu = tcpu;
+			goto found;
+		}
 	}
+
+	cpu = map->cpus[((u64) hash * map->len) >> 32];
+	if (!cpu_online(cpu))
+		cpu = -1;
+found:
+	if (cpu == smp_processor_id())
+		cpu = -1;
+out:
+	rcu_read_unlock();
+	return cpu;
+}
+
+/* Called from the IPI: the backlog of this CPU has packets to process */
+static void rps_trigger_softirq(void *data)
+{
+	struct softnet_data *queue = data;
+
+	__netif_rx_schedule(&queue->backlog_dev);
+}
+
+/*
+ * Kick the CPUs that this CPU queued packets for and that weren't
+ * processing their backlog yet.
+ */
+static void net_rps_action(struct softnet_data *queue)
+{
+	cpumask_t mask;
+	int cpu;
+
+	local_irq_disable();
+	mask = queue->rps_ipi_mask;
+	cpus_clear(queue->rps_ipi_mask);
+	local_irq_enable();
+
+	for_each_cpu_mask(cpu, mask) {
+		__get_cpu_var(netdev_rx_stat).rps_ipi++;
+		smp_call_function_single(cpu, rps_trigger_softirq,
+					 &per_cpu(softnet_data, cpu), 0, 0);
+	}
+}
+#else
+#define rps_lock(sd)	do { } while (0)
+#define rps_unlock(sd)	do { } while (0)
 #endif
-	/**
-	 * 还没有设置包的接收时间，则设置它。
-	 */
-	if (!skb->stamp.tv_sec)
-		/**
-		 * net_enable_timestamp表示对有人对时间戳感兴趣，只有这样，才更新stamp。
-		 * 这是在net_timestamp中判断的。
-		 * 驱动中设置的时间，是针对设备的，并且保存的是tick.
-		 */
-		net_timestamp(&skb->stamp);
+
+/*
+ * Queue @skb on the backlog of @cpu, or of this CPU if @cpu is negative.
+ * Returns the congestion level of that backlog, or NET_RX_DROP.
+ */
+static int enqueue_to_backlog(struct sk_buff *skb, int cpu)
+{
+	struct softnet_data *queue;
+	unsigned long flags;
 
 	/*
 	 * The code is rearranged so that the path is the most
@@ -1643,12 +1967,16 @@ int netif_rx(struct sk_buff *skb)
 	 */
 	local_irq_save(flags);
 	/**
-	 * 获取每CPU softnet_data数据结构，并设置计数。
+	 * 获取目标CPU的softnet_data数据结构，并设置计数。
 	 */
-	this_cpu = smp_processor_id();
-	queue = &__get_cpu_var(softnet_data);
+	if (cpu < 0)
+		cpu = smp_processor_id();
+	else
+		__get_cpu_var(netdev_rx_stat).rps_steered++;
+	queue = &per_cpu(softnet_data, cpu);
 
 	__get_cpu_var(netdev_rx_stat).total++;
+	rps_lock(queue);
 	/**
 	 * 判断CPU的输入队列是否满了。
 	 */
@@ -1671,8 +1999,9 @@ enqueue:
 			/**
 			 * Avg_blog和cng_level在get_sample_status中更新
 			 */
-			get_sample_stats(this_cpu);
+			get_sample_stats(cpu);
 #endif
+			rps_unlock(queue);
 			local_irq_restore(flags);
 			/**
 			 * 返回当前拥塞级别，外层驱动可以根据此值确定是否在驱动中丢包。
@@ -1692,6 +2021,19 @@ enqueue:
 		 * 这里会触发软中断处理报文。
 		 * 注意：仅当新缓冲区添加到一个空的队列中时，netif_rx_schedule才会被调用。这是因为如果队列非空，NET_RX_SOFTIRQ已经被调度，没有必要再调度它了。
 		 */
+#ifdef CONFIG_RPS
+		/**
+		 * 其他CPU的backlog设备只能由那个CPU加入它的poll_list，
+		 * 这里只做标记，在net_rx_action结束时用IPI通知它。
+		 */
+		if (cpu != smp_processor_id()) {
+			if (netif_rx_schedule_prep(&queue->backlog_dev)) {
+				cpu_set(cpu, __get_cpu_var(softnet_data).rps_ipi_mask);
+				__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+			}
+			goto enqueue;
+		}
+#endif
 		netif_rx_schedule(&queue->backlog_dev);
 		goto enqueue;
 	}
@@ -1710,6 +2052,7 @@ drop:
 	 * 设置丢包数并退出。
 	 */
 	__get_cpu_var(netdev_rx_stat).dropped++;
+	rps_unlock(queue);
 	local_irq_restore(flags);
 
 	/**
@@ -1719,6 +2062,61 @@ drop:
 	return NET_RX_DROP;
 }
 
+/**
+ *	netif_rx	-	post buffer to the network code
+ *	@skb: buffer to post
+ *
+ *	This function receives a packet from a device driver and queues it for
+ *	the upper (protocol) levels to process.  It always succeeds. The buffer
+ *	may be dropped during processing for congestion control or by the
+ *	protocol layers.
+ *
+ *	return values:
+ *	NET_RX_SUCCESS	(no congestion)
+ *	NET_RX_CN_LOW   (low congestion)
+ *	NET_RX_CN_MOD   (moderate congestion)
+ *	NET_RX_CN_HIGH  (high congestion)
+ *	NET_RX_DROP     (packet was dropped)
+ *
+ */
+/**
+ * 在中断中处理多个帧的方法。用于非NAPI驱动。一般运行在中断上下文。
+ * 		skb:	接收到的缓冲区。
+ * 返回值:		拥塞级别。
+ */
+int netif_rx(struct sk_buff *skb)
+{
+	int cpu = -1;
+
+#ifdef CONFIG_NETPOLL
+	/**
+	 * 如果netpoll截获此包，则退出。
+	 */
+	if (skb->dev->netpoll_rx && netpoll_rx(skb)) {
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+#endif
+	/**
+	 * 还没有设置包的接收时间，则设置它。
+	 */
+	if (!skb->stamp.tv_sec)
+		/**
+		 * net_enable_timestamp表示对有人对时间戳感兴趣，只有这样，才更新stamp。
+		 * 这是在net_timestamp中判断的。
+		 * 驱动中设置的时间，是针对设备的，并且保存的是tick.
+		 */
+		net_timestamp(&skb->stamp);
+
+#ifdef CONFIG_RPS
+	/**
+	 * 配置了RPS的设备，按流的哈希选择处理包的CPU。
+	 */
+	cpu = get_rps_cpu(skb->dev, skb);
+#endif
+	return enqueue_to_backlog(skb, cpu);
+}
+
 /**
  * netif_rx的姊妹函数，它被用于非中断上下文。大多数情况下，它由TUN驱动使用。
  */
@@ -1818,6 +2216,33 @@ static void net_tx_action(struct softirq_action *h)
 			}
 		}
 	}
+
+	/**
+	 * 多队列设备的发送队列，处理方法同上。
+	 */
+	if (sd->output_txq) {
+		struct netdev_queue *head;
+
+		local_irq_disable();
+		head = sd->output_txq;
+		sd->output_txq = NULL;
+		local_irq_enable();
+
+		while (head) {
+			struct netdev_queue *txq = head;
+			head = head->next_sched;
+
+			smp_mb__before_clear_bit();
+			clear_bit(__QUEUE_STATE_SCHED, &txq->state);
+
+			if (spin_trylock(&txq->lock)) {
+				qdisc_run_queue(txq);
+				spin_unlock(&txq->lock);
+			} else {
+				netif_schedule_queue(txq);
+			}
+		}
+	}
 }
 
 static __inline__ int deliver_skb(struct sk_buff *skb,
@@ -1922,6 +2347,18 @@ int netif_receive_skb(struct sk_buff *skb)
 	if (!skb->stamp.tv_sec)
 		net_timestamp(&skb->stamp);
 
+#ifdef CONFIG_RPS
+	/**
+	 * 配置了RPS时，包可能被转到其他CPU的backlog上，由那个CPU再次调用本函数处理。
+	 */
+	{
+		int cpu = get_rps_cpu(skb->dev, skb);
+
+		if (cpu >= 0)
+			return enqueue_to_backlog(skb, cpu);
+	}
+#endif
+
 	/**
 	 * 绑定功能允许一组网卡能够被组合在一起，并被当成一个单一的网卡进行处理。
 	 * 如果接收帧的网卡属于这样的组，sk_buff数据结构中的接口必须必须在netif_receive_skb分发包到L3层处理接口前变成组设备。
@@ -2038,6 +2475,148 @@ out:
 	return ret;
 }
 
+/*
+ * Hand a skb that sat on the gro_list to the stack, after letting the
+ * protocol fix up the headers of a merged one.
+ */
+static int netif_gro_complete(struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	int type = skb->protocol;
+	int err = -ENOENT;
+
+	if (NAPI_GRO_CB(skb)->count == 1)
+		goto out;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type) & 15], list) {
+		if (ptype->type == type && !ptype->dev && ptype->gro_complete) {
+			err = ptype->gro_complete(skb);
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (err) {
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+
+out:
+	__get_cpu_var(netdev_rx_stat).gro_flushed++;
+	memset(skb->cb, 0, sizeof(skb->cb));
+	return netif_receive_skb(skb);
+}
+
+/*
+ * Deliver everything held for merging on this CPU.  Called at the end
+ * of every net_rx_action() run, so nothing waits longer than one
+ * softirq worth of packets.
+ */
+static void netif_gro_flush(struct softnet_data *queue)
+{
+	struct sk_buff *skb, *next;
+
+	for (skb = queue->gro_list; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		netif_gro_complete(skb);
+	}
+
+	queue->gro_list = NULL;
+	queue->gro_count = 0;
+}
+
+/**
+ *	netif_gro_receive - merge a received buffer with its flow, or pass it up
+ *	@skb: buffer to process
+ *
+ *	Drop-in replacement for netif_receive_skb() in NAPI poll routines.
+ *	Consecutive TCP segments of one flow are chained onto the frag_list
+ *	of the first one and go up the stack as a single skb, once per flow
+ *	and net_rx_action() run, or earlier when the flow sends something
+ *	that can't be merged.  Everything else is passed straight on.
+ *	Must be called from the NET_RX softirq.
+ */
+int netif_gro_receive(struct sk_buff *skb)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+	struct sk_buff **pp = NULL;
+	struct packet_type *ptype;
+	struct sk_buff *p;
+	int type = skb->protocol;
+	int mac_len;
+	int found = 0;
+
+	if (!(skb->dev->features & NETIF_F_GRO) || skb->dev->br_port ||
+	    skb_shinfo(skb)->frag_list || skb_cloned(skb))
+		goto normal;
+#ifdef CONFIG_NETPOLL
+	if (skb->dev->netpoll_rx)
+		goto normal;
+#endif
+
+	skb->nh.raw = skb->data;
+	mac_len = skb->nh.raw - skb->mac.raw;
+	skb->mac_len = mac_len;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type) & 15], list) {
+		if (ptype->type != type || ptype->dev || !ptype->gro_receive)
+			continue;
+
+		NAPI_GRO_CB(skb)->count = 1;
+		NAPI_GRO_CB(skb)->same_flow = 0;
+		NAPI_GRO_CB(skb)->flush = 0;
+		NAPI_GRO_CB(skb)->last = skb;
+
+		for (p = queue->gro_list; p; p = p->next) {
+			NAPI_GRO_CB(p)->same_flow = p->dev == skb->dev &&
+				p->mac_len == mac_len &&
+				!memcmp(p->mac.raw, skb->mac.raw, mac_len);
+			NAPI_GRO_CB(p)->flush = 0;
+		}
+
+		pp = ptype->gro_receive(&queue->gro_list, skb);
+		found = 1;
+		break;
+	}
+	rcu_read_unlock();
+
+	if (!found)
+		goto normal;
+
+	if (pp) {
+		struct sk_buff *nskb = *pp;
+
+		*pp = nskb->next;
+		nskb->next = NULL;
+		queue->gro_count--;
+		netif_gro_complete(nskb);
+	}
+
+	if (NAPI_GRO_CB(skb)->same_flow) {
+		__get_cpu_var(netdev_rx_stat).gro_merged++;
+		return NET_RX_SUCCESS;
+	}
+
+	if (NAPI_GRO_CB(skb)->flush || queue->gro_count >= MAX_GRO_SKBS)
+		goto normal;
+
+	queue->gro_count++;
+	skb->next = queue->gro_list;
+	queue->gro_list = skb;
+	return NET_RX_SUCCESS;
+
+normal:
+	/*
+	 * The gro_receive handlers may have left NAPI_GRO_CB() state in
+	 * cb, and the layers above expect to find it clear.
+	 */
+	memset(skb->cb, 0, sizeof(skb->cb));
+	return netif_receive_skb(skb);
+}
+
 /**
  * 在NAPI架构下，一些旧设备驱动不支持NAPI，仍然将入包放到每CPU多设备共享输入队列中。
  * process_backlog函数作为默认的poll函数，处理共享输入队列中的包。
@@ -2068,17 +2647,20 @@ static int process_backlog(struct net_device *backlog_dev, int *budget)
 		/**
 		 * 取出待处理的包。
 		 */
+		rps_lock(queue);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
 		if (!skb)
 			goto job_done;
+		rps_unlock(queue);
 		local_irq_enable();
 
 		dev = skb->dev;
 
 		/**
 		 * 处理帧的主函数，不论是NAPI还是非NAPI，都会调用此函数将包传递给上层协议栈处理。
+		 * 同一个流中连续的TCP段先由GRO合并，在net_rx_action结束时再送往协议栈。
 		 */
-		netif_receive_skb(skb);
+		netif_gro_receive(skb);
 
 		dev_put(dev);
 
@@ -2115,6 +2697,7 @@ job_done:
 	 */
 	if (queue->throttle)
 		queue->throttle = 0;
+	rps_unlock(queue);
 	local_irq_enable();
 	return 0;
 }
@@ -2187,6 +2770,16 @@ static void net_rx_action(struct softirq_action *h)
 	}
 out:
 	local_irq_enable();
+	/**
+	 * 把GRO暂存的包全部送往协议栈。
+	 */
+	netif_gro_flush(queue);
+#ifdef CONFIG_RPS
+	/**
+	 * 通知接收了本CPU转交的包的其他CPU。
+	 */
+	net_rps_action(queue);
+#endif
 	return;
 
 softnet_break:
@@ -2201,6 +2794,112 @@ softnet_break:
 	goto out;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * Busy polling.  A reader of a socket with SO_BUSY_POLL set spins here
+ * for up to sk_ll_usec microseconds before it goes to sleep, driving the
+ * receive path of the device that last fed the socket itself.  That
+ * saves the wakeup and, when the device is already scheduled on this
+ * CPU, the wait for the softirq to get around to it.
+ *
+ * dev->poll() must only run on the CPU whose poll_list the device sits
+ * on, so we call it only when that is ours, and with bottom halves off
+ * so net_rx_action() can't run it under us.  A device that is idle or
+ * scheduled elsewhere is left to its interrupt; if that comes in on
+ * this CPU, the softirq runs as the interrupt returns and the data is
+ * on the socket without anyone having to be woken.
+ */
+unsigned int sysctl_net_busy_read;
+
+#define BUSY_POLL_BUDGET	8
+
+static int busy_poll_dev(struct softnet_data *queue, struct net_device *dev)
+{
+	struct net_device *d;
+	int budget = BUSY_POLL_BUDGET;
+
+	local_irq_disable();
+	list_for_each_entry(d, &queue->poll_list, poll_list) {
+		if (d == dev)
+			goto found;
+	}
+	local_irq_enable();
+	return 0;
+
+found:
+	local_irq_enable();
+	if (dev->quota <= 0 || dev->poll(dev, &budget)) {
+		/* Still scheduled here, net_rx_action() will carry on */
+		local_irq_disable();
+		if (dev->quota < 0)
+			dev->quota += dev->weight;
+		else if (dev->quota == 0)
+			dev->quota = dev->weight;
+		local_irq_enable();
+	} else {
+		/* Drop the reference __netif_rx_schedule() took */
+		dev_put(dev);
+	}
+
+	return BUSY_POLL_BUDGET - budget;
+}
+
+/**
+ *	sk_busy_loop - busy poll for data before sleeping on a socket
+ *	@sk: socket to wait for
+ *	@nonblock: poll once instead of spinning
+ *
+ *	Returns non-zero if the receive queue of @sk is not empty anymore.
+ *	Must be called from process context without the socket locked,
+ *	so that packets are queued to it and not to its backlog.
+ */
+int sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long long end_time;
+	struct net_device *dev;
+	int found;
+
+	dev = dev_get_by_index(sk->sk_napi_ifindex);
+	if (!dev)
+		return 0;
+
+	end_time = sched_clock() + (unsigned long long)sk->sk_ll_usec * 1000;
+	get_cpu_var(netdev_rx_stat).busy_poll++;
+	put_cpu_var(netdev_rx_stat);
+
+	do {
+		struct softnet_data *queue;
+		int work = 0;
+
+		local_bh_disable();
+		queue = &__get_cpu_var(softnet_data);
+		if (dev->poll)
+			work = busy_poll_dev(queue, dev);
+		if (work) {
+			__get_cpu_var(netdev_rx_stat).busy_poll_packets += work;
+			netif_gro_flush(queue);
+#ifdef CONFIG_RPS
+			net_rps_action(queue);
+#endif
+		}
+		local_bh_enable();
+
+		found = !skb_queue_empty(&sk->sk_receive_queue);
+		if (found)
+			break;
+		cpu_relax();
+	} while (!nonblock && !need_resched() && !signal_pending(current) &&
+		 sched_clock() < end_time);
+
+	if (found) {
+		get_cpu_var(netdev_rx_stat).busy_poll_hit++;
+		put_cpu_var(netdev_rx_stat);
+	}
+	dev_put(dev);
+	return found;
+}
+#endif
+
 static gifconf_func_t * gifconf_list [NPROTO];
 
 /**
@@ -2423,15 +3122,18 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct netif_rx_stats *s = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   s->total, s->dropped, s->time_squeeze, s->throttled,
 		   s->fastroute_hit, s->fastroute_success, s->fastroute_defer,
 		   s->fastroute_deferred_out,
 #if 0
-		   s->fastroute_latency_reduction
+		   s->fastroute_latency_reduction,
 #else
-		   s->cpu_collision
+		   s->cpu_collision,
 #endif
+		   s->gro_merged, s->gro_flushed,
+		   s->rps_steered, s->rps_ipi,
+		   s->busy_poll, s->busy_poll_hit, s->busy_poll_packets
 		  );
 	return 0;
 }
@@ -3088,6 +3790,40 @@ static inline void net_set_todo(struct net_device *dev)
 	spin_unlock(&net_todo_list_lock);
 }
 
+/*
+ * A driver with several hardware transmit rings sets dev->num_tx_queues
+ * before registering the device; give it a struct netdev_queue per ring.
+ */
+static int netdev_alloc_tx_queues(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (dev->num_tx_queues <= 1) {
+		dev->num_tx_queues = 1;
+		return 0;
+	}
+	if (dev->num_tx_queues > 0xffff)
+		return -EINVAL;
+
+	dev->tx_queues = kmalloc(dev->num_tx_queues * sizeof(struct netdev_queue),
+				 GFP_KERNEL);
+	if (!dev->tx_queues)
+		return -ENOMEM;
+	memset(dev->tx_queues, 0,
+	       dev->num_tx_queues * sizeof(struct netdev_queue));
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = &dev->tx_queues[i];
+
+		spin_lock_init(&txq->lock);
+		spin_lock_init(&txq->xmit_lock);
+		txq->xmit_lock_owner = -1;
+		txq->dev = dev;
+		txq->index = i;
+	}
+	return 0;
+}
+
 /**
  *	register_netdevice	- register a network device
  *	@dev: device to register
@@ -3198,6 +3934,18 @@ int register_netdevice(struct net_device *dev)
 		dev->features &= ~NETIF_F_TSO;
 	}
 
+	/*
+	 * Software GSO costs nothing for packets that are already small
+	 * and saves a trip through the stack for every other one, so
+	 * every device gets it.  GRO is left to the drivers that feed
+	 * netif_gro_receive() to turn on.
+	 */
+	dev->features |= NETIF_F_GSO;
+
+	ret = netdev_alloc_tx_queues(dev);
+	if (ret)
+		goto out_err;
+
 	/*
 	 *	nil rebuild_header routine,
 	 *	that should be never called and used as just bug trap.
@@ -3689,6 +4437,7 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 {
 	struct sk_buff **list_skb;
 	struct net_device **list_net;
+	struct netdev_queue **list_txq;
 	struct sk_buff *skb;
 	unsigned int cpu, oldcpu = (unsigned long)ocpu;
 	struct softnet_data *sd, *oldsd;
@@ -3717,11 +4466,17 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	*list_net = oldsd->output_queue;
 	oldsd->output_queue = NULL;
 
+	list_txq = &sd->output_txq;
+	while (*list_txq)
+		list_txq = &(*list_txq)->next_sched;
+	*list_txq = oldsd->output_txq;
+	oldsd->output_txq = NULL;
+
 	raise_softirq_irqoff(NET_TX_SOFTIRQ);
 	local_irq_enable();
 
 	/* Process offline CPU's input_pkt_queue */
-	while ((skb = __skb_dequeue(&oldsd->input_pkt_queue)))
+	while ((skb = skb_dequeue(&oldsd->input_pkt_queue)))
 		netif_rx(skb);
 
 	return NOTIFY_OK;
@@ -3754,6 +4509,10 @@ static int __init net_dev_init(void)
 	 * net_random_init初始化每个cpu的种子数组，这些数组在 net_random 生成随机数时使用。
 	 */
 	net_random_init();
+#ifdef CONFIG_RPS
+	get_random_bytes(&rps_hashrnd, sizeof(rps_hashrnd));
+#endif
+	get_random_bytes(&dev_tx_hashrnd, sizeof(dev_tx_hashrnd));
 
 	/**
 	 * 如果内核编译选项中包含了/proc文件系统（这是缺省配置），dev_proc_init和dev_mcast_init就会在/proc目录下增加一些文件
@@ -3859,6 +4618,16 @@ EXPORT_SYMBOL(dev_get_by_name);
 EXPORT_SYMBOL(dev_ioctl);
 EXPORT_SYMBOL(dev_open);
 EXPORT_SYMBOL(dev_queue_xmit);
+EXPORT_SYMBOL(dev_hard_start_xmit);
+EXPORT_SYMBOL(skb_gso_segment);
+EXPORT_SYMBOL(netif_gro_receive);
+#ifdef CONFIG_RPS
+EXPORT_SYMBOL(rps_hashrnd);
+EXPORT_SYMBOL(rps_sock_flow_table);
+#endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+EXPORT_SYMBOL(sk_busy_loop);
+#endif
 EXPORT_SYMBOL(dev_remove_pack);
 EXPORT_SYMBOL(dev_set_allmulti);
 EXPORT_SYMBOL(dev_set_promiscuity);
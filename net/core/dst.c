@@ -238,7 +238,7 @@ again:
 	if (dst) {
 		if (atomic_dec_and_test(&dst->__refcnt)) {
 			/* We were real parent of this dst, so kill child. */
-			if (dst->flags&DST_NOHASH)
+			if (dst->flags&(DST_NOHASH|DST_NOCACHE))
 				goto again;
 		} else {
 			/* Child is still referenced, return it for freeing. */
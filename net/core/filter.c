@@ -318,6 +318,61 @@ load_b:
 	return 0;
 }
 
+#ifdef CONFIG_BPF_JIT
+int bpf_jit_enable;
+
+/**
+ *	sk_filter_load	-	slow path of a compiled filter's loads
+ *	@skb: buffer the filter runs on
+ *	@k: offset, as sk_run_filter() computes it
+ *	@size: 4, 2 or 1 bytes
+ *	@val: where to put the value loaded
+ *
+ * Compiled filters load from the linear data themselves and call this
+ * for everything else: negative offsets, ancillary data and data past
+ * the linear part.  Returns 0 where sk_run_filter() would return 0.
+ */
+asmlinkage int sk_filter_load(const struct sk_buff *skb, int k,
+			      unsigned int size, u32 *val)
+{
+	u8 *ptr;
+
+	if (k < 0) {
+		if (k >= SKF_AD_OFF) {
+			switch (k-SKF_AD_OFF) {
+			case SKF_AD_PROTOCOL:
+				*val = htons(skb->protocol);
+				return 1;
+			case SKF_AD_PKTTYPE:
+				*val = skb->pkt_type;
+				return 1;
+			case SKF_AD_IFINDEX:
+				*val = skb->dev->ifindex;
+				return 1;
+			}
+			return 0;
+		}
+		ptr = load_pointer((struct sk_buff *)skb, k);
+	} else {
+		u32 _tmp;
+
+		ptr = skb_header_pointer((struct sk_buff *)skb, k, size,
+					 &_tmp);
+		if (ptr == (u8 *)&_tmp) {
+			*val = size == 4 ? ntohl(_tmp) :
+			       size == 2 ? ntohs(*(u16 *)&_tmp) : *(u8 *)&_tmp;
+			return 1;
+		}
+	}
+	if (!ptr)
+		return 0;
+
+	*val = size == 4 ? ntohl(*(u32 *)ptr) :
+	       size == 2 ? ntohs(*(u16 *)ptr) : *ptr;
+	return 1;
+}
+#endif
+
 /**
  *	sk_chk_filter - verify socket filter code
  *	@filter: filter to verify
@@ -411,11 +466,17 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+	fp->bpf_func = NULL;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (!err) {
 		struct sk_filter *old_fp;
 
+#ifdef CONFIG_BPF_JIT
+		if (bpf_jit_enable)
+			bpf_jit_compile(fp);
+#endif
+
 		spin_lock_bh(&sk->sk_lock.slock);
 		old_fp = sk->sk_filter;
 		sk->sk_filter = fp;
@@ -16,6 +16,7 @@
 #include <net/sock.h>
 #include <linux/rtnetlink.h>
 #include <linux/wireless.h>
+#include <asm/uaccess.h>
 
 #define to_class_dev(obj) container_of(obj,struct class_device,kobj)
 #define to_net_dev(class) container_of(class, struct net_device, class_dev)
@@ -184,6 +185,82 @@ static ssize_t store_tx_queue_len(struct class_device *dev, const char *buf, siz
 static CLASS_DEVICE_ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len, 
 			 store_tx_queue_len);
 
+#ifdef CONFIG_RPS
+static ssize_t show_rps_cpus(struct class_device *dev, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map;
+	cpumask_t mask = CPU_MASK_NONE;
+	int i, len;
+
+	rcu_read_lock();
+	map = rcu_dereference(net->rps_map);
+	if (map)
+		for (i = 0; i < map->len; i++)
+			cpu_set(map->cpus[i], mask);
+	rcu_read_unlock();
+
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 1, mask);
+	buf[len++] = '\n';
+	return len;
+}
+
+static void rps_map_release(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct rps_map, rcu));
+}
+
+static ssize_t store_rps_cpus(struct class_device *dev, const char *buf,
+			      size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map = NULL, *old_map;
+	cpumask_t mask;
+	mm_segment_t oldfs;
+	int cpu, i, err;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	oldfs = get_fs();
+	set_fs(KERNEL_DS);
+	err = cpumask_parse((const char __user *)buf, len, mask);
+	set_fs(oldfs);
+	if (err)
+		return err;
+
+	/* CPUs that are offline are skipped when steering */
+	cpus_and(mask, mask, cpu_possible_map);
+	if (!cpus_empty(mask)) {
+		map = kmalloc(RPS_MAP_SIZE(cpus_weight(mask)), GFP_KERNEL);
+		if (!map)
+			return -ENOMEM;
+		i = 0;
+		for_each_cpu_mask(cpu, mask)
+			map->cpus[i++] = cpu;
+		map->len = i;
+	}
+
+	rtnl_lock();
+	if (!dev_isalive(net)) {
+		rtnl_unlock();
+		kfree(map);
+		return -EINVAL;
+	}
+	old_map = net->rps_map;
+	rcu_assign_pointer(net->rps_map, map);
+	rtnl_unlock();
+
+	if (old_map)
+		call_rcu(&old_map->rcu, rps_map_release);
+
+	return len;
+}
+
+static CLASS_DEVICE_ATTR(rps_cpus, S_IRUGO | S_IWUSR, show_rps_cpus,
+			 store_rps_cpus);
+#endif
+
 
 static struct class_device_attribute *net_class_attributes[] = {
 	&class_device_attr_ifindex,
@@ -197,6 +274,9 @@ static struct class_device_attribute *net_class_attributes[] = {
 	&class_device_attr_address,
 	&class_device_attr_broadcast,
 	&class_device_attr_carrier,
+#ifdef CONFIG_RPS
+	&class_device_attr_rps_cpus,
+#endif
 	NULL
 };
 
@@ -383,6 +463,10 @@ static void netdev_release(struct class_device *cd)
 
 	BUG_ON(dev->reg_state != NETREG_RELEASED);
 
+#ifdef CONFIG_RPS
+	kfree(dev->rps_map);
+#endif
+	kfree(dev->tx_queues);
 	kfree((char *)dev - dev->padded);
 }
 
@@ -176,7 +176,9 @@ struct sk_buff *alloc_skb(unsigned int size, int gfp_mask)
 	skb_shinfo(skb)->nr_frags  = 0;
 	skb_shinfo(skb)->tso_size = 0;
 	skb_shinfo(skb)->tso_segs = 0;
+	skb_shinfo(skb)->gso_type = 0;
 	skb_shinfo(skb)->frag_list = NULL;
+	skb_shinfo(skb)->destructor_arg = NULL;
 out:
 	return skb;
 nodata:
@@ -229,7 +231,9 @@ struct sk_buff *alloc_skb_from_cache(kmem_cache_t *cp,
 	skb_shinfo(skb)->nr_frags  = 0;
 	skb_shinfo(skb)->tso_size = 0;
 	skb_shinfo(skb)->tso_segs = 0;
+	skb_shinfo(skb)->gso_type = 0;
 	skb_shinfo(skb)->frag_list = NULL;
+	skb_shinfo(skb)->destructor_arg = NULL;
 out:
 	return skb;
 nodata:
@@ -404,6 +408,7 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int gfp_mask)
 	C(ip_summed);
 	C(priority);
 	C(protocol);
+	C(queue_mapping);
 	C(security);
 	n->destructor = NULL;
 #ifdef CONFIG_NETFILTER
@@ -456,26 +461,23 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int gfp_mask)
 	return n;
 }
 
-static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
+/*
+ * Copy the per-packet state that goes with the data, but none of the
+ * data pointers: shared by full copies and by skb_segment().
+ */
+static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 {
-	/*
-	 *	Shift between the two data areas in bytes
-	 */
-	unsigned long offset = new->data - old->data;
-
 	new->list	= NULL;
 	new->sk		= NULL;
 	new->dev	= old->dev;
 	new->real_dev	= old->real_dev;
 	new->priority	= old->priority;
 	new->protocol	= old->protocol;
+	new->queue_mapping = old->queue_mapping;
 	new->dst	= dst_clone(old->dst);
 #ifdef CONFIG_INET
 	new->sp		= secpath_get(old->sp);
 #endif
-	new->h.raw	= old->h.raw + offset;
-	new->nh.raw	= old->nh.raw + offset;
-	new->mac.raw	= old->mac.raw + offset;
 	memcpy(new->cb, old->cb, sizeof(old->cb));
 	new->local_df	= old->local_df;
 	new->pkt_type	= old->pkt_type;
@@ -502,9 +504,23 @@ static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 #endif
 	new->tc_index	= old->tc_index;
 #endif
+}
+
+static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
+{
+	/*
+	 *	Shift between the two data areas in bytes
+	 */
+	unsigned long offset = new->data - old->data;
+
+	__copy_skb_header(new, old);
+	new->h.raw	= old->h.raw + offset;
+	new->nh.raw	= old->nh.raw + offset;
+	new->mac.raw	= old->mac.raw + offset;
 	atomic_set(&new->users, 1);
 	skb_shinfo(new)->tso_size = skb_shinfo(old)->tso_size;
 	skb_shinfo(new)->tso_segs = skb_shinfo(old)->tso_segs;
+	skb_shinfo(new)->gso_type = skb_shinfo(old)->gso_type;
 }
 
 /**
@@ -1562,6 +1578,220 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 		skb_split_no_header(skb, skb1, len, pos);
 }
 
+/**
+ *	skb_append_datato_frags - append user data to the page frags of a skb
+ *	@sk: sock the data is sent on, charged for the pages
+ *	@skb: buffer to append to
+ *	@getfrag: copy routine, as for ip_append_data()
+ *	@from: opaque cookie handed to @getfrag
+ *	@length: number of bytes to append
+ *
+ *	Used to build a single large datagram that is only cut into wire
+ *	sized pieces just before the device.  Each chunk is copied into a
+ *	fresh page; on failure the caller frees the skb together with the
+ *	pages already attached.
+ */
+int skb_append_datato_frags(struct sock *sk, struct sk_buff *skb,
+			int (*getfrag)(void *from, char *to, int offset,
+				       int len, int odd, struct sk_buff *skb),
+			void *from, int length)
+{
+	int offset = 0;
+
+	while (length > 0) {
+		int i = skb_shinfo(skb)->nr_frags;
+		struct page *page;
+		int copy;
+
+		if (i >= MAX_SKB_FRAGS)
+			return -EMSGSIZE;
+
+		page = alloc_pages(sk->sk_allocation, 0);
+		if (!page)
+			return -ENOMEM;
+
+		copy = min_t(int, length, PAGE_SIZE);
+		skb_fill_page_desc(skb, i, page, 0, 0);
+		skb->truesize += PAGE_SIZE;
+		atomic_add(PAGE_SIZE, &sk->sk_wmem_alloc);
+
+		if (getfrag(from, page_address(page), offset, copy,
+			    skb->len, skb) < 0)
+			return -EFAULT;
+
+		skb_shinfo(skb)->frags[i].size = copy;
+		skb->len += copy;
+		skb->data_len += copy;
+		offset += copy;
+		length -= copy;
+	}
+
+	return 0;
+}
+
+/**
+ *	skb_segment - Perform protocol segmentation on skb.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	Cuts the payload behind skb->data into tso_size sized pieces and
+ *	returns them as a list chained through ->next.  Every segment gets
+ *	its own copy of the headers in front of skb->data, which the
+ *	protocol handlers then fix up.  Page frags are shared with the
+ *	original if the output path does scatter/gather and @skb has no
+ *	frag_list; otherwise the data is copied and the checksum of the
+ *	copied part left in ->csum.
+ *	Returns an ERR_PTR() on failure.
+ */
+struct sk_buff *skb_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = NULL;
+	struct sk_buff *tail = NULL;
+	unsigned int mss = skb_shinfo(skb)->tso_size;
+	unsigned int doffset = skb->data - skb->mac.raw;
+	unsigned int offset = doffset;
+	unsigned int headroom;
+	unsigned int len;
+	int sg = features & NETIF_F_SG;
+	int nfrags = skb_shinfo(skb)->nr_frags;
+	int i = 0;
+	int pos;
+
+	/*
+	 * A GRO-merged skb keeps the segments it swallowed on its
+	 * frag_list, which the frag sharing loop below doesn't follow.
+	 * Copy those out instead, skb_copy_and_csum_bits() walks it.
+	 */
+	if (skb_shinfo(skb)->frag_list)
+		sg = 0;
+
+	__skb_push(skb, doffset);
+	headroom = skb_headroom(skb);
+	pos = skb_headlen(skb);
+
+	do {
+		struct sk_buff *nskb;
+		skb_frag_t *frag;
+		int hsize, nsize;
+		int k;
+		int size;
+
+		len = skb->len - offset;
+		if (len > mss)
+			len = mss;
+
+		hsize = skb_headlen(skb) - offset;
+		if (hsize < 0)
+			hsize = 0;
+		nsize = hsize + doffset;
+		if (nsize > len + doffset || !sg)
+			nsize = len + doffset;
+
+		nskb = alloc_skb(nsize + headroom, GFP_ATOMIC);
+		if (unlikely(!nskb))
+			goto err;
+
+		if (segs)
+			tail->next = nskb;
+		else
+			segs = nskb;
+		tail = nskb;
+
+		__copy_skb_header(nskb, skb);
+		nskb->mac_len = skb->mac_len;
+
+		skb_reserve(nskb, headroom);
+		nskb->mac.raw = nskb->data;
+		nskb->nh.raw = nskb->data + (skb->nh.raw - skb->mac.raw);
+		nskb->h.raw = nskb->data + (skb->h.raw - skb->mac.raw);
+		memcpy(skb_put(nskb, doffset), skb->data, doffset);
+
+		if (!sg) {
+			nskb->csum = skb_copy_and_csum_bits(skb, offset,
+							    skb_put(nskb, len),
+							    len, 0);
+			continue;
+		}
+
+		frag = skb_shinfo(nskb)->frags;
+		k = 0;
+
+		nskb->ip_summed = skb->ip_summed;
+		nskb->csum = skb->csum;
+		memcpy(skb_put(nskb, hsize), skb->data + offset, hsize);
+
+		while (pos < offset + len) {
+			BUG_ON(i >= nfrags);
+
+			*frag = skb_shinfo(skb)->frags[i];
+			get_page(frag->page);
+			size = frag->size;
+
+			if (pos < offset) {
+				frag->page_offset += offset - pos;
+				frag->size -= offset - pos;
+			}
+
+			k++;
+
+			if (pos + size <= offset + len) {
+				i++;
+				pos += size;
+			} else {
+				frag->size -= pos + size - (offset + len);
+				break;
+			}
+
+			frag++;
+		}
+
+		skb_shinfo(nskb)->nr_frags = k;
+		nskb->data_len = len - hsize;
+		nskb->len += nskb->data_len;
+		nskb->truesize += nskb->data_len;
+	} while ((offset += len) < skb->len);
+
+	__skb_pull(skb, doffset);
+	return segs;
+
+err:
+	__skb_pull(skb, doffset);
+	while ((tail = segs)) {
+		segs = tail->next;
+		kfree_skb(tail);
+	}
+	return ERR_PTR(-ENOMEM);
+}
+
+/**
+ *	skb_gro_receive - chain a received segment onto a held skb
+ *	@p: skb held by GRO, whose headers will describe the merged whole
+ *	@skb: next segment of the same flow, skb->data at its payload
+ *
+ *	The payload of @skb is appended to @p through its frag_list and
+ *	@skb is owned by @p from then on.  Returns -E2BIG if the result
+ *	would not fit in one IP datagram.
+ */
+int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
+{
+	if (p->len + skb->len > 65535)
+		return -E2BIG;
+
+	if (!skb_shinfo(p)->frag_list)
+		skb_shinfo(p)->frag_list = skb;
+	else
+		NAPI_GRO_CB(p)->last->next = skb;
+	NAPI_GRO_CB(p)->last = skb;
+	NAPI_GRO_CB(p)->count++;
+
+	p->data_len += skb->len;
+	p->truesize += skb->truesize;
+	p->len += skb->len;
+
+	NAPI_GRO_CB(skb)->same_flow = 1;
+	return 0;
+}
+
 /**
  * 初始化sk_buff缓冲区。
  */
@@ -1603,6 +1833,9 @@ EXPORT_SYMBOL(skb_queue_tail);
 EXPORT_SYMBOL(skb_unlink);
 EXPORT_SYMBOL(skb_append);
 EXPORT_SYMBOL(skb_split);
+EXPORT_SYMBOL_GPL(skb_segment);
+EXPORT_SYMBOL_GPL(skb_gro_receive);
+EXPORT_SYMBOL_GPL(skb_append_datato_frags);
 EXPORT_SYMBOL(skb_iter_first);
 EXPORT_SYMBOL(skb_iter_next);
 EXPORT_SYMBOL(skb_iter_abort);
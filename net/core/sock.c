@@ -110,6 +110,7 @@
 #include <linux/poll.h>
 #include <linux/tcp.h>
 #include <linux/init.h>
+#include <linux/random.h>
 
 #include <asm/uaccess.h>
 #include <asm/system.h>
@@ -118,6 +119,7 @@
 #include <net/protocol.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
+#include <net/busy_poll.h>
 #include <net/xfrm.h>
 #include <linux/ipsec.h>
 
@@ -249,6 +251,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 		case SO_REUSEADDR:
 			sk->sk_reuse = valbool;
 			break;
+		case SO_REUSEPORT:
+			sk->sk_reuseport = valbool;
+			break;
 		case SO_TYPE:
 		case SO_ERROR:
 			ret = -ENOPROTOOPT;
@@ -367,6 +372,18 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 			ret = sock_set_timeout(&sk->sk_rcvtimeo, optval, optlen);
 			break;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		case SO_BUSY_POLL:
+			/* Spinning costs CPU time, only lowering it is free */
+			if (val < 0)
+				ret = -EINVAL;
+			else if (val > sk->sk_ll_usec && !capable(CAP_NET_ADMIN))
+				ret = -EPERM;
+			else
+				sk->sk_ll_usec = val;
+			break;
+#endif
+
 		case SO_SNDTIMEO:
 			ret = sock_set_timeout(&sk->sk_sndtimeo, optval, optlen);
 			break;
@@ -501,6 +518,10 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 			v.val = sk->sk_reuse;
 			break;
 
+		case SO_REUSEPORT:
+			v.val = sk->sk_reuseport;
+			break;
+
 		case SO_KEEPALIVE:
 			v.val = !!sock_flag(sk, SOCK_KEEPOPEN);
 			break;
@@ -567,6 +588,12 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 			v.val = sk->sk_rcvlowat;
 			break;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		case SO_BUSY_POLL:
+			v.val = sk->sk_ll_usec;
+			break;
+#endif
+
 		case SO_SNDLOWAT:
 			v.val=1;
 			break; 
@@ -647,8 +674,17 @@ struct sock *sk_alloc(int family, int priority, int zero_it, kmem_cache_t *slab)
 	sk = kmem_cache_alloc(slab, priority);
 	if (sk) {
 		if (zero_it) {/* 需要初始化它 */
-			memset(sk, 0,
-			       zero_it == 1 ? sizeof(struct sock) : zero_it);
+			int size = zero_it == 1 ? sizeof(struct sock) : zero_it;
+
+			/*
+			 * Don't clear sk_node.next: on SLAB_DESTROY_BY_RCU
+			 * caches a lockless reader may still walk through
+			 * this object and must never find a plain NULL.
+			 * An unhashed node's next is never looked at.
+			 */
+			memset(sk, 0, offsetof(struct sock, sk_node.next));
+			memset(&sk->sk_node.pprev, 0,
+			       size - offsetof(struct sock, sk_node.pprev));
 			sk->sk_family = family;
 			sock_lock_init(sk);
 		}
@@ -694,6 +730,8 @@ void sk_free(struct sock *sk)
 	module_put(owner);/* 递减模块引用计数 */
 }
 
+u32 sk_reuseport_hashrnd;
+
 void __init sk_init(void)
 {
 	sk_cachep = kmem_cache_create("sock", sizeof(struct sock), 0,
@@ -710,6 +748,8 @@ void __init sk_init(void)
 		sysctl_wmem_max = 131071;
 		sysctl_rmem_max = 131071;
 	}
+
+	get_random_bytes(&sk_reuseport_hashrnd, sizeof(sk_reuseport_hashrnd));
 }
 
 /*
@@ -1262,6 +1302,10 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 	sk->sk_rcvlowat		=	1;
 	sk->sk_rcvtimeo		=	MAX_SCHEDULE_TIMEOUT;
 	sk->sk_sndtimeo		=	MAX_SCHEDULE_TIMEOUT;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	sk->sk_ll_usec		=	sysctl_net_busy_read;
+	sk->sk_napi_ifindex	=	0;
+#endif
 	sk->sk_owner		=	NULL;
 
 	sk->sk_stamp.tv_sec     = -1L;
@@ -1414,7 +1458,8 @@ int sk_alloc_slab(struct proto *prot, char *name)
 {
 	prot->slab = kmem_cache_create(name,
 				       prot->slab_obj_size, 0,
-				       SLAB_HWCACHE_ALIGN, NULL, NULL);
+				       SLAB_HWCACHE_ALIGN | prot->slab_flags,
+				       NULL, NULL);
 
 	return prot->slab != NULL ? 0 : -ENOBUFS;
 }
@@ -1458,6 +1503,7 @@ EXPORT_SYMBOL(sock_setsockopt);
 EXPORT_SYMBOL(sock_wfree);
 EXPORT_SYMBOL(sock_wmalloc);
 EXPORT_SYMBOL(sock_i_uid);
+EXPORT_SYMBOL(sk_reuseport_hashrnd);
 EXPORT_SYMBOL(sock_i_ino);
 #ifdef CONFIG_SYSCTL
 EXPORT_SYMBOL(sysctl_optmem_max);
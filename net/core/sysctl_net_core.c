@@ -9,6 +9,9 @@
 #include <linux/sysctl.h>
 #include <linux/config.h>
 #include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/filter.h>
 
 #ifdef CONFIG_SYSCTL
 
@@ -31,6 +34,10 @@ extern int sysctl_core_destroy_delay;
 extern int sysctl_optmem_max;
 extern int sysctl_somaxconn;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+extern unsigned int sysctl_net_busy_read;
+#endif
+
 #ifdef CONFIG_NET_DIVERT
 extern char sysctl_divert_version[];
 #endif /* CONFIG_NET_DIVERT */
@@ -48,6 +55,64 @@ char *net_sysctl_strdup(const char *s)
 	return rv;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * Writing rps_sock_flow_entries replaces the flow table with an empty one
+ * of that many entries (rounded up to a power of two), 0 removes it.
+ */
+static int rps_sock_flow_sysctl(ctl_table *table, int write, struct file *filp,
+				void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	static DECLARE_MUTEX(sock_flow_sem);
+	struct rps_sock_flow_table *orig_sock_table, *sock_table;
+	unsigned int orig_size, size;
+	ctl_table tmp = {
+		.data = &size,
+		.maxlen = sizeof(size),
+		.mode = table->mode
+	};
+	int ret, i;
+
+	down(&sock_flow_sem);
+
+	orig_sock_table = rps_sock_flow_table;
+	size = orig_size = orig_sock_table ? orig_sock_table->mask + 1 : 0;
+
+	ret = proc_dointvec(&tmp, write, filp, buffer, lenp, ppos);
+	if (!write || ret)
+		goto out;
+
+	sock_table = NULL;
+	if (size) {
+		if (size > 1 << 24) {
+			ret = -EINVAL;
+			goto out;
+		}
+		size = roundup_pow_of_two(size);
+		sock_table = orig_sock_table;
+		if (size != orig_size) {
+			sock_table = vmalloc(RPS_SOCK_FLOW_TABLE_SIZE(size));
+			if (!sock_table) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			sock_table->mask = size - 1;
+		}
+		for (i = 0; i < size; i++)
+			sock_table->ents[i] = RPS_NO_CPU;
+	}
+
+	if (sock_table != orig_sock_table) {
+		rcu_assign_pointer(rps_sock_flow_table, sock_table);
+		synchronize_kernel();
+		vfree(orig_sock_table);
+	}
+out:
+	up(&sock_flow_sem);
+	return ret;
+}
+#endif
+
 ctl_table core_table[] = {
 #ifdef CONFIG_NET
 	{
@@ -155,6 +220,15 @@ ctl_table core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec
 	},
+#ifdef CONFIG_RPS
+	{
+		.ctl_name	= NET_CORE_RPS_SOCK_FLOW_ENTRIES,
+		.procname	= "rps_sock_flow_entries",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &rps_sock_flow_sysctl
+	},
+#endif
 #ifdef CONFIG_NET_DIVERT
 	{
 		.ctl_name	= NET_CORE_DIVERT_VERSION,
@@ -174,6 +248,26 @@ ctl_table core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec
 	},
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	{
+		.ctl_name	= NET_CORE_BUSY_READ,
+		.procname	= "busy_read",
+		.data		= &sysctl_net_busy_read,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
+#endif
+#ifdef CONFIG_BPF_JIT
+	{
+		.ctl_name	= NET_CORE_BPF_JIT_ENABLE,
+		.procname	= "bpf_jit_enable",
+		.data		= &bpf_jit_enable,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
+#endif
 	{ .ctl_name = 0 }
 };
 
@@ -699,11 +699,39 @@ int inet_getname(struct socket *sock, struct sockaddr *uaddr,
 	return 0;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * Remember the CPU a connected socket is used on, so that RPS steers
+ * its packets to the cache that will consume them.
+ */
+static inline void inet_rps_record_flow(struct sock *sk)
+{
+	struct rps_sock_flow_table *sock_table;
+
+	rcu_read_lock();
+	sock_table = rcu_dereference(rps_sock_flow_table);
+	if (sock_table && sk->sk_state == TCP_ESTABLISHED) {
+		struct inet_sock *inet = inet_sk(sk);
+
+		rps_record_sock_flow(sock_table,
+				     rps_flow_hash(inet->daddr, inet->rcv_saddr,
+						   inet->dport, inet->sport));
+	}
+	rcu_read_unlock();
+}
+#else
+static inline void inet_rps_record_flow(struct sock *sk)
+{
+}
+#endif
+
 int inet_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *msg,
 		 size_t size)
 {
 	struct sock *sk = sock->sk;
 
+	inet_rps_record_flow(sk);
+
 	/* We may need to bind the socket. */
 	if (!inet_sk(sk)->num && inet_autobind(sk))
 		return -EAGAIN;
@@ -711,6 +739,14 @@ int inet_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *msg,
 	return sk->sk_prot->sendmsg(iocb, sk, msg, size);
 }
 
+int inet_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *msg,
+		 size_t size, int flags)
+{
+	inet_rps_record_flow(sock->sk);
+
+	return sock_common_recvmsg(iocb, sock, msg, size, flags);
+}
+
 
 static ssize_t inet_sendpage(struct socket *sock, struct page *page, int offset, size_t size, int flags)
 {
@@ -855,9 +891,10 @@ struct proto_ops inet_stream_ops = {
 	.setsockopt =	sock_common_setsockopt,
 	.getsockopt =	sock_common_getsockopt,
 	.sendmsg =	inet_sendmsg,
-	.recvmsg =	sock_common_recvmsg,
+	.recvmsg =	inet_recvmsg,
 	.mmap =		sock_no_mmap,
-	.sendpage =	tcp_sendpage
+	.sendpage =	tcp_sendpage,
+	.sendpages =	tcp_sendpages
 };
 
 struct proto_ops inet_dgram_ops = {
@@ -876,7 +913,7 @@ struct proto_ops inet_dgram_ops = {
 	.setsockopt =	sock_common_setsockopt,
 	.getsockopt =	sock_common_getsockopt,
 	.sendmsg =	inet_sendmsg,
-	.recvmsg =	sock_common_recvmsg,
+	.recvmsg =	inet_recvmsg,
 	.mmap =		sock_no_mmap,
 	.sendpage =	inet_sendpage,
 };
@@ -901,7 +938,7 @@ static struct proto_ops inet_sockraw_ops = {
 	.setsockopt =	sock_common_setsockopt,
 	.getsockopt =	sock_common_getsockopt,
 	.sendmsg =	inet_sendmsg,
-	.recvmsg =	sock_common_recvmsg,
+	.recvmsg =	inet_recvmsg,
 	.mmap =		sock_no_mmap,
 	.sendpage =	inet_sendpage,
 };
@@ -1036,12 +1073,16 @@ static struct net_protocol igmp_protocol = {
 static struct net_protocol tcp_protocol = {
 	.handler =	tcp_v4_rcv,
 	.err_handler =	tcp_v4_err,
+	.gso_segment =	tcp_tso_segment,
+	.gro_receive =	tcp4_gro_receive,
+	.gro_complete =	tcp4_gro_complete,
 	.no_policy =	1,
 };
 
 static struct net_protocol udp_protocol = {
 	.handler =	udp_rcv,
 	.err_handler =	udp_err,
+	.gso_segment =	udp4_ufo_fragment,
 	.no_policy =	1,
 };
 
@@ -1106,6 +1147,9 @@ static int __init inet_init(void)
 		goto out_udp_free_slab;
 	}
 
+	/* The UDP hash must be usable before anything binds or delivers. */
+	udp_init();
+
 	/*
 	 *	Tell SOCKET that we are alive... 
 	 */
@@ -1248,6 +1292,7 @@ EXPORT_SYMBOL(inet_listen);
 EXPORT_SYMBOL(inet_register_protosw);
 EXPORT_SYMBOL(inet_release);
 EXPORT_SYMBOL(inet_sendmsg);
+EXPORT_SYMBOL(inet_recvmsg);
 EXPORT_SYMBOL(inet_shutdown);
 EXPORT_SYMBOL(inet_sock_destruct);
 EXPORT_SYMBOL(inet_stream_connect);
@@ -0,0 +1,127 @@
+/*
+ * FIB lookup benchmark.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Times tb_lookup() of one routing table with whatever FIB algorithm
+ * the kernel was built with (fib_hash or fib_trie), so the two can be
+ * compared on the same routing table.  Destinations are drawn at random
+ * before the clock starts; the results go to the kernel log:
+ *
+ *	modprobe fib_bench table=254 lookups=1000000 dests=65536
+ *
+ * Lookups are done in batches with bottom halves disabled, as they are
+ * on the receive path, and the CPU is given up between batches.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/time.h>
+#include <linux/vmalloc.h>
+#include <linux/interrupt.h>
+#include <linux/net.h>
+#include <linux/rtnetlink.h>
+#include <asm/timex.h>
+#include <asm/div64.h>
+
+#include <net/flow.h>
+#include <net/ip_fib.h>
+
+#define FIB_BENCH_BATCH	1024
+
+static int table = RT_TABLE_MAIN;
+static int lookups = 1000000;
+static int dests = 65536;
+
+module_param(table, int, 0);
+MODULE_PARM_DESC(table, "Routing table to look up in (default 254, main)");
+module_param(lookups, int, 0);
+MODULE_PARM_DESC(lookups, "Number of lookups to time");
+module_param(dests, int, 0);
+MODULE_PARM_DESC(dests, "Number of distinct random destinations");
+
+static int __init fib_bench_init(void)
+{
+	struct fib_table *tb;
+	struct timeval start, end;
+	unsigned long long cycles = 0, nsecs;
+	unsigned long usecs = 0;
+	unsigned int hits = 0;
+	u32 *dst;
+	int i, done;
+
+	if (table <= 0 || table > RT_TABLE_MAX || lookups <= 0 || dests <= 0)
+		return -EINVAL;
+
+	rtnl_lock();
+	tb = fib_get_table(table);
+	rtnl_unlock();
+	if (!tb) {
+		printk(KERN_INFO "fib_bench: no routing table %d\n", table);
+		return -ENOENT;
+	}
+
+	dst = vmalloc(dests * sizeof(u32));
+	if (!dst)
+		return -ENOMEM;
+	for (i = 0; i < dests; i++)
+		dst[i] = net_random();
+
+	for (done = 0; done < lookups; ) {
+		int n = min(lookups - done, FIB_BENCH_BATCH);
+		cycles_t c0, c1;
+
+		local_bh_disable();
+		do_gettimeofday(&start);
+		c0 = get_cycles();
+		for (i = 0; i < n; i++) {
+			struct flowi fl = { .nl_u = { .ip4_u =
+					    { .daddr = dst[(done + i) % dests],
+					      .scope = RT_SCOPE_UNIVERSE } } };
+			struct fib_result res;
+
+			memset(&res, 0, sizeof(res));
+			if (tb->tb_lookup(tb, &fl, &res) == 0) {
+				hits++;
+				fib_res_put(&res);
+			}
+		}
+		c1 = get_cycles();
+		do_gettimeofday(&end);
+		local_bh_enable();
+
+		cycles += c1 - c0;
+		usecs += (end.tv_sec - start.tv_sec) * USEC_PER_SEC +
+			 end.tv_usec - start.tv_usec;
+		done += n;
+		cond_resched();
+	}
+	vfree(dst);
+
+	nsecs = (unsigned long long)usecs * 1000;
+	do_div(nsecs, lookups);
+	do_div(cycles, lookups);
+
+	printk(KERN_INFO "fib_bench: table %d: %d lookups (%u hits) "
+	       "in %lu us, %lu ns/lookup, %llu cycles/lookup\n",
+	       table, lookups, hits, usecs, (unsigned long) nsecs, cycles);
+	return 0;
+}
+
+/*
+ * If an init function is provided, an exit function must also be provided
+ * to allow module unload.
+ */
+static void __exit fib_bench_exit(void) { }
+
+module_init(fib_bench_init);
+module_exit(fib_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IPv4 FIB lookup benchmark");
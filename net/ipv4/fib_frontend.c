@@ -716,3 +716,9 @@ void __init ip_fib_init(void)
 EXPORT_SYMBOL(inet_addr_type);
 EXPORT_SYMBOL(ip_dev_find);
 EXPORT_SYMBOL(ip_rt_ioctl);
+#ifndef CONFIG_IP_MULTIPLE_TABLES
+EXPORT_SYMBOL_GPL(ip_fib_local_table);
+EXPORT_SYMBOL_GPL(ip_fib_main_table);
+#else
+EXPORT_SYMBOL_GPL(fib_tables);
+#endif
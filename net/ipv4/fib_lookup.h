@@ -3,6 +3,7 @@
 
 #include <linux/types.h>
 #include <linux/list.h>
+#include <linux/rcupdate.h>
 #include <net/ip_fib.h>
 
 /**
@@ -38,6 +39,10 @@ struct fib_alias {
 	 * 一些标志的比特位图。只使用了一个标志:FA_S_ACCESSED。
 	 */
 	u8			fa_state;
+	/**
+	 * fib_trie的查找不加锁，删除的fib_alias要等RCU宽限期结束后才能释放。
+	 */
+	struct rcu_head		rcu;
 };
 
 #define FA_S_ACCESSED	0x01
@@ -16,6 +16,7 @@
  */
 
 #include <linux/config.h>
+#include <linux/module.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <linux/bitops.h>
@@ -171,6 +172,7 @@ void free_fib_info(struct fib_info *fi)
 		return;
 	}
 	change_nexthops(fi) {
+		rt_nexthop_flush(nh);
 		if (nh->nh_dev)
 			dev_put(nh->nh_dev);
 		nh->nh_dev = NULL;
@@ -178,6 +180,7 @@ void free_fib_info(struct fib_info *fi)
 	fib_info_cnt--;
 	kfree(fi);
 }
+EXPORT_SYMBOL_GPL(free_fib_info);
 
 void fib_release_info(struct fib_info *fi)
 {
@@ -869,7 +872,7 @@ int fib_semantic_match(struct list_head *head, const struct flowi *flp,
 	/**
 	 * 在与给定的fib_node相关的路由（fib_alias结构）中，查找与搜索key所有字段都匹配的路由项。
 	 */
-	list_for_each_entry(fa, head, fa_list) {
+	list_for_each_entry_rcu(fa, head, fa_list) {
 		int err;
 
 		/**
@@ -1237,6 +1240,9 @@ int fib_sync_down(u32 local, struct net_device *dev, int force)
 			prev_fi = fi;
 			dead = 0;
 			change_nexthops(fi) {
+				/* The cached forwarding route pins the device. */
+				if (nh->nh_dev == dev)
+					rt_nexthop_flush(nh);
 				if (nh->nh_flags&RTNH_F_DEAD)
 					dead++;
 				else if (nh->nh_dev == dev &&
@@ -0,0 +1,1864 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: LC-trie lookup engine and maintenance routines.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A level compressed trie (Nilsson & Karlsson, "IP-address lookup
+ * using LC-tries") replacing the per prefix length hash tables of
+ * fib_hash.c.  fib_hash has to probe up to 33 zones for every miss;
+ * here a lookup walks a handful of wide internal nodes instead, so the
+ * cost depends on the depth of the trie rather than on how many prefix
+ * lengths are in use.
+ *
+ * Keys are kept in host byte order, bit 0 being the most significant
+ * one.  Every internal node (tnode) tests `bits' bits of the key starting
+ * at bit `pos' and has 2^bits children; bits skipped between a tnode and
+ * its parent are implied by the tnode's key (path compression).  All
+ * prefixes sharing the same masked key hang off one leaf, sorted longest
+ * first.  Nodes are doubled or halved after every update so that they
+ * stay reasonably full (level compression).
+ *
+ * Updates run under the RTNL semaphore; lookups take no lock at all and
+ * rely on RCU, so nodes, leaves and aliases are freed through call_rcu().
+ */
+
+#include <linux/config.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <linux/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/inetdevice.h>
+#include <linux/if_arp.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/rcupdate.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/init.h>
+
+#include <net/ip.h>
+#include <net/protocol.h>
+#include <net/route.h>
+#include <net/tcp.h>
+#include <net/sock.h>
+#include <net/ip_fib.h>
+
+#include "fib_lookup.h"
+
+#define KEYLENGTH	(8*sizeof(t_key))
+#define MASK_PFX(k, l)	(((l) == 0) ? 0 : (k) & (~0U << (KEYLENGTH - (l))))
+
+/* Don't let a single node grow past 2^16 children (512k on 64bit) */
+#define TNODE_MAX_BITS	16
+
+typedef unsigned int t_key;
+
+#define T_TNODE		0
+#define T_LEAF		1
+#define NODE_TYPE_MASK	0x1UL
+#define NODE_TYPE(node)	((node)->parent & NODE_TYPE_MASK)
+
+#define IS_TNODE(n)	(!((n)->parent & T_LEAF))
+#define IS_LEAF(n)	((n)->parent & T_LEAF)
+
+/**
+ * leaf与tnode共有的头部，查找时先通过它判断节点类型。
+ */
+struct node {
+	/**
+	 * 主机字节序的键值。
+	 */
+	t_key		key;
+	/**
+	 * 父节点指针，最低位用来保存节点类型(T_LEAF/T_TNODE)。
+	 */
+	unsigned long	parent;
+};
+
+/**
+ * 叶子节点。键值相同、掩码长度不同的路由前缀共享同一个叶子。
+ */
+struct leaf {
+	t_key		key;
+	unsigned long	parent;
+	/**
+	 * leaf_info链表，按前缀长度由长到短排列，查找时第一个匹配的就是最长匹配。
+	 */
+	struct list_head list;
+	struct rcu_head	rcu;
+};
+
+/**
+ * 叶子上某一个前缀长度对应的路由。
+ */
+struct leaf_info {
+	struct list_head list;
+	/**
+	 * 前缀长度及对应的主机字节序掩码。
+	 */
+	int		plen;
+	u32		mask_plen;
+	/**
+	 * 该前缀的fib_alias链表，与fib_hash中fib_node的fn_alias相同。
+	 */
+	struct list_head falh;
+	struct rcu_head	rcu;
+};
+
+/**
+ * 内部节点，用键值中从pos开始的bits位索引2^bits个子节点。
+ */
+struct tnode {
+	t_key		key;
+	unsigned long	parent;
+	/**
+	 * 本节点检查的第一位和位数。
+	 */
+	unsigned char	pos;
+	unsigned char	bits;
+	/**
+	 * 没有跳过任何位的tnode子节点个数，扩大本节点时它们会被拆开。
+	 */
+	unsigned int	full_children;
+	/**
+	 * 空子节点个数，用来决定是否扩大或缩小本节点。
+	 */
+	unsigned int	empty_children;
+	struct rcu_head	rcu;
+	struct node	*child[0];
+};
+
+/**
+ * fib_table的tb_data部分。
+ */
+struct trie {
+	/**
+	 * 根节点，可能是叶子、tnode或者NULL。
+	 */
+	struct node	*trie;
+	/**
+	 * 叶子个数。
+	 */
+	unsigned int	size;
+};
+
+static kmem_cache_t *fn_alias_kmem;
+static kmem_cache_t *trie_leaf_kmem;
+
+/*
+ * A node is doubled while at least inflate_threshold percent of the
+ * children of the doubled node would be in use, and halved while less
+ * than halve_threshold percent of its own children are.  The root is
+ * allowed to be sparser: it is visited by every lookup, and making it
+ * wide takes a level off all of them.
+ */
+static const int halve_threshold = 25;
+static const int inflate_threshold = 50;
+static const int halve_threshold_root = 15;
+static const int inflate_threshold_root = 30;
+
+static inline struct tnode *node_parent(struct node *node)
+{
+	struct tnode *ret;
+
+	ret = (struct tnode *)(node->parent & ~NODE_TYPE_MASK);
+	return rcu_dereference(ret);
+}
+
+static inline void node_set_parent(struct node *node, struct tnode *ptr)
+{
+	smp_wmb();
+	node->parent = (unsigned long)ptr | NODE_TYPE(node);
+}
+
+static inline struct node *tnode_get_child(struct tnode *tn, unsigned int i)
+{
+	return rcu_dereference(tn->child[i]);
+}
+
+static inline int tnode_child_length(const struct tnode *tn)
+{
+	return 1 << tn->bits;
+}
+
+static inline t_key tkey_extract_bits(t_key a, int offset, int bits)
+{
+	if (offset < KEYLENGTH)
+		return ((t_key)(a << offset)) >> (KEYLENGTH - bits);
+	else
+		return 0;
+}
+
+static inline int tkey_sub_equals(t_key a, int offset, int bits, t_key b)
+{
+	if (bits == 0 || offset >= KEYLENGTH)
+		return 1;
+	bits = bits > KEYLENGTH ? KEYLENGTH : bits;
+	return ((a ^ b) << offset) >> (KEYLENGTH - bits) == 0;
+}
+
+/* First bit at or after offset where a and b differ; they must differ */
+static inline int tkey_mismatch(t_key a, int offset, t_key b)
+{
+	t_key diff = (a ^ b) << offset;
+	int i = offset;
+
+	while (!(diff & (1U << (KEYLENGTH - 1)))) {
+		diff <<= 1;
+		i++;
+	}
+	return i;
+}
+
+/*
+ * Could anything below tn match key?  The bits tn->key fixes in front of
+ * tn->pos have to agree with key, except that a prefix ending before the
+ * first difference still matches as long as the rest of it is zero.  All
+ * such prefixes live below child 0.  On success *cindex is set to the
+ * first child worth looking at.
+ */
+static inline int tnode_may_match(struct tnode *tn, t_key key, t_key *cindex)
+{
+	t_key diff = (tn->key ^ key) & MASK_PFX(~0U, tn->pos);
+	t_key hi;
+
+	if (!diff) {
+		*cindex = tkey_extract_bits(key, tn->pos, tn->bits);
+		return 1;
+	}
+
+	hi = 1U << (fls(diff) - 1);
+	if (tn->key & ((hi << 1) - 1))
+		return 0;
+
+	*cindex = 0;
+	return 1;
+}
+
+/*
+ * Allocation and freeing.  Nodes are only freed after a grace period
+ * since a lookup may still be walking them.
+ */
+
+static struct leaf *leaf_new(t_key key)
+{
+	struct leaf *l = kmem_cache_alloc(trie_leaf_kmem, SLAB_KERNEL);
+
+	if (l) {
+		l->key = key;
+		l->parent = T_LEAF;
+		INIT_LIST_HEAD(&l->list);
+	}
+	return l;
+}
+
+static void __leaf_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(trie_leaf_kmem, container_of(head, struct leaf, rcu));
+}
+
+static inline void free_leaf(struct leaf *l)
+{
+	call_rcu(&l->rcu, __leaf_free_rcu);
+}
+
+static struct leaf_info *leaf_info_new(int plen)
+{
+	struct leaf_info *li = kmalloc(sizeof(struct leaf_info), GFP_KERNEL);
+
+	if (li) {
+		li->plen = plen;
+		li->mask_plen = ntohl(inet_make_mask(plen));
+		INIT_LIST_HEAD(&li->falh);
+	}
+	return li;
+}
+
+static void __leaf_info_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct leaf_info, rcu));
+}
+
+static inline void free_leaf_info(struct leaf_info *li)
+{
+	call_rcu(&li->rcu, __leaf_info_free_rcu);
+}
+
+static inline size_t tnode_size(int bits)
+{
+	return sizeof(struct tnode) + (sizeof(struct node *) << bits);
+}
+
+static struct tnode *tnode_new(t_key key, int pos, int bits)
+{
+	size_t size = tnode_size(bits);
+	struct tnode *tn;
+
+	if (size <= PAGE_SIZE)
+		tn = kmalloc(size, GFP_KERNEL);
+	else
+		tn = (struct tnode *)
+			__get_free_pages(GFP_KERNEL, get_order(size));
+
+	if (tn) {
+		memset(tn, 0, size);
+		tn->parent = T_TNODE;
+		tn->pos = pos;
+		tn->bits = bits;
+		tn->key = MASK_PFX(key, pos);
+		tn->full_children = 0;
+		tn->empty_children = 1 << bits;
+	}
+	return tn;
+}
+
+static void tnode_free_now(struct tnode *tn)
+{
+	size_t size = tnode_size(tn->bits);
+
+	if (size <= PAGE_SIZE)
+		kfree(tn);
+	else
+		free_pages((unsigned long)tn, get_order(size));
+}
+
+static void __tnode_free_rcu(struct rcu_head *head)
+{
+	tnode_free_now(container_of(head, struct tnode, rcu));
+}
+
+static inline void tnode_free(struct tnode *tn)
+{
+	call_rcu(&tn->rcu, __tnode_free_rcu);
+}
+
+/*
+ * The alias keeps its own reference to the fib_info until the grace
+ * period is over, so a lookup that found it can still use fa_info.
+ */
+static void __alias_free_rcu(struct rcu_head *head)
+{
+	struct fib_alias *fa = container_of(head, struct fib_alias, rcu);
+
+	fib_info_put(fa->fa_info);
+	kmem_cache_free(fn_alias_kmem, fa);
+}
+
+static inline void trie_free_alias(struct fib_alias *fa)
+{
+	fib_release_info(fa->fa_info);
+	call_rcu(&fa->rcu, __alias_free_rcu);
+}
+
+/*
+ * Check whether a tnode 'n' is "full", i.e. it is an internal node
+ * and no bits are skipped.
+ */
+static inline int tnode_full(const struct tnode *tn, const struct node *n)
+{
+	if (n == NULL || IS_LEAF(n))
+		return 0;
+
+	return ((struct tnode *) n)->pos == tn->pos + tn->bits;
+}
+
+/*
+ * Add a child at position i overwriting the old value.
+ * Update the value of full_children and empty_children.
+ */
+static void tnode_put_child_reorg(struct tnode *tn, int i, struct node *n,
+				  int wasfull)
+{
+	struct node *chi = tn->child[i];
+	int isfull;
+
+	BUG_ON(i >= 1 << tn->bits);
+
+	if (n == NULL && chi != NULL)
+		tn->empty_children++;
+	else if (n != NULL && chi == NULL)
+		tn->empty_children--;
+
+	if (wasfull == -1)
+		wasfull = tnode_full(tn, chi);
+
+	isfull = tnode_full(tn, n);
+	if (wasfull && !isfull)
+		tn->full_children--;
+	else if (!wasfull && isfull)
+		tn->full_children++;
+
+	if (n)
+		node_set_parent(n, tn);
+
+	rcu_assign_pointer(tn->child[i], n);
+}
+
+static inline void put_child(struct tnode *tn, int i, struct node *n)
+{
+	tnode_put_child_reorg(tn, i, n, -1);
+}
+
+static struct node *resize(struct tnode *tn);
+
+/*
+ * Double the size of tn.  Full children are split in two along the way;
+ * all memory that may be needed is allocated before anything visible to
+ * lookups is touched, so failure leaves the trie as it was.
+ */
+static struct tnode *inflate(struct tnode *oldtnode)
+{
+	int olen = tnode_child_length(oldtnode);
+	struct tnode *tn;
+	int i;
+
+	tn = tnode_new(oldtnode->key, oldtnode->pos, oldtnode->bits + 1);
+	if (!tn)
+		return ERR_PTR(-ENOMEM);
+	tn->parent = oldtnode->parent;
+
+	for (i = 0; i < olen; i++) {
+		struct tnode *inode = (struct tnode *) oldtnode->child[i];
+
+		if (inode && tnode_full(oldtnode, (struct node *) inode) &&
+		    inode->bits > 1) {
+			struct tnode *left, *right;
+			t_key m = 1U << (KEYLENGTH - 1 - inode->pos);
+
+			left = tnode_new(inode->key, inode->pos + 1,
+					 inode->bits - 1);
+			if (!left)
+				goto nomem;
+
+			right = tnode_new(inode->key | m, inode->pos + 1,
+					  inode->bits - 1);
+			if (!right) {
+				tnode_free_now(left);
+				goto nomem;
+			}
+
+			put_child(tn, 2*i, (struct node *) left);
+			put_child(tn, 2*i+1, (struct node *) right);
+		}
+	}
+
+	for (i = 0; i < olen; i++) {
+		struct node *node = oldtnode->child[i];
+		struct tnode *inode, *left, *right;
+		int size, j;
+
+		if (node == NULL)
+			continue;
+
+		/* A leaf or an internal node with skipped bits */
+		if (!tnode_full(oldtnode, node)) {
+			if (tkey_extract_bits(node->key,
+					      oldtnode->pos + oldtnode->bits,
+					      1) == 0)
+				put_child(tn, 2*i, node);
+			else
+				put_child(tn, 2*i+1, node);
+			continue;
+		}
+
+		/* An internal node with two children */
+		inode = (struct tnode *) node;
+		if (inode->bits == 1) {
+			put_child(tn, 2*i, inode->child[0]);
+			put_child(tn, 2*i+1, inode->child[1]);
+			tnode_free(inode);
+			continue;
+		}
+
+		/*
+		 * An internal node with more than two children: its
+		 * top bit now goes to tn, the rest is split between the
+		 * two nodes allocated above.
+		 */
+		left = (struct tnode *) tn->child[2*i];
+		put_child(tn, 2*i, NULL);
+		right = (struct tnode *) tn->child[2*i+1];
+		put_child(tn, 2*i+1, NULL);
+
+		size = tnode_child_length(left);
+		for (j = 0; j < size; j++) {
+			put_child(left, j, inode->child[j]);
+			put_child(right, j, inode->child[j + size]);
+		}
+		put_child(tn, 2*i, resize(left));
+		put_child(tn, 2*i+1, resize(right));
+
+		tnode_free(inode);
+	}
+	tnode_free(oldtnode);
+	return tn;
+
+nomem:
+	for (i = 0; i < tnode_child_length(tn); i++)
+		if (tn->child[i])
+			tnode_free_now((struct tnode *) tn->child[i]);
+	tnode_free_now(tn);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* Halve the size of tn, pairs of non-empty children get a binary node */
+static struct tnode *halve(struct tnode *oldtnode)
+{
+	int olen = tnode_child_length(oldtnode);
+	struct node *left, *right;
+	struct tnode *tn;
+	int i;
+
+	tn = tnode_new(oldtnode->key, oldtnode->pos, oldtnode->bits - 1);
+	if (!tn)
+		return ERR_PTR(-ENOMEM);
+	tn->parent = oldtnode->parent;
+
+	for (i = 0; i < olen; i += 2) {
+		left = oldtnode->child[i];
+		right = oldtnode->child[i+1];
+
+		if (left && right) {
+			struct tnode *newn;
+
+			newn = tnode_new(left->key, tn->pos + tn->bits, 1);
+			if (!newn)
+				goto nomem;
+			put_child(tn, i/2, (struct node *) newn);
+		}
+	}
+
+	for (i = 0; i < olen; i += 2) {
+		struct tnode *newbinode;
+
+		left = oldtnode->child[i];
+		right = oldtnode->child[i+1];
+
+		if (left == NULL) {
+			if (right)
+				put_child(tn, i/2, right);
+			continue;
+		}
+		if (right == NULL) {
+			put_child(tn, i/2, left);
+			continue;
+		}
+
+		newbinode = (struct tnode *) tn->child[i/2];
+		put_child(tn, i/2, NULL);
+		put_child(newbinode, 0, left);
+		put_child(newbinode, 1, right);
+		put_child(tn, i/2, resize(newbinode));
+	}
+	tnode_free(oldtnode);
+	return tn;
+
+nomem:
+	for (i = 0; i < tnode_child_length(tn); i++)
+		if (tn->child[i])
+			tnode_free_now((struct tnode *) tn->child[i]);
+	tnode_free_now(tn);
+	return ERR_PTR(-ENOMEM);
+}
+
+/*
+ * Rebuild tn after its children changed and return what has to take
+ * its place: NULL if it became empty, its only child, or a wider or
+ * narrower replacement node.
+ */
+static struct node *resize(struct tnode *tn)
+{
+	int inflate_th = inflate_threshold;
+	int halve_th = halve_threshold;
+	struct tnode *old_tn;
+	struct node *n;
+	int i;
+
+	if (!tn)
+		return NULL;
+
+	if (!node_parent((struct node *) tn)) {
+		inflate_th = inflate_threshold_root;
+		halve_th = halve_threshold_root;
+	}
+
+	/* No children */
+	if (tn->empty_children == tnode_child_length(tn)) {
+		tnode_free(tn);
+		return NULL;
+	}
+
+	/*
+	 * Inflating is worth it only if it does away with some full
+	 * children, and pays off when the children of the doubled node
+	 * are used well enough.  A full child contributes two children
+	 * to the doubled node, every other non-empty child one:
+	 *
+	 *   100 * (non-empty + full) / (2 * length) >= inflate_th
+	 */
+	while (tn->full_children > 0 && tn->bits < TNODE_MAX_BITS &&
+	       tn->pos + tn->bits < KEYLENGTH &&
+	       50 * (tn->full_children + tnode_child_length(tn) -
+		     tn->empty_children) >=
+	       inflate_th * tnode_child_length(tn)) {
+		old_tn = tn;
+		tn = inflate(tn);
+		if (IS_ERR(tn)) {
+			tn = old_tn;
+			break;
+		}
+	}
+
+	while (tn->bits > 1 &&
+	       100 * (tnode_child_length(tn) - tn->empty_children) <
+	       halve_th * tnode_child_length(tn)) {
+		old_tn = tn;
+		tn = halve(tn);
+		if (IS_ERR(tn)) {
+			tn = old_tn;
+			break;
+		}
+	}
+
+	/* Only one child remains: the node can be collapsed away */
+	if (tn->empty_children == tnode_child_length(tn) - 1) {
+		for (i = 0; i < tnode_child_length(tn); i++) {
+			n = tn->child[i];
+			if (!n)
+				continue;
+
+			node_set_parent(n, node_parent((struct node *) tn));
+			tnode_free(tn);
+			return n;
+		}
+	}
+	return (struct node *) tn;
+}
+
+/* Resize every node from tn up to the root */
+static void trie_rebalance(struct trie *t, struct tnode *tn)
+{
+	struct tnode *tp;
+	struct node *n;
+	t_key cindex;
+	int wasfull;
+
+	while ((tp = node_parent((struct node *) tn)) != NULL) {
+		cindex = tkey_extract_bits(tn->key, tp->pos, tp->bits);
+		wasfull = tnode_full(tp, tp->child[cindex]);
+		n = resize(tn);
+		tnode_put_child_reorg(tp, cindex, n, wasfull);
+		tn = tp;
+	}
+
+	n = resize(tn);
+	if (n)
+		node_set_parent(n, NULL);
+	rcu_assign_pointer(t->trie, n);
+}
+
+/* Return the leaf holding exactly KEY */
+static struct leaf *fib_find_node(struct trie *t, t_key key)
+{
+	struct node *n = rcu_dereference(t->trie);
+	struct tnode *tn;
+	int pos = 0;
+
+	while (n != NULL && IS_TNODE(n)) {
+		tn = (struct tnode *) n;
+		if (!tkey_sub_equals(tn->key, pos, tn->pos - pos, key))
+			return NULL;
+		pos = tn->pos + tn->bits;
+		n = tnode_get_child(tn, tkey_extract_bits(key, tn->pos,
+							  tn->bits));
+	}
+
+	if (n != NULL && n->key == key)
+		return (struct leaf *) n;
+	return NULL;
+}
+
+static struct leaf_info *find_leaf_info(struct leaf *l, int plen)
+{
+	struct leaf_info *li;
+
+	list_for_each_entry_rcu(li, &l->list, list) {
+		if (li->plen == plen)
+			return li;
+	}
+	return NULL;
+}
+
+static inline struct list_head *get_fa_head(struct leaf *l, int plen)
+{
+	struct leaf_info *li = find_leaf_info(l, plen);
+
+	if (!li)
+		return NULL;
+	return &li->falh;
+}
+
+/* Keep the list sorted by prefix length, longest first */
+static void insert_leaf_info(struct list_head *head, struct leaf_info *new)
+{
+	struct leaf_info *li;
+
+	list_for_each_entry(li, head, list) {
+		if (new->plen > li->plen) {
+			list_add_tail_rcu(&new->list, &li->list);
+			return;
+		}
+	}
+	list_add_tail_rcu(&new->list, head);
+}
+
+/*
+ * Add the prefix KEY/PLEN to the trie and return its (empty) alias
+ * list.  If the leaf for KEY exists only a leaf_info is added to it,
+ * otherwise a new leaf goes either into an empty slot or next to the
+ * node it collides with, below a new binary node.
+ */
+static struct list_head *fib_insert_node(struct trie *t, t_key key, int plen)
+{
+	struct tnode *tp = NULL, *tn;
+	struct leaf_info *li;
+	struct leaf *l;
+	struct node *n;
+	t_key cindex;
+	int pos = 0;
+
+	n = t->trie;
+	while (n != NULL && IS_TNODE(n)) {
+		tn = (struct tnode *) n;
+		if (!tkey_sub_equals(tn->key, pos, tn->pos - pos, key))
+			break;
+		tp = tn;
+		pos = tn->pos + tn->bits;
+		n = tn->child[tkey_extract_bits(key, tn->pos, tn->bits)];
+
+		BUG_ON(n && node_parent(n) != tn);
+	}
+
+	/* n is NULL, a leaf, or a tnode whose skipped bits don't match */
+	li = leaf_info_new(plen);
+	if (!li)
+		return NULL;
+
+	if (n != NULL && IS_LEAF(n) && n->key == key) {
+		insert_leaf_info(&((struct leaf *) n)->list, li);
+		return &li->falh;
+	}
+
+	l = leaf_new(key);
+	if (!l) {
+		kfree(li);
+		return NULL;
+	}
+	insert_leaf_info(&l->list, li);
+
+	if (n == NULL) {
+		if (tp) {
+			cindex = tkey_extract_bits(key, tp->pos, tp->bits);
+			put_child(tp, cindex, (struct node *) l);
+		} else {
+			/* First leaf */
+			rcu_assign_pointer(t->trie, (struct node *) l);
+		}
+	} else {
+		int newpos, missbit;
+
+		newpos = tkey_mismatch(key, pos, n->key);
+		tn = tnode_new(key, newpos, 1);
+		if (!tn) {
+			kfree(li);
+			kmem_cache_free(trie_leaf_kmem, l);
+			return NULL;
+		}
+		tn->parent = (unsigned long) tp;
+
+		missbit = tkey_extract_bits(key, newpos, 1);
+		put_child(tn, missbit, (struct node *) l);
+		put_child(tn, 1 - missbit, n);
+
+		if (tp) {
+			cindex = tkey_extract_bits(key, tp->pos, tp->bits);
+			put_child(tp, cindex, (struct node *) tn);
+		} else {
+			rcu_assign_pointer(t->trie, (struct node *) tn);
+		}
+		tp = tn;
+	}
+	t->size++;
+
+	if (tp)
+		trie_rebalance(t, tp);
+	return &li->falh;
+}
+
+static void trie_leaf_remove(struct trie *t, struct leaf *l)
+{
+	struct tnode *tp = node_parent((struct node *) l);
+
+	if (tp) {
+		t_key cindex = tkey_extract_bits(l->key, tp->pos, tp->bits);
+
+		put_child(tp, cindex, NULL);
+		trie_rebalance(t, tp);
+	} else
+		rcu_assign_pointer(t->trie, NULL);
+
+	t->size--;
+	free_leaf(l);
+}
+
+/*
+ * Leaf walking, in ascending key order.  Starting from child c of p
+ * (or from the first child if c is NULL) return the next leaf.
+ */
+static struct leaf *leaf_walk_rcu(struct tnode *p, struct node *c)
+{
+	do {
+		t_key idx;
+
+		if (c)
+			idx = tkey_extract_bits(c->key, p->pos, p->bits) + 1;
+		else
+			idx = 0;
+
+		while (idx < 1U << p->bits) {
+			c = tnode_get_child(p, idx++);
+			if (!c)
+				continue;
+
+			if (IS_LEAF(c))
+				return (struct leaf *) c;
+
+			/* Descend and start over in the child */
+			p = (struct tnode *) c;
+			idx = 0;
+		}
+
+		/* Done with this node, go back up */
+		c = (struct node *) p;
+	} while ((p = node_parent(c)) != NULL);
+
+	return NULL;
+}
+
+static struct leaf *trie_firstleaf(struct trie *t)
+{
+	struct node *n = rcu_dereference(t->trie);
+
+	if (!n)
+		return NULL;
+	if (IS_LEAF(n))
+		return (struct leaf *) n;
+	return leaf_walk_rcu((struct tnode *) n, NULL);
+}
+
+static struct leaf *trie_nextleaf(struct leaf *l)
+{
+	struct node *c = (struct node *) l;
+	struct tnode *p = node_parent(c);
+
+	if (!p)
+		return NULL;
+	return leaf_walk_rcu(p, c);
+}
+
+/* First leaf with a key above KEY; only used when resuming a dump */
+static struct leaf *trie_leaf_after(struct trie *t, t_key key)
+{
+	struct leaf *l;
+
+	for (l = trie_firstleaf(t); l; l = trie_nextleaf(l))
+		if (l->key > key)
+			break;
+	return l;
+}
+
+/* Try the prefixes of one leaf, longest first */
+static inline int check_leaf(struct leaf *l, t_key key,
+			     const struct flowi *flp, struct fib_result *res)
+{
+	struct leaf_info *li;
+	int err;
+
+	list_for_each_entry_rcu(li, &l->list, list) {
+		if (l->key != (key & li->mask_plen))
+			continue;
+
+		err = fib_semantic_match(&li->falh, flp, res, li->plen);
+		if (err <= 0)
+			return err;
+	}
+	return 1;
+}
+
+/*
+ * Longest prefix match.  At every tnode the child selected by the key
+ * is tried first.  When nothing matches below it, shorter prefixes can
+ * only be found by zeroing bits of the index, so the next candidate is
+ * the index with its lowest set bit cleared; once the index is zero we
+ * back up to the parent and continue there the same way.  The first
+ * match found is the longest one.
+ */
+static int
+fn_trie_lookup(struct fib_table *tb, const struct flowi *flp, struct fib_result *res)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	t_key key = ntohl(flp->fl4_dst);
+	struct tnode *pn;
+	struct node *n;
+	t_key cindex;
+	int ret = 1;
+
+	rcu_read_lock();
+
+	n = rcu_dereference(t->trie);
+	if (!n)
+		goto out;
+
+	if (IS_LEAF(n)) {
+		ret = check_leaf((struct leaf *) n, key, flp, res);
+		goto out;
+	}
+
+	pn = (struct tnode *) n;
+	if (!tnode_may_match(pn, key, &cindex))
+		goto out;
+
+	for (;;) {
+		n = tnode_get_child(pn, cindex);
+		if (n) {
+			if (IS_LEAF(n)) {
+				ret = check_leaf((struct leaf *) n, key,
+						 flp, res);
+				if (ret <= 0)
+					goto out;
+			} else if (tnode_may_match((struct tnode *) n, key,
+						   &cindex)) {
+				pn = (struct tnode *) n;
+				continue;
+			}
+		}
+
+		while (!cindex) {
+			struct tnode *parent = node_parent((struct node *) pn);
+
+			if (!parent)
+				goto out;
+			cindex = tkey_extract_bits(pn->key, parent->pos,
+						   parent->bits);
+			pn = parent;
+		}
+		cindex &= cindex - 1;
+	}
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+static int trie_last_dflt = -1;
+
+static void
+fn_trie_select_default(struct fib_table *tb, const struct flowi *flp, struct fib_result *res)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	int order, last_idx;
+	struct fib_info *fi = NULL;
+	struct fib_info *last_resort;
+	struct fib_alias *fa;
+	struct list_head *fa_head;
+	struct leaf *l;
+
+	last_idx = -1;
+	last_resort = NULL;
+	order = -1;
+
+	rcu_read_lock();
+
+	l = fib_find_node(t, 0);
+	if (!l)
+		goto out;
+
+	fa_head = get_fa_head(l, 0);
+	if (!fa_head)
+		goto out;
+
+	list_for_each_entry_rcu(fa, fa_head, fa_list) {
+		struct fib_info *next_fi = fa->fa_info;
+
+		if (fa->fa_scope != res->scope ||
+		    fa->fa_type != RTN_UNICAST)
+			continue;
+
+		if (next_fi->fib_priority > res->fi->fib_priority)
+			break;
+		if (!next_fi->fib_nh[0].nh_gw ||
+		    next_fi->fib_nh[0].nh_scope != RT_SCOPE_LINK)
+			continue;
+		fa->fa_state |= FA_S_ACCESSED;
+
+		if (fi == NULL) {
+			if (next_fi != res->fi)
+				break;
+		} else if (!fib_detect_death(fi, order, &last_resort,
+					     &last_idx, &trie_last_dflt)) {
+			if (res->fi)
+				fib_info_put(res->fi);
+			res->fi = fi;
+			atomic_inc(&fi->fib_clntref);
+			trie_last_dflt = order;
+			goto out;
+		}
+		fi = next_fi;
+		order++;
+	}
+
+	if (order <= 0 || fi == NULL) {
+		trie_last_dflt = -1;
+		goto out;
+	}
+
+	if (!fib_detect_death(fi, order, &last_resort, &last_idx, &trie_last_dflt)) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = fi;
+		atomic_inc(&fi->fib_clntref);
+		trie_last_dflt = order;
+		goto out;
+	}
+
+	if (last_idx >= 0) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = last_resort;
+		if (last_resort)
+			atomic_inc(&last_resort->fib_clntref);
+	}
+	trie_last_dflt = last_idx;
+out:
+	rcu_read_unlock();
+}
+
+static int
+fn_trie_insert(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct fib_alias *fa, *new_fa;
+	struct list_head *fa_head = NULL;
+	struct fib_info *fi;
+	int plen = r->rtm_dst_len;
+	int type = r->rtm_type;
+	u8 tos = r->rtm_tos;
+	struct leaf *l;
+	t_key key;
+	int err;
+
+	if (plen > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst)
+		memcpy(&key, rta->rta_dst, 4);
+	key = ntohl(key);
+
+	if (key & ~ntohl(inet_make_mask(plen)))
+		return -EINVAL;
+
+	if ((fi = fib_create_info(r, rta, n, &err)) == NULL)
+		return err;
+
+	l = fib_find_node(t, key);
+	fa = NULL;
+	if (l) {
+		fa_head = get_fa_head(l, plen);
+		if (fa_head)
+			fa = fib_find_alias(fa_head, tos, fi->fib_priority);
+	}
+
+	/* Now fa, if non-NULL, points to the first fib alias
+	 * with the same keys [prefix,tos,priority], if such key already
+	 * exists or to the node before which we will insert new one.
+	 *
+	 * If fa is NULL, we will need to allocate a new one and
+	 * insert to the head of f.
+	 *
+	 * If f is NULL, no fib node matched the destination key
+	 * and we need to allocate a new one of those as well.
+	 */
+
+	if (fa && fa->fa_tos == tos &&
+	    fa->fa_info->fib_priority == fi->fib_priority) {
+		struct fib_alias *fa_orig;
+
+		err = -EEXIST;
+		if (n->nlmsg_flags & NLM_F_EXCL)
+			goto out;
+
+		if (n->nlmsg_flags & NLM_F_REPLACE) {
+			u8 state;
+
+			/* Lookups may be using fa, swap in a fresh copy */
+			err = -ENOBUFS;
+			new_fa = kmem_cache_alloc(fn_alias_kmem, SLAB_KERNEL);
+			if (new_fa == NULL)
+				goto out;
+
+			state = fa->fa_state;
+			new_fa->fa_info = fi;
+			new_fa->fa_tos = fa->fa_tos;
+			new_fa->fa_type = type;
+			new_fa->fa_scope = r->rtm_scope;
+			new_fa->fa_state = state & ~FA_S_ACCESSED;
+
+			atomic_inc(&fi->fib_clntref);
+			list_replace_rcu(&fa->fa_list, &new_fa->fa_list);
+			trie_free_alias(fa);
+
+			if (state & FA_S_ACCESSED)
+				rt_cache_flush(-1);
+			return 0;
+		}
+
+		/* Error if we find a perfect match which
+		 * uses the same scope, type, and nexthop
+		 * information.
+		 */
+		fa_orig = fa;
+		fa = list_entry(fa->fa_list.prev, struct fib_alias, fa_list);
+		list_for_each_entry_continue(fa, fa_head, fa_list) {
+			if (fa->fa_tos != tos)
+				break;
+			if (fa->fa_info->fib_priority != fi->fib_priority)
+				break;
+			if (fa->fa_type == type &&
+			    fa->fa_scope == r->rtm_scope &&
+			    fa->fa_info == fi)
+				goto out;
+		}
+		if (!(n->nlmsg_flags & NLM_F_APPEND))
+			fa = fa_orig;
+	}
+
+	err = -ENOENT;
+	if (!(n->nlmsg_flags & NLM_F_CREATE))
+		goto out;
+
+	err = -ENOBUFS;
+	new_fa = kmem_cache_alloc(fn_alias_kmem, SLAB_KERNEL);
+	if (new_fa == NULL)
+		goto out;
+
+	new_fa->fa_info = fi;
+	new_fa->fa_tos = tos;
+	new_fa->fa_type = type;
+	new_fa->fa_scope = r->rtm_scope;
+	new_fa->fa_state = 0;
+
+	if (!fa_head) {
+		fa_head = fib_insert_node(t, key, plen);
+		if (fa_head == NULL)
+			goto out_free_new_fa;
+	}
+
+	atomic_inc(&fi->fib_clntref);
+	list_add_tail_rcu(&new_fa->fa_list,
+			  (fa ? &fa->fa_list : fa_head));
+
+	rt_cache_flush(-1);
+	rtmsg_fib(RTM_NEWROUTE, htonl(key), new_fa, plen, tb->tb_id, n, req);
+	return 0;
+
+out_free_new_fa:
+	kmem_cache_free(fn_alias_kmem, new_fa);
+out:
+	fib_release_info(fi);
+	return err;
+}
+
+static int
+fn_trie_delete(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct fib_alias *fa, *fa_to_delete;
+	struct list_head *fa_head;
+	struct leaf_info *li;
+	int plen = r->rtm_dst_len;
+	u8 tos = r->rtm_tos;
+	struct leaf *l;
+	t_key key;
+
+	if (plen > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst)
+		memcpy(&key, rta->rta_dst, 4);
+	key = ntohl(key);
+
+	if (key & ~ntohl(inet_make_mask(plen)))
+		return -EINVAL;
+
+	l = fib_find_node(t, key);
+	if (!l)
+		return -ESRCH;
+
+	li = find_leaf_info(l, plen);
+	if (!li)
+		return -ESRCH;
+	fa_head = &li->falh;
+
+	fa = fib_find_alias(fa_head, tos, 0);
+	if (!fa)
+		return -ESRCH;
+
+	fa_to_delete = NULL;
+	fa = list_entry(fa->fa_list.prev, struct fib_alias, fa_list);
+	list_for_each_entry_continue(fa, fa_head, fa_list) {
+		struct fib_info *fi = fa->fa_info;
+
+		if (fa->fa_tos != tos)
+			break;
+
+		if ((!r->rtm_type ||
+		     fa->fa_type == r->rtm_type) &&
+		    (r->rtm_scope == RT_SCOPE_NOWHERE ||
+		     fa->fa_scope == r->rtm_scope) &&
+		    (!r->rtm_protocol ||
+		     fi->fib_protocol == r->rtm_protocol) &&
+		    fib_nh_match(r, n, rta, fi) == 0) {
+			fa_to_delete = fa;
+			break;
+		}
+	}
+
+	if (!fa_to_delete)
+		return -ESRCH;
+
+	fa = fa_to_delete;
+	rtmsg_fib(RTM_DELROUTE, htonl(key), fa, plen, tb->tb_id, n, req);
+
+	list_del_rcu(&fa->fa_list);
+	if (list_empty(fa_head)) {
+		list_del_rcu(&li->list);
+		free_leaf_info(li);
+	}
+	if (list_empty(&l->list))
+		trie_leaf_remove(t, l);
+
+	if (fa->fa_state & FA_S_ACCESSED)
+		rt_cache_flush(-1);
+	trie_free_alias(fa);
+	return 0;
+}
+
+static int trie_flush_list(struct list_head *head)
+{
+	struct fib_alias *fa, *fa_node;
+	int found = 0;
+
+	list_for_each_entry_safe(fa, fa_node, head, fa_list) {
+		struct fib_info *fi = fa->fa_info;
+
+		if (fi && (fi->fib_flags & RTNH_F_DEAD)) {
+			list_del_rcu(&fa->fa_list);
+			trie_free_alias(fa);
+			found++;
+		}
+	}
+	return found;
+}
+
+static int trie_flush_leaf(struct leaf *l)
+{
+	struct leaf_info *li, *tmp;
+	int found = 0;
+
+	list_for_each_entry_safe(li, tmp, &l->list, list) {
+		found += trie_flush_list(&li->falh);
+
+		if (list_empty(&li->falh)) {
+			list_del_rcu(&li->list);
+			free_leaf_info(li);
+		}
+	}
+	return found;
+}
+
+static int fn_trie_flush(struct fib_table *tb)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct leaf *l, *ll = NULL;
+	int found = 0;
+
+	/* The previous leaf is removed only once we have moved past it */
+	for (l = trie_firstleaf(t); l; l = trie_nextleaf(l)) {
+		found += trie_flush_leaf(l);
+
+		if (ll && list_empty(&ll->list))
+			trie_leaf_remove(t, ll);
+		ll = l;
+	}
+
+	if (ll && list_empty(&ll->list))
+		trie_leaf_remove(t, ll);
+
+	return found;
+}
+
+static int fn_trie_dump_leaf(struct leaf *l, struct fib_table *tb,
+			     struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct leaf_info *li;
+	struct fib_alias *fa;
+	u32 xkey = htonl(l->key);
+	int i, s_i;
+
+	s_i = cb->args[3];
+	i = 0;
+	list_for_each_entry_rcu(li, &l->list, list) {
+		list_for_each_entry_rcu(fa, &li->falh, fa_list) {
+			if (i < s_i)
+				goto next;
+
+			if (fib_dump_info(skb, NETLINK_CB(cb->skb).pid,
+					  cb->nlh->nlmsg_seq,
+					  RTM_NEWROUTE,
+					  tb->tb_id,
+					  fa->fa_type,
+					  fa->fa_scope,
+					  &xkey,
+					  li->plen,
+					  fa->fa_tos,
+					  fa->fa_info) < 0) {
+				cb->args[3] = i;
+				return -1;
+			}
+		next:
+			i++;
+		}
+	}
+	cb->args[3] = i;
+	return skb->len;
+}
+
+/*
+ * cb->args[1] is set once the dump has started, args[2] holds the key
+ * of the leaf being dumped and args[3] the number of aliases of that
+ * leaf already sent.  If the leaf went away meanwhile we carry on with
+ * the next one.
+ */
+static int fn_trie_dump(struct fib_table *tb, struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct leaf *l;
+
+	rcu_read_lock();
+	if (cb->args[1]) {
+		l = fib_find_node(t, cb->args[2]);
+		if (!l) {
+			l = trie_leaf_after(t, cb->args[2]);
+			cb->args[3] = 0;
+		}
+	} else
+		l = trie_firstleaf(t);
+
+	cb->args[1] = 1;
+	for (; l; l = trie_nextleaf(l)) {
+		cb->args[2] = l->key;
+		if (fn_trie_dump_leaf(l, tb, skb, cb) < 0) {
+			rcu_read_unlock();
+			return -1;
+		}
+		cb->args[3] = 0;
+	}
+	rcu_read_unlock();
+	return skb->len;
+}
+
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+struct fib_table * fib_hash_init(int id)
+#else
+struct fib_table * __init fib_hash_init(int id)
+#endif
+{
+	struct fib_table *tb;
+	struct trie *t;
+
+	if (fn_alias_kmem == NULL)
+		fn_alias_kmem = kmem_cache_create("ip_fib_alias",
+						  sizeof(struct fib_alias),
+						  0, SLAB_HWCACHE_ALIGN,
+						  NULL, NULL);
+
+	if (trie_leaf_kmem == NULL)
+		trie_leaf_kmem = kmem_cache_create("ip_fib_trie",
+						   sizeof(struct leaf),
+						   0, SLAB_HWCACHE_ALIGN,
+						   NULL, NULL);
+
+	tb = kmalloc(sizeof(struct fib_table) + sizeof(struct trie),
+		     GFP_KERNEL);
+	if (tb == NULL)
+		return NULL;
+
+	tb->tb_id = id;
+	tb->tb_lookup = fn_trie_lookup;
+	tb->tb_insert = fn_trie_insert;
+	tb->tb_delete = fn_trie_delete;
+	tb->tb_flush = fn_trie_flush;
+	tb->tb_select_default = fn_trie_select_default;
+	tb->tb_dump = fn_trie_dump;
+
+	t = (struct trie *) tb->tb_data;
+	t->trie = NULL;
+	t->size = 0;
+
+	if (id == RT_TABLE_LOCAL)
+		printk(KERN_INFO "IPv4 FIB: Using LC-trie version 1\n");
+
+	return tb;
+}
+
+/* ------------------------------------------------------------------------ */
+#ifdef CONFIG_PROC_FS
+
+/**
+ * 遍历/proc/net/route时保存的当前位置。
+ */
+struct fib_route_iter {
+	struct leaf	 *l;
+	struct leaf_info *li;
+	struct fib_alias *fa;
+	/* Where fa is, to pick up there again on the next read */
+	loff_t		 pos;	/* index of fa */
+	t_key		 key;	/* key of l */
+	unsigned int	 skip;	/* aliases of l before fa */
+};
+
+/*
+ * Advance to the alias after iter->fa, moving on to the next leaf_info
+ * and leaf as needed.  iter->l must be set; li and fa may be NULL to
+ * start at the beginning of the leaf.
+ */
+static struct fib_alias *fib_route_get_next(struct fib_route_iter *iter)
+{
+	struct leaf *l = iter->l;
+	struct leaf *prev = iter->fa ? l : NULL;
+	struct leaf_info *li = iter->li;
+	struct list_head *p = iter->fa ? &iter->fa->fa_list : NULL;
+	struct list_head *lp;
+
+	while (l) {
+		if (li) {
+			p = rcu_dereference(p ? p->next : li->falh.next);
+			if (p != &li->falh) {
+				if (l != prev) {
+					iter->key = l->key;
+					iter->skip = 0;
+				} else
+					iter->skip++;
+				iter->l = l;
+				iter->li = li;
+				iter->fa = list_entry(p, struct fib_alias,
+						      fa_list);
+				return iter->fa;
+			}
+			lp = rcu_dereference(li->list.next);
+		} else
+			lp = rcu_dereference(l->list.next);
+
+		p = NULL;
+		if (lp != &l->list) {
+			li = list_entry(lp, struct leaf_info, list);
+			continue;
+		}
+
+		l = trie_nextleaf(l);
+		li = NULL;
+	}
+
+	iter->l = NULL;
+	iter->li = NULL;
+	iter->fa = NULL;
+	return NULL;
+}
+
+/*
+ * Find the alias at POS.  Whatever the iterator points at may have been
+ * freed since the last read left the RCU section, so only its key is
+ * trusted: a read that goes on from where the last one stopped looks
+ * that leaf up again and starts there, rather than from the first leaf
+ * every time.
+ */
+static struct fib_alias *fib_route_get_idx(struct fib_route_iter *iter,
+					   loff_t pos)
+{
+	struct trie *t = (struct trie *) ip_fib_main_table->tb_data;
+	struct fib_alias *fa;
+	loff_t idx = 0;
+	struct leaf *l = NULL;
+
+	if (iter->fa && pos >= iter->pos - iter->skip) {
+		l = fib_find_node(t, iter->key);
+		idx = iter->pos - iter->skip;
+	}
+	if (!l) {
+		l = trie_firstleaf(t);
+		idx = 0;
+	}
+	iter->l = l;
+	iter->li = NULL;
+	iter->fa = NULL;
+
+	fa = fib_route_get_next(iter);
+	while (fa && idx < pos) {
+		fa = fib_route_get_next(iter);
+		idx++;
+	}
+	iter->pos = idx;
+	return fa;
+}
+
+static void *fib_route_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	rcu_read_lock();
+	if (!ip_fib_main_table)
+		return NULL;
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	return fib_route_get_idx(seq->private, *pos - 1);
+}
+
+static void *fib_route_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct fib_route_iter *iter = seq->private;
+
+	++*pos;
+	if (v == SEQ_START_TOKEN)
+		return fib_route_get_idx(iter, 0);
+	iter->pos++;
+	return fib_route_get_next(iter);
+}
+
+static void fib_route_seq_stop(struct seq_file *seq, void *v)
+{
+	rcu_read_unlock();
+}
+
+static unsigned fib_flag_trans(int type, u32 mask, struct fib_info *fi)
+{
+	static unsigned type2flags[RTN_MAX + 1] = {
+		[7] = RTF_REJECT, [8] = RTF_REJECT,
+	};
+	unsigned flags = type2flags[type];
+
+	if (fi && fi->fib_nh->nh_gw)
+		flags |= RTF_GATEWAY;
+	if (mask == 0xFFFFFFFF)
+		flags |= RTF_HOST;
+	flags |= RTF_UP;
+	return flags;
+}
+
+/*
+ *	This outputs /proc/net/route.
+ *
+ *	It always works in backward compatibility mode.
+ *	The format of the file is not supposed to be changed.
+ */
+static int fib_route_seq_show(struct seq_file *seq, void *v)
+{
+	struct fib_route_iter *iter;
+	char bf[128];
+	u32 prefix, mask;
+	unsigned flags;
+	struct fib_alias *fa;
+	struct fib_info *fi;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(seq, "%-127s\n", "Iface\tDestination\tGateway "
+			   "\tFlags\tRefCnt\tUse\tMetric\tMask\t\tMTU"
+			   "\tWindow\tIRTT");
+		goto out;
+	}
+
+	iter	= seq->private;
+	fa	= iter->fa;
+	fi	= fa->fa_info;
+	prefix	= htonl(iter->l->key);
+	mask	= inet_make_mask(iter->li->plen);
+	flags	= fib_flag_trans(fa->fa_type, mask, fi);
+	if (fi)
+		snprintf(bf, sizeof(bf),
+			 "%s\t%08X\t%08X\t%04X\t%d\t%u\t%d\t%08X\t%d\t%u\t%u",
+			 fi->fib_dev ? fi->fib_dev->name : "*", prefix,
+			 fi->fib_nh->nh_gw, flags, 0, 0, fi->fib_priority,
+			 mask, (fi->fib_advmss ? fi->fib_advmss + 40 : 0),
+			 fi->fib_window,
+			 fi->fib_rtt >> 3);
+	else
+		snprintf(bf, sizeof(bf),
+			 "*\t%08X\t%08X\t%04X\t%d\t%u\t%d\t%08X\t%d\t%u\t%u",
+			 prefix, 0, flags, 0, 0, 0, mask, 0, 0, 0);
+	seq_printf(seq, "%-127s\n", bf);
+out:
+	return 0;
+}
+
+static struct seq_operations fib_route_seq_ops = {
+	.start  = fib_route_seq_start,
+	.next   = fib_route_seq_next,
+	.stop   = fib_route_seq_stop,
+	.show   = fib_route_seq_show,
+};
+
+static int fib_route_seq_open(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq;
+	int rc = -ENOMEM;
+	struct fib_route_iter *s = kmalloc(sizeof(*s), GFP_KERNEL);
+
+	if (!s)
+		goto out;
+
+	rc = seq_open(file, &fib_route_seq_ops);
+	if (rc)
+		goto out_kfree;
+
+	seq	     = file->private_data;
+	seq->private = s;
+	memset(s, 0, sizeof(*s));
+out:
+	return rc;
+out_kfree:
+	kfree(s);
+	goto out;
+}
+
+static struct file_operations fib_route_fops = {
+	.owner		= THIS_MODULE,
+	.open           = fib_route_seq_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release	= seq_release_private,
+};
+
+/**
+ * /proc/net/fib_triestat输出的统计信息。
+ */
+struct trie_stat {
+	/**
+	 * 所有叶子深度之和及最大深度，用来计算平均深度。
+	 */
+	unsigned int	totdepth;
+	unsigned int	maxdepth;
+	unsigned int	tnodes;
+	unsigned int	leaves;
+	unsigned int	prefixes;
+	unsigned int	nullpointers;
+	/**
+	 * 按bits统计的tnode个数。
+	 */
+	unsigned int	nodesizes[TNODE_MAX_BITS + 1];
+	unsigned long	memory;
+};
+
+/*
+ * Walk the whole trie without recursion.  Done under RCU only, so on a
+ * table that is being changed the numbers are approximate.
+ */
+static void trie_collect_stats(struct trie *t, struct trie_stat *s)
+{
+	struct node *n = rcu_dereference(t->trie);
+	struct tnode *tn;
+	struct leaf_info *li;
+	unsigned int depth;
+	t_key idx;
+
+	memset(s, 0, sizeof(*s));
+	if (!n)
+		return;
+
+	if (IS_LEAF(n)) {
+		s->leaves = 1;
+		list_for_each_entry_rcu(li, &((struct leaf *) n)->list, list)
+			s->prefixes++;
+		s->memory = sizeof(struct leaf) +
+			    s->prefixes * sizeof(struct leaf_info);
+		return;
+	}
+
+	tn = (struct tnode *) n;
+	depth = 1;
+	idx = 0;
+	s->tnodes++;
+	s->nodesizes[tn->bits]++;
+	s->memory += tnode_size(tn->bits);
+
+	for (;;) {
+		if (idx < 1U << tn->bits) {
+			n = tnode_get_child(tn, idx++);
+			if (!n) {
+				s->nullpointers++;
+				continue;
+			}
+
+			if (IS_LEAF(n)) {
+				s->leaves++;
+				s->totdepth += depth;
+				if (depth > s->maxdepth)
+					s->maxdepth = depth;
+				s->memory += sizeof(struct leaf);
+				list_for_each_entry_rcu(li,
+						&((struct leaf *) n)->list, list) {
+					s->prefixes++;
+					s->memory += sizeof(struct leaf_info);
+				}
+				continue;
+			}
+
+			tn = (struct tnode *) n;
+			s->tnodes++;
+			if (tn->bits <= TNODE_MAX_BITS)
+				s->nodesizes[tn->bits]++;
+			s->memory += tnode_size(tn->bits);
+			depth++;
+			idx = 0;
+			continue;
+		}
+
+		n = (struct node *) tn;
+		tn = node_parent(n);
+		if (!tn)
+			break;
+		depth--;
+		idx = tkey_extract_bits(n->key, tn->pos, tn->bits) + 1;
+	}
+}
+
+static void trie_show_stats(struct seq_file *seq, const char *name,
+			    struct fib_table *tb)
+{
+	struct trie_stat st;
+	unsigned int avdepth;
+	int i;
+
+	rcu_read_lock();
+	trie_collect_stats((struct trie *) tb->tb_data, &st);
+	rcu_read_unlock();
+
+	if (st.leaves)
+		avdepth = st.totdepth * 100 / st.leaves;
+	else
+		avdepth = 0;
+
+	seq_printf(seq, "%s:\n", name);
+	seq_printf(seq, "\tAver depth:     %u.%02u\n",
+		   avdepth / 100, avdepth % 100);
+	seq_printf(seq, "\tMax depth:      %u\n", st.maxdepth);
+	seq_printf(seq, "\tLeaves:         %u\n", st.leaves);
+	seq_printf(seq, "\tPrefixes:       %u\n", st.prefixes);
+	seq_printf(seq, "\tInternal nodes: %u\n\t", st.tnodes);
+	for (i = 0; i <= TNODE_MAX_BITS; i++)
+		if (st.nodesizes[i])
+			seq_printf(seq, "  %d: %u", i, st.nodesizes[i]);
+	seq_printf(seq, "\n");
+	seq_printf(seq, "\tNull ptrs:      %u\n", st.nullpointers);
+	seq_printf(seq, "\tTotal size:     %lu kB\n",
+		   (st.memory + 1023) / 1024);
+}
+
+/*
+ *	This outputs /proc/net/fib_triestat: depth and node size
+ *	statistics of every routing table.
+ */
+static int fib_triestat_seq_show(struct seq_file *seq, void *v)
+{
+	seq_printf(seq, "Basic info: size of leaf: %Zd bytes, "
+		   "size of tnode: %Zd bytes.\n",
+		   sizeof(struct leaf), sizeof(struct tnode));
+
+	rtnl_lock();
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	{
+		char name[16];
+		int id;
+
+		for (id = 1; id <= RT_TABLE_MAX; id++) {
+			if (!fib_tables[id])
+				continue;
+			if (id == RT_TABLE_LOCAL)
+				strcpy(name, "Local");
+			else if (id == RT_TABLE_MAIN)
+				strcpy(name, "Main");
+			else
+				sprintf(name, "Id %d", id);
+			trie_show_stats(seq, name, fib_tables[id]);
+		}
+	}
+#else
+	if (ip_fib_local_table)
+		trie_show_stats(seq, "Local", ip_fib_local_table);
+	if (ip_fib_main_table)
+		trie_show_stats(seq, "Main", ip_fib_main_table);
+#endif
+	rtnl_unlock();
+	return 0;
+}
+
+static int fib_triestat_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fib_triestat_seq_show, NULL);
+}
+
+static struct file_operations fib_triestat_fops = {
+	.owner		= THIS_MODULE,
+	.open           = fib_triestat_seq_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release	= single_release,
+};
+
+int __init fib_proc_init(void)
+{
+	if (!proc_net_fops_create("route", S_IRUGO, &fib_route_fops))
+		goto out1;
+	if (!proc_net_fops_create("fib_triestat", S_IRUGO, &fib_triestat_fops))
+		goto out2;
+	return 0;
+
+out2:
+	proc_net_remove("route");
+out1:
+	return -ENOMEM;
+}
+
+void __init fib_proc_exit(void)
+{
+	proc_net_remove("fib_triestat");
+	proc_net_remove("route");
+}
+#endif /* CONFIG_PROC_FS */
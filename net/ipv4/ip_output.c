@@ -61,6 +61,7 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/inetdevice.h>
 #include <linux/proc_fs.h>
 #include <linux/stat.h>
 #include <linux/init.h>
@@ -297,7 +298,7 @@ int ip_mc_output(struct sk_buff *skb)
 				newskb->dev, ip_dev_loopback_xmit);
 	}
 
-	if (skb->len > dst_pmtu(&rt->u.dst))
+	if (skb->len > dst_pmtu(&rt->u.dst) && !skb_shinfo(skb)->tso_size)
 		return ip_fragment(skb, ip_finish_output);
 	else
 		return ip_finish_output(skb);
@@ -918,6 +919,49 @@ csum_page(struct page *page, int offset, int copy)
 	return csum;
 }
 
+/*
+ * UDP fragmentation offload: the device, or software GSO right in front
+ * of it, will cut the datagram into IP fragments, so keep the whole thing
+ * in one skb with the payload in page frags instead of building a chain of
+ * MTU sized skbs here.  The checksum is still accumulated in skb->csum as
+ * the data is copied in.
+ */
+static int ip_ufo_append_data(struct sock *sk,
+			int getfrag(void *from, char *to, int offset, int len,
+				    int odd, struct sk_buff *skb),
+			void *from, int length, int hh_len, int fragheaderlen,
+			int transhdrlen, int maxfraglen, unsigned int flags)
+{
+	struct sk_buff *skb;
+	int err;
+
+	if ((skb = skb_peek_tail(&sk->sk_write_queue)) == NULL) {
+		skb = sock_alloc_send_skb(sk,
+				hh_len + fragheaderlen + transhdrlen + 15,
+				(flags & MSG_DONTWAIT), &err);
+		if (skb == NULL)
+			return err;
+
+		/* reserve space for the hardware header */
+		skb_reserve(skb, hh_len);
+
+		/* room for the IP and UDP headers */
+		skb_put(skb, fragheaderlen + transhdrlen);
+		skb->nh.raw = skb->data;
+		skb->h.raw = skb->data + fragheaderlen;
+		skb->ip_summed = CHECKSUM_NONE;
+		skb->csum = 0;
+
+		/* payload carried by each IP fragment */
+		skb_shinfo(skb)->tso_size = maxfraglen - fragheaderlen;
+		skb_shinfo(skb)->gso_type = SKB_GSO_UDPV4;
+		__skb_queue_tail(&sk->sk_write_queue, skb);
+	}
+
+	return skb_append_datato_frags(sk, skb, getfrag, from,
+				       length - transhdrlen);
+}
+
 /*
  *	ip_append_data() and ip_append_page() can make one large IP datagram
  *	from many pieces of data. Each pieces will be holded on the socket
@@ -1073,6 +1117,24 @@ int ip_append_data(struct sock *sk,
 	 */
 	inet->cork.length += length;
 
+	/**
+	 * 设备（或者软件GSO）可以切分UDP报文时，整个报文放在一个skb中，
+	 * 在发送前才切分成IP片段。已经开始这样构造的报文必须继续这样构造。
+	 */
+	skb = skb_peek_tail(&sk->sk_write_queue);
+	if (skb ? skb_shinfo(skb)->gso_type == SKB_GSO_UDPV4 :
+		  (length + fragheaderlen > mtu &&
+		   sk->sk_protocol == IPPROTO_UDP && !exthdrlen &&
+		   inet->pmtudisc != IP_PMTUDISC_DO &&
+		   (rt->u.dst.dev->features & (NETIF_F_UFO | NETIF_F_GSO)))) {
+		err = ip_ufo_append_data(sk, getfrag, from, length, hh_len,
+					 fragheaderlen, transhdrlen,
+					 maxfraglen, flags);
+		if (err)
+			goto error;
+		return 0;
+	}
+
 	/* So, what's going on in the loop below?
 	 *
 	 * We use calculated fragment length to generate chained skb,
@@ -1412,9 +1474,14 @@ ssize_t	ip_append_page(struct sock *sk, struct page *page,
 		int i;
 
 		/* Check if the remaining data fits into current packet. */
-		len = mtu - skb->len;
-		if (len < size)
-			len = maxfraglen - skb->len;
+		if (skb_shinfo(skb)->gso_type == SKB_GSO_UDPV4) {
+			/* One skb for the whole datagram, see ip_ufo_append_data() */
+			len = size;
+		} else {
+			len = mtu - skb->len;
+			if (len < size)
+				len = maxfraglen - skb->len;
+		}
 		if (len <= 0) {
 			struct sk_buff *skb_prev;
 			char *data;
@@ -1763,6 +1830,173 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 	ip_rt_put(rt);
 }
 
+/*
+ * Software GSO for IPv4: let the transport protocol cut the payload, then
+ * fix up the IP header of every segment.  TCP segments are separate
+ * datagrams and get consecutive ids (ip_queue_xmit() reserved them);
+ * UDP datagrams are sent as fragments of a single datagram instead.
+ */
+static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct iphdr *iph;
+	struct net_protocol *ops;
+	int proto;
+	int ihl;
+	int id;
+	int ufo;
+	int offset = 0;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		goto out;
+
+	iph = skb->nh.iph;
+	ihl = iph->ihl * 4;
+	if (ihl < sizeof(*iph))
+		goto out;
+
+	if (!pskb_may_pull(skb, ihl))
+		goto out;
+
+	skb->h.raw = __skb_pull(skb, ihl);
+	iph = skb->nh.iph;
+	id = ntohs(iph->id);
+	proto = iph->protocol & (MAX_INET_PROTOS - 1);
+	ufo = skb_shinfo(skb)->gso_type & SKB_GSO_UDPV4;
+	segs = ERR_PTR(-EPROTONOSUPPORT);
+
+	rcu_read_lock();
+	ops = rcu_dereference(inet_protos[proto]);
+	if (ops && ops->gso_segment)
+		segs = ops->gso_segment(skb, features);
+	rcu_read_unlock();
+
+	if (unlikely(IS_ERR(segs)))
+		goto out;
+
+	skb = segs;
+	do {
+		iph = skb->nh.iph;
+		if (ufo) {
+			iph->frag_off = htons(offset >> 3);
+			if (skb->next)
+				iph->frag_off |= htons(IP_MF);
+			offset += skb->len - skb->mac_len - ihl;
+		} else
+			iph->id = htons(id++);
+		iph->tot_len = htons(skb->len - skb->mac_len);
+		iph->check = 0;
+		iph->check = ip_fast_csum(skb->nh.raw, iph->ihl);
+	} while ((skb = skb->next));
+
+out:
+	return segs;
+}
+
+/*
+ * GRO for IPv4.  Only plain datagrams are candidates: no options, no
+ * fragments and no trailing padding.  Held packets of the same address
+ * pair must also agree on TTL and TOS and carry consecutive ids, so
+ * that the merged packet can be split up again exactly as it was sent.
+ * Merged packets end up with a frag_list, which skb_segment() has to
+ * copy out again, so nothing is merged on interfaces that forward.
+ */
+static struct sk_buff **inet_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	struct iphdr *iph;
+	struct in_device *in_dev;
+	struct net_protocol *ops;
+	int flush = 1;
+	int proto;
+	u16 id;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		goto out;
+
+	iph = skb->nh.iph;
+	proto = iph->protocol & (MAX_INET_PROTOS - 1);
+
+	rcu_read_lock();
+	ops = rcu_dereference(inet_protos[proto]);
+	if (!ops || !ops->gro_receive)
+		goto out_unlock;
+
+	if (*(u8 *)iph != 0x45)
+		goto out_unlock;
+
+	if (unlikely(ip_fast_csum((u8 *)iph, iph->ihl)))
+		goto out_unlock;
+
+	in_dev = __in_dev_get(skb->dev);
+	if (!in_dev || IN_DEV_FORWARD(in_dev))
+		goto out_unlock;
+
+	flush = ntohs(iph->tot_len) != skb->len ||
+		(iph->frag_off & ~htons(IP_DF)) != 0;
+	id = ntohs(iph->id);
+
+	for (p = *head; p; p = p->next) {
+		struct iphdr *iph2;
+
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		iph2 = p->nh.iph;
+		if (iph->protocol != iph2->protocol ||
+		    iph->saddr != iph2->saddr ||
+		    iph->daddr != iph2->daddr) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		NAPI_GRO_CB(p)->flush |= flush ||
+			iph->ttl != iph2->ttl || iph->tos != iph2->tos ||
+			(u16)(ntohs(iph2->id) + NAPI_GRO_CB(p)->count) != id;
+	}
+
+	/*
+	 * Even a packet that can't be merged goes to the transport
+	 * protocol, which delivers whatever it holds of the same flow
+	 * first, so the stack still sees the flow in order.
+	 */
+	NAPI_GRO_CB(skb)->flush |= flush;
+	skb->h.raw = __skb_pull(skb, sizeof(*iph));
+	pp = ops->gro_receive(head, skb);
+	if (!NAPI_GRO_CB(skb)->same_flow)
+		__skb_push(skb, sizeof(*iph));
+	flush = 0;
+
+out_unlock:
+	rcu_read_unlock();
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+	return pp;
+}
+
+/* The merged packet is about to go up the stack: make its header true. */
+static int inet_gro_complete(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+	struct net_protocol *ops;
+	int proto = iph->protocol & (MAX_INET_PROTOS - 1);
+	int err = -ENOSYS;
+
+	iph->tot_len = htons(skb->len);
+	iph->check = 0;
+	iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+
+	rcu_read_lock();
+	ops = rcu_dereference(inet_protos[proto]);
+	if (ops && ops->gro_complete)
+		err = ops->gro_complete(skb);
+	rcu_read_unlock();
+
+	return err;
+}
+
 /*
  *	IP protocol layer initialiser
  */
@@ -1773,6 +2007,9 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 static struct packet_type ip_packet_type = {
 	.type = __constant_htons(ETH_P_IP),
 	.func = ip_rcv,
+	.gso_segment = inet_gso_segment,
+	.gro_receive = inet_gro_receive,
+	.gro_complete = inet_gro_complete,
 };
 
 /*
@@ -37,9 +37,14 @@
 #include <linux/err.h>
 #include <linux/percpu.h>
 #include <linux/moduleparam.h>
-
-/* This rwlock protects the main hash table, protocol/helper/expected
-   registrations, conntrack timers*/
+#include <linux/workqueue.h>
+#include <linux/rcupdate.h>
+#include <linux/list_nulls.h>
+#include <linux/seqlock.h>
+#include <asm/semaphore.h>
+
+/* This rwlock protects protocol/helper registrations and expectations.
+   The main hash table has its own bucket locks (see IP_CT_BUCKET_LOCK). */
 #define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(&ip_conntrack_lock)
 #define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(&ip_conntrack_lock)
 
@@ -68,16 +73,47 @@ struct ip_conntrack_protocol *ip_ct_protos[MAX_IP_CT_PROTO];
 static LIST_HEAD(helpers);
 unsigned int ip_conntrack_htable_size = 0;
 int ip_conntrack_max;
-struct list_head *ip_conntrack_hash;
+struct hlist_nulls_head *ip_conntrack_hash;
+spinlock_t ip_conntrack_locks[IP_CT_LOCKS];
+seqcount_t ip_conntrack_hash_seq = SEQCNT_ZERO;
+/* Serializes resizes against walks of the whole table */
+static DECLARE_MUTEX(ip_conntrack_resize_sem);
 static kmem_cache_t *ip_conntrack_cachep;
 static kmem_cache_t *ip_conntrack_expect_cachep;
 struct ip_conntrack ip_conntrack_untracked;
 unsigned int ip_ct_log_invalid;
-static LIST_HEAD(unconfirmed);
 static int ip_conntrack_vmalloc;
 
+/* Conntracks that are not confirmed yet hang off the list of the CPU
+   that created them, by their original tuple.  The nulls marker is
+   never a bucket index, so a lockless lookup that strays onto one of
+   these lists restarts. */
+#define IP_CT_UNCONFIRMED_NULLS	(~0U >> 1)
+
+struct ip_conntrack_unconfirmed
+{
+	spinlock_t lock;
+	struct hlist_nulls_head list;
+};
+static DEFINE_PER_CPU(struct ip_conntrack_unconfirmed, unconfirmed);
+
 DEFINE_PER_CPU(struct ip_conntrack_stat, ip_conntrack_stat);
 
+/* Lookups take no lock: a conntrack found may be on its way back to
+   the (SLAB_DESTROY_BY_RCU) cache, so the reference is only taken if
+   the count is still non-zero, and the tuple is checked again after.
+   Architectures that can't do that atomically take the bucket lock,
+   under which both always succeed. */
+#ifdef __HAVE_ARCH_ATOMIC_INC_NOT_ZERO
+#define ip_ct_bucket_read_lock(bucket)		do { } while (0)
+#define ip_ct_bucket_read_unlock(bucket)	do { } while (0)
+#define ip_ct_hold(ct)		atomic_inc_not_zero(&(ct)->ct_general.use)
+#else
+#define ip_ct_bucket_read_lock(bucket)	spin_lock(IP_CT_BUCKET_LOCK(bucket))
+#define ip_ct_bucket_read_unlock(bucket) spin_unlock(IP_CT_BUCKET_LOCK(bucket))
+#define ip_ct_hold(ct)		({ atomic_inc(&(ct)->ct_general.use); 1; })
+#endif
+
 void 
 ip_conntrack_put(struct ip_conntrack *ct)
 {
@@ -89,7 +125,7 @@ static int ip_conntrack_hash_rnd_initted;
 static unsigned int ip_conntrack_hash_rnd;
 
 static u_int32_t
-hash_conntrack(const struct ip_conntrack_tuple *tuple)
+__hash_conntrack(const struct ip_conntrack_tuple *tuple, unsigned int size)
 {
 #if 0
 	dump_tuple(tuple);
@@ -97,7 +133,76 @@ hash_conntrack(const struct ip_conntrack_tuple *tuple)
 	return (jhash_3words(tuple->src.ip,
 	                     (tuple->dst.ip ^ tuple->dst.protonum),
 	                     (tuple->src.u.all | (tuple->dst.u.all << 16)),
-	                     ip_conntrack_hash_rnd) % ip_conntrack_htable_size);
+	                     ip_conntrack_hash_rnd) % size);
+}
+
+static inline u_int32_t
+hash_conntrack(const struct ip_conntrack_tuple *tuple)
+{
+	return __hash_conntrack(tuple, ip_conntrack_htable_size);
+}
+
+static void ip_ct_unlock_buckets(unsigned int hash, unsigned int repl_hash)
+{
+	unsigned int a = hash % IP_CT_LOCKS, b = repl_hash % IP_CT_LOCKS;
+
+	if (a != b)
+		spin_unlock(&ip_conntrack_locks[max(a, b)]);
+	spin_unlock_bh(&ip_conntrack_locks[min(a, b)]);
+}
+
+/* Lock the buckets both tuples of ct hash to.  Locks are taken in
+   ascending order, and again if a resize moved the table meanwhile. */
+static void ip_ct_lock_buckets(const struct ip_conntrack *ct,
+			       unsigned int *hash, unsigned int *repl_hash)
+{
+	unsigned int seq, a, b;
+
+	for (;;) {
+		seq = read_seqcount_begin(&ip_conntrack_hash_seq);
+		*hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		*repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+		a = *hash % IP_CT_LOCKS;
+		b = *repl_hash % IP_CT_LOCKS;
+
+		spin_lock_bh(&ip_conntrack_locks[min(a, b)]);
+		if (a != b)
+			spin_lock(&ip_conntrack_locks[max(a, b)]);
+		if (!read_seqcount_retry(&ip_conntrack_hash_seq, seq))
+			return;
+		ip_ct_unlock_buckets(*hash, *repl_hash);
+	}
+}
+
+/* Caller has bottom halves disabled. */
+static void unconfirmed_add(struct ip_conntrack *ct)
+{
+	struct ip_conntrack_unconfirmed *u;
+
+	ct->cpu = smp_processor_id();
+	u = &per_cpu(unconfirmed, ct->cpu);
+	spin_lock(&u->lock);
+	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
+				 &u->list);
+	spin_unlock(&u->lock);
+}
+
+/* Caller has bottom halves disabled. */
+static void unconfirmed_del(struct ip_conntrack *ct)
+{
+	struct ip_conntrack_unconfirmed *u;
+
+	u = &per_cpu(unconfirmed, ct->cpu);
+	spin_lock(&u->lock);
+	hlist_nulls_del_init_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+	spin_unlock(&u->lock);
+}
+
+/* A conntrack that timed out or is being killed is as good as gone,
+   even if the garbage collector hasn't unhashed it yet. */
+static inline int ip_ct_alive(const struct ip_conntrack *ct)
+{
+	return !ip_ct_expired(ct) && !test_bit(IPS_DYING_BIT, &ct->status);
 }
 
 int
@@ -203,21 +308,14 @@ static void remove_expectations(struct ip_conntrack *ct)
 	}
 }
 
+/* Caller holds both bucket locks. */
 static void
 clean_from_lists(struct ip_conntrack *ct)
 {
-	unsigned int ho, hr;
-	
 	DEBUGP("clean_from_lists(%p)\n", ct);
-	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
-
-	ho = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	hr = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-	LIST_DELETE(&ip_conntrack_hash[ho], &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-	LIST_DELETE(&ip_conntrack_hash[hr], &ct->tuplehash[IP_CT_DIR_REPLY]);
 
-	/* Destroy all pending expectations */
-	remove_expectations(ct);
+	hlist_nulls_del_init_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+	hlist_nulls_del_init_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode);
 }
 
 static void
@@ -228,7 +326,7 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	DEBUGP("destroy_conntrack(%p)\n", ct);
 	IP_NF_ASSERT(atomic_read(&nfct->use) == 0);
-	IP_NF_ASSERT(!timer_pending(&ct->timeout));
+	IP_NF_ASSERT(hlist_nulls_unhashed(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode));
 
 	/* To make sure we don't get any weird locking issues here:
 	 * destroy_conntrack() MUST NOT be called with a write lock
@@ -240,21 +338,25 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	if (ip_conntrack_destroyed)
 		ip_conntrack_destroyed(ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
-	/* Expectations will have been removed in clean_from_lists,
+	/* Expectations will have been removed in ip_ct_kill,
 	 * except TFTP can create an expectation on the first packet,
 	 * before connection is in the list, so we need to clean here,
 	 * too. */
-	remove_expectations(ct);
+	if (ct->expecting) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		remove_expectations(ct);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
 
+	local_bh_disable();
 	/* We overload first tuple to link into unconfirmed list. */
 	if (!is_confirmed(ct)) {
-		BUG_ON(list_empty(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list));
-		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+		BUG_ON(hlist_nulls_unhashed(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode));
+		unconfirmed_del(ct);
 	}
 
 	CONNTRACK_STAT_INC(delete);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	local_bh_enable();
 
 	if (ct->master)
 		ip_conntrack_put(ct->master);
@@ -264,17 +366,32 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	atomic_dec(&ip_conntrack_count);
 }
 
-static void death_by_timeout(unsigned long ul_conntrack)
+/* Take a confirmed conntrack out of the hash table and drop the
+   table's reference, as the timeout would have.  Returns 0 if it was
+   already on its way out. */
+int ip_ct_kill(struct ip_conntrack *ct)
 {
-	struct ip_conntrack *ct = (void *)ul_conntrack;
+	unsigned int hash, repl_hash;
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	if (!is_confirmed(ct) || test_and_set_bit(IPS_DYING_BIT, &ct->status))
+		return 0;
+
+	ip_ct_lock_buckets(ct, &hash, &repl_hash);
 	/* Inside lock so preempt is disabled on module removal path.
 	 * Otherwise we can get spurious warnings. */
 	CONNTRACK_STAT_INC(delete_list);
 	clean_from_lists(ct);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	ip_ct_unlock_buckets(hash, repl_hash);
+
+	/* Destroy all pending expectations */
+	if (ct->expecting) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		remove_expectations(ct);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
+
 	ip_conntrack_put(ct);
+	return 1;
 }
 
 static inline int
@@ -282,28 +399,62 @@ conntrack_tuple_cmp(const struct ip_conntrack_tuple_hash *i,
 		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 	return tuplehash_to_ctrack(i) != ignored_conntrack
 		&& ip_ct_tuple_equal(tuple, &i->tuple);
 }
 
+/* Caller has bottom halves disabled. */
 static struct ip_conntrack_tuple_hash *
-__ip_conntrack_find(const struct ip_conntrack_tuple *tuple,
-		    const struct ip_conntrack *ignored_conntrack)
+__ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
+			const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
-	unsigned int hash = hash_conntrack(tuple);
+	struct hlist_nulls_head *head;
+	struct hlist_nulls_node *n;
+	struct ip_conntrack *ct;
+	unsigned int hash, seq;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	list_for_each_entry(h, &ip_conntrack_hash[hash], list) {
-		if (conntrack_tuple_cmp(h, tuple, ignored_conntrack)) {
-			CONNTRACK_STAT_INC(found);
-			return h;
+begin:
+	do {
+		seq = read_seqcount_begin(&ip_conntrack_hash_seq);
+		hash = hash_conntrack(tuple);
+		head = &ip_conntrack_hash[hash];
+	} while (read_seqcount_retry(&ip_conntrack_hash_seq, seq));
+
+	ip_ct_bucket_read_lock(hash);
+	hlist_nulls_for_each_entry_rcu(h, n, head, hnnode) {
+		ct = tuplehash_to_ctrack(h);
+		if (!conntrack_tuple_cmp(h, tuple, ignored_conntrack)
+		    || !ip_ct_alive(ct)) {
+			CONNTRACK_STAT_INC(searched);
+			continue;
+		}
+		if (unlikely(!ip_ct_hold(ct)))
+			goto restart;
+		if (unlikely(!conntrack_tuple_cmp(h, tuple, ignored_conntrack)
+			     || !is_confirmed(ct))) {
+			ip_ct_bucket_read_unlock(hash);
+			ip_conntrack_put(ct);
+			CONNTRACK_STAT_INC(search_restart);
+			goto begin;
 		}
-		CONNTRACK_STAT_INC(searched);
+		ip_ct_bucket_read_unlock(hash);
+		CONNTRACK_STAT_INC(found);
+		return h;
 	}
+	/* An entry we walked through was freed and reused on another
+	   chain, or a resize moved it: the miss proves nothing. */
+	if (get_nulls_value(n) != hash
+	    || read_seqcount_retry(&ip_conntrack_hash_seq, seq))
+		goto restart;
+	ip_ct_bucket_read_unlock(hash);
 
 	return NULL;
+
+restart:
+	ip_ct_bucket_read_unlock(hash);
+	CONNTRACK_STAT_INC(search_restart);
+	goto begin;
 }
 
 /* Find a connection corresponding to a tuple. */
@@ -313,11 +464,9 @@ ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack_tuple_hash *h;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	if (h)
-		atomic_inc(&tuplehash_to_ctrack(h)->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+	rcu_read_lock_bh();
+	h = __ip_conntrack_find_get(tuple, ignored_conntrack);
+	rcu_read_unlock_bh();
 
 	return h;
 }
@@ -327,6 +476,9 @@ int
 __ip_conntrack_confirm(struct sk_buff **pskb)
 {
 	unsigned int hash, repl_hash;
+	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	struct ip_conntrack_unconfirmed *u;
 	struct ip_conntrack *ct;
 	enum ip_conntrack_info ctinfo;
 
@@ -339,9 +491,6 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 	if (CTINFO2DIR(ctinfo) != IP_CT_DIR_ORIGINAL)
 		return NF_ACCEPT;
 
-	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-
 	/* We're not in hash table, and we refuse to set up related
 	   connections for unconfirmed conns.  But packet copies and
 	   REJECT will give spurious warnings here. */
@@ -352,40 +501,50 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 	IP_NF_ASSERT(!is_confirmed(ct));
 	DEBUGP("Confirming conntrack %p\n", ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	ip_ct_lock_buckets(ct, &hash, &repl_hash);
 
 	/* See if there's one in the list already, including reverse:
            NAT could have grabbed it without realizing, since we're
            not in the hash.  If there is, we lost race. */
-	if (!LIST_FIND(&ip_conntrack_hash[hash],
-		       conntrack_tuple_cmp,
-		       struct ip_conntrack_tuple_hash *,
-		       &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, NULL)
-	    && !LIST_FIND(&ip_conntrack_hash[repl_hash],
-			  conntrack_tuple_cmp,
-			  struct ip_conntrack_tuple_hash *,
-			  &ct->tuplehash[IP_CT_DIR_REPLY].tuple, NULL)) {
-		/* Remove from unconfirmed list */
-		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
-
-		list_prepend(&ip_conntrack_hash[hash],
-			     &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-		list_prepend(&ip_conntrack_hash[repl_hash],
-			     &ct->tuplehash[IP_CT_DIR_REPLY]);
-		/* Timer relative to confirmation time, not original
-		   setting time, otherwise we'd get timer wrap in
-		   weird delay cases. */
-		ct->timeout.expires += jiffies;
-		add_timer(&ct->timeout);
-		atomic_inc(&ct->ct_general.use);
-		set_bit(IPS_CONFIRMED_BIT, &ct->status);
-		CONNTRACK_STAT_INC(insert);
-		WRITE_UNLOCK(&ip_conntrack_lock);
-		return NF_ACCEPT;
+	hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[hash], hnnode)
+		if (conntrack_tuple_cmp(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+					NULL)
+		    && ip_ct_alive(tuplehash_to_ctrack(h)))
+			goto out;
+	hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[repl_hash], hnnode)
+		if (conntrack_tuple_cmp(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+					NULL)
+		    && ip_ct_alive(tuplehash_to_ctrack(h)))
+			goto out;
+
+	/* Remove from unconfirmed list, unless ip_ct_iterate_cleanup()
+	   wanted it gone while it was there. */
+	u = &per_cpu(unconfirmed, ct->cpu);
+	spin_lock(&u->lock);
+	if (test_bit(IPS_DYING_BIT, &ct->status)) {
+		spin_unlock(&u->lock);
+		goto out;
 	}
+	hlist_nulls_del_init_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+	spin_unlock(&u->lock);
+
+	/* Timeout relative to confirmation time, not original
+	   setting time, otherwise we'd get timer wrap in
+	   weird delay cases. */
+	ct->timeout += jiffies;
+	atomic_inc(&ct->ct_general.use);
+	set_bit(IPS_CONFIRMED_BIT, &ct->status);
+	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
+				 &ip_conntrack_hash[hash]);
+	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
+				 &ip_conntrack_hash[repl_hash]);
+	CONNTRACK_STAT_INC(insert);
+	ip_ct_unlock_buckets(hash, repl_hash);
+	return NF_ACCEPT;
 
+out:
 	CONNTRACK_STAT_INC(insert_failed);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	ip_ct_unlock_buckets(hash, repl_hash);
 
 	return NF_DROP;
 }
@@ -398,11 +557,12 @@ ip_conntrack_tuple_taken(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack_tuple_hash *h;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	READ_UNLOCK(&ip_conntrack_lock);
+	h = ip_conntrack_find_get(tuple, ignored_conntrack);
+	if (!h)
+		return 0;
+	ip_conntrack_put(tuplehash_to_ctrack(h));
 
-	return h != NULL;
+	return 1;
 }
 
 /* There's a small race here where we may free a just-assured
@@ -412,26 +572,32 @@ static inline int unreplied(const struct ip_conntrack_tuple_hash *i)
 	return !(test_bit(IPS_ASSURED_BIT, &tuplehash_to_ctrack(i)->status));
 }
 
-static int early_drop(struct list_head *chain)
+static int early_drop(unsigned int hash)
 {
-	/* Traverse backwards: gives us oldest, which is roughly LRU */
+	/* Last one on the chain is the oldest, which is roughly LRU */
 	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
 	struct ip_conntrack *ct = NULL;
 	int dropped = 0;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = LIST_FIND_B(chain, unreplied, struct ip_conntrack_tuple_hash *);
-	if (h) {
-		ct = tuplehash_to_ctrack(h);
-		atomic_inc(&ct->ct_general.use);
+	spin_lock_bh(IP_CT_BUCKET_LOCK(hash));
+	/* Table may have been resized since hash was worked out. */
+	if (hash < ip_conntrack_htable_size) {
+		hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[hash],
+					   hnnode)
+			if (unreplied(h)
+			    && !test_bit(IPS_DYING_BIT,
+					 &tuplehash_to_ctrack(h)->status))
+				ct = tuplehash_to_ctrack(h);
+		if (ct)
+			atomic_inc(&ct->ct_general.use);
 	}
-	READ_UNLOCK(&ip_conntrack_lock);
+	spin_unlock_bh(IP_CT_BUCKET_LOCK(hash));
 
 	if (!ct)
 		return dropped;
 
-	if (del_timer(&ct->timeout)) {
-		death_by_timeout((unsigned long)ct);
+	if (ip_ct_kill(ct)) {
 		dropped = 1;
 		CONNTRACK_STAT_INC(early_drop);
 	}
@@ -439,17 +605,16 @@ static int early_drop(struct list_head *chain)
 	return dropped;
 }
 
-static inline int helper_cmp(const struct ip_conntrack_helper *i,
-			     const struct ip_conntrack_tuple *rtuple)
-{
-	return ip_ct_tuple_mask_cmp(rtuple, &i->tuple, &i->mask);
-}
-
+/* Under ip_conntrack_lock, or with bottom halves disabled. */
 static struct ip_conntrack_helper *ip_ct_find_helper(const struct ip_conntrack_tuple *tuple)
 {
-	return LIST_FIND(&helpers, helper_cmp,
-			 struct ip_conntrack_helper *,
-			 tuple);
+	struct ip_conntrack_helper *h;
+
+	list_for_each_entry_rcu(h, &helpers, list) {
+		if (ip_ct_tuple_mask_cmp(tuple, &h->tuple, &h->mask))
+			return h;
+	}
+	return NULL;
 }
 
 /* Allocate a new conntrack: we return -ENOMEM if classification
@@ -474,7 +639,7 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 	if (ip_conntrack_max
 	    && atomic_read(&ip_conntrack_count) >= ip_conntrack_max) {
 		/* Try dropping from this hash chain. */
-		if (!early_drop(&ip_conntrack_hash[hash])) {
+		if (!early_drop(hash)) {
 			if (net_ratelimit())
 				printk(KERN_WARNING
 				       "ip_conntrack: table full, dropping"
@@ -494,22 +659,33 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 		return ERR_PTR(-ENOMEM);
 	}
 
-	memset(conntrack, 0, sizeof(*conntrack));
-	atomic_set(&conntrack->ct_general.use, 1);
+	/* A lockless lookup may still be walking through this memory:
+	   leave the hash nodes alone, and the refcnt zero until the
+	   tuples are in place. */
+	memset(conntrack, 0, offsetof(struct ip_conntrack, tuplehash));
 	conntrack->ct_general.destroy = destroy_conntrack;
 	conntrack->tuplehash[IP_CT_DIR_ORIGINAL].tuple = *tuple;
 	conntrack->tuplehash[IP_CT_DIR_REPLY].tuple = repl_tuple;
+#ifdef CONFIG_IP_NF_CT_ACCT
+	spin_lock_init(&conntrack->counters_lock);
+#endif
 	if (!protocol->new(conntrack, skb)) {
 		kmem_cache_free(ip_conntrack_cachep, conntrack);
 		return NULL;
 	}
-	/* Don't set timer yet: wait for confirmation */
-	init_timer(&conntrack->timeout);
-	conntrack->timeout.data = (unsigned long)conntrack;
-	conntrack->timeout.function = death_by_timeout;
+	/* Don't start the timeout yet: wait for confirmation */
+	smp_wmb();
+	atomic_set(&conntrack->ct_general.use, 1);
 
-	WRITE_LOCK(&ip_conntrack_lock);
-	exp = find_expectation(tuple);
+	/* Keeps the helper we find alive until we're on the unconfirmed
+	   list, where ip_conntrack_helper_unregister() will see us. */
+	local_bh_disable();
+	exp = NULL;
+	if (!list_empty(&ip_conntrack_expect_list)) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		exp = find_expectation(tuple);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
 
 	if (exp) {
 		DEBUGP("conntrack: expectation arrives ct=%p exp=%p\n",
@@ -529,10 +705,10 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 	}
 
 	/* Overload tuple linked list to put us in unconfirmed list. */
-	list_add(&conntrack->tuplehash[IP_CT_DIR_ORIGINAL].list, &unconfirmed);
+	unconfirmed_add(conntrack);
 
 	atomic_inc(&ip_conntrack_count);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	local_bh_enable();
 
 	if (exp) {
 		if (exp->expectfn)
@@ -858,28 +1034,29 @@ int ip_conntrack_helper_register(struct ip_conntrack_helper *me)
 {
 	BUG_ON(me->timeout == 0);
 	WRITE_LOCK(&ip_conntrack_lock);
-	list_prepend(&helpers, me);
+	list_add_rcu(&me->list, &helpers);
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
 	return 0;
 }
 
-static inline int unhelp(struct ip_conntrack_tuple_hash *i,
-			 const struct ip_conntrack_helper *me)
+static inline void unhelp(struct ip_conntrack_tuple_hash *i,
+			  const struct ip_conntrack_helper *me)
 {
 	if (tuplehash_to_ctrack(i)->helper == me)
 		tuplehash_to_ctrack(i)->helper = NULL;
-	return 0;
 }
 
 void ip_conntrack_helper_unregister(struct ip_conntrack_helper *me)
 {
 	unsigned int i;
 	struct ip_conntrack_expect *exp, *tmp;
+	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
 
 	/* Need write lock here, to delete helper. */
 	WRITE_LOCK(&ip_conntrack_lock);
-	LIST_DELETE(&helpers, me);
+	list_del_rcu(&me->list);
 
 	/* Get rid of expectations */
 	list_for_each_entry_safe(exp, tmp, &ip_conntrack_expect_list, list) {
@@ -888,13 +1065,31 @@ void ip_conntrack_helper_unregister(struct ip_conntrack_helper *me)
 			destroy_expect(exp);
 		}
 	}
-	/* Get rid of expecteds, set helpers to NULL. */
-	LIST_FIND_W(&unconfirmed, unhelp, struct ip_conntrack_tuple_hash*, me);
-	for (i = 0; i < ip_conntrack_htable_size; i++)
-		LIST_FIND_W(&ip_conntrack_hash[i], unhelp,
-			    struct ip_conntrack_tuple_hash *, me);
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
+	/* init_conntrack() finds helpers without the lock: wait until
+	   everyone who did has put their conntrack on a list below. */
+	synchronize_net();
+
+	/* Get rid of expecteds, set helpers to NULL. */
+	for_each_cpu(i) {
+		struct ip_conntrack_unconfirmed *u;
+
+		u = &per_cpu(unconfirmed, i);
+		spin_lock_bh(&u->lock);
+		hlist_nulls_for_each_entry(h, n, &u->list, hnnode)
+			unhelp(h, me);
+		spin_unlock_bh(&u->lock);
+	}
+	down(&ip_conntrack_resize_sem);
+	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		spin_lock_bh(IP_CT_BUCKET_LOCK(i));
+		hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[i], hnnode)
+			unhelp(h, me);
+		spin_unlock_bh(IP_CT_BUCKET_LOCK(i));
+	}
+	up(&ip_conntrack_resize_sem);
+
 	/* Someone could be still looking at the helper in a bh. */
 	synchronize_net();
 }
@@ -905,9 +1100,11 @@ static inline void ct_add_counters(struct ip_conntrack *ct,
 {
 #ifdef CONFIG_IP_NF_CT_ACCT
 	if (skb) {
+		spin_lock_bh(&ct->counters_lock);
 		ct->counters[CTINFO2DIR(ctinfo)].packets++;
 		ct->counters[CTINFO2DIR(ctinfo)].bytes += 
 					ntohs(skb->nh.iph->tot_len);
+		spin_unlock_bh(&ct->counters_lock);
 	}
 #endif
 }
@@ -918,22 +1115,15 @@ void ip_ct_refresh_acct(struct ip_conntrack *ct,
 			const struct sk_buff *skb,
 			unsigned long extra_jiffies)
 {
-	IP_NF_ASSERT(ct->timeout.data == (unsigned long)ct);
-
-	/* If not in hash table, timer will not be active yet */
-	if (!is_confirmed(ct)) {
-		ct->timeout.expires = extra_jiffies;
-		ct_add_counters(ct, ctinfo, skb);
-	} else {
-		WRITE_LOCK(&ip_conntrack_lock);
-		/* Need del_timer for race avoidance (may already be dying). */
-		if (del_timer(&ct->timeout)) {
-			ct->timeout.expires = jiffies + extra_jiffies;
-			add_timer(&ct->timeout);
-		}
-		ct_add_counters(ct, ctinfo, skb);
-		WRITE_UNLOCK(&ip_conntrack_lock);
-	}
+	/* If not in hash table, timeout is still relative */
+	if (!is_confirmed(ct))
+		ct->timeout = extra_jiffies;
+	/* Once timed out (or being killed), it stays dead; no lock
+	   needed, a racing refresh just makes it live a little longer. */
+	else if (ip_ct_alive(ct))
+		ct->timeout = jiffies + extra_jiffies;
+
+	ct_add_counters(ct, ctinfo, skb);
 }
 
 /* Returns new sk_buff, or NULL */
@@ -994,53 +1184,134 @@ static void ip_conntrack_attach(struct sk_buff *nskb, struct sk_buff *skb)
 	nf_conntrack_get(nskb->nfct);
 }
 
-static inline int
-do_iter(const struct ip_conntrack_tuple_hash *i,
-	int (*iter)(struct ip_conntrack *i, void *data),
-	void *data)
-{
-	return iter(tuplehash_to_ctrack(i), data);
-}
-
-/* Bring out ya dead! */
-static struct ip_conntrack_tuple_hash *
+/* Bring out ya dead!  Caller holds ip_conntrack_resize_sem. */
+static struct ip_conntrack *
 get_next_corpse(int (*iter)(struct ip_conntrack *i, void *data),
 		void *data, unsigned int *bucket)
 {
-	struct ip_conntrack_tuple_hash *h = NULL;
+	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	struct ip_conntrack *ct;
 
-	WRITE_LOCK(&ip_conntrack_lock);
 	for (; *bucket < ip_conntrack_htable_size; (*bucket)++) {
-		h = LIST_FIND_W(&ip_conntrack_hash[*bucket], do_iter,
-				struct ip_conntrack_tuple_hash *, iter, data);
-		if (h)
-			break;
+		spin_lock_bh(IP_CT_BUCKET_LOCK(*bucket));
+		hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[*bucket],
+					   hnnode) {
+			ct = tuplehash_to_ctrack(h);
+			if (!test_bit(IPS_DYING_BIT, &ct->status)
+			    && iter(ct, data)) {
+				atomic_inc(&ct->ct_general.use);
+				spin_unlock_bh(IP_CT_BUCKET_LOCK(*bucket));
+				return ct;
+			}
+		}
+		spin_unlock_bh(IP_CT_BUCKET_LOCK(*bucket));
 	}
-	if (!h)
-		h = LIST_FIND_W(&unconfirmed, do_iter,
-				struct ip_conntrack_tuple_hash *, iter, data);
-	if (h)
-		atomic_inc(&tuplehash_to_ctrack(h)->ct_general.use);
-	WRITE_UNLOCK(&ip_conntrack_lock);
-
-	return h;
+	return NULL;
 }
 
 void
 ip_ct_iterate_cleanup(int (*iter)(struct ip_conntrack *i, void *), void *data)
 {
 	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	struct ip_conntrack *ct;
 	unsigned int bucket = 0;
+	int cpu;
+
+	/* Not in the hash yet: make sure they never get there.  Those
+	   confirmed meanwhile are in the hash by the time we walk it. */
+	for_each_cpu(cpu) {
+		struct ip_conntrack_unconfirmed *u;
+
+		u = &per_cpu(unconfirmed, cpu);
+		spin_lock_bh(&u->lock);
+		hlist_nulls_for_each_entry(h, n, &u->list, hnnode) {
+			ct = tuplehash_to_ctrack(h);
+			if (iter(ct, data))
+				set_bit(IPS_DYING_BIT, &ct->status);
+		}
+		spin_unlock_bh(&u->lock);
+	}
 
-	while ((h = get_next_corpse(iter, data, &bucket)) != NULL) {
-		struct ip_conntrack *ct = tuplehash_to_ctrack(h);
+	down(&ip_conntrack_resize_sem);
+	while ((ct = get_next_corpse(iter, data, &bucket)) != NULL) {
 		/* Time to push up daises... */
-		if (del_timer(&ct->timeout))
-			death_by_timeout((unsigned long)ct);
-		/* ... else the timer will get him soon. */
+		ip_ct_kill(ct);
 
 		ip_conntrack_put(ct);
 	}
+	up(&ip_conntrack_resize_sem);
+}
+
+/* Expired conntracks are reaped by a worker that walks a slice of the
+   table every IP_CT_GC_INTERVAL, instead of by one timer each. */
+#define IP_CT_GC_INTERVAL	(HZ / 10)
+#define IP_CT_GC_SLICES		20	/* whole table every 2 seconds */
+
+static void ip_conntrack_gc(void *data);
+static DECLARE_WORK(ip_conntrack_gc_work, ip_conntrack_gc, NULL);
+static int ip_conntrack_gc_running;
+static unsigned int ip_conntrack_gc_bucket;
+
+static void ip_conntrack_gc_chain(unsigned int bucket)
+{
+	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	struct ip_conntrack *ct;
+
+	do {
+		ct = NULL;
+		spin_lock_bh(IP_CT_BUCKET_LOCK(bucket));
+		/* Table may have shrunk under us. */
+		if (bucket < ip_conntrack_htable_size) {
+			hlist_nulls_for_each_entry(h, n,
+						   &ip_conntrack_hash[bucket],
+						   hnnode) {
+				ct = tuplehash_to_ctrack(h);
+				if (!ip_ct_expired(ct)
+				    || test_bit(IPS_DYING_BIT, &ct->status)) {
+					ct = NULL;
+					continue;
+				}
+				atomic_inc(&ct->ct_general.use);
+				break;
+			}
+		}
+		spin_unlock_bh(IP_CT_BUCKET_LOCK(bucket));
+
+		if (ct) {
+			ip_ct_kill(ct);
+			ip_conntrack_put(ct);
+		}
+	} while (ct);
+}
+
+static void ip_conntrack_gc(void *data)
+{
+	unsigned int i, n;
+
+	n = ip_conntrack_htable_size / IP_CT_GC_SLICES + 1;
+	for (i = 0; i < n; i++) {
+		if (ip_conntrack_gc_bucket >= ip_conntrack_htable_size)
+			ip_conntrack_gc_bucket = 0;
+		ip_conntrack_gc_chain(ip_conntrack_gc_bucket++);
+		cond_resched();
+	}
+
+	if (ip_conntrack_gc_running)
+		schedule_delayed_work(&ip_conntrack_gc_work, IP_CT_GC_INTERVAL);
+}
+
+static void ip_conntrack_gc_stop(void)
+{
+	ip_conntrack_gc_running = 0;
+	smp_mb();
+	/* Twice: a run in flight may have queued the next one. */
+	cancel_delayed_work(&ip_conntrack_gc_work);
+	flush_scheduled_work();
+	cancel_delayed_work(&ip_conntrack_gc_work);
+	flush_scheduled_work();
 }
 
 /* Fast function for those who don't want to parse /proc (and I don't
@@ -1110,14 +1381,87 @@ static int kill_all(struct ip_conntrack *i, void *data)
 	return 1;
 }
 
-static void free_conntrack_hash(void)
+static struct hlist_nulls_head *alloc_conntrack_hash(unsigned int size,
+							int *vmalloced)
 {
-	if (ip_conntrack_vmalloc)
-		vfree(ip_conntrack_hash);
+	struct hlist_nulls_head *hash;
+	unsigned int i;
+
+	*vmalloced = 0; 
+	hash = (void*)__get_free_pages(GFP_KERNEL, 
+				       get_order(sizeof(struct hlist_nulls_head)
+						 * size));
+	if (!hash) { 
+		*vmalloced = 1;
+		printk(KERN_WARNING "ip_conntrack: falling back to vmalloc.\n");
+		hash = vmalloc(sizeof(struct hlist_nulls_head) * size);
+	}
+
+	if (hash)
+		for (i = 0; i < size; i++)
+			INIT_HLIST_NULLS_HEAD(&hash[i], i);
+	return hash;
+}
+
+static void free_conntrack_hash(struct hlist_nulls_head *hash, int vmalloced,
+				unsigned int size)
+{
+	if (vmalloced)
+		vfree(hash);
 	else
-		free_pages((unsigned long)ip_conntrack_hash, 
-			   get_order(sizeof(struct list_head)
-				     * ip_conntrack_htable_size));
+		free_pages((unsigned long)hash, 
+			   get_order(sizeof(struct hlist_nulls_head) * size));
+}
+
+/* Move every conntrack to a table of a new size.  Lookups keep going
+   meanwhile: they notice the seqcount change and search again. */
+static int ip_conntrack_resize(unsigned int size)
+{
+	struct hlist_nulls_head *hash, *old_hash;
+	struct ip_conntrack_tuple_hash *h;
+	unsigned int i, bucket, old_size;
+	int vmalloced, old_vmalloced;
+
+	hash = alloc_conntrack_hash(size, &vmalloced);
+	if (!hash)
+		return -ENOMEM;
+
+	down(&ip_conntrack_resize_sem);
+	local_bh_disable();
+	for (i = 0; i < IP_CT_LOCKS; i++)
+		spin_lock(&ip_conntrack_locks[i]);
+	write_seqcount_begin(&ip_conntrack_hash_seq);
+
+	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		while (!hlist_nulls_empty(&ip_conntrack_hash[i])) {
+			h = hlist_nulls_entry(ip_conntrack_hash[i].first,
+					      struct ip_conntrack_tuple_hash,
+					      hnnode);
+			hlist_nulls_del_init_rcu(&h->hnnode);
+			bucket = __hash_conntrack(&h->tuple, size);
+			hlist_nulls_add_head_rcu(&h->hnnode, &hash[bucket]);
+		}
+	}
+	old_hash = ip_conntrack_hash;
+	old_size = ip_conntrack_htable_size;
+	old_vmalloced = ip_conntrack_vmalloc;
+	ip_conntrack_hash = hash;
+	ip_conntrack_htable_size = size;
+	ip_conntrack_vmalloc = vmalloced;
+
+	write_seqcount_end(&ip_conntrack_hash_seq);
+	for (i = 0; i < IP_CT_LOCKS; i++)
+		spin_unlock(&ip_conntrack_locks[i]);
+	local_bh_enable();
+	up(&ip_conntrack_resize_sem);
+
+	/* Lockless lookups may still be walking the old table. */
+	synchronize_net();
+	free_conntrack_hash(old_hash, old_vmalloced, old_size);
+
+	printk(KERN_INFO "ip_conntrack: hash table resized to %u buckets\n",
+	       size);
+	return 0;
 }
 
 /* Mishearing the voices in his head, our hero wonders how he's
@@ -1129,6 +1473,8 @@ void ip_conntrack_cleanup(void)
            netfilter framework.  Roll on, two-stage module
            delete... */
 	synchronize_net();
+
+	ip_conntrack_gc_stop();
  
  i_see_dead_people:
 	ip_ct_iterate_cleanup(kill_all, NULL);
@@ -1139,26 +1485,51 @@ void ip_conntrack_cleanup(void)
 
 	kmem_cache_destroy(ip_conntrack_cachep);
 	kmem_cache_destroy(ip_conntrack_expect_cachep);
-	free_conntrack_hash();
+	free_conntrack_hash(ip_conntrack_hash, ip_conntrack_vmalloc,
+			    ip_conntrack_htable_size);
 	nf_unregister_sockopt(&so_getorigdst);
 }
 
-static int hashsize;
-module_param(hashsize, int, 0400);
+/* Before the table exists this just sets its initial size; writing
+   /sys/module/ip_conntrack/parameters/hashsize later resizes it. */
+static int set_hashsize(const char *val, struct kernel_param *kp)
+{
+	unsigned int size;
+
+	if (!ip_conntrack_hash)
+		return param_set_uint(val, kp);
+
+	size = simple_strtoul(val, NULL, 0);
+	if (!size)
+		return -EINVAL;
+
+	return ip_conntrack_resize(size);
+}
+
+module_param_call(hashsize, set_hashsize, param_get_uint,
+		  &ip_conntrack_htable_size, 0600);
 
 int __init ip_conntrack_init(void)
 {
 	unsigned int i;
 	int ret;
 
+	for (i = 0; i < IP_CT_LOCKS; i++)
+		spin_lock_init(&ip_conntrack_locks[i]);
+	for_each_cpu(i) {
+		struct ip_conntrack_unconfirmed *u;
+
+		u = &per_cpu(unconfirmed, i);
+		spin_lock_init(&u->lock);
+		INIT_HLIST_NULLS_HEAD(&u->list, IP_CT_UNCONFIRMED_NULLS);
+	}
+
 	/* Idea from tcp.c: use 1/16384 of memory.  On i386: 32MB
-	 * machine has 256 buckets.  >= 1GB machines have 8192 buckets. */
- 	if (hashsize) {
- 		ip_conntrack_htable_size = hashsize;
- 	} else {
+	 * machine has 512 buckets.  >= 1GB machines have 8192 buckets. */
+ 	if (!ip_conntrack_htable_size) {
 		ip_conntrack_htable_size
 			= (((num_physpages << PAGE_SHIFT) / 16384)
-			   / sizeof(struct list_head));
+			   / sizeof(struct hlist_nulls_head));
 		if (num_physpages > (1024 * 1024 * 1024 / PAGE_SIZE))
 			ip_conntrack_htable_size = 8192;
 		if (ip_conntrack_htable_size < 16)
@@ -1177,28 +1548,18 @@ int __init ip_conntrack_init(void)
 		return ret;
 	}
 
-	/* AK: the hash table is twice as big than needed because it
-	   uses list_head.  it would be much nicer to caches to use a
-	   single pointer list head here. */
-	ip_conntrack_vmalloc = 0; 
-	ip_conntrack_hash 
-		=(void*)__get_free_pages(GFP_KERNEL, 
-					 get_order(sizeof(struct list_head)
-						   *ip_conntrack_htable_size));
-	if (!ip_conntrack_hash) { 
-		ip_conntrack_vmalloc = 1;
-		printk(KERN_WARNING "ip_conntrack: falling back to vmalloc.\n");
-		ip_conntrack_hash = vmalloc(sizeof(struct list_head)
-					    * ip_conntrack_htable_size);
-	}
+	ip_conntrack_hash = alloc_conntrack_hash(ip_conntrack_htable_size,
+						 &ip_conntrack_vmalloc);
 	if (!ip_conntrack_hash) {
 		printk(KERN_ERR "Unable to create ip_conntrack_hash\n");
 		goto err_unreg_sockopt;
 	}
 
+	/* Lookups are lockless, so a conntrack may be looked at after
+	   it was freed, but never after its memory left the cache. */
 	ip_conntrack_cachep = kmem_cache_create("ip_conntrack",
 	                                        sizeof(struct ip_conntrack), 0,
-	                                        0, NULL, NULL);
+	                                        SLAB_DESTROY_BY_RCU, NULL, NULL);
 	if (!ip_conntrack_cachep) {
 		printk(KERN_ERR "Unable to create ip_conntrack slab cache\n");
 		goto err_free_hash;
@@ -1222,9 +1583,6 @@ int __init ip_conntrack_init(void)
 	ip_ct_protos[IPPROTO_ICMP] = &ip_conntrack_protocol_icmp;
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
-	for (i = 0; i < ip_conntrack_htable_size; i++)
-		INIT_LIST_HEAD(&ip_conntrack_hash[i]);
-
 	/* For use by ipt_REJECT */
 	ip_ct_attach = ip_conntrack_attach;
 
@@ -1234,12 +1592,17 @@ int __init ip_conntrack_init(void)
 	/*  - and look it like as a confirmed connection */
 	set_bit(IPS_CONFIRMED_BIT, &ip_conntrack_untracked.status);
 
+	ip_conntrack_gc_running = 1;
+	schedule_delayed_work(&ip_conntrack_gc_work, IP_CT_GC_INTERVAL);
+
 	return ret;
 
 err_free_conntrack_slab:
 	kmem_cache_destroy(ip_conntrack_cachep);
 err_free_hash:
-	free_conntrack_hash();
+	free_conntrack_hash(ip_conntrack_hash, ip_conntrack_vmalloc,
+			    ip_conntrack_htable_size);
+	ip_conntrack_hash = NULL;
 err_unreg_sockopt:
 	nf_unregister_sockopt(&so_getorigdst);
 
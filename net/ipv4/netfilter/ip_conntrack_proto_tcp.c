@@ -867,9 +867,7 @@ static int tcp_packet(struct ip_conntrack *conntrack,
 			if (LOG_INVALID(IPPROTO_TCP))
 				nf_log_packet(PF_INET, 0, skb, NULL, NULL, 
 					  "ip_ct_tcp: killing out of sync session ");
-		    	if (del_timer(&conntrack->timeout))
-		    		conntrack->timeout.function((unsigned long)
-		    					    conntrack);
+		    	ip_ct_kill(conntrack);
 		    	return -NF_DROP;
 		}
 		conntrack->proto.tcp.last_index = index;
@@ -896,9 +894,7 @@ static int tcp_packet(struct ip_conntrack *conntrack,
 		    	/* Attempt to reopen a closed connection.
 		    	* Delete this connection and look up again. */
 		    	WRITE_UNLOCK(&tcp_lock);
-		    	if (del_timer(&conntrack->timeout))
-		    		conntrack->timeout.function((unsigned long)
-		    					    conntrack);
+		    	ip_ct_kill(conntrack);
 		    	return -NF_REPEAT;
 		}
 		break;
@@ -955,9 +951,7 @@ static int tcp_packet(struct ip_conntrack *conntrack,
 		   problem case, so we can delete the conntrack
 		   immediately.  --RR */
 		if (th->rst) {
-			if (del_timer(&conntrack->timeout))
-				conntrack->timeout.function((unsigned long)
-							    conntrack);
+			ip_ct_kill(conntrack);
 			return NF_ACCEPT;
 		}
 	} else if (!test_bit(IPS_ASSURED_BIT, &conntrack->status)
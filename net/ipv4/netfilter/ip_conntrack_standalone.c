@@ -77,11 +77,13 @@ seq_print_counters(struct seq_file *s,
 #define seq_print_counters(x, y)	0
 #endif
 
+/* The iterator is the bucket number: the table itself may be
+   replaced by a resize between two reads. */
 static void *ct_seq_start(struct seq_file *s, loff_t *pos)
 {
 	if (*pos >= ip_conntrack_htable_size)
 		return NULL;
-	return &ip_conntrack_hash[*pos];
+	return pos;
 }
   
 static void ct_seq_stop(struct seq_file *s, void *v)
@@ -93,7 +95,7 @@ static void *ct_seq_next(struct seq_file *s, void *v, loff_t *pos)
 	(*pos)++;
 	if (*pos >= ip_conntrack_htable_size)
 		return NULL;
-	return &ip_conntrack_hash[*pos];
+	return pos;
 }
   
 /* return 0 on success, 1 in case of error */
@@ -103,8 +105,6 @@ static int ct_seq_real_show(const struct ip_conntrack_tuple_hash *hash,
 	const struct ip_conntrack *conntrack = tuplehash_to_ctrack(hash);
 	struct ip_conntrack_protocol *proto;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-
 	IP_NF_ASSERT(conntrack);
 
 	/* we only want to print DIR_ORIGINAL */
@@ -118,8 +118,9 @@ static int ct_seq_real_show(const struct ip_conntrack_tuple_hash *hash,
 	if (seq_printf(s, "%-8s %u %lu ",
 		      proto->name,
 		      conntrack->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum,
-		      timer_pending(&conntrack->timeout)
-		      ? (conntrack->timeout.expires - jiffies)/HZ : 0) != 0)
+		      is_confirmed((struct ip_conntrack *)conntrack)
+		      && !ip_ct_expired(conntrack)
+		      ? (conntrack->timeout - jiffies)/HZ : 0) != 0)
 		return 1;
 
 	if (proto->print_conntrack(s, conntrack))
@@ -160,15 +161,24 @@ static int ct_seq_real_show(const struct ip_conntrack_tuple_hash *hash,
 
 static int ct_seq_show(struct seq_file *s, void *v)
 {
-	struct list_head *list = v;
+	unsigned int bucket = *(loff_t *)v;
+	struct ip_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
 	int ret = 0;
 
 	/* FIXME: Simply truncates if hash chain too long. */
-	READ_LOCK(&ip_conntrack_lock);
-	if (LIST_FIND(list, ct_seq_real_show,
-		      struct ip_conntrack_tuple_hash *, s))
-		ret = -ENOSPC;
-	READ_UNLOCK(&ip_conntrack_lock);
+	spin_lock_bh(IP_CT_BUCKET_LOCK(bucket));
+	/* The table may have shrunk since ct_seq_next() looked. */
+	if (bucket < ip_conntrack_htable_size) {
+		hlist_nulls_for_each_entry(h, n, &ip_conntrack_hash[bucket],
+					   hnnode) {
+			if (ct_seq_real_show(h, s)) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
+	}
+	spin_unlock_bh(IP_CT_BUCKET_LOCK(bucket));
 	return ret;
 }
 	
@@ -308,12 +318,12 @@ static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 	struct ip_conntrack_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_printf(seq, "entries  searched found new invalid ignore delete delete_list insert insert_failed drop early_drop icmp_error  expect_new expect_create expect_delete\n");
+		seq_printf(seq, "entries  searched found new invalid ignore delete delete_list insert insert_failed drop early_drop icmp_error  expect_new expect_create expect_delete search_restart\n");
 		return 0;
 	}
 
 	seq_printf(seq, "%08x  %08x %08x %08x %08x %08x %08x %08x "
-			"%08x %08x %08x %08x %08x  %08x %08x %08x \n",
+			"%08x %08x %08x %08x %08x  %08x %08x %08x %08x\n",
 		   nr_conntracks,
 		   st->searched,
 		   st->found,
@@ -330,7 +340,8 @@ static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 
 		   st->expect_new,
 		   st->expect_create,
-		   st->expect_delete
+		   st->expect_delete,
+		   st->search_restart
 		);
 	return 0;
 }
@@ -903,6 +914,7 @@ EXPORT_SYMBOL(ip_conntrack_helper_register);
 EXPORT_SYMBOL(ip_conntrack_helper_unregister);
 EXPORT_SYMBOL(ip_ct_iterate_cleanup);
 EXPORT_SYMBOL(ip_ct_refresh_acct);
+EXPORT_SYMBOL(ip_ct_kill);
 EXPORT_SYMBOL(ip_ct_protos);
 EXPORT_SYMBOL(ip_ct_find_proto);
 EXPORT_SYMBOL(ip_conntrack_expect_alloc);
@@ -914,6 +926,8 @@ EXPORT_SYMBOL(ip_ct_gather_frags);
 EXPORT_SYMBOL(ip_conntrack_htable_size);
 EXPORT_SYMBOL(ip_conntrack_lock);
 EXPORT_SYMBOL(ip_conntrack_hash);
+EXPORT_SYMBOL(ip_conntrack_locks);
+EXPORT_SYMBOL(ip_conntrack_hash_seq);
 EXPORT_SYMBOL(ip_conntrack_untracked);
 EXPORT_SYMBOL_GPL(ip_conntrack_find_get);
 EXPORT_SYMBOL_GPL(ip_conntrack_put);
@@ -0,0 +1,678 @@
+/*
+ * IP sets: named sets of addresses, networks or ports for iptables.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A set is one object of a set type (hash, bitmap, nettree, ...), which
+ * keeps its elements any way it likes behind add/del/test.  Rules refer
+ * to sets by index into ip_set_list and hold a reference, so a set in
+ * use can be neither destroyed nor moved; its contents, however, can be
+ * swapped wholesale with those of another set, which is how user space
+ * replaces a set atomically.
+ *
+ * Locking: ip_set_mutex serializes user space requests against each
+ * other and against the match/target looking sets up; each set's rwlock
+ * protects its contents against the packet path.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kmod.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netfilter.h>
+#include <linux/err.h>
+#include <net/ip.h>
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+
+#include <linux/netfilter_ipv4/ip_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IP sets");
+
+#if 0
+#define DEBUGP printk
+#else
+#define DEBUGP(format, args...)
+#endif
+
+/* Elements copied from user space at a time */
+#define IP_SET_CHUNK	(PAGE_SIZE / sizeof(struct ip_set_elem))
+
+static unsigned int max_sets = 256;
+module_param(max_sets, uint, 0400);
+MODULE_PARM_DESC(max_sets, "maximal number of sets");
+
+static DECLARE_MUTEX(ip_set_mutex);
+static LIST_HEAD(ip_set_types);
+static struct ip_set **ip_set_list;
+
+/* Must hold ip_set_mutex */
+static struct ip_set_type *__find_type(const char *name)
+{
+	struct ip_set_type *type;
+
+	list_for_each_entry(type, &ip_set_types, list)
+		if (strcmp(type->typename, name) == 0)
+			return type;
+	return NULL;
+}
+
+/* Returns the type with a reference on its module, or NULL/ERR_PTR() */
+static struct ip_set_type *find_type_get(const char *name)
+{
+	struct ip_set_type *type;
+
+	if (down_interruptible(&ip_set_mutex) != 0)
+		return ERR_PTR(-EINTR);
+	type = __find_type(name);
+	if (type && !try_module_get(type->me))
+		type = NULL;
+	up(&ip_set_mutex);
+	return type;
+}
+
+/* Must hold ip_set_mutex */
+static struct ip_set *__find_set(const char *name)
+{
+	ip_set_id_t id;
+
+	for (id = 0; id < max_sets; id++)
+		if (ip_set_list[id]
+		    && strcmp(ip_set_list[id]->name, name) == 0)
+			return ip_set_list[id];
+	return NULL;
+}
+
+int ip_set_register_type(struct ip_set_type *type)
+{
+	int ret = 0;
+
+	down(&ip_set_mutex);
+	if (__find_type(type->typename))
+		ret = -EEXIST;
+	else
+		list_add(&type->list, &ip_set_types);
+	up(&ip_set_mutex);
+	return ret;
+}
+
+/* No sets of the type can exist: they hold the type's module */
+void ip_set_unregister_type(struct ip_set_type *type)
+{
+	down(&ip_set_mutex);
+	list_del(&type->list);
+	up(&ip_set_mutex);
+}
+
+ip_set_id_t ip_set_get_byname(const char *name)
+{
+	struct ip_set *set;
+	ip_set_id_t id = IP_SET_INVALID_ID;
+
+	down(&ip_set_mutex);
+	set = __find_set(name);
+	if (set) {
+		atomic_inc(&set->ref);
+		id = set->id;
+	}
+	up(&ip_set_mutex);
+	return id;
+}
+
+void ip_set_put(ip_set_id_t id)
+{
+	atomic_dec(&ip_set_list[id]->ref);
+}
+
+/* The element of a packet a set of this kind holds; under set->lock.
+   -ENOENT if the packet has none (a port set and a later fragment or
+   another protocol), -EINVAL if its header is cut short. */
+static int
+ip_set_skb_key(const struct ip_set *set, const struct sk_buff *skb,
+	       int dst, u_int32_t *key)
+{
+	const struct iphdr *iph = skb->nh.iph;
+
+	if ((set->flags & IP_SET_KIND_MASK) == IP_SET_ADDR) {
+		*key = ntohl(dst ? iph->daddr : iph->saddr);
+		return 0;
+	}
+
+	if (iph->frag_off & htons(IP_OFFSET))
+		return -ENOENT;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP: {
+		struct tcphdr _tcph, *th;
+
+		th = skb_header_pointer(skb, iph->ihl*4, sizeof(_tcph),
+					&_tcph);
+		if (th == NULL)
+			return -EINVAL;
+		*key = ntohs(dst ? th->dest : th->source);
+		return 0;
+	}
+	case IPPROTO_UDP: {
+		struct udphdr _udph, *uh;
+
+		uh = skb_header_pointer(skb, iph->ihl*4, sizeof(_udph),
+					&_udph);
+		if (uh == NULL)
+			return -EINVAL;
+		*key = ntohs(dst ? uh->dest : uh->source);
+		return 0;
+	}
+	}
+	return -ENOENT;
+}
+
+int ip_set_test_skb(ip_set_id_t id, const struct sk_buff *skb, int dst)
+{
+	struct ip_set *set = ip_set_list[id];
+	u_int32_t key;
+	int ret;
+
+	read_lock_bh(&set->lock);
+	ret = ip_set_skb_key(set, skb, dst, &key);
+	if (ret == 0)
+		ret = !!set->type->test(set, key);	/* test_bit() may be -1 */
+	read_unlock_bh(&set->lock);
+	return ret;
+}
+
+/* A full set is not grown from here: that needs process context. */
+int ip_set_add_skb(ip_set_id_t id, const struct sk_buff *skb, int dst)
+{
+	struct ip_set *set = ip_set_list[id];
+	u_int32_t key;
+	int ret;
+
+	write_lock_bh(&set->lock);
+	ret = ip_set_skb_key(set, skb, dst, &key);
+	if (ret == 0)
+		ret = set->type->add(set, key, 32);
+	write_unlock_bh(&set->lock);
+	return ret;
+}
+
+int ip_set_del_skb(ip_set_id_t id, const struct sk_buff *skb, int dst)
+{
+	struct ip_set *set = ip_set_list[id];
+	u_int32_t key;
+	int ret;
+
+	write_lock_bh(&set->lock);
+	ret = ip_set_skb_key(set, skb, dst, &key);
+	if (ret == 0)
+		ret = set->type->del(set, key, 32);
+	write_unlock_bh(&set->lock);
+	return ret;
+}
+
+static int ip_set_check_elem(const struct ip_set *set, struct ip_set_elem *elem)
+{
+	if ((set->flags & IP_SET_KIND_MASK) == IP_SET_PORT) {
+		if (elem->key > 0xFFFF)
+			return -EINVAL;
+		elem->cidr = 32;
+	} else if (elem->cidr > 32)
+		return -EINVAL;
+	return 0;
+}
+
+/* Must hold ip_set_mutex */
+static int ip_set_add(struct ip_set *set, struct ip_set_elem *elem)
+{
+	int ret;
+
+	for (;;) {
+		write_lock_bh(&set->lock);
+		ret = set->type->add(set, elem->key, elem->cidr);
+		write_unlock_bh(&set->lock);
+
+		if (ret != -EAGAIN || !set->type->grow)
+			break;
+		ret = set->type->grow(set);
+		if (ret != 0)
+			break;
+	}
+	return ret;
+}
+
+/* Must hold ip_set_mutex.  Elements of a bulk request which are
+   already in (or, deleting, not in) the set are skipped. */
+static int
+ip_set_adt(struct ip_set *set, int add, const struct ip_set_elem __user *user,
+	   unsigned int count)
+{
+	struct ip_set_elem *elem;
+	unsigned int i, n;
+	int bulk = count > 1, ret = 0;
+
+	elem = kmalloc(IP_SET_CHUNK * sizeof(*elem), GFP_KERNEL);
+	if (!elem)
+		return -ENOMEM;
+
+	for (; count > 0 && ret == 0; count -= n, user += n) {
+		n = min_t(unsigned int, count, IP_SET_CHUNK);
+		if (copy_from_user(elem, user, n * sizeof(*elem)) != 0) {
+			ret = -EFAULT;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			ret = ip_set_check_elem(set, &elem[i]);
+			if (ret != 0)
+				break;
+			if (add)
+				ret = ip_set_add(set, &elem[i]);
+			else {
+				write_lock_bh(&set->lock);
+				ret = set->type->del(set, elem[i].key,
+						     elem[i].cidr);
+				write_unlock_bh(&set->lock);
+			}
+			if ((ret == -EEXIST || ret == -ENOENT) && bulk)
+				ret = 0;
+			if (ret != 0)
+				break;
+		}
+		cond_resched();
+	}
+	kfree(elem);
+	return ret;
+}
+
+static int ip_set_create(const void __user *user, unsigned int len)
+{
+	struct ip_set_req_create req;
+	struct ip_set_type *type;
+	struct ip_set *set;
+	void *data = NULL;
+	ip_set_id_t id;
+	int ret;
+
+	if (len < sizeof(req))
+		return -EINVAL;
+	if (copy_from_user(&req, user, sizeof(req)) != 0)
+		return -EFAULT;
+	req.name[IP_SET_MAXNAMELEN-1] = '\0';
+	req.typename[IP_SET_MAXNAMELEN-1] = '\0';
+	if (req.name[0] == '\0' || (req.flags & ~IP_SET_KIND_MASK))
+		return -EINVAL;
+
+	type = try_then_request_module(find_type_get(req.typename),
+				       "ip_set_%s", req.typename);
+	if (IS_ERR(type) || !type)
+		return type ? PTR_ERR(type) : -ENOENT;
+
+	ret = -EINVAL;
+	if (!(type->kinds & (1 << req.flags))
+	    || len != sizeof(req) + type->create_size)
+		goto put_type;
+
+	ret = -ENOMEM;
+	if (type->create_size) {
+		data = kmalloc(type->create_size, GFP_KERNEL);
+		if (!data)
+			goto put_type;
+		ret = -EFAULT;
+		if (copy_from_user(data, user + sizeof(req),
+				   type->create_size) != 0)
+			goto free_data;
+	}
+
+	ret = -ENOMEM;
+	set = kmalloc(sizeof(*set), GFP_KERNEL);
+	if (!set)
+		goto free_data;
+	memset(set, 0, sizeof(*set));
+	strcpy(set->name, req.name);
+	rwlock_init(&set->lock);
+	atomic_set(&set->ref, 0);
+	set->flags = req.flags;
+	set->type = type;
+
+	ret = type->create(set, data);
+	if (ret != 0)
+		goto free_set;
+
+	down(&ip_set_mutex);
+	if (__find_set(set->name)) {
+		ret = -EEXIST;
+		goto destroy;
+	}
+	for (id = 0; id < max_sets && ip_set_list[id]; id++)
+		;
+	if (id == max_sets) {
+		ret = -ENOSPC;
+		goto destroy;
+	}
+	set->id = id;
+	ip_set_list[id] = set;
+	up(&ip_set_mutex);
+
+	DEBUGP("ip_set: created %s (%s) as %u\n",
+	       set->name, type->typename, id);
+	kfree(data);
+	return 0;
+
+ destroy:
+	up(&ip_set_mutex);
+	type->destroy(set);
+ free_set:
+	kfree(set);
+ free_data:
+	kfree(data);
+ put_type:
+	module_put(type->me);
+	return ret;
+}
+
+/* Must hold ip_set_mutex */
+static int ip_set_destroy(struct ip_set *set)
+{
+	if (atomic_read(&set->ref) != 0)
+		return -EBUSY;
+
+	ip_set_list[set->id] = NULL;
+	set->type->destroy(set);
+	module_put(set->type->me);
+	kfree(set);
+	return 0;
+}
+
+/* Must hold ip_set_mutex */
+static int ip_set_swap(struct ip_set *a, struct ip_set *b)
+{
+	struct ip_set_type *type;
+	void *data;
+
+	if (a == b)
+		return 0;
+	if ((a->flags & IP_SET_KIND_MASK) != (b->flags & IP_SET_KIND_MASK))
+		return -EINVAL;
+	if (a->id > b->id) {
+		struct ip_set *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	write_lock_bh(&a->lock);
+	write_lock(&b->lock);
+	type = a->type;
+	a->type = b->type;
+	b->type = type;
+	data = a->data;
+	a->data = b->data;
+	b->data = data;
+	write_unlock(&b->lock);
+	write_unlock_bh(&a->lock);
+	return 0;
+}
+
+static int
+do_ip_set_set_ctl(struct sock *sk, int cmd, void __user *user, unsigned int len)
+{
+	struct ip_set_req_adt req;
+	struct ip_set *set, *set2;
+	int ret;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (len < sizeof(struct ip_set_req_std))
+		return -EINVAL;
+	if (copy_from_user(&req, user, sizeof(struct ip_set_req_std)) != 0)
+		return -EFAULT;
+	if (req.version != IP_SET_PROTOCOL_VERSION)
+		return -EPROTO;
+	req.name[IP_SET_MAXNAMELEN-1] = '\0';
+
+	if (req.op == IP_SET_OP_CREATE)
+		return ip_set_create(user, len);
+
+	if (down_interruptible(&ip_set_mutex) != 0)
+		return -EINTR;
+	set = __find_set(req.name);
+	if (!set) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	switch (req.op) {
+	case IP_SET_OP_DESTROY:
+		ret = ip_set_destroy(set);
+		break;
+
+	case IP_SET_OP_FLUSH:
+		write_lock_bh(&set->lock);
+		set->type->flush(set);
+		write_unlock_bh(&set->lock);
+		ret = 0;
+		break;
+
+	case IP_SET_OP_RENAME:
+	case IP_SET_OP_SWAP: {
+		struct ip_set_req_swap sreq;
+
+		ret = -EINVAL;
+		if (len != sizeof(sreq))
+			break;
+		ret = -EFAULT;
+		if (copy_from_user(&sreq, user, sizeof(sreq)) != 0)
+			break;
+		sreq.name2[IP_SET_MAXNAMELEN-1] = '\0';
+
+		set2 = __find_set(sreq.name2);
+		if (req.op == IP_SET_OP_SWAP)
+			ret = set2 ? ip_set_swap(set, set2) : -ENOENT;
+		else if (set2)
+			ret = -EEXIST;
+		else if (sreq.name2[0] == '\0')
+			ret = -EINVAL;
+		else {
+			strcpy(set->name, sreq.name2);
+			ret = 0;
+		}
+		break;
+	}
+
+	case IP_SET_OP_ADD:
+	case IP_SET_OP_DEL:
+		ret = -EINVAL;
+		if (len < sizeof(req))
+			break;
+		ret = -EFAULT;
+		if (copy_from_user(&req, user, sizeof(req)) != 0)
+			break;
+		ret = -EINVAL;
+		if ((len - sizeof(req)) / sizeof(struct ip_set_elem)
+		    != req.count)
+			break;
+		ret = ip_set_adt(set, req.op == IP_SET_OP_ADD,
+				 user + sizeof(req), req.count);
+		break;
+
+	default:
+		DEBUGP("ip_set: unknown request %u\n", req.op);
+		ret = -EBADMSG;
+	}
+ out:
+	up(&ip_set_mutex);
+	return ret;
+}
+
+/* Must hold ip_set_mutex */
+static int ip_set_list_set(struct ip_set *set, void __user *user, int *len)
+{
+	struct ip_set_req_list req;
+	struct ip_set_elem *elem = NULL;
+	unsigned int max;
+	int ret = 0;
+
+	if (*len < sizeof(req))
+		return -EINVAL;
+	max = (*len - sizeof(req)) / sizeof(*elem);
+	if (max) {
+		if ((max * sizeof(*elem)) >> PAGE_SHIFT > num_physpages)
+			return -ENOMEM;
+		elem = vmalloc(max * sizeof(*elem));
+		if (!elem)
+			return -ENOMEM;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.op = IP_SET_OP_LIST;
+	req.version = IP_SET_PROTOCOL_VERSION;
+	strcpy(req.name, set->name);
+	read_lock_bh(&set->lock);
+	strcpy(req.typename, set->type->typename);
+	req.flags = set->flags;
+	req.count = set->type->dump(set, elem, max);
+	read_unlock_bh(&set->lock);
+
+	if (copy_to_user(user, &req, sizeof(req)) != 0
+	    || (elem && copy_to_user(user + sizeof(req), elem,
+				     min(max, req.count) * sizeof(*elem))))
+		ret = -EFAULT;
+	vfree(elem);
+	return ret;
+}
+
+static int
+do_ip_set_get_ctl(struct sock *sk, int cmd, void __user *user, int *len)
+{
+	struct ip_set_req_adt req;
+	struct ip_set *set;
+	int ret;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (*len < sizeof(struct ip_set_req_std))
+		return -EINVAL;
+	if (copy_from_user(&req, user, sizeof(struct ip_set_req_std)) != 0)
+		return -EFAULT;
+	req.name[IP_SET_MAXNAMELEN-1] = '\0';
+
+	/* Lets user space find out what the kernel speaks */
+	if (req.op == IP_SET_OP_VERSION) {
+		req.version = IP_SET_PROTOCOL_VERSION;
+		if (copy_to_user(user, &req, sizeof(struct ip_set_req_std)))
+			return -EFAULT;
+		return 0;
+	}
+	if (req.version != IP_SET_PROTOCOL_VERSION)
+		return -EPROTO;
+
+	if (down_interruptible(&ip_set_mutex) != 0)
+		return -EINTR;
+	set = __find_set(req.name);
+	if (!set) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	switch (req.op) {
+	case IP_SET_OP_TEST: {
+		struct ip_set_elem elem;
+
+		ret = -EINVAL;
+		if (*len != sizeof(req) + sizeof(elem))
+			break;
+		ret = -EFAULT;
+		if (copy_from_user(&elem, user + sizeof(req), sizeof(elem)))
+			break;
+		ret = ip_set_check_elem(set, &elem);
+		if (ret != 0)
+			break;
+
+		/* Only exact elements: a network is in if its address is */
+		read_lock_bh(&set->lock);
+		req.count = !!set->type->test(set, elem.key);
+		read_unlock_bh(&set->lock);
+
+		ret = copy_to_user(user, &req, sizeof(req)) ? -EFAULT : 0;
+		break;
+	}
+
+	case IP_SET_OP_LIST:
+		ret = ip_set_list_set(set, user, len);
+		break;
+
+	default:
+		DEBUGP("ip_set: unknown request %u\n", req.op);
+		ret = -EBADMSG;
+	}
+ out:
+	up(&ip_set_mutex);
+	return ret;
+}
+
+static struct nf_sockopt_ops ip_set_sockopts = {
+	.pf		= PF_INET,
+	.set_optmin	= SO_IP_SET,
+	.set_optmax	= SO_IP_SET + 1,
+	.set		= do_ip_set_set_ctl,
+	.get_optmin	= SO_IP_SET,
+	.get_optmax	= SO_IP_SET + 1,
+	.get		= do_ip_set_get_ctl,
+};
+
+static int __init init(void)
+{
+	int ret;
+
+	if (max_sets == 0 || max_sets >= IP_SET_INVALID_ID)
+		return -EINVAL;
+
+	ip_set_list = vmalloc(max_sets * sizeof(struct ip_set *));
+	if (!ip_set_list)
+		return -ENOMEM;
+	memset(ip_set_list, 0, max_sets * sizeof(struct ip_set *));
+
+	ret = nf_register_sockopt(&ip_set_sockopts);
+	if (ret != 0) {
+		vfree(ip_set_list);
+		return ret;
+	}
+
+	printk(KERN_INFO "ip_set: %u sets max\n", max_sets);
+	return 0;
+}
+
+/* Sets hold their type's module, which holds this one, so there should
+   be none left; don't leak them if there are. */
+static void __exit fini(void)
+{
+	ip_set_id_t id;
+
+	nf_unregister_sockopt(&ip_set_sockopts);
+
+	down(&ip_set_mutex);
+	for (id = 0; id < max_sets; id++)
+		if (ip_set_list[id])
+			ip_set_destroy(ip_set_list[id]);
+	up(&ip_set_mutex);
+	vfree(ip_set_list);
+}
+
+EXPORT_SYMBOL(ip_set_register_type);
+EXPORT_SYMBOL(ip_set_unregister_type);
+EXPORT_SYMBOL(ip_set_get_byname);
+EXPORT_SYMBOL(ip_set_put);
+EXPORT_SYMBOL(ip_set_test_skb);
+EXPORT_SYMBOL(ip_set_add_skb);
+EXPORT_SYMBOL(ip_set_del_skb);
+
+module_init(init);
+module_exit(fini);
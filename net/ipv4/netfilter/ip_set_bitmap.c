@@ -0,0 +1,174 @@
+/*
+ * "bitmap" IP set type: addresses or ports from a fixed range.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * One bit per possible element, so a lookup is a single bit test; an
+ * address network is added or removed as the run of bits it covers.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+
+#include <linux/netfilter_ipv4/ip_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("bitmap type of IP sets");
+
+#define BITMAP_MAX_ELEMENTS	(1 << 20)
+
+struct ip_set_bitmap {
+	u_int32_t from, to;
+	unsigned long *map;
+};
+
+static inline size_t bitmap_bytes(const struct ip_set_bitmap *b)
+{
+	return BITS_TO_LONGS(b->to - b->from + 1) * sizeof(unsigned long);
+}
+
+static int bitmap_create(struct ip_set *set, const void *data)
+{
+	const struct ip_set_req_bitmap_create *req = data;
+	struct ip_set_bitmap *b;
+
+	if (req->from > req->to
+	    || req->to - req->from >= BITMAP_MAX_ELEMENTS)
+		return -EINVAL;
+	if ((set->flags & IP_SET_KIND_MASK) == IP_SET_PORT
+	    && req->to > 0xFFFF)
+		return -EINVAL;
+
+	b = kmalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+	b->from = req->from;
+	b->to = req->to;
+	b->map = vmalloc(bitmap_bytes(b));
+	if (!b->map) {
+		kfree(b);
+		return -ENOMEM;
+	}
+	memset(b->map, 0, bitmap_bytes(b));
+
+	set->data = b;
+	return 0;
+}
+
+static void bitmap_destroy(struct ip_set *set)
+{
+	struct ip_set_bitmap *b = set->data;
+
+	vfree(b->map);
+	kfree(b);
+}
+
+static void bitmap_flush(struct ip_set *set)
+{
+	struct ip_set_bitmap *b = set->data;
+
+	memset(b->map, 0, bitmap_bytes(b));
+}
+
+/* Bits first to last of the map stand for key/cidr */
+static int
+bitmap_range(const struct ip_set_bitmap *b, u_int32_t key, u_int8_t cidr,
+	     u_int32_t *first, u_int32_t *last)
+{
+	u_int32_t mask = ip_set_netmask(cidr);
+
+	if ((key & mask) < b->from || (key | ~mask) > b->to)
+		return -ERANGE;
+	*first = (key & mask) - b->from;
+	*last = (key | ~mask) - b->from;
+	return 0;
+}
+
+static int bitmap_add(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_bitmap *b = set->data;
+	u_int32_t i, first, last;
+	int ret = bitmap_range(b, key, cidr, &first, &last);
+
+	if (ret != 0)
+		return ret;
+	if (first == last)
+		return __test_and_set_bit(first, b->map) ? -EEXIST : 0;
+	for (i = first; i <= last; i++)
+		__set_bit(i, b->map);
+	return 0;
+}
+
+static int bitmap_del(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_bitmap *b = set->data;
+	u_int32_t i, first, last;
+	int ret = bitmap_range(b, key, cidr, &first, &last);
+
+	if (ret != 0)
+		return ret;
+	if (first == last)
+		return __test_and_clear_bit(first, b->map) ? 0 : -ENOENT;
+	for (i = first; i <= last; i++)
+		__clear_bit(i, b->map);
+	return 0;
+}
+
+static int bitmap_test(const struct ip_set *set, u_int32_t key)
+{
+	const struct ip_set_bitmap *b = set->data;
+
+	if (key < b->from || key > b->to)
+		return 0;
+	return test_bit(key - b->from, b->map);
+}
+
+static unsigned int
+bitmap_dump(const struct ip_set *set, struct ip_set_elem *elem, unsigned int max)
+{
+	const struct ip_set_bitmap *b = set->data;
+	u_int32_t i, size = b->to - b->from + 1;
+	unsigned int n = 0;
+
+	for (i = find_first_bit(b->map, size); i < size;
+	     i = find_next_bit(b->map, size, i + 1)) {
+		if (n < max) {
+			elem[n].key = b->from + i;
+			elem[n].cidr = 32;
+		}
+		n++;
+	}
+	return n;
+}
+
+static struct ip_set_type ip_set_bitmap = {
+	.typename	= "bitmap",
+	.kinds		= (1 << IP_SET_ADDR) | (1 << IP_SET_PORT),
+	.create_size	= sizeof(struct ip_set_req_bitmap_create),
+	.create		= bitmap_create,
+	.destroy	= bitmap_destroy,
+	.flush		= bitmap_flush,
+	.add		= bitmap_add,
+	.del		= bitmap_del,
+	.test		= bitmap_test,
+	.dump		= bitmap_dump,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	return ip_set_register_type(&ip_set_bitmap);
+}
+
+static void __exit fini(void)
+{
+	ip_set_unregister_type(&ip_set_bitmap);
+}
+
+module_init(init);
+module_exit(fini);
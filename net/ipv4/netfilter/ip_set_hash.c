@@ -0,0 +1,285 @@
+/*
+ * "hash" IP set type: addresses or ports in an open addressed hash.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * An element can live in any of `probes' slots, each chosen by its own
+ * hash function, so a lookup reads at most that many words and a
+ * deletion just clears the slot.  When all of an element's slots are
+ * taken the table is doubled from process context.  Addresses may be
+ * stored masked to a netmask, making the set one of networks of that
+ * size.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
+#include <linux/errno.h>
+
+#include <linux/netfilter_ipv4/ip_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("hash type of IP sets");
+
+#define HASH_DEFAULT_SIZE	1024
+#define HASH_MAX_SIZE		(1 << 24)
+#define HASH_DEFAULT_PROBES	4
+#define HASH_MAX_PROBES		16
+
+struct ip_set_hash {
+	u_int32_t *slot;		/* 0: free */
+	unsigned int size;		/* power of two */
+	unsigned int probes;
+	unsigned int elements;
+	u_int32_t initval;
+	u_int8_t netbits;
+	u_int32_t netmask;
+	int zero;			/* 0 can't go in a slot */
+};
+
+static inline unsigned int
+hash_slot(const struct ip_set_hash *h, u_int32_t key, unsigned int probe,
+	  unsigned int size)
+{
+	return jhash_2words(key, probe, h->initval) & (size - 1);
+}
+
+/* Puts key into slot, which has size entries; 0 if there was no room */
+static int
+hash_insert(const struct ip_set_hash *h, u_int32_t *slot, unsigned int size,
+	    u_int32_t key)
+{
+	unsigned int i, s;
+
+	for (i = 0; i < h->probes; i++) {
+		s = hash_slot(h, key, i, size);
+		if (!slot[s]) {
+			slot[s] = key;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* The slot holding key, or -1 */
+static int hash_find(const struct ip_set_hash *h, u_int32_t key)
+{
+	unsigned int i, s;
+
+	for (i = 0; i < h->probes; i++) {
+		s = hash_slot(h, key, i, h->size);
+		if (h->slot[s] == key)
+			return s;
+	}
+	return -1;
+}
+
+static int hash_create(struct ip_set *set, const void *data)
+{
+	const struct ip_set_req_hash_create *req = data;
+	struct ip_set_hash *h;
+	unsigned int size;
+
+	if (req->probes > HASH_MAX_PROBES || req->netmask > 32
+	    || req->hashsize > HASH_MAX_SIZE)
+		return -EINVAL;
+	if ((set->flags & IP_SET_KIND_MASK) == IP_SET_PORT
+	    && req->netmask && req->netmask != 32)
+		return -EINVAL;
+
+	h = kmalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+
+	for (size = 1; size < (req->hashsize ? : HASH_DEFAULT_SIZE); size <<= 1)
+		;
+	h->slot = vmalloc(size * sizeof(u_int32_t));
+	if (!h->slot) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	memset(h->slot, 0, size * sizeof(u_int32_t));
+	h->size = size;
+	h->probes = req->probes ? : HASH_DEFAULT_PROBES;
+	h->elements = 0;
+	get_random_bytes(&h->initval, sizeof(h->initval));
+	h->netbits = req->netmask ? : 32;
+	h->netmask = ip_set_netmask(h->netbits);
+	h->zero = 0;
+
+	set->data = h;
+	return 0;
+}
+
+static void hash_destroy(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+
+	vfree(h->slot);
+	kfree(h);
+}
+
+static void hash_flush(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+
+	memset(h->slot, 0, h->size * sizeof(u_int32_t));
+	h->elements = 0;
+	h->zero = 0;
+}
+
+/* Single elements, or networks of exactly the set's netmask */
+static inline int
+hash_key(const struct ip_set_hash *h, u_int32_t *key, u_int8_t cidr)
+{
+	if (cidr != 32 && cidr != h->netbits)
+		return -EINVAL;
+	*key &= h->netmask;
+	return 0;
+}
+
+static int hash_add(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_hash *h = set->data;
+	int ret = hash_key(h, &key, cidr);
+
+	if (ret != 0)
+		return ret;
+	if (!key) {
+		if (h->zero)
+			return -EEXIST;
+		h->zero = 1;
+		h->elements++;
+		return 0;
+	}
+	if (hash_find(h, key) >= 0)
+		return -EEXIST;
+	if (!hash_insert(h, h->slot, h->size, key))
+		return -EAGAIN;
+	h->elements++;
+	return 0;
+}
+
+static int hash_del(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_hash *h = set->data;
+	int s, ret = hash_key(h, &key, cidr);
+
+	if (ret != 0)
+		return ret;
+	if (!key) {
+		if (!h->zero)
+			return -ENOENT;
+		h->zero = 0;
+		h->elements--;
+		return 0;
+	}
+	s = hash_find(h, key);
+	if (s < 0)
+		return -ENOENT;
+	h->slot[s] = 0;
+	h->elements--;
+	return 0;
+}
+
+static int hash_test(const struct ip_set *set, u_int32_t key)
+{
+	const struct ip_set_hash *h = set->data;
+
+	key &= h->netmask;
+	if (!key)
+		return h->zero;
+	return hash_find(h, key) >= 0;
+}
+
+static unsigned int
+hash_dump(const struct ip_set *set, struct ip_set_elem *elem, unsigned int max)
+{
+	const struct ip_set_hash *h = set->data;
+	unsigned int i, n = 0;
+
+	if (h->zero) {
+		if (n < max) {
+			elem[n].key = 0;
+			elem[n].cidr = h->netbits;
+		}
+		n++;
+	}
+	for (i = 0; i < h->size; i++) {
+		if (!h->slot[i])
+			continue;
+		if (n < max) {
+			elem[n].key = h->slot[i];
+			elem[n].cidr = h->netbits;
+		}
+		n++;
+	}
+	return n;
+}
+
+/* Doubles the table until everything fits again.  The packet path may
+   add elements while the new table is allocated, so the rehash is
+   done under the lock, and retried with a bigger table if it fails. */
+static int hash_grow(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+	unsigned int i, size = h->size;
+	u_int32_t *slot, *old;
+
+	for (;;) {
+		size <<= 1;
+		if (size > HASH_MAX_SIZE)
+			return -ENOSPC;
+		slot = vmalloc(size * sizeof(u_int32_t));
+		if (!slot)
+			return -ENOMEM;
+		memset(slot, 0, size * sizeof(u_int32_t));
+
+		write_lock_bh(&set->lock);
+		for (i = 0; i < h->size; i++)
+			if (h->slot[i] && !hash_insert(h, slot, size, h->slot[i]))
+				break;
+		if (i == h->size) {
+			old = h->slot;
+			h->slot = slot;
+			h->size = size;
+			write_unlock_bh(&set->lock);
+			vfree(old);
+			return 0;
+		}
+		write_unlock_bh(&set->lock);
+		vfree(slot);
+	}
+}
+
+static struct ip_set_type ip_set_hash = {
+	.typename	= "hash",
+	.kinds		= (1 << IP_SET_ADDR) | (1 << IP_SET_PORT),
+	.create_size	= sizeof(struct ip_set_req_hash_create),
+	.create		= hash_create,
+	.destroy	= hash_destroy,
+	.flush		= hash_flush,
+	.add		= hash_add,
+	.del		= hash_del,
+	.test		= hash_test,
+	.dump		= hash_dump,
+	.grow		= hash_grow,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	return ip_set_register_type(&ip_set_hash);
+}
+
+static void __exit fini(void)
+{
+	ip_set_unregister_type(&ip_set_hash);
+}
+
+module_init(init);
+module_exit(fini);
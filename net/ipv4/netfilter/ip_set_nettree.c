@@ -0,0 +1,265 @@
+/*
+ * "nettree" IP set type: networks of any prefix length.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The networks are kept in a path compressed binary trie.  Every node
+ * is a prefix; the ones added to the set are members, the others are
+ * branch points with two children, made where two members part ways.
+ * An address is in the set if any member on its path down the tree
+ * covers it, so a lookup takes at most 33 steps and usually far fewer.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+
+#include <linux/netfilter_ipv4/ip_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("nettree type of IP sets");
+
+struct nettree_node {
+	struct nettree_node *child[2];
+	u_int32_t key;			/* masked to cidr */
+	u_int8_t cidr;
+	u_int8_t member;
+};
+
+struct ip_set_nettree {
+	struct nettree_node *root;
+	unsigned int elements;
+};
+
+/* The bit after the first cidr ones; cidr < 32 */
+static inline int nettree_bit(u_int32_t key, u_int8_t cidr)
+{
+	return (key >> (31 - cidr)) & 1;
+}
+
+static inline int nettree_covers(const struct nettree_node *n, u_int32_t key)
+{
+	return ((key ^ n->key) & ip_set_netmask(n->cidr)) == 0;
+}
+
+static struct nettree_node *
+nettree_node(u_int32_t key, u_int8_t cidr, int member)
+{
+	struct nettree_node *n;
+
+	/* Also called from the packet path, by the SET target */
+	n = kmalloc(sizeof(*n), GFP_ATOMIC);
+	if (n) {
+		n->child[0] = n->child[1] = NULL;
+		n->key = key;
+		n->cidr = cidr;
+		n->member = member;
+	}
+	return n;
+}
+
+static void nettree_free(struct nettree_node *n)
+{
+	if (n) {
+		nettree_free(n->child[0]);
+		nettree_free(n->child[1]);
+		kfree(n);
+	}
+}
+
+static int nettree_create(struct ip_set *set, const void *data)
+{
+	struct ip_set_nettree *t;
+
+	t = kmalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->root = NULL;
+	t->elements = 0;
+
+	set->data = t;
+	return 0;
+}
+
+static void nettree_destroy(struct ip_set *set)
+{
+	struct ip_set_nettree *t = set->data;
+
+	nettree_free(t->root);
+	kfree(t);
+}
+
+static void nettree_flush(struct ip_set *set)
+{
+	struct ip_set_nettree *t = set->data;
+
+	nettree_free(t->root);
+	t->root = NULL;
+	t->elements = 0;
+}
+
+static int nettree_add(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_nettree *t = set->data;
+	struct nettree_node **pp, *n, *leaf, *branch;
+	unsigned int common;
+
+	key &= ip_set_netmask(cidr);
+	for (pp = &t->root; (n = *pp) != NULL; ) {
+		common = 32 - fls(key ^ n->key);
+		common = min_t(unsigned int, common, min(cidr, n->cidr));
+
+		if (common == n->cidr) {
+			/* n is key/cidr or one of its supernets */
+			if (n->cidr == cidr) {
+				if (n->member)
+					return -EEXIST;
+				n->member = 1;
+				t->elements++;
+				return 0;
+			}
+			pp = &n->child[nettree_bit(key, n->cidr)];
+			continue;
+		}
+
+		/* key/cidr and n part ways, or key/cidr is a supernet of n */
+		leaf = nettree_node(key, cidr, 1);
+		if (!leaf)
+			return -ENOMEM;
+		if (common == cidr) {
+			leaf->child[nettree_bit(n->key, cidr)] = n;
+			*pp = leaf;
+		} else {
+			branch = nettree_node(key & ip_set_netmask(common),
+					      common, 0);
+			if (!branch) {
+				kfree(leaf);
+				return -ENOMEM;
+			}
+			branch->child[nettree_bit(key, common)] = leaf;
+			branch->child[nettree_bit(n->key, common)] = n;
+			*pp = branch;
+		}
+		t->elements++;
+		return 0;
+	}
+
+	n = nettree_node(key, cidr, 1);
+	if (!n)
+		return -ENOMEM;
+	*pp = n;
+	t->elements++;
+	return 0;
+}
+
+static int nettree_del(struct ip_set *set, u_int32_t key, u_int8_t cidr)
+{
+	struct ip_set_nettree *t = set->data;
+	struct nettree_node **pp, **parent = NULL, *n, *p;
+
+	key &= ip_set_netmask(cidr);
+	for (pp = &t->root; (n = *pp) != NULL; ) {
+		if (n->cidr > cidr || !nettree_covers(n, key))
+			return -ENOENT;
+		if (n->cidr == cidr)
+			break;
+		parent = pp;
+		pp = &n->child[nettree_bit(key, n->cidr)];
+	}
+	if (!n || !n->member)
+		return -ENOENT;
+
+	n->member = 0;
+	t->elements--;
+	if (n->child[0] && n->child[1])
+		return 0;
+
+	if (n->child[0] || n->child[1]) {
+		*pp = n->child[0] ? n->child[0] : n->child[1];
+		kfree(n);
+		return 0;
+	}
+
+	/* A leaf: its parent may have been a branch point just for it */
+	*pp = NULL;
+	kfree(n);
+	if (parent) {
+		p = *parent;
+		if (!p->member) {
+			*parent = p->child[0] ? p->child[0] : p->child[1];
+			kfree(p);
+		}
+	}
+	return 0;
+}
+
+static int nettree_test(const struct ip_set *set, u_int32_t key)
+{
+	const struct ip_set_nettree *t = set->data;
+	const struct nettree_node *n = t->root;
+
+	while (n && nettree_covers(n, key)) {
+		if (n->member)
+			return 1;
+		if (n->cidr == 32)
+			break;
+		n = n->child[nettree_bit(key, n->cidr)];
+	}
+	return 0;
+}
+
+static unsigned int
+nettree_walk(const struct nettree_node *n, struct ip_set_elem *elem,
+	     unsigned int max, unsigned int count)
+{
+	if (!n)
+		return count;
+	if (n->member) {
+		if (count < max) {
+			elem[count].key = n->key;
+			elem[count].cidr = n->cidr;
+		}
+		count++;
+	}
+	count = nettree_walk(n->child[0], elem, max, count);
+	return nettree_walk(n->child[1], elem, max, count);
+}
+
+static unsigned int
+nettree_dump(const struct ip_set *set, struct ip_set_elem *elem,
+	     unsigned int max)
+{
+	const struct ip_set_nettree *t = set->data;
+
+	return nettree_walk(t->root, elem, max, 0);
+}
+
+static struct ip_set_type ip_set_nettree = {
+	.typename	= "nettree",
+	.kinds		= (1 << IP_SET_ADDR),
+	.create_size	= 0,
+	.create		= nettree_create,
+	.destroy	= nettree_destroy,
+	.flush		= nettree_flush,
+	.add		= nettree_add,
+	.del		= nettree_del,
+	.test		= nettree_test,
+	.dump		= nettree_dump,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	return ip_set_register_type(&ip_set_nettree);
+}
+
+static void __exit fini(void)
+{
+	ip_set_unregister_type(&ip_set_nettree);
+}
+
+module_init(init);
+module_exit(fini);
@@ -27,6 +27,8 @@
 #include <asm/semaphore.h>
 #include <linux/proc_fs.h>
 #include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/bitops.h>
 
 #include <linux/netfilter_ipv4/ip_tables.h>
 
@@ -90,6 +92,8 @@ static DECLARE_MUTEX(ipt_mutex);
 
    Hence the start of any table is given by get_table() below.  */
 
+struct ipt_classifier;
+
 /* The table itself */
 struct ipt_table_info
 {
@@ -104,6 +108,13 @@ struct ipt_table_info
 	unsigned int hook_entry[NF_IP_NUMHOOKS];
 	unsigned int underflow[NF_IP_NUMHOOKS];
 
+	/* Candidate rule index (see below), shared by all CPUs; or NULL */
+	struct ipt_classifier *cls;
+
+	/* Hooks each rule can be reached from, by rule index; what the
+	   rule's matches and target were last checked against */
+	unsigned int *hookmask;
+
 	/* ipt_entry tables: one per CPU */
 	char entries[0] ____cacheline_aligned;
 };
@@ -119,6 +130,88 @@ static LIST_HEAD(ipt_tables);
 #define TABLE_OFFSET(t,p) 0
 #endif
 
+/*
+   Walking every rule of a chain in order is most of the cost of a
+   packet once there are thousands of rules, although nearly all of
+   them are ruled out by addresses, protocol or destination port
+   alone.  So translate_table() cuts the table into segments, one
+   starting at every hook entry and jump target (i.e. at every chain),
+   and sorts the rules of each long segment into a few groups of rules
+   keying on the same fields: source and destination masks, and
+   whether a protocol and a single destination port are given.  Each
+   group hashes its rules on those fields.  A packet then tries, in
+   rule order, only the rules in its own bucket of each group.  A rule
+   left out could not have matched and would have run no match
+   function, so verdicts, counters and hotdrops are exactly those of
+   the linear walk.
+
+   Only a rule's first match is looked at for the port (a match before
+   it might hotdrop or keep state), and a field is not indexed if it is
+   inverted; such rules go to a group keying on less, down to the
+   catch-all group 0.  Non-first fragments and TCP/UDP headers which
+   cannot be read are walked linearly, since the tcp and udp matches
+   may hotdrop those.  The offsets of the entries are the same in
+   every CPU's copy of the table, so one index serves them all.  */
+#define IPT_CLS_MIN_RULES	16	/* shorter segments are walked */
+#define IPT_CLS_GROUPS		8
+#define IPT_CLS_SIGS		16	/* signatures counted per segment */
+#define IPT_CLS_END		0xFFFFFFFF
+
+/* The fields of a packet or rule which can be hashed */
+struct ipt_cls_key
+{
+	u_int32_t src, dst;
+	u_int16_t dport;
+	u_int8_t proto;
+};
+
+/* Which of them a group keys on */
+struct ipt_cls_sig
+{
+	u_int32_t smsk, dmsk;
+	u_int8_t proto, dport;
+};
+
+struct ipt_cls_group
+{
+	struct ipt_cls_sig sig;
+	unsigned int hmask;
+	/* First rule (by index) in each bucket, or IPT_CLS_END */
+	unsigned int *bucket;
+};
+
+struct ipt_cls_seg
+{
+	/* Index of the first rule; offsets of it and of the next segment */
+	unsigned int first, start, end;
+	/* All the segment's nfcache bits */
+	unsigned int nfcache;
+	/* Zero if the segment is walked linearly */
+	unsigned int ngroups;
+	struct ipt_cls_group *group;
+};
+
+struct ipt_classifier
+{
+	unsigned int number;
+	unsigned int nsegs;
+	struct ipt_cls_seg *seg;
+	/* Offset of each rule, and the next rule in the same bucket */
+	unsigned int *offset;
+	unsigned int *next;
+};
+
+/* Where a packet is in its walk through the classifier */
+struct ipt_cls_walk
+{
+	const struct ipt_classifier *cls;	/* NULL: walk linearly */
+	const struct ipt_cls_seg *seg;		/* NULL: segment is walked */
+	unsigned int end;			/* offset the segment ends at */
+	unsigned int g;				/* group of the current rule */
+	struct ipt_cls_key key;
+	unsigned int cur[IPT_CLS_GROUPS];
+};
+
 #if 0
 #define down(x) do { printk("DOWN:%u:" #x "\n", __LINE__); down(x); } while(0)
 #define down_interruptible(x) ({ int __r; printk("DOWNi:%u:" #x "\n", __LINE__); __r = down_interruptible(x); if (__r != 0) printk("ABORT-DOWNi:%u\n", __LINE__); __r; })
@@ -255,6 +348,163 @@ get_entry(void *base, unsigned int offset)
 	return (struct ipt_entry *)(base + offset);
 }
 
+static inline u_int32_t
+ipt_cls_hash(const struct ipt_cls_key *key, const struct ipt_cls_sig *sig)
+{
+	return jhash_3words(key->src & sig->smsk, key->dst & sig->dmsk,
+			    (sig->proto ? key->proto << 16 : 0)
+			    | (sig->dport ? key->dport : 0), 0);
+}
+
+/* Index of the last rule starting at or before offset pos */
+static inline unsigned int
+ipt_cls_find(const unsigned int *offset, unsigned int n, unsigned int pos)
+{
+	unsigned int lo = 0, hi = n, mid;
+
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (offset[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Returns 0 if the packet has to be walked linearly. */
+static int
+ipt_cls_key(struct ipt_cls_key *key, const struct sk_buff *skb, int offset)
+{
+	const struct iphdr *ip = skb->nh.iph;
+
+	key->src = ip->saddr;
+	key->dst = ip->daddr;
+	key->proto = ip->protocol;
+	key->dport = 0;
+
+	if (ip->protocol == IPPROTO_TCP) {
+		struct tcphdr _tcph, *th;
+
+		if (offset)
+			return 0;
+		th = skb_header_pointer(skb, ip->ihl*4, sizeof(_tcph), &_tcph);
+		if (th == NULL)
+			return 0;
+		key->dport = ntohs(th->dest);
+	} else if (ip->protocol == IPPROTO_UDP) {
+		struct udphdr _udph, *uh;
+
+		if (offset)
+			return 0;
+		uh = skb_header_pointer(skb, ip->ihl*4, sizeof(_udph), &_udph);
+		if (uh == NULL)
+			return 0;
+		key->dport = ntohs(uh->dest);
+	}
+	return 1;
+}
+
+static inline void
+ipt_cls_start(struct ipt_cls_walk *w, const struct ipt_classifier *cls,
+	      const struct sk_buff *skb, int offset)
+{
+	w->seg = NULL;
+	w->cls = cls && ipt_cls_key(&w->key, skb, offset) ? cls : NULL;
+}
+
+/* Makes the lowest cursor current; returns 0 if all are used up. */
+static inline int
+ipt_cls_pick(struct ipt_cls_walk *w)
+{
+	unsigned int g;
+
+	w->g = 0;
+	for (g = 1; g < w->seg->ngroups; g++)
+		if (w->cur[g] < w->cur[w->g])
+			w->g = g;
+	return w->cur[w->g] != IPT_CLS_END;
+}
+
+/* Offset of the first rule at or after pos the packet may match */
+static unsigned int
+ipt_cls_enter(struct ipt_cls_walk *w, unsigned int pos, struct sk_buff *skb)
+{
+	const struct ipt_classifier *cls = w->cls;
+	const struct ipt_cls_seg *seg;
+	unsigned int idx, lo, hi, mid, g, i;
+
+	for (;;) {
+		idx = ipt_cls_find(cls->offset, cls->number, pos);
+
+		lo = 0;
+		hi = cls->nsegs;
+		while (hi - lo > 1) {
+			mid = (lo + hi) / 2;
+			if (cls->seg[mid].first <= idx)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		seg = &cls->seg[lo];
+		w->end = seg->end;
+		if (!seg->ngroups) {
+			w->seg = NULL;
+			return pos;
+		}
+
+		w->seg = seg;
+		skb->nfcache |= seg->nfcache;
+		for (g = 0; g < seg->ngroups; g++) {
+			const struct ipt_cls_group *grp = &seg->group[g];
+
+			i = grp->bucket[ipt_cls_hash(&w->key, &grp->sig)
+					& grp->hmask];
+			while (i < idx)
+				i = cls->next[i];
+			w->cur[g] = i;
+		}
+		if (ipt_cls_pick(w))
+			return cls->offset[w->cur[w->g]];
+
+		/* Nothing here for us: fall through to the next segment */
+		pos = seg->end;
+	}
+}
+
+/* Next rule to try, starting at e */
+static inline struct ipt_entry *
+ipt_cls_goto(struct ipt_cls_walk *w, void *table_base,
+	     struct ipt_entry *e, struct sk_buff *skb)
+{
+	if (!w->cls)
+		return e;
+	return get_entry(table_base,
+			 ipt_cls_enter(w, (void *)e - table_base, skb));
+}
+
+/* Next rule to try after e did not match */
+static inline struct ipt_entry *
+ipt_cls_skip(struct ipt_cls_walk *w, void *table_base,
+	     struct ipt_entry *e, struct sk_buff *skb)
+{
+	unsigned int pos;
+
+	if (w->seg) {
+		w->cur[w->g] = w->cls->next[w->cur[w->g]];
+		if (ipt_cls_pick(w))
+			return get_entry(table_base,
+					 w->cls->offset[w->cur[w->g]]);
+		pos = w->seg->end;
+	} else {
+		e = (void *)e + e->next_offset;
+		if (!w->cls || (void *)e - table_base < w->end)
+			return e;
+		pos = (void *)e - table_base;
+	}
+	return get_entry(table_base, ipt_cls_enter(w, pos, skb));
+}
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff **pskb,
@@ -274,6 +524,7 @@ ipt_do_table(struct sk_buff **pskb,
 	const char *indev, *outdev;
 	void *table_base;
 	struct ipt_entry *e, *back;
+	struct ipt_cls_walk walk;
 
 	/* Initialization */
 	ip = (*pskb)->nh.iph;
@@ -310,6 +561,9 @@ ipt_do_table(struct sk_buff **pskb,
 	/* For return from builtin chain */
 	back = get_entry(table_base, table->private->underflow[hook]);
 
+	ipt_cls_start(&walk, table->private->cls, *pskb, offset);
+	e = ipt_cls_goto(&walk, table_base, e, *pskb);
+
 	do {
 		IP_NF_ASSERT(e);
 		IP_NF_ASSERT(back);
@@ -340,6 +594,8 @@ ipt_do_table(struct sk_buff **pskb,
 					e = back;
 					back = get_entry(table_base,
 							 back->comefrom);
+					e = ipt_cls_goto(&walk, table_base,
+							 e, *pskb);
 					continue;
 				}
 				if (table_base + v
@@ -353,7 +609,9 @@ ipt_do_table(struct sk_buff **pskb,
 					back = next;
 				}
 
-				e = get_entry(table_base, v);
+				e = ipt_cls_goto(&walk, table_base,
+						 get_entry(table_base, v),
+						 *pskb);
 			} else {
 				/* Targets which reenter must return
                                    abs. verdicts */
@@ -382,16 +640,22 @@ ipt_do_table(struct sk_buff **pskb,
 				ip = (*pskb)->nh.iph;
 				datalen = (*pskb)->len - ip->ihl * 4;
 
-				if (verdict == IPT_CONTINUE)
-					e = (void *)e + e->next_offset;
-				else
+				if (verdict == IPT_CONTINUE) {
+					ipt_cls_start(&walk,
+						      table->private->cls,
+						      *pskb, offset);
+					e = ipt_cls_goto(&walk, table_base,
+							 (void *)e
+							 + e->next_offset,
+							 *pskb);
+				} else
 					/* Verdict */
 					break;
 			}
 		} else {
 
 		no_match:
-			e = (void *)e + e->next_offset;
+			e = ipt_cls_skip(&walk, table_base, e, *pskb);
 		}
 	} while (!hotdrop);
 
@@ -561,10 +825,23 @@ unconditional(const struct ipt_ip *ip)
 	return 1;
 }
 
+static struct ipt_target ipt_standard_target, ipt_error_target;
+
+/* Before check_entry() a target is known by its name, after it by
+   its ipt_target */
+static inline int
+standard_target(const struct ipt_entry_target *t, int translated)
+{
+	if (translated)
+		return t->u.kernel.target == &ipt_standard_target;
+	return strcmp(t->u.user.name, IPT_STANDARD_TARGET) == 0;
+}
+
 /* Figures out from what hook each rule can be called: returns 0 if
    there are loops.  Puts hook bitmask in comefrom. */
 static int
-mark_source_chains(struct ipt_table_info *newinfo, unsigned int valid_hooks)
+mark_source_chains(struct ipt_table_info *newinfo, unsigned int valid_hooks,
+		   int translated)
 {
 	unsigned int hook;
 
@@ -595,8 +872,7 @@ mark_source_chains(struct ipt_table_info *newinfo, unsigned int valid_hooks)
 
 			/* Unconditional return/END. */
 			if (e->target_offset == sizeof(struct ipt_entry)
-			    && (strcmp(t->target.u.user.name,
-				       IPT_STANDARD_TARGET) == 0)
+			    && standard_target(&t->target, translated)
 			    && t->verdict < 0
 			    && unconditional(&e->ip)) {
 				unsigned int oldpos, size;
@@ -635,8 +911,7 @@ mark_source_chains(struct ipt_table_info *newinfo, unsigned int valid_hooks)
 			} else {
 				int newpos = t->verdict;
 
-				if (strcmp(t->target.u.user.name,
-					   IPT_STANDARD_TARGET) == 0
+				if (standard_target(&t->target, translated)
 				    && newpos >= 0) {
 					/* This a jump; chase it. */
 					duprintf("Jump rule %u -> %u\n",
@@ -732,8 +1007,6 @@ check_match(struct ipt_entry_match *m,
 	return 0;
 }
 
-static struct ipt_target ipt_standard_target;
-
 static inline int
 check_entry(struct ipt_entry *e, const char *name, unsigned int size,
 	    unsigned int *i)
@@ -850,6 +1123,305 @@ cleanup_entry(struct ipt_entry *e, unsigned int *i)
 	return 0;
 }
 
+static struct ipt_match tcp_matchstruct, udp_matchstruct;
+
+/* The part of a rule which the classifier can look up exactly */
+static void
+ipt_cls_rule(const struct ipt_entry *e, struct ipt_cls_sig *sig,
+	     struct ipt_cls_key *key)
+{
+	const struct ipt_ip *ip = &e->ip;
+	const struct ipt_entry_match *m = (void *)e->elems;
+
+	memset(sig, 0, sizeof(*sig));
+	memset(key, 0, sizeof(*key));
+
+	if (!(ip->invflags & IPT_INV_SRCIP)) {
+		sig->smsk = ip->smsk.s_addr;
+		key->src = ip->src.s_addr;
+	}
+	if (!(ip->invflags & IPT_INV_DSTIP)) {
+		sig->dmsk = ip->dmsk.s_addr;
+		key->dst = ip->dst.s_addr;
+	}
+	if (!ip->proto || (ip->invflags & IPT_INV_PROTO))
+		return;
+	sig->proto = 1;
+	key->proto = ip->proto;
+
+	if (e->target_offset == sizeof(struct ipt_entry))
+		return;
+	if (m->u.kernel.match == &tcp_matchstruct) {
+		const struct ipt_tcp *tcpinfo = (void *)m->data;
+
+		if (tcpinfo->dpts[0] == tcpinfo->dpts[1]
+		    && !(tcpinfo->invflags & IPT_TCP_INV_DSTPT)) {
+			sig->dport = 1;
+			key->dport = tcpinfo->dpts[0];
+		}
+	} else if (m->u.kernel.match == &udp_matchstruct) {
+		const struct ipt_udp *udpinfo = (void *)m->data;
+
+		if (udpinfo->dpts[0] == udpinfo->dpts[1]
+		    && !(udpinfo->invflags & IPT_UDP_INV_DSTPT)) {
+			sig->dport = 1;
+			key->dport = udpinfo->dpts[0];
+		}
+	}
+}
+
+static inline int
+ipt_cls_wild(const struct ipt_cls_sig *sig)
+{
+	return !sig->smsk && !sig->dmsk && !sig->proto && !sig->dport;
+}
+
+static inline int
+ipt_cls_sig_eq(const struct ipt_cls_sig *a, const struct ipt_cls_sig *b)
+{
+	return a->smsk == b->smsk && a->dmsk == b->dmsk
+		&& a->proto == b->proto && a->dport == b->dport;
+}
+
+/* The most specific group whose fields the rule gives all of */
+static unsigned int
+ipt_cls_group_of(const struct ipt_cls_sig *group, unsigned int ngroups,
+		 const struct ipt_cls_sig *sig)
+{
+	unsigned int g, best = 0, weight, best_weight = 0;
+
+	for (g = 1; g < ngroups; g++) {
+		if ((group[g].smsk & ~sig->smsk)
+		    || (group[g].dmsk & ~sig->dmsk)
+		    || (group[g].proto && !sig->proto)
+		    || (group[g].dport && !sig->dport))
+			continue;
+		weight = hweight32(group[g].smsk) + hweight32(group[g].dmsk)
+			+ (group[g].proto ? 8 : 0) + (group[g].dport ? 16 : 0);
+		if (weight > best_weight) {
+			best = g;
+			best_weight = weight;
+		}
+	}
+	return best;
+}
+
+static inline unsigned int
+ipt_cls_nbuckets(const struct ipt_cls_sig *sig, unsigned int count)
+{
+	unsigned int n = 1;
+
+	if (!ipt_cls_wild(sig))
+		while (n < count)
+			n <<= 1;
+	return n;
+}
+
+/* Picks the groups for rules first to first+n-1: the catch-all one and
+   the most common signatures shared by at least two rules.  Returns
+   the number of groups and how many rules each gets, or 0 if the
+   segment is not worth classifying. */
+static unsigned int
+ipt_cls_plan(const struct ipt_table_info *info, const unsigned int *offset,
+	     unsigned int first, unsigned int n,
+	     struct ipt_cls_sig *group, unsigned int *count)
+{
+	struct ipt_cls_sig sig[IPT_CLS_SIGS], rsig;
+	unsigned int seen[IPT_CLS_SIGS];
+	struct ipt_cls_key rkey;
+	unsigned int i, j, best, nsigs = 0, ngroups = 1;
+
+	if (n < IPT_CLS_MIN_RULES)
+		return 0;
+
+	for (i = first; i < first + n; i++) {
+		ipt_cls_rule((void *)info->entries + offset[i], &rsig, &rkey);
+		if (ipt_cls_wild(&rsig))
+			continue;
+		for (j = 0; j < nsigs; j++) {
+			if (ipt_cls_sig_eq(&sig[j], &rsig)) {
+				seen[j]++;
+				break;
+			}
+		}
+		if (j == nsigs && nsigs < IPT_CLS_SIGS) {
+			sig[nsigs] = rsig;
+			seen[nsigs++] = 1;
+		}
+	}
+
+	memset(&group[0], 0, sizeof(group[0]));
+	while (ngroups < IPT_CLS_GROUPS) {
+		best = 0;
+		for (j = 1; j < nsigs; j++)
+			if (seen[j] > seen[best])
+				best = j;
+		if (nsigs == 0 || seen[best] < 2)
+			break;
+		group[ngroups++] = sig[best];
+		seen[best] = 0;
+	}
+	if (ngroups == 1)
+		return 0;
+
+	memset(count, 0, ngroups * sizeof(count[0]));
+	for (i = first; i < first + n; i++) {
+		ipt_cls_rule((void *)info->entries + offset[i], &rsig, &rkey);
+		count[ipt_cls_group_of(group, ngroups, &rsig)]++;
+	}
+	return ngroups;
+}
+
+static void
+ipt_cls_free(struct ipt_classifier *cls)
+{
+	if (cls) {
+		vfree(cls->offset);
+		vfree(cls);
+	}
+}
+
+/* Builds the classifier for a checked table.  It is only an index, so
+   if it cannot be built the table is simply walked linearly. */
+static struct ipt_classifier *
+ipt_cls_build(const struct ipt_table_info *info, unsigned int valid_hooks)
+{
+	struct ipt_cls_sig group[IPT_CLS_GROUPS], rsig;
+	unsigned int count[IPT_CLS_GROUPS];
+	struct ipt_cls_key rkey;
+	struct ipt_classifier *cls;
+	struct ipt_cls_seg *seg;
+	struct ipt_cls_group *grp;
+	unsigned int *offset, *mark, *bucket;
+	unsigned int n = info->number, nsegs, ngroups, nbuckets;
+	unsigned int i, j, g, h, first, pos;
+	void *p;
+
+	if (n < IPT_CLS_MIN_RULES)
+		return NULL;
+
+	offset = vmalloc(2 * n * sizeof(unsigned int));
+	if (!offset)
+		return NULL;
+	/* Segment starts are marked in what becomes the next array */
+	mark = offset + n;
+
+	for (i = 0, pos = 0; i < n; i++) {
+		offset[i] = pos;
+		mark[i] = 0;
+		pos += ((struct ipt_entry *)(info->entries + pos))->next_offset;
+	}
+
+	mark[0] = 1;
+	for (h = 0; h < NF_IP_NUMHOOKS; h++) {
+		if (!(valid_hooks & (1 << h)))
+			continue;
+		i = ipt_cls_find(offset, n, info->hook_entry[h]);
+		mark[i] = 1;
+	}
+	for (i = 0; i < n; i++) {
+		struct ipt_entry *e = (void *)info->entries + offset[i];
+		struct ipt_standard_target *t = (void *)ipt_get_target(e);
+
+		if (t->target.u.kernel.target != &ipt_standard_target
+		    || t->verdict < 0)
+			continue;
+		j = ipt_cls_find(offset, n, t->verdict);
+		/* A jump into the middle of a rule: leave well alone */
+		if (offset[j] != (unsigned int)t->verdict)
+			goto free_offset;
+		mark[j] = 1;
+	}
+
+	/* Size everything up */
+	nsegs = ngroups = nbuckets = 0;
+	for (first = 0; first < n; first = i) {
+		for (i = first + 1; i < n && !mark[i]; i++)
+			;
+		nsegs++;
+		h = ipt_cls_plan(info, offset, first, i - first, group, count);
+		for (g = 0; g < h; g++)
+			nbuckets += ipt_cls_nbuckets(&group[g], count[g]);
+		ngroups += h;
+	}
+	if (!ngroups)
+		goto free_offset;
+
+	p = vmalloc(sizeof(*cls) + nsegs * sizeof(*seg)
+		    + ngroups * sizeof(*grp) + nbuckets * sizeof(*bucket));
+	if (!p)
+		goto free_offset;
+	cls = p;
+	seg = p + sizeof(*cls);
+	grp = (void *)(seg + nsegs);
+	bucket = (void *)(grp + ngroups);
+
+	cls->number = n;
+	cls->nsegs = nsegs;
+	cls->seg = seg;
+	cls->offset = offset;
+	cls->next = mark;
+
+	for (first = 0, j = 0; first < n; first = i, j++) {
+		for (i = first + 1; i < n && !mark[i]; i++)
+			;
+		seg[j].first = first;
+		seg[j].start = offset[first];
+		seg[j].end = i < n ? offset[i] : info->size;
+	}
+
+	/* The marks are done with: fill in the buckets */
+	for (j = 0; j < nsegs; j++) {
+		unsigned int last = j + 1 < nsegs ? seg[j+1].first : n;
+
+		first = seg[j].first;
+		seg[j].nfcache = 0;
+		seg[j].ngroups = ipt_cls_plan(info, offset, first,
+					      last - first, group, count);
+		seg[j].group = grp;
+		for (g = 0; g < seg[j].ngroups; g++, grp++) {
+			grp->sig = group[g];
+			h = ipt_cls_nbuckets(&group[g], count[g]);
+			grp->hmask = h - 1;
+			grp->bucket = bucket;
+			memset(bucket, 0xFF, h * sizeof(*bucket));
+			bucket += h;
+		}
+
+		/* Backwards, so that the buckets end up in rule order */
+		for (i = last; i-- > first; ) {
+			struct ipt_entry *e = (void *)info->entries + offset[i];
+
+			seg[j].nfcache |= e->nfcache;
+			mark[i] = IPT_CLS_END;
+			if (!seg[j].ngroups)
+				continue;
+			ipt_cls_rule(e, &rsig, &rkey);
+			g = ipt_cls_group_of(group, seg[j].ngroups, &rsig);
+			h = ipt_cls_hash(&rkey, &group[g])
+				& seg[j].group[g].hmask;
+			mark[i] = seg[j].group[g].bucket[h];
+			seg[j].group[g].bucket[h] = i;
+		}
+	}
+
+	duprintf("ipt_cls_build: %u rules, %u segments, %u groups\n",
+		 n, nsegs, ngroups);
+	return cls;
+
+ free_offset:
+	vfree(offset);
+	return NULL;
+}
+
+static inline int
+save_hookmask(const struct ipt_entry *e, unsigned int hookmask[],
+	      unsigned int *i)
+{
+	hookmask[(*i)++] = e->comefrom;
+	return 0;
+}
+
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
 static int
@@ -866,6 +1438,8 @@ translate_table(const char *name,
 
 	newinfo->size = size;
 	newinfo->number = number;
+	newinfo->cls = NULL;
+	newinfo->hookmask = NULL;
 
 	/* Init all hooks to impossible value. */
 	for (i = 0; i < NF_IP_NUMHOOKS; i++) {
@@ -908,7 +1482,7 @@ translate_table(const char *name,
 		}
 	}
 
-	if (!mark_source_chains(newinfo, valid_hooks))
+	if (!mark_source_chains(newinfo, valid_hooks, 0))
 		return -ELOOP;
 
 	/* Finally, each sanity check must pass */
@@ -922,6 +1496,16 @@ translate_table(const char *name,
 		return ret;
 	}
 
+	newinfo->hookmask = vmalloc(number * sizeof(unsigned int));
+	if (!newinfo->hookmask) {
+		IPT_ENTRY_ITERATE(newinfo->entries, newinfo->size,
+				  cleanup_entry, NULL);
+		return -ENOMEM;
+	}
+	i = 0;
+	IPT_ENTRY_ITERATE(newinfo->entries, newinfo->size,
+			  save_hookmask, newinfo->hookmask, &i);
+
 	/* And one copy for every other CPU */
 	for (i = 1; i < NR_CPUS; i++) {
 		memcpy(newinfo->entries + SMP_ALIGN(newinfo->size)*i,
@@ -929,9 +1513,20 @@ translate_table(const char *name,
 		       SMP_ALIGN(newinfo->size));
 	}
 
+	newinfo->cls = ipt_cls_build(newinfo, valid_hooks);
 	return ret;
 }
 
+/* Frees a table translate_table() has succeeded on; the rules must
+   have been cleaned up already */
+static void
+free_table_info(struct ipt_table_info *info)
+{
+	ipt_cls_free(info->cls);
+	vfree(info->hookmask);
+	vfree(info);
+}
+
 static struct ipt_table_info *
 replace_table(struct ipt_table *table,
 	      unsigned int num_counters,
@@ -1109,6 +1704,23 @@ get_entries(const struct ipt_get_entries *entries,
 	return ret;
 }
 
+/* Drops the reference find_table_lock() took, unless the table now
+   has rules beyond its initial ones, which hold one of their own */
+static void
+update_module_count(struct ipt_table *t,
+		    const struct ipt_table_info *oldinfo,
+		    const struct ipt_table_info *newinfo)
+{
+	duprintf("update_module_count: oldnum=%u, initnum=%u, newnum=%u\n",
+		oldinfo->number, oldinfo->initial_entries, newinfo->number);
+	if ((oldinfo->number > oldinfo->initial_entries) || 
+	    (newinfo->number <= oldinfo->initial_entries)) 
+		module_put(t->me);
+	if ((oldinfo->number > oldinfo->initial_entries) &&
+	    (newinfo->number <= oldinfo->initial_entries))
+		module_put(t->me);
+}
+
 static int
 do_replace(void __user *user, unsigned int len)
 {
@@ -1175,20 +1787,13 @@ do_replace(void __user *user, unsigned int len)
 		goto put_module;
 
 	/* Update module usage count based on number of rules */
-	duprintf("do_replace: oldnum=%u, initnum=%u, newnum=%u\n",
-		oldinfo->number, oldinfo->initial_entries, newinfo->number);
-	if ((oldinfo->number > oldinfo->initial_entries) || 
-	    (newinfo->number <= oldinfo->initial_entries)) 
-		module_put(t->me);
-	if ((oldinfo->number > oldinfo->initial_entries) &&
-	    (newinfo->number <= oldinfo->initial_entries))
-		module_put(t->me);
+	update_module_count(t, oldinfo, newinfo);
 
 	/* Get the old counters. */
 	get_counters(oldinfo, counters);
 	/* Decrease module usage counts and free resource */
 	IPT_ENTRY_ITERATE(oldinfo->entries, oldinfo->size, cleanup_entry,NULL);
-	vfree(oldinfo);
+	free_table_info(oldinfo);
 	if (copy_to_user(tmp.counters, counters,
 			 sizeof(struct ipt_counters) * tmp.num_counters) != 0)
 		ret = -EFAULT;
@@ -1201,6 +1806,8 @@ do_replace(void __user *user, unsigned int len)
 	up(&ipt_mutex);
  free_newinfo_counters_untrans:
 	IPT_ENTRY_ITERATE(newinfo->entries, newinfo->size, cleanup_entry,NULL);
+	ipt_cls_free(newinfo->cls);
+	vfree(newinfo->hookmask);
  free_newinfo_counters:
 	vfree(counters);
  free_newinfo:
@@ -1281,37 +1888,937 @@ do_add_counters(void __user *user, unsigned int len)
 	return ret;
 }
 
+/*
+   IPT_SO_SET_UPDATE: inserting and deleting single rules and chains.
+
+   The changes are first made to a list of the new table's rules, each
+   of them a rule of the old table or one from the request; where rules
+   and jumps end up is only worked out once all changes are in.  The
+   new table is then laid out in one go.  Only the rules added, and old
+   ones which can now be reached from other hooks than before, have
+   their matches and targets checked: the others are moved over as
+   they are, keeping their data and their counters.  So, like
+   IPT_SO_SET_REPLACE, an update either happens completely or not at
+   all.
+
+   The work is still in proportion to the whole table: it is copied
+   for every CPU, walked for loops and its classifier is rebuilt.  What
+   an update saves over a replace is the round trip of the table
+   through user space, and running checkentry and destroy again for
+   every rule it does not change.
+*/
+
+/* Built-in chains go by the name of their hook */
+static const char *const ipt_hooknames[NF_IP_NUMHOOKS] = {
+	[NF_IP_PRE_ROUTING]	= "PREROUTING",
+	[NF_IP_LOCAL_IN]	= "INPUT",
+	[NF_IP_FORWARD]		= "FORWARD",
+	[NF_IP_LOCAL_OUT]	= "OUTPUT",
+	[NF_IP_POST_ROUTING]	= "POSTROUTING",
+};
+
+#define IPT_UPD_NEW	0xFFFFFFFF
+
+struct ipt_upd_rule
+{
+	/* In the old table, in the request, or made up */
+	struct ipt_entry *e;
+	/* Index in the old table, or IPT_UPD_NEW */
+	unsigned int old;
+	/* Built-in chains which start here, and whose policy this is */
+	unsigned int hooks, underflows;
+	/* Standard target jumping to rule[jump] (-1 for none)... */
+	int jump;
+	/* ... or, if set, to the rule after that: the start of the chain
+	   whose head jump is, or the next rule */
+	int after;
+	int deleted;
+	/* Matches and target were checked for the new table */
+	int checked;
+	/* In the old table, then in the new one */
+	unsigned int offset;
+};
+
+/* Head and tail of a new user chain */
+struct ipt_upd_chain
+{
+	struct ipt_error head;
+	struct ipt_standard tail;
+};
+
+struct ipt_upd
+{
+	struct ipt_table *table;
+	struct ipt_table_info *oldinfo;
+	/* The old table's rules first, then those added */
+	struct ipt_upd_rule *rule;
+	unsigned int nrules;
+	/* The new table, as indexes into rule */
+	unsigned int *order;
+	unsigned int norder;
+	struct ipt_upd_chain *chains;
+	unsigned int nchains;
+};
+
+/* Sanity checks on a rule passed in with an update, so it can be
+   walked safely */
 static int
-do_ipt_set_ctl(struct sock *sk,	int cmd, void __user *user, unsigned int len)
+check_update_entry(struct ipt_entry *e, unsigned int size)
 {
-	int ret;
+	struct ipt_entry_match *m;
+	struct ipt_entry_target *t;
+	unsigned int i;
 
-	if (!capable(CAP_NET_ADMIN))
-		return -EPERM;
+	if (e->next_offset != size
+	    || size < sizeof(struct ipt_entry) + sizeof(struct ipt_entry_target)
+	    || e->target_offset < sizeof(struct ipt_entry)
+	    || e->target_offset > size - sizeof(struct ipt_entry_target))
+		return -EINVAL;
 
-	switch (cmd) {
-	case IPT_SO_SET_REPLACE:
-		ret = do_replace(user, len);
-		break;
+	for (i = sizeof(struct ipt_entry); i < e->target_offset;
+	     i += m->u.match_size) {
+		m = (void *)e + i;
+		if (e->target_offset - i < sizeof(*m)
+		    || m->u.match_size < sizeof(*m)
+		    || m->u.match_size > e->target_offset - i)
+			return -EINVAL;
+	}
 
-	case IPT_SO_SET_ADD_COUNTERS:
-		ret = do_add_counters(user, len);
-		break;
+	t = ipt_get_target(e);
+	if (t->u.target_size < sizeof(*t)
+	    || t->u.target_size > size - e->target_offset)
+		return -EINVAL;
 
-	default:
-		duprintf("do_ipt_set_ctl:  unknown request %i\n", cmd);
-		ret = -EINVAL;
+	if (!ip_checkentry(&e->ip))
+		return -EINVAL;
+
+	e->counters = ((struct ipt_counters) { 0, 0 });
+	e->comefrom = 0;
+	return 0;
+}
+
+static inline int
+resolve_match(struct ipt_entry_match *m, unsigned int *i)
+{
+	struct ipt_match *match;
+
+	match = try_then_request_module(find_match(m->u.user.name,
+						   m->u.user.revision),
+					"ipt_%s", m->u.user.name);
+	if (IS_ERR(match) || !match) {
+		duprintf("resolve_match: `%s' not found\n", m->u.user.name);
+		return match ? PTR_ERR(match) : -ENOENT;
 	}
+	m->u.kernel.match = match;
 
-	return ret;
+	(*i)++;
+	return 0;
+}
+
+static inline int
+release_match(struct ipt_entry_match *m, unsigned int *i)
+{
+	if (i && (*i)-- == 0)
+		return 1;
+
+	module_put(m->u.kernel.match->me);
+	return 0;
 }
 
+/* Looks up a new rule's matches and target, holding their modules,
+   but leaves checking them until it is known where the rule can be
+   reached from.  Can't be called with ipt_mutex held. */
 static int
-do_ipt_get_ctl(struct sock *sk, int cmd, void __user *user, int *len)
+resolve_entry(struct ipt_entry *e)
 {
+	struct ipt_entry_target *t;
+	struct ipt_target *target;
+	unsigned int j;
 	int ret;
 
-	if (!capable(CAP_NET_ADMIN))
+	j = 0;
+	ret = IPT_MATCH_ITERATE(e, resolve_match, &j);
+	if (ret != 0)
+		goto release_matches;
+
+	t = ipt_get_target(e);
+	target = try_then_request_module(find_target(t->u.user.name,
+						     t->u.user.revision),
+					 "ipt_%s", t->u.user.name);
+	if (IS_ERR(target) || !target) {
+		duprintf("resolve_entry: `%s' not found\n", t->u.user.name);
+		ret = target ? PTR_ERR(target) : -ENOENT;
+		goto release_matches;
+	}
+	t->u.kernel.target = target;
+	return 0;
+
+ release_matches:
+	IPT_MATCH_ITERATE(e, release_match, &j);
+	return ret;
+}
+
+static void
+release_entry(struct ipt_entry *e)
+{
+	IPT_MATCH_ITERATE(e, release_match, NULL);
+	module_put(ipt_get_target(e)->u.kernel.target->me);
+}
+
+static inline int
+recheck_match(struct ipt_entry_match *m,
+	      const char *name,
+	      const struct ipt_ip *ip,
+	      unsigned int hookmask,
+	      unsigned int *i)
+{
+	__module_get(m->u.kernel.match->me);
+	if (m->u.kernel.match->checkentry
+	    && !m->u.kernel.match->checkentry(name, ip, m->data,
+					      m->u.match_size - sizeof(*m),
+					      hookmask)) {
+		module_put(m->u.kernel.match->me);
+		duprintf("ip_tables: check failed for `%s'.\n",
+			 m->u.kernel.match->name);
+		return -EINVAL;
+	}
+
+	(*i)++;
+	return 0;
+}
+
+/* check_entry() for a rule whose matches and target have been looked
+   up already: on success the rule holds its own module references and
+   is undone by cleanup_entry() */
+static int
+recheck_entry(struct ipt_entry *e, const char *name, unsigned int size)
+{
+	struct ipt_entry_target *t;
+	unsigned int j;
+	int ret;
+
+	j = 0;
+	ret = IPT_MATCH_ITERATE(e, recheck_match, name, &e->ip, e->comefrom,
+				&j);
+	if (ret != 0)
+		goto cleanup_matches;
+
+	t = ipt_get_target(e);
+	__module_get(t->u.kernel.target->me);
+	if (t->u.kernel.target == &ipt_standard_target) {
+		if (!standard_check(t, size)) {
+			ret = -EINVAL;
+			goto put_target;
+		}
+	} else if (t->u.kernel.target->checkentry
+		   && !t->u.kernel.target->checkentry(name, e, t->data,
+						      t->u.target_size
+						      - sizeof(*t),
+						      e->comefrom)) {
+		duprintf("ip_tables: check failed for `%s'.\n",
+			 t->u.kernel.target->name);
+		ret = -EINVAL;
+		goto put_target;
+	}
+	return 0;
+
+ put_target:
+	module_put(t->u.kernel.target->me);
+ cleanup_matches:
+	IPT_MATCH_ITERATE(e, cleanup_match, &j);
+	return ret;
+}
+
+#define for_each_update_op(op, ops, n, i)				\
+	for ((i) = 0, (op) = (void *)(ops); (i) < (n);			\
+	     (i)++, (op) = (void *)(op) + (op)->size)
+
+/* Checks the shape of the operations, and looks up the matches and
+   targets of the rules to insert */
+static int
+resolve_update_ops(unsigned char *ops, unsigned int num, unsigned int size)
+{
+	struct ipt_update_op *op;
+	unsigned int i, left = size;
+	int ret = 0;
+
+	for_each_update_op(op, ops, num, i) {
+		if (left < sizeof(*op)
+		    || op->size < sizeof(*op) || op->size > left
+		    || op->size % __alignof__(struct ipt_update_op) != 0
+		    || strnlen(op->chain, IPT_FUNCTION_MAXNAMELEN)
+		       == IPT_FUNCTION_MAXNAMELEN
+		    || strnlen(op->jump, IPT_FUNCTION_MAXNAMELEN)
+		       == IPT_FUNCTION_MAXNAMELEN) {
+			ret = -EINVAL;
+			break;
+		}
+		left -= op->size;
+
+		if (op->op == IPT_UPDATE_INSERT) {
+			ret = check_update_entry(op->entry,
+						 op->size - sizeof(*op));
+			if (ret == 0)
+				ret = resolve_entry(op->entry);
+		} else if (op->op != IPT_UPDATE_DELETE
+			   && op->op != IPT_UPDATE_NEW_CHAIN
+			   && op->op != IPT_UPDATE_DEL_CHAIN)
+			ret = -EINVAL;
+		if (ret != 0)
+			break;
+	}
+	if (ret == 0 && left != 0)
+		ret = -EINVAL;
+
+	if (ret != 0) {
+		/* Let go of the rules resolved so far */
+		num = i;
+		for_each_update_op(op, ops, num, i)
+			if (op->op == IPT_UPDATE_INSERT)
+				release_entry(op->entry);
+	}
+	return ret;
+}
+
+static void
+release_update_ops(unsigned char *ops, unsigned int num)
+{
+	struct ipt_update_op *op;
+	unsigned int i;
+
+	for_each_update_op(op, ops, num, i)
+		if (op->op == IPT_UPDATE_INSERT)
+			release_entry(op->entry);
+}
+
+static inline int
+upd_is_head(struct ipt_entry *e)
+{
+	return ipt_get_target(e)->u.kernel.target == &ipt_error_target;
+}
+
+static inline int
+upd_is_chain(struct ipt_entry *e, const char *name)
+{
+	return upd_is_head(e)
+		&& strcmp(((struct ipt_error_target *)ipt_get_target(e))
+			  ->errorname, name) == 0;
+}
+
+static inline struct ipt_upd_rule *
+upd_rule(const struct ipt_upd *upd, unsigned int pos)
+{
+	return &upd->rule[upd->order[pos]];
+}
+
+static struct ipt_upd_rule *
+upd_new_rule(struct ipt_upd *upd, struct ipt_entry *e)
+{
+	struct ipt_upd_rule *r = &upd->rule[upd->nrules++];
+
+	memset(r, 0, sizeof(*r));
+	r->e = e;
+	r->old = IPT_UPD_NEW;
+	r->jump = -1;
+	return r;
+}
+
+static void
+upd_insert(struct ipt_upd *upd, unsigned int pos, unsigned int idx)
+{
+	memmove(&upd->order[pos + 1], &upd->order[pos],
+		(upd->norder - pos) * sizeof(upd->order[0]));
+	upd->order[pos] = idx;
+	upd->norder++;
+}
+
+static void
+upd_remove(struct ipt_upd *upd, unsigned int pos, unsigned int n)
+{
+	memmove(&upd->order[pos], &upd->order[pos + n],
+		(upd->norder - pos - n) * sizeof(upd->order[0]));
+	upd->norder -= n;
+}
+
+/* The rules of a chain are order[*start] up to, but not including,
+   order[*end]: its policy or RETURN.  *hook is -1 for a user chain. */
+static int
+upd_find_chain(const struct ipt_upd *upd, const char *name,
+	       unsigned int *start, unsigned int *end, int *hook)
+{
+	unsigned int h, i;
+
+	for (h = 0; h < NF_IP_NUMHOOKS; h++) {
+		if (!(upd->table->valid_hooks & (1 << h))
+		    || strcmp(name, ipt_hooknames[h]) != 0)
+			continue;
+
+		*start = *end = upd->norder;
+		for (i = 0; i < upd->norder; i++) {
+			if (upd_rule(upd, i)->hooks & (1 << h))
+				*start = i;
+			if (upd_rule(upd, i)->underflows & (1 << h))
+				*end = i;
+		}
+		if (*end == upd->norder || *start > *end)
+			return -EINVAL;
+		*hook = h;
+		return 0;
+	}
+
+	/* The table ends with an error rule of that name */
+	if (strcmp(name, IPT_ERROR_TARGET) == 0)
+		return -ENOENT;
+
+	for (i = 0; i < upd->norder; i++) {
+		if (!upd_is_chain(upd_rule(upd, i)->e, name))
+			continue;
+
+		for (*start = *end = i + 1;
+		     *end + 1 < upd->norder
+			     && !upd_is_head(upd_rule(upd, *end + 1)->e);
+		     (*end)++);
+		if (*end + 1 == upd->norder)
+			return -EINVAL;
+		*hook = -1;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/* Whether any rule but idx itself jumps to rule[idx] (after = 0) or
+   the chain it heads (after = 1) */
+static int
+upd_jumped_to(const struct ipt_upd *upd, unsigned int idx, int after)
+{
+	unsigned int i;
+
+	for (i = 0; i < upd->norder; i++)
+		if (upd_rule(upd, i)->jump == idx
+		    && upd_rule(upd, i)->after == after
+		    && upd->order[i] != idx)
+			return 1;
+	return 0;
+}
+
+/* The old table's rule at offset, or -1 */
+static int
+upd_rule_at(const struct ipt_upd *upd, unsigned int offset)
+{
+	unsigned int lo = 0, hi = upd->oldinfo->number, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (upd->rule[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < upd->oldinfo->number && upd->rule[lo].offset == offset)
+		return lo;
+	return -1;
+}
+
+static inline int
+upd_load_entry(struct ipt_entry *e, struct ipt_upd *upd, unsigned int *pos)
+{
+	const struct ipt_table_info *info = upd->oldinfo;
+	struct ipt_upd_rule *r = upd_new_rule(upd, e);
+	unsigned int h;
+
+	r->old = upd->nrules - 1;
+	r->offset = *pos;
+	for (h = 0; h < NF_IP_NUMHOOKS; h++) {
+		if (!(upd->table->valid_hooks & (1 << h)))
+			continue;
+		if (info->hook_entry[h] == *pos)
+			r->hooks |= 1 << h;
+		if (info->underflow[h] == *pos)
+			r->underflows |= 1 << h;
+	}
+	upd->order[upd->norder++] = r->old;
+
+	*pos += e->next_offset;
+	return 0;
+}
+
+/* Fills in the list from the old table, with jumps as rule indexes */
+static int
+upd_load(struct ipt_upd *upd)
+{
+	struct ipt_table_info *info = upd->oldinfo;
+	struct ipt_standard_target *t;
+	struct ipt_upd_rule *r;
+	unsigned int i, pos = 0;
+	int j;
+
+	IPT_ENTRY_ITERATE(info->entries, info->size, upd_load_entry,
+			  upd, &pos);
+
+	for (i = 0; i < info->number; i++) {
+		r = &upd->rule[i];
+		t = (void *)ipt_get_target(r->e);
+		if (t->target.u.kernel.target != &ipt_standard_target
+		    || t->verdict < 0)
+			continue;
+
+		if (t->verdict == r->offset + r->e->next_offset) {
+			/* Fall through */
+			r->jump = i;
+			r->after = 1;
+			continue;
+		}
+		j = upd_rule_at(upd, t->verdict);
+		if (j < 0)
+			return -EINVAL;
+		if (j > 0 && upd_is_head(upd->rule[j - 1].e)) {
+			r->jump = j - 1;
+			r->after = 1;
+		} else
+			r->jump = j;
+	}
+	return 0;
+}
+
+static int
+upd_insert_rule(struct ipt_upd *upd, struct ipt_update_op *op)
+{
+	struct ipt_standard_target *t = (void *)ipt_get_target(op->entry);
+	int standard = t->target.u.kernel.target == &ipt_standard_target;
+	unsigned int start, end, jstart, jend, idx;
+	struct ipt_upd_rule *r;
+	int hook, jhook, ret;
+
+	/* ERROR targets only head chains here, upd_find_chain() relies
+	   on it */
+	if (upd_is_head(op->entry))
+		return -EINVAL;
+
+	ret = upd_find_chain(upd, op->chain, &start, &end, &hook);
+	if (ret != 0)
+		return ret;
+	if (op->rulenum == IPT_UPDATE_APPEND)
+		op->rulenum = end - start;
+	if (op->rulenum > end - start)
+		return -E2BIG;
+
+	idx = upd->nrules;
+	r = upd_new_rule(upd, op->entry);
+	if (op->jump[0]) {
+		if (!standard)
+			return -EINVAL;
+		ret = upd_find_chain(upd, op->jump, &jstart, &jend, &jhook);
+		if (ret != 0)
+			return ret;
+		if (jhook >= 0)
+			return -EINVAL;
+		r->jump = upd->order[jstart - 1];
+		r->after = 1;
+	} else if (standard && t->verdict >= 0) {
+		r->jump = idx;
+		r->after = 1;
+	}
+
+	if (hook >= 0 && op->rulenum == 0) {
+		upd_rule(upd, start)->hooks &= ~(1 << hook);
+		r->hooks |= 1 << hook;
+	}
+	upd_insert(upd, start + op->rulenum, idx);
+	return 0;
+}
+
+static int
+upd_delete_rule(struct ipt_upd *upd, const struct ipt_update_op *op)
+{
+	unsigned int start, end, idx;
+	int hook, ret;
+
+	ret = upd_find_chain(upd, op->chain, &start, &end, &hook);
+	if (ret != 0)
+		return ret;
+	if (op->rulenum >= end - start)
+		return -E2BIG;
+
+	/* Something jumps right into the chain here */
+	idx = upd->order[start + op->rulenum];
+	if (upd_jumped_to(upd, idx, 0))
+		return -EBUSY;
+
+	if (hook >= 0 && op->rulenum == 0) {
+		upd->rule[idx].hooks &= ~(1 << hook);
+		upd_rule(upd, start + 1)->hooks |= 1 << hook;
+	}
+	upd->rule[idx].deleted = 1;
+	upd_remove(upd, start + op->rulenum, 1);
+	return 0;
+}
+
+static int
+upd_new_chain(struct ipt_upd *upd, const struct ipt_update_op *op)
+{
+	unsigned int start, end, idx;
+	struct ipt_upd_chain *c;
+	int hook, ret;
+
+	if (op->chain[0] == '\0' || strcmp(op->chain, IPT_ERROR_TARGET) == 0)
+		return -EINVAL;
+	ret = upd_find_chain(upd, op->chain, &start, &end, &hook);
+	if (ret != -ENOENT)
+		return ret ? ret : -EEXIST;
+
+	c = &upd->chains[upd->nchains++];
+	memset(c, 0, sizeof(*c));
+	c->head.entry.target_offset = sizeof(struct ipt_entry);
+	c->head.entry.next_offset = sizeof(struct ipt_error);
+	c->head.target.target.u.target_size
+		= IPT_ALIGN(sizeof(struct ipt_error_target));
+	c->head.target.target.u.kernel.target = &ipt_error_target;
+	strcpy(c->head.target.errorname, op->chain);
+	c->tail.entry.target_offset = sizeof(struct ipt_entry);
+	c->tail.entry.next_offset = sizeof(struct ipt_standard);
+	c->tail.target.target.u.target_size
+		= IPT_ALIGN(sizeof(struct ipt_standard_target));
+	c->tail.target.target.u.kernel.target = &ipt_standard_target;
+	c->tail.target.verdict = IPT_RETURN;
+
+	/* User chains go at the end, before the table's error rule */
+	idx = upd->nrules;
+	upd_new_rule(upd, &c->head.entry);
+	upd_new_rule(upd, &c->tail.entry);
+	upd_insert(upd, upd->norder - 1, idx);
+	upd_insert(upd, upd->norder - 1, idx + 1);
+	return 0;
+}
+
+static int
+upd_del_chain(struct ipt_upd *upd, const struct ipt_update_op *op)
+{
+	unsigned int start, end;
+	int hook, ret;
+
+	ret = upd_find_chain(upd, op->chain, &start, &end, &hook);
+	if (ret != 0)
+		return ret;
+	if (hook >= 0)
+		return -EINVAL;
+	if (end != start)
+		return -ENOTEMPTY;
+	if (upd_jumped_to(upd, upd->order[start - 1], 1))
+		return -EBUSY;
+
+	upd_rule(upd, start - 1)->deleted = 1;
+	upd_rule(upd, start)->deleted = 1;
+	upd_remove(upd, start - 1, 2);
+	return 0;
+}
+
+static int
+upd_apply(struct ipt_upd *upd, unsigned char *ops, unsigned int num)
+{
+	struct ipt_update_op *op;
+	unsigned int i;
+	int ret = 0;
+
+	for_each_update_op(op, ops, num, i) {
+		switch (op->op) {
+		case IPT_UPDATE_INSERT:
+			ret = upd_insert_rule(upd, op);
+			break;
+		case IPT_UPDATE_DELETE:
+			ret = upd_delete_rule(upd, op);
+			break;
+		case IPT_UPDATE_NEW_CHAIN:
+			ret = upd_new_chain(upd, op);
+			break;
+		case IPT_UPDATE_DEL_CHAIN:
+			ret = upd_del_chain(upd, op);
+			break;
+		}
+		if (ret != 0) {
+			duprintf("upd_apply: op %u (%u) on `%s': %d\n",
+				 i, op->op, op->chain, ret);
+			break;
+		}
+	}
+	return ret;
+}
+
+/* Undoes the checks made for a new table which won't be used */
+static void
+upd_discard(struct ipt_upd *upd, struct ipt_table_info *newinfo)
+{
+	struct ipt_upd_rule *r;
+	unsigned int i;
+
+	for (i = 0; i < upd->norder; i++) {
+		r = upd_rule(upd, i);
+		if (r->checked) {
+			cleanup_entry((void *)newinfo->entries + r->offset,
+				      NULL);
+			r->checked = 0;
+		}
+	}
+	free_table_info(newinfo);
+}
+
+/* Lays out and checks the new table */
+static struct ipt_table_info *
+upd_build(struct ipt_upd *upd, int *error)
+{
+	struct ipt_table_info *newinfo;
+	struct ipt_upd_rule *r, *j;
+	struct ipt_entry *e;
+	unsigned int i, h, size = 0;
+	int ret;
+
+	for (i = 0; i < upd->norder; i++) {
+		r = upd_rule(upd, i);
+		r->offset = size;
+		size += r->e->next_offset;
+	}
+
+	/* Pedantry: prevent them from hitting BUG() in vmalloc.c --RR */
+	*error = -ENOMEM;
+	if ((SMP_ALIGN(size) >> PAGE_SHIFT) + 2 > num_physpages)
+		return NULL;
+	newinfo = vmalloc(sizeof(struct ipt_table_info)
+			  + SMP_ALIGN(size) * NR_CPUS);
+	if (!newinfo)
+		return NULL;
+	newinfo->size = size;
+	newinfo->number = upd->norder;
+	newinfo->cls = NULL;
+	newinfo->hookmask = vmalloc(upd->norder * sizeof(unsigned int));
+	if (!newinfo->hookmask) {
+		vfree(newinfo);
+		return NULL;
+	}
+
+	for (h = 0; h < NF_IP_NUMHOOKS; h++) {
+		newinfo->hook_entry[h] = 0xFFFFFFFF;
+		newinfo->underflow[h] = 0xFFFFFFFF;
+	}
+	/* Kept rules are copied raw, match and target data included;
+	   see checkentry in ip_tables.h for what that asks of them */
+	for (i = 0; i < upd->norder; i++) {
+		r = upd_rule(upd, i);
+		e = (void *)newinfo->entries + r->offset;
+		memcpy(e, r->e, r->e->next_offset);
+		e->counters = ((struct ipt_counters) { 0, 0 });
+		e->comefrom = 0;
+
+		for (h = 0; h < NF_IP_NUMHOOKS; h++) {
+			if (r->hooks & (1 << h))
+				newinfo->hook_entry[h] = r->offset;
+			if (r->underflows & (1 << h))
+				newinfo->underflow[h] = r->offset;
+		}
+		if (r->jump >= 0) {
+			j = &upd->rule[r->jump];
+			((struct ipt_standard_target *)ipt_get_target(e))
+				->verdict = j->offset
+				+ (r->after ? j->e->next_offset : 0);
+		}
+	}
+
+	if (!mark_source_chains(newinfo, upd->table->valid_hooks, 1)) {
+		free_table_info(newinfo);
+		*error = -ELOOP;
+		return NULL;
+	}
+
+	for (i = 0; i < upd->norder; i++) {
+		r = upd_rule(upd, i);
+		e = (void *)newinfo->entries + r->offset;
+		newinfo->hookmask[i] = e->comefrom;
+		if (r->old != IPT_UPD_NEW
+		    && upd->oldinfo->hookmask[r->old] == e->comefrom)
+			continue;
+
+		ret = recheck_entry(e, upd->table->name, size);
+		if (ret != 0) {
+			upd_discard(upd, newinfo);
+			*error = ret;
+			return NULL;
+		}
+		r->checked = 1;
+	}
+
+	/* And one copy for every other CPU */
+	for (i = 1; i < NR_CPUS; i++) {
+		memcpy(newinfo->entries + SMP_ALIGN(newinfo->size)*i,
+		       newinfo->entries,
+		       SMP_ALIGN(newinfo->size));
+	}
+
+	newinfo->cls = ipt_cls_build(newinfo, upd->table->valid_hooks);
+	return newinfo;
+}
+
+static int
+do_update(void __user *user, unsigned int len)
+{
+	struct ipt_update tmp;
+	struct ipt_upd upd;
+	struct ipt_table *t;
+	struct ipt_table_info *newinfo, *oldinfo;
+	struct ipt_counters *counters = NULL;
+	struct ipt_upd_rule *r;
+	struct ipt_entry *e;
+	unsigned char *ops;
+	unsigned int i, max;
+	int ret;
+
+	if (copy_from_user(&tmp, user, sizeof(tmp)) != 0)
+		return -EFAULT;
+
+	if (len != sizeof(tmp) + tmp.size
+	    || tmp.num_ops == 0
+	    || tmp.num_ops > tmp.size / sizeof(struct ipt_update_op))
+		return -EINVAL;
+	tmp.name[IPT_TABLE_MAXNAMELEN-1] = '\0';
+
+	if ((tmp.size >> PAGE_SHIFT) + 2 > num_physpages)
+		return -ENOMEM;
+
+	ops = vmalloc(tmp.size);
+	if (!ops)
+		return -ENOMEM;
+	if (copy_from_user(ops, user + sizeof(tmp), tmp.size) != 0) {
+		ret = -EFAULT;
+		goto free_ops;
+	}
+
+	/* Before taking ipt_mutex, which looking them up needs */
+	ret = resolve_update_ops(ops, tmp.num_ops, tmp.size);
+	if (ret != 0)
+		goto free_ops;
+
+	t = try_then_request_module(find_table_lock(tmp.name),
+				    "iptable_%s", tmp.name);
+	if (!t || IS_ERR(t)) {
+		ret = t ? PTR_ERR(t) : -ENOENT;
+		goto release_ops;
+	}
+
+	memset(&upd, 0, sizeof(upd));
+	upd.table = t;
+	upd.oldinfo = oldinfo = t->private;
+	if (tmp.num_entries && tmp.num_entries != oldinfo->number) {
+		ret = -EAGAIN;
+		goto put_module;
+	}
+
+	/* Every operation adds two rules at most */
+	max = oldinfo->number + 2 * tmp.num_ops;
+	ret = -ENOMEM;
+	upd.rule = vmalloc(max * sizeof(struct ipt_upd_rule));
+	upd.order = vmalloc(max * sizeof(unsigned int));
+	upd.chains = vmalloc(tmp.num_ops * sizeof(struct ipt_upd_chain));
+	counters = vmalloc(oldinfo->number * sizeof(struct ipt_counters));
+	if (!upd.rule || !upd.order || !upd.chains || !counters)
+		goto free;
+	memset(counters, 0, oldinfo->number * sizeof(struct ipt_counters));
+
+	ret = upd_load(&upd);
+	if (ret != 0)
+		goto free;
+	ret = upd_apply(&upd, ops, tmp.num_ops);
+	if (ret != 0)
+		goto free;
+	newinfo = upd_build(&upd, &ret);
+	if (!newinfo)
+		goto free;
+
+	if (!replace_table(t, oldinfo->number, newinfo, &ret)) {
+		upd_discard(&upd, newinfo);
+		goto free;
+	}
+
+	/* Update module usage count based on number of rules */
+	update_module_count(t, oldinfo, newinfo);
+
+	/* Rules moved over keep their counters.  The new table is
+	   live: add them to the first CPU's copy, as
+	   do_add_counters() does. */
+	get_counters(oldinfo, counters);
+	write_lock_bh(&t->lock);
+	for (i = 0; i < upd.norder; i++) {
+		r = upd_rule(&upd, i);
+		if (r->old == IPT_UPD_NEW)
+			continue;
+		e = (void *)newinfo->entries + r->offset;
+		ADD_COUNTER(e->counters, counters[r->old].bcnt,
+			    counters[r->old].pcnt);
+	}
+	write_unlock_bh(&t->lock);
+
+	/* Only rules that are gone or were checked again are done with
+	   their matches' and targets' data */
+	for (i = 0; i < oldinfo->number; i++)
+		if (upd.rule[i].deleted || upd.rule[i].checked)
+			cleanup_entry(upd.rule[i].e, NULL);
+	free_table_info(oldinfo);
+
+	vfree(counters);
+	vfree(upd.chains);
+	vfree(upd.order);
+	vfree(upd.rule);
+	up(&ipt_mutex);
+	release_update_ops(ops, tmp.num_ops);
+	vfree(ops);
+	return 0;
+
+ free:
+	vfree(counters);
+	vfree(upd.chains);
+	vfree(upd.order);
+	vfree(upd.rule);
+ put_module:
+	module_put(t->me);
+	up(&ipt_mutex);
+ release_ops:
+	release_update_ops(ops, tmp.num_ops);
+ free_ops:
+	vfree(ops);
+	return ret;
+}
+
+static int
+do_ipt_set_ctl(struct sock *sk,	int cmd, void __user *user, unsigned int len)
+{
+	int ret;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	switch (cmd) {
+	case IPT_SO_SET_REPLACE:
+		ret = do_replace(user, len);
+		break;
+
+	case IPT_SO_SET_ADD_COUNTERS:
+		ret = do_add_counters(user, len);
+		break;
+
+	case IPT_SO_SET_UPDATE:
+		ret = do_update(user, len);
+		break;
+
+	default:
+		duprintf("do_ipt_set_ctl:  unknown request %i\n", cmd);
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+static int
+do_ipt_get_ctl(struct sock *sk, int cmd, void __user *user, int *len)
+{
+	int ret;
+
+	if (!capable(CAP_NET_ADMIN))
 		return -EPERM;
 
 	switch (cmd) {
@@ -1457,7 +2964,7 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 	int ret;
 	struct ipt_table_info *newinfo;
 	static struct ipt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, NULL, { } };
 
 	newinfo = vmalloc(sizeof(struct ipt_table_info)
 			  + SMP_ALIGN(repl->size) * NR_CPUS);
@@ -1478,7 +2985,7 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 
 	ret = down_interruptible(&ipt_mutex);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		return ret;
 	}
 
@@ -1507,7 +3014,7 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 	return ret;
 
  free_unlock:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	goto unlock;
 }
 
@@ -1520,7 +3027,7 @@ void ipt_unregister_table(struct ipt_table *table)
 	/* Decrease module usage counts and free resources */
 	IPT_ENTRY_ITERATE(table->private->entries, table->private->size,
 			  cleanup_entry, NULL);
-	vfree(table->private);
+	free_table_info(table->private);
 }
 
 /* Returns 1 if the port is matched by the range, 0 otherwise */
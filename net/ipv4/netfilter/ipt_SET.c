@@ -0,0 +1,114 @@
+/*
+ * This is a module which is used for adding a packet's address or port
+ * to an IP set, or deleting it from one.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/skbuff.h>
+
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv4/ipt_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("iptables IP set target module");
+
+static unsigned int
+target(struct sk_buff **pskb,
+       const struct net_device *in,
+       const struct net_device *out,
+       unsigned int hooknum,
+       const void *targinfo,
+       void *userinfo)
+{
+	const struct ipt_set_target_info *info = targinfo;
+
+	if (info->add_set.id != IP_SET_INVALID_ID)
+		ip_set_add_skb(info->add_set.id, *pskb,
+			       info->add_set.flags & IPT_SET_DST);
+	if (info->del_set.id != IP_SET_INVALID_ID)
+		ip_set_del_skb(info->del_set.id, *pskb,
+			       info->del_set.flags & IPT_SET_DST);
+
+	return IPT_CONTINUE;
+}
+
+/* Looks up an optional set; 0 if it is named but doesn't exist */
+static int get_set(struct ipt_set_info *set)
+{
+	set->name[IP_SET_MAXNAMELEN-1] = '\0';
+	set->id = IP_SET_INVALID_ID;
+	if (set->name[0] == '\0')
+		return 1;
+	if (set->flags & ~IPT_SET_DST)
+		return 0;
+
+	set->id = ip_set_get_byname(set->name);
+	if (set->id == IP_SET_INVALID_ID) {
+		printk(KERN_WARNING "SET: no set named `%s'\n", set->name);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+checkentry(const char *tablename,
+	   const struct ipt_entry *e,
+	   void *targinfo,
+	   unsigned int targinfosize,
+	   unsigned int hook_mask)
+{
+	struct ipt_set_target_info *info = targinfo;
+
+	if (targinfosize != IPT_ALIGN(sizeof(struct ipt_set_target_info))) {
+		printk(KERN_ERR "SET: invalid size (%u != %Zu).\n",
+		       targinfosize,
+		       IPT_ALIGN(sizeof(struct ipt_set_target_info)));
+		return 0;
+	}
+
+	if (!get_set(&info->add_set))
+		return 0;
+	if (!get_set(&info->del_set)) {
+		if (info->add_set.id != IP_SET_INVALID_ID)
+			ip_set_put(info->add_set.id);
+		return 0;
+	}
+	return 1;
+}
+
+static void destroy(void *targinfo, unsigned int targinfosize)
+{
+	struct ipt_set_target_info *info = targinfo;
+
+	if (info->add_set.id != IP_SET_INVALID_ID)
+		ip_set_put(info->add_set.id);
+	if (info->del_set.id != IP_SET_INVALID_ID)
+		ip_set_put(info->del_set.id);
+}
+
+static struct ipt_target ipt_set_reg = {
+	.name		= "SET",
+	.target		= target,
+	.checkentry	= checkentry,
+	.destroy	= destroy,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	return ipt_register_target(&ipt_set_reg);
+}
+
+static void __exit fini(void)
+{
+	ipt_unregister_target(&ipt_set_reg);
+}
+
+module_init(init);
+module_exit(fini);
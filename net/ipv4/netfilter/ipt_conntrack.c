@@ -93,7 +93,7 @@ match(const struct sk_buff *skb,
 		if(!ct)
 			return 0;
 
-		expires = timer_pending(&ct->timeout) ? (ct->timeout.expires - jiffies)/HZ : 0;
+		expires = is_confirmed(ct) && !ip_ct_expired(ct) ? (ct->timeout - jiffies)/HZ : 0;
 
 		if (FWINV(!(expires >= sinfo->expires_min && expires <= sinfo->expires_max), IPT_CONNTRACK_EXPIRES))
 			return 0;
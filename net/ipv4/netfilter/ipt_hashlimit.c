@@ -427,8 +427,10 @@ hashlimit_match(const struct sk_buff *skb,
 		int offset,
 		int *hotdrop)
 {
-	struct ipt_hashlimit_info *r = 
-		((struct ipt_hashlimit_info *)matchinfo)->u.master;
+	/* All state lives in the shared hash table; the rule itself may
+	   be moved to another copy of the table without being checked
+	   again, so nothing may point into it. */
+	const struct ipt_hashlimit_info *r = matchinfo;
 	struct ipt_hashlimit_htable *hinfo = r->hinfo;
 	unsigned long now = jiffies;
 	struct dsthash_ent *dh;
@@ -546,8 +548,7 @@ hashlimit_checkentry(const char *tablename,
 	}
 	up(&hlimit_mutex);
 
-	/* Ugly hack: For SMP, we only want to use one set */
-	r->u.master = r;
+	r->u.ptr = NULL;
 
 	return 1;
 }
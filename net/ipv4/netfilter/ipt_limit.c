@@ -15,6 +15,7 @@
 
 #include <linux/module.h>
 #include <linux/skbuff.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
 
@@ -128,16 +129,28 @@ ipt_limit_checkentry(const char *tablename,
 	r->credit_cap = user2credits(r->avg * r->burst); /* Credits full. */
 	r->cost = user2credits(r->avg);
 
-	/* For SMP, we only want to use one set of counters. */
-	r->master = r;
+	/* For SMP, we only want to use one set of counters.  They live
+	   outside the rule, which may be moved to another copy of the
+	   table without being checked again. */
+	r->master = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (!r->master)
+		return 0;
+	*r->master = *r;
 
 	return 1;
 }
 
+static void
+ipt_limit_destroy(void *matchinfo, unsigned int matchsize)
+{
+	kfree(((struct ipt_rateinfo *)matchinfo)->master);
+}
+
 static struct ipt_match ipt_limit_reg = {
 	.name		= "limit",
 	.match		= ipt_limit_match,
 	.checkentry	= ipt_limit_checkentry,
+	.destroy	= ipt_limit_destroy,
 	.me		= THIS_MODULE,
 };
 
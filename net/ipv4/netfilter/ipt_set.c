@@ -0,0 +1,92 @@
+/* Kernel module to match a packet's address or port against an IP set. */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/skbuff.h>
+
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv4/ipt_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("iptables IP set match module");
+
+static int
+match(const struct sk_buff *skb,
+      const struct net_device *in,
+      const struct net_device *out,
+      const void *matchinfo,
+      int offset,
+      int *hotdrop)
+{
+	const struct ipt_set_match_info *info = matchinfo;
+	const struct ipt_set_info *set = &info->match_set;
+	int ret;
+
+	ret = ip_set_test_skb(set->id, skb, set->flags & IPT_SET_DST);
+	if (ret < 0) {
+		/* No port to test: match neither way, so `!' doesn't let
+		   fragments through.  A header cut short is dropped, as
+		   the tcp and udp matches do. */
+		if (ret == -EINVAL)
+			*hotdrop = 1;
+		return 0;
+	}
+	return ret ^ !!(set->flags & IPT_SET_INV);
+}
+
+static int
+checkentry(const char *tablename,
+	   const struct ipt_ip *ip,
+	   void *matchinfo,
+	   unsigned int matchsize,
+	   unsigned int hook_mask)
+{
+	struct ipt_set_match_info *info = matchinfo;
+	struct ipt_set_info *set = &info->match_set;
+
+	if (matchsize != IPT_ALIGN(sizeof(struct ipt_set_match_info)))
+		return 0;
+	if (set->flags & ~(IPT_SET_DST | IPT_SET_INV))
+		return 0;
+
+	set->name[IP_SET_MAXNAMELEN-1] = '\0';
+	set->id = ip_set_get_byname(set->name);
+	if (set->id == IP_SET_INVALID_ID) {
+		printk(KERN_WARNING "ipt_set: no set named `%s'\n", set->name);
+		return 0;
+	}
+	return 1;
+}
+
+static void destroy(void *matchinfo, unsigned int matchsize)
+{
+	struct ipt_set_match_info *info = matchinfo;
+
+	ip_set_put(info->match_set.id);
+}
+
+static struct ipt_match set_match = {
+	.name		= "set",
+	.match		= &match,
+	.checkentry	= &checkentry,
+	.destroy	= &destroy,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	return ipt_register_match(&set_match);
+}
+
+static void __exit fini(void)
+{
+	ipt_unregister_match(&set_match);
+}
+
+module_init(init);
+module_exit(fini);
@@ -136,7 +136,16 @@ static int ip_rt_mtu_expires		= 10 * 60 * HZ;
 static int ip_rt_min_pmtu		= 512 + 20 + 20;
 static int ip_rt_min_advmss		= 256;
 static int ip_rt_secret_interval	= 10 * 60 * HZ;
+/**
+ * 非0时，输入路由不进入路由缓存：每个报文直接查找FIB，转发报文共用下一跳中缓存的路由。
+ * 可以避免随机源地址的洪泛报文冲刷路由缓存。
+ */
+static int ip_rt_input_nocache;
 static unsigned long rt_deadline;
+/**
+ * 路由缓存的刷新代数，每次刷新递增。保存在下一跳中的路由据此判断是否已经失效。
+ */
+static atomic_t rt_genid = ATOMIC_INIT(0);
 
 #define RTprint(a...)	printk(KERN_DEBUG a)
 
@@ -627,6 +636,7 @@ static void rt_run_flush(unsigned long dummy)
 	rt_deadline = 0;
 
 	get_random_bytes(&rt_hash_rnd, 4);
+	atomic_inc(&rt_genid);
 
 	for (i = rt_hash_mask; i >= 0; i--) {
 		spin_lock_bh(&rt_hash_table[i].lock);
@@ -1064,6 +1074,167 @@ restart:
 	return 0;
 }
 
+/*
+ * Input routes when route/input_nocache is set: the route is handed
+ * to the packet without going into the hash and is freed by
+ * dst_release() when the last packet referring to it goes away.
+ */
+static int rt_intern_nocache(struct rtable *rt, struct rtable **rp)
+{
+	if (rt->rt_type == RTN_UNICAST || rt->fl.iif == 0) {
+		int err = arp_bind_neighbour(&rt->u.dst);
+		if (err) {
+			if (err == -ENOBUFS && net_ratelimit())
+				printk(KERN_WARNING "Neighbour table overflow.\n");
+			rt_drop(rt);
+			return err;
+		}
+	}
+
+	rt->u.dst.flags |= DST_NOCACHE;
+	rt->u.dst.lastuse = jiffies;
+	*rp = rt;
+	return 0;
+}
+
+static inline int rt_intern_input(unsigned hash, struct rtable *rt,
+				  struct sk_buff *skb)
+{
+	if (ip_rt_input_nocache)
+		return rt_intern_nocache(rt, (struct rtable **)&skb->dst);
+	return rt_intern_hash(hash, rt, (struct rtable **)&skb->dst);
+}
+
+/*
+ * Per-nexthop forwarding routes.
+ *
+ * With input route caching off, a forwarded packet that needs nothing
+ * from its route but the nexthop shares one route with every other
+ * such packet arriving on the same device for the same nexthop.  That
+ * leaves out packets that may trigger a redirect, carry IP options
+ * (they read the per-packet addresses from the route), may be subject
+ * to IPsec, or are accounted to a realm of their own.  Only gatewayed
+ * nexthops qualify: on a directly connected one the neighbour, and so
+ * the route, belongs to the destination.
+ *
+ * Readers get at nh_rth_input under RCU, as with the hash chains;
+ * rt_nh_lock serializes the writers.
+ */
+static DEFINE_SPINLOCK(rt_nh_lock);
+
+static inline int rt_nexthop_cacheable(struct sk_buff *skb,
+				       struct fib_result *res, u32 daddr,
+				       unsigned flags, u32 itag)
+{
+	if (flags & RTCF_DOREDIRECT)
+		return 0;
+	/* inet_rtm_getroute() passes an skb without an IP header */
+	if (skb->protocol != htons(ETH_P_IP) || !skb->nh.raw ||
+	    skb->nh.iph->ihl != 5)
+		return 0;
+	if (!FIB_RES_GW(*res) || FIB_RES_NH(*res).nh_scope != RT_SCOPE_LINK ||
+	    FIB_RES_GW(*res) == daddr)
+		return 0;
+#ifdef CONFIG_NET_CLS_ROUTE
+	if (itag)
+		return 0;
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	if (fib_rules_tclass(res))
+		return 0;
+#endif
+#endif
+#ifdef CONFIG_XFRM
+	if (xfrm_policy_list[XFRM_POLICY_OUT])
+		return 0;
+#endif
+	return 1;
+}
+
+static inline unsigned rt_input_dst_flags(struct in_device *in_dev)
+{
+	unsigned flags = DST_HOST;
+
+	if (in_dev->cnf.no_policy)
+		flags |= DST_NOPOLICY;
+	if (in_dev->cnf.no_xfrm)
+		flags |= DST_NOXFRM;
+	return flags;
+}
+
+static struct rtable *rt_nexthop_get(struct fib_nh *nh, struct in_device *in_dev,
+				     int iif)
+{
+	struct rtable *rth;
+
+	rcu_read_lock();
+	rth = rcu_dereference(nh->nh_rth_input);
+	if (rth && rth->fl.iif == iif &&
+	    rth->rt_genid == atomic_read(&rt_genid) &&
+	    rth->u.dst.flags == rt_input_dst_flags(in_dev) &&
+	    !rth->u.dst.obsolete &&
+	    (!rth->u.dst.expires ||
+	     time_before(jiffies, rth->u.dst.expires))) {
+		rth->u.dst.lastuse = jiffies;
+		dst_hold(&rth->u.dst);
+		rth->u.dst.__use++;
+	} else
+		rth = NULL;
+	rcu_read_unlock();
+	return rth;
+}
+
+static int rt_nexthop_intern(struct fib_nh *nh, struct rtable *rt,
+			     struct rtable **rp)
+{
+	struct rtable *old;
+	int err;
+
+	/* Forget the packet the route was built for. */
+	rt->fl.fl4_dst	= 0;
+	rt->rt_dst	= 0;
+	rt->fl.fl4_src	= 0;
+	rt->rt_src	= 0;
+	rt->fl.fl4_tos	= 0;
+#ifdef CONFIG_IP_ROUTE_FWMARK
+	rt->fl.fl4_fwmark = 0;
+#endif
+	rt->rt_spec_dst	= 0;
+	rt->rt_flags	&= ~RTCF_DIRECTSRC;
+	rt->rt_genid	= atomic_read(&rt_genid);
+
+	err = arp_bind_neighbour(&rt->u.dst);
+	if (err) {
+		rt_drop(rt);
+		return err;
+	}
+	rt->u.dst.lastuse = jiffies;
+
+	spin_lock_bh(&rt_nh_lock);
+	old = nh->nh_rth_input;
+	rcu_assign_pointer(nh->nh_rth_input, rt);
+	spin_unlock_bh(&rt_nh_lock);
+	if (old)
+		rt_free(old);
+
+	*rp = rt;
+	return 0;
+}
+
+/**
+ * 释放下一跳中缓存的转发路由。在下一跳的设备被关闭以及fib_info被释放时调用。
+ */
+void rt_nexthop_flush(struct fib_nh *nh)
+{
+	struct rtable *rt;
+
+	spin_lock_bh(&rt_nh_lock);
+	rt = nh->nh_rth_input;
+	nh->nh_rth_input = NULL;
+	spin_unlock_bh(&rt_nh_lock);
+	if (rt)
+		rt_free(rt);
+}
+
 void rt_bind_peer(struct rtable *rt, int create)
 {
 	static DEFINE_SPINLOCK(rt_peer_lock);
@@ -1726,7 +1897,7 @@ static int ip_route_input_mc(struct sk_buff *skb, u32 daddr, u32 saddr,
 
 	in_dev_put(in_dev);
 	hash = rt_hash_code(daddr, saddr ^ (dev->ifindex << 5), tos);
-	return rt_intern_hash(hash, rth, (struct rtable**) &skb->dst);
+	return rt_intern_input(hash, rth, skb);
 
 e_nobufs:
 	in_dev_put(in_dev);
@@ -1772,6 +1943,7 @@ static int ip_route_input_slow(struct sk_buff *skb, u32 daddr, u32 saddr,
 	u32		spec_dst;
 	int		err = -EINVAL;
 	int		free_res = 0;
+	int		nh_cache = 0;
 
 	/* IP on this device is disabled. */
 
@@ -1915,16 +2087,23 @@ static int ip_route_input_slow(struct sk_buff *skb, u32 daddr, u32 saddr,
 			goto e_inval;
 	}
 
+	if (ip_rt_input_nocache &&
+	    rt_nexthop_cacheable(skb, &res, daddr, flags, itag)) {
+		nh_cache = 1;
+		rth = rt_nexthop_get(&FIB_RES_NH(res), in_dev, dev->ifindex);
+		if (rth) {
+			skb->dst = (struct dst_entry*)rth;
+			err = 0;
+			goto done;
+		}
+	}
+
 	rth = dst_alloc(&ipv4_dst_ops);
 	if (!rth)
 		goto e_nobufs;
 
 	atomic_set(&rth->u.dst.__refcnt, 1);
-	rth->u.dst.flags= DST_HOST;
-	if (in_dev->cnf.no_policy)
-		rth->u.dst.flags |= DST_NOPOLICY;
-	if (in_dev->cnf.no_xfrm)
-		rth->u.dst.flags |= DST_NOXFRM;
+	rth->u.dst.flags= rt_input_dst_flags(in_dev);
 	rth->fl.fl4_dst	= daddr;
 	rth->rt_dst	= daddr;
 	rth->fl.fl4_tos	= tos;
@@ -1949,8 +2128,14 @@ static int ip_route_input_slow(struct sk_buff *skb, u32 daddr, u32 saddr,
 
 	rth->rt_flags = flags;
 
+	if (nh_cache) {
+		err = rt_nexthop_intern(&FIB_RES_NH(res), rth,
+					(struct rtable**)&skb->dst);
+		goto done;
+	}
+
 intern:
-	err = rt_intern_hash(hash, rth, (struct rtable**)&skb->dst);
+	err = rt_intern_input(hash, rth, skb);
 done:
 	in_dev_put(in_dev);
 	if (out_dev)
@@ -2122,6 +2307,12 @@ int ip_route_input(struct sk_buff *skb, u32 daddr, u32 saddr,
 	 */
 	hash = rt_hash_code(daddr, saddr ^ (iif << 5), tos);
 
+	/**
+	 * 关闭了输入路由缓存，直接查找FIB。
+	 */
+	if (ip_rt_input_nocache)
+		goto no_cache;
+
 	rcu_read_lock();
 	/**
 	 * 然后一个接一个遍历哈希桶链表中的路由项，比较所有必须的字段，直到查找到匹配或到链表尾部时还没有找到匹配。
@@ -2154,6 +2345,7 @@ int ip_route_input(struct sk_buff *skb, u32 daddr, u32 saddr,
 	}
 	rcu_read_unlock();
 
+no_cache:
 	/* Multicast recognition logic is moved from route cache to here.
 	   The problem was that too many Ethernet cards have broken/missing
 	   hardware multicast filters :-( As result the host on multicasting
@@ -3091,6 +3283,14 @@ ctl_table ipv4_route_table[] = {
 		.proc_handler	= &proc_dointvec_jiffies,
 		.strategy	= &sysctl_jiffies,
 	},
+	{
+		.ctl_name	= NET_IPV4_ROUTE_INPUT_NOCACHE,
+		.procname	= "input_nocache",
+		.data		= &ip_rt_input_nocache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
 	{ .ctl_name = 0 }
 };
 #endif
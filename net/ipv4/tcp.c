@@ -262,6 +262,7 @@
 #include <net/tcp.h>
 #include <net/xfrm.h>
 #include <net/ip.h>
+#include <net/busy_poll.h>
 
 
 #include <asm/uaccess.h>
@@ -798,6 +799,36 @@ ssize_t tcp_sendpage(struct socket *sock, struct page *page, int offset,
 	return res;
 }
 
+/*
+ * Send a contiguous run of pages under a single socket lock. The data
+ * starts at 'offset' in pages[0] and continues from the start of each
+ * following page.
+ */
+ssize_t tcp_sendpages(struct socket *sock, struct page **pages, int offset,
+		      size_t size, int flags)
+{
+	ssize_t res;
+	struct sock *sk = sock->sk;
+
+#define TCP_ZC_CSUM_FLAGS (NETIF_F_IP_CSUM | NETIF_F_NO_CSUM | NETIF_F_HW_CSUM)
+
+	/* Without zero copy, send the first page and let the caller loop */
+	if (!(sk->sk_route_caps & NETIF_F_SG) ||
+	    !(sk->sk_route_caps & TCP_ZC_CSUM_FLAGS))
+		return sock_no_sendpage(sock, pages[0], offset,
+					min_t(size_t, size, PAGE_SIZE - offset),
+					flags);
+
+#undef TCP_ZC_CSUM_FLAGS
+
+	lock_sock(sk);
+	TCP_CHECK_TIMER(sk);
+	res = do_tcp_sendpages(sk, pages, offset, size, flags);
+	TCP_CHECK_TIMER(sk);
+	release_sock(sk);
+	return res;
+}
+
 #define TCP_PAGE(sk)	(sk->sk_sndmsg_page)
 #define TCP_OFF(sk)	(sk->sk_sndmsg_off)
 
@@ -1288,6 +1319,13 @@ int tcp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	long timeo;
 	struct task_struct *user_recv = NULL;
 
+	/**
+	 * 设置了SO_BUSY_POLL时，先在不持有锁的情况下忙轮询网卡等待数据。
+	 */
+	if (sk_can_busy_loop(sk) && skb_queue_empty(&sk->sk_receive_queue) &&
+	    sk->sk_state == TCP_ESTABLISHED)
+		sk_busy_loop(sk, nonblock);
+
 	lock_sock(sk);/* 首先获取套接口的锁 */
 
 	TCP_CHECK_TIMER(sk);
@@ -2040,6 +2078,25 @@ int tcp_setsockopt(struct sock *sk, int level, int optname, char __user *optval,
 		return tp->af_specific->setsockopt(sk, level, optname,
 						   optval, optlen);
 
+	/* This is a string value all the others are int's */
+	if (optname == TCP_CONGESTION) {
+		char name[TCP_CA_NAME_MAX];
+
+		if (optlen < 1)
+			return -EINVAL;
+
+		val = strncpy_from_user(name, optval,
+					min(TCP_CA_NAME_MAX-1, optlen));
+		if (val < 0)
+			return -EFAULT;
+		name[val] = 0;
+
+		lock_sock(sk);
+		err = tcp_set_congestion_control(tp, name);
+		release_sock(sk);
+		return err;
+	}
+
 	if (optlen < sizeof(int))
 		return -EINVAL;
 
@@ -2324,6 +2381,15 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char __user *optval,
 	case TCP_QUICKACK:
 		val = !tp->ack.pingpong;
 		break;
+	case TCP_CONGESTION:
+		if (get_user(len, optlen))
+			return -EFAULT;
+		len = min_t(unsigned int, len, TCP_CA_NAME_MAX);
+		if (put_user(len, optlen))
+			return -EFAULT;
+		if (copy_to_user(optval, tp->ca_ops->name, len))
+			return -EFAULT;
+		return 0;
 	default:
 		return -ENOPROTOOPT;
 	};
@@ -2336,6 +2402,209 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char __user *optval,
 }
 
 
+/*
+ * Cut a super-sized TCP segment into tso_size sized ones on behalf of a
+ * device without TSO.  The headers are copied by skb_segment(); here the
+ * sequence numbers, the flags that may only appear once (FIN, PSH, CWR)
+ * and the checksums are fixed up.  If the segments still carry
+ * CHECKSUM_HW the pseudo header sum is just adjusted for the new length,
+ * otherwise the full checksum is computed from the data csum that
+ * skb_segment() left behind.
+ */
+struct sk_buff *tcp_tso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct tcphdr *th;
+	unsigned thlen;
+	unsigned int seq;
+	unsigned int delta;
+	unsigned int oldlen;
+	unsigned int len;
+
+	if (!pskb_may_pull(skb, sizeof(*th)))
+		goto out;
+
+	th = skb->h.th;
+	thlen = th->doff * 4;
+	if (thlen < sizeof(*th))
+		goto out;
+
+	if (!pskb_may_pull(skb, thlen))
+		goto out;
+
+	oldlen = (u16)~skb->len;
+	__skb_pull(skb, thlen);
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	len = skb_shinfo(skb)->tso_size;
+	delta = htonl(oldlen + (thlen + len));
+
+	skb = segs;
+	th = skb->h.th;
+	seq = ntohl(th->seq);
+
+	while (skb->next) {
+		th->fin = th->psh = 0;
+
+		th->check = ~csum_fold(th->check + delta);
+		if (skb->ip_summed != CHECKSUM_HW)
+			th->check = csum_fold(csum_partial(skb->h.raw, thlen,
+							   skb->csum));
+
+		seq += len;
+		skb = skb->next;
+		th = skb->h.th;
+
+		th->seq = htonl(seq);
+		th->cwr = 0;
+	}
+
+	delta = htonl(oldlen + (skb->tail - skb->h.raw) + skb->data_len);
+	th->check = ~csum_fold(th->check + delta);
+	if (skb->ip_summed != CHECKSUM_HW)
+		th->check = csum_fold(csum_partial(skb->h.raw, thlen,
+						   skb->csum));
+
+out:
+	return segs;
+}
+
+/* Verify the checksum of a GRO candidate, skb->data is at the TCP header. */
+static int tcp4_gro_checksum(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	switch (skb->ip_summed) {
+	case CHECKSUM_UNNECESSARY:
+		return 0;
+	case CHECKSUM_HW:
+		if (!tcp_v4_check(skb->h.th, skb->len, iph->saddr,
+				  iph->daddr, skb->csum))
+			break;
+		/* Fall back to a software check like tcp_v4_checksum_init() */
+	default:
+		if (tcp_v4_check(skb->h.th, skb->len, iph->saddr, iph->daddr,
+				 skb_checksum(skb, 0, skb->len, 0)))
+			return -EINVAL;
+		break;
+	}
+
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	return 0;
+}
+
+/*
+ * GRO for TCP over IPv4.  A held segment is extended by the next one of
+ * its connection as long as the data is contiguous, the segment is no
+ * bigger than the first one and the headers agree on everything but the
+ * sequence number, PSH and the checksum.  Returns the slot of the held
+ * segment if it has to go up now, either because the new segment ended
+ * the batch (PSH, short segment) or because it could not be merged.
+ */
+struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct sk_buff *p;
+	struct tcphdr *th, *th2;
+	unsigned int thlen;
+	unsigned int len;
+	unsigned int mss;
+	u32 flags = 0;
+	int flush = 1;
+	int i;
+
+	if (!pskb_may_pull(skb, sizeof(*th)))
+		goto out;
+
+	th = skb->h.th;
+	thlen = th->doff * 4;
+	if (thlen < sizeof(*th))
+		goto out;
+
+	if (!pskb_may_pull(skb, thlen))
+		goto out;
+
+	th = skb->h.th;
+	len = skb->len - thlen;
+	flags = tcp_flag_word(th);
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		th2 = p->h.th;
+		if (th->source != th2->source || th->dest != th2->dest) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+		break;
+	}
+
+	/*
+	 * Only data segments with nothing but ACK and PSH set can be
+	 * merged, or be held waiting for more.
+	 */
+	flush = NAPI_GRO_CB(skb)->flush || !len ||
+		(flags & (TCP_FLAG_URG | TCP_FLAG_RST | TCP_FLAG_SYN |
+			  TCP_FLAG_FIN | TCP_FLAG_CWR)) ||
+		!(flags & TCP_FLAG_ACK) || tcp4_gro_checksum(skb);
+	if (!p)
+		goto out;
+	if (flush)
+		goto flush;
+
+	th2 = p->h.th;
+	mss = skb_shinfo(p)->tso_size;
+	if (!mss)
+		mss = p->len - (p->h.raw - p->data) - thlen;
+
+	if (NAPI_GRO_CB(p)->flush ||
+	    ((flags ^ tcp_flag_word(th2)) & ~TCP_FLAG_PSH) ||
+	    th->ack_seq != th2->ack_seq || len > mss ||
+	    ntohl(th->seq) != ntohl(th2->seq) + p->len -
+			      (p->h.raw - p->data) - thlen)
+		goto flush;
+
+	for (i = sizeof(*th); i < thlen; i += 4)
+		if (*(u32 *)((u8 *)th + i) != *(u32 *)((u8 *)th2 + i))
+			goto flush;
+
+	__skb_pull(skb, thlen);
+	if (skb_gro_receive(p, skb)) {
+		__skb_push(skb, thlen);
+		goto flush;
+	}
+
+	skb_shinfo(p)->tso_size = mss;
+	th2->psh |= th->psh;
+	if (th->psh || len < mss)
+		return head;
+	return NULL;
+
+flush:
+	/* The held segment goes first, skb may start a new batch */
+	NAPI_GRO_CB(skb)->flush |= flush || (flags & TCP_FLAG_PSH);
+	return head;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush || (flags & TCP_FLAG_PSH);
+	return NULL;
+}
+
+/*
+ * A merged segment looks to the rest of the stack like one large
+ * segment received from a TSO capable peer.
+ */
+int tcp4_gro_complete(struct sk_buff *skb)
+{
+	skb_shinfo(skb)->tso_segs = NAPI_GRO_CB(skb)->count;
+	skb_shinfo(skb)->gso_type = SKB_GSO_TCPV4;
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	return 0;
+}
+
 extern void __skb_cb_too_small_for_tcp(int, int);
 extern void tcpdiag_init(void);
 
@@ -2376,7 +2645,8 @@ void __init tcp_init(void)
 
 	tcp_timewait_cachep = kmem_cache_create("tcp_tw_bucket",
 						sizeof(struct tcp_tw_bucket),
-						0, SLAB_HWCACHE_ALIGN,
+						0, SLAB_HWCACHE_ALIGN |
+						SLAB_DESTROY_BY_RCU,
 						NULL, NULL);
 	if (!tcp_timewait_cachep)
 		panic("tcp_init: Cannot alloc tcp_tw_bucket cache.");
@@ -2401,7 +2671,7 @@ void __init tcp_init(void)
 	tcp_ehash_size = (1 << tcp_ehash_size) >> 1;
 	for (i = 0; i < (tcp_ehash_size << 1); i++) {
 		rwlock_init(&tcp_ehash[i].lock);
-		INIT_HLIST_HEAD(&tcp_ehash[i].chain);
+		INIT_HLIST_NULLS_HEAD(&tcp_ehash[i].chain, i);
 	}
 
 	/* 分配绑定端口的散列表。 */
@@ -2459,6 +2729,8 @@ void __init tcp_init(void)
 	printk(KERN_INFO "TCP: Hash tables configured "
 	       "(established %d bind %d)\n",
 	       tcp_ehash_size << 1, tcp_bhash_size);
+
+	tcp_register_congestion_control(&tcp_reno);
 }
 
 EXPORT_SYMBOL(tcp_accept);
@@ -2473,7 +2745,11 @@ EXPORT_SYMBOL(tcp_read_sock);
 EXPORT_SYMBOL(tcp_recvmsg);
 EXPORT_SYMBOL(tcp_sendmsg);
 EXPORT_SYMBOL(tcp_sendpage);
+EXPORT_SYMBOL(tcp_sendpages);
 EXPORT_SYMBOL(tcp_setsockopt);
 EXPORT_SYMBOL(tcp_shutdown);
 EXPORT_SYMBOL(tcp_statistics);
+EXPORT_SYMBOL(tcp_tso_segment);
+EXPORT_SYMBOL(tcp4_gro_receive);
+EXPORT_SYMBOL(tcp4_gro_complete);
 EXPORT_SYMBOL(tcp_timewait_cachep);
@@ -68,6 +68,7 @@
 #include <net/ipv6.h>
 #include <net/inet_common.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -191,6 +192,8 @@ static inline int tcp_bind_conflict(struct sock *sk, struct tcp_bind_bucket *tb)
 	struct sock *sk2;
 	struct hlist_node *node;
 	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	int uid = sock_i_uid(sk);
 
 	sk_for_each_bound(sk2, node, &tb->owners) {
 		if (sk != sk2 &&
@@ -198,8 +201,16 @@ static inline int tcp_bind_conflict(struct sock *sk, struct tcp_bind_bucket *tb)
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if)) {
-			if (!reuse || !sk2->sk_reuse ||
-			    sk2->sk_state == TCP_LISTEN) {
+			/*
+			 * SO_REUSEPORT sockets of the same user may share the
+			 * address even while listening.  TIME_WAIT buckets have
+			 * no owner left to compare against.
+			 */
+			if ((!reuse || !sk2->sk_reuse ||
+			     sk2->sk_state == TCP_LISTEN) &&
+			    (!reuseport || !sk2->sk_reuseport ||
+			     (sk2->sk_state != TCP_TIME_WAIT &&
+			      uid != sock_i_uid(sk2)))) {
 				const u32 sk2_rcv_saddr = tcp_v4_rcv_saddr(sk2);
 				if (!sk2_rcv_saddr || !sk_rcv_saddr ||
 				    sk2_rcv_saddr == sk_rcv_saddr)
@@ -366,20 +377,22 @@ void tcp_listen_wlock(void)
 
 static __inline__ void __tcp_v4_hash(struct sock *sk, const int listen_possible)
 {
-	struct hlist_head *list;
 	rwlock_t *lock;
 
 	BUG_TRAP(sk_unhashed(sk));
 	if (listen_possible && sk->sk_state == TCP_LISTEN) {
-		list = &tcp_listening_hash[tcp_sk_listen_hashfn(sk)];
 		lock = &tcp_lhash_lock;
 		tcp_listen_wlock();
+		__sk_add_node(sk,
+			      &tcp_listening_hash[tcp_sk_listen_hashfn(sk)]);
 	} else {
-		list = &tcp_ehash[(sk->sk_hashent = tcp_sk_hashfn(sk))].chain;
-		lock = &tcp_ehash[sk->sk_hashent].lock;
+		struct tcp_ehash_bucket *head;
+
+		head = &tcp_ehash[(sk->sk_hashent = tcp_sk_hashfn(sk))];
+		lock = &head->lock;
 		write_lock(lock);
+		__sk_nulls_add_node_rcu(sk, &head->chain);
 	}
-	__sk_add_node(sk, list);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(lock);
 	if (listen_possible && sk->sk_state == TCP_LISTEN)
@@ -408,14 +421,15 @@ void tcp_unhash(struct sock *sk)
 		local_bh_disable();
 		tcp_listen_wlock();
 		lock = &tcp_lhash_lock;
+		if (__sk_del_node_init(sk))
+			sock_prot_dec_use(sk->sk_prot);
 	} else {
 		struct tcp_ehash_bucket *head = &tcp_ehash[sk->sk_hashent];
 		lock = &head->lock;
 		write_lock_bh(&head->lock);
+		if (__sk_nulls_del_node_init_rcu(sk))
+			sock_prot_dec_use(sk->sk_prot);
 	}
-
-	if (__sk_del_node_init(sk))
-		sock_prot_dec_use(sk->sk_prot);
 	write_unlock_bh(lock);
 
  ende:
@@ -429,12 +443,14 @@ void tcp_unhash(struct sock *sk)
  * connection.  So always assume those are both wildcarded
  * during the search since they can never be otherwise.
  */
-static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
+static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head,
+					     u32 saddr, u16 sport, u32 daddr,
 					     unsigned short hnum, int dif)
 {
 	struct sock *result = NULL, *sk;
 	struct hlist_node *node;
-	int score, hiscore;
+	int score, hiscore, matches = 0;
+	u32 phash = 0;
 
 	hiscore=-1;
 	sk_for_each(sk, node, head) {
@@ -454,11 +470,22 @@ static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
 					continue;
 				score+=2;
 			}
-			if (score == 5)
+			if (score == 5 && !sk->sk_reuseport)
 				return sk;
 			if (score > hiscore) {
 				hiscore = score;
 				result = sk;
+				matches = 0;
+				if (sk->sk_reuseport) {
+					phash = sk_reuseport_hash(saddr, sport,
+								  daddr, hnum);
+					matches = 1;
+				}
+			} else if (score == hiscore && matches &&
+				   sk->sk_reuseport) {
+				/* Spread flows over the SO_REUSEPORT group */
+				if (sk_reuseport_pick(&phash, ++matches))
+					result = sk;
 			}
 		}
 	}
@@ -466,8 +493,8 @@ static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
 }
 
 /* Optimize the common listener case. */
-static inline struct sock *tcp_v4_lookup_listener(u32 daddr,
-		unsigned short hnum, int dif)
+static inline struct sock *tcp_v4_lookup_listener(u32 saddr, u16 sport,
+		u32 daddr, unsigned short hnum, int dif)
 {
 	struct sock *sk = NULL;
 	struct hlist_head *head;
@@ -482,7 +509,8 @@ static inline struct sock *tcp_v4_lookup_listener(u32 daddr,
 		    (sk->sk_family == PF_INET || !ipv6_only_sock(sk)) &&
 		    !sk->sk_bound_dev_if)
 			goto sherry_cache;
-		sk = __tcp_v4_lookup_listener(head, daddr, hnum, dif);
+		sk = __tcp_v4_lookup_listener(head, saddr, sport, daddr,
+					      hnum, dif);
 	}
 	if (sk) {
 sherry_cache:
@@ -506,30 +534,53 @@ static inline struct sock *__tcp_v4_lookup_established(u32 saddr, u16 sport,
 	TCP_V4_ADDR_COOKIE(acookie, saddr, daddr)
 	__u32 ports = TCP_COMBINED_PORTS(sport, hnum);
 	struct sock *sk;
-	struct hlist_node *node;
+	struct hlist_nulls_node *node;
 	/* Optimize here for direct hit, only listening connections can
 	 * have wildcards anyways.
 	 */
 	int hash = tcp_hashfn(daddr, hnum, saddr, sport);
 	head = &tcp_ehash[hash];
-	read_lock(&head->lock);
-	sk_for_each(sk, node, &head->chain) {
-		if (TCP_IPV4_MATCH(sk, acookie, saddr, daddr, ports, dif))
-			goto hit; /* You sunk my battleship! */
+	tcp_ehash_read_lock(head);
+begin:
+	sk_nulls_for_each_rcu(sk, node, &head->chain) {
+		if (TCP_IPV4_MATCH(sk, acookie, saddr, daddr, ports, dif)) {
+			if (unlikely(!tcp_ehash_hold(sk)))
+				goto begin;
+			if (unlikely(!TCP_IPV4_MATCH(sk, acookie, saddr, daddr,
+						     ports, dif))) {
+				sock_put(sk);
+				goto begin;
+			}
+			goto out; /* You sunk my battleship! */
+		}
 	}
+	/*
+	 * The socket we were standing on was freed and reused on another
+	 * chain: the walk ended there instead of here, start over.
+	 */
+	if (get_nulls_value(node) != hash)
+		goto begin;
 
 	/* Must check for a TIME_WAIT'er before going to listener hash. */
-	sk_for_each(sk, node, &(head + tcp_ehash_size)->chain) {
-		if (TCP_IPV4_TW_MATCH(sk, acookie, saddr, daddr, ports, dif))
-			goto hit;
+begin_tw:
+	sk_nulls_for_each_rcu(sk, node, &(head + tcp_ehash_size)->chain) {
+		if (TCP_IPV4_TW_MATCH(sk, acookie, saddr, daddr, ports, dif)) {
+			if (unlikely(!tcp_ehash_hold(sk)))
+				goto begin_tw;
+			if (unlikely(!TCP_IPV4_TW_MATCH(sk, acookie, saddr,
+							daddr, ports, dif))) {
+				tcp_tw_put(tcptw_sk(sk));
+				goto begin_tw;
+			}
+			goto out;
+		}
 	}
+	if (get_nulls_value(node) != hash + tcp_ehash_size)
+		goto begin_tw;
 	sk = NULL;
 out:
-	read_unlock(&head->lock);
+	tcp_ehash_read_unlock(head);
 	return sk;
-hit:
-	sock_hold(sk);
-	goto out;
 }
 
 static inline struct sock *__tcp_v4_lookup(u32 saddr, u16 sport,
@@ -538,7 +589,7 @@ static inline struct sock *__tcp_v4_lookup(u32 saddr, u16 sport,
 	struct sock *sk = __tcp_v4_lookup_established(saddr, sport,
 						      daddr, hnum, dif);
 
-	return sk ? : tcp_v4_lookup_listener(daddr, hnum, dif);
+	return sk ? : tcp_v4_lookup_listener(saddr, sport, daddr, hnum, dif);
 }
 
 inline struct sock *tcp_v4_lookup(u32 saddr, u16 sport, u32 daddr,
@@ -576,13 +627,13 @@ static int __tcp_v4_check_established(struct sock *sk, __u16 lport,
 	int hash = tcp_hashfn(daddr, lport, saddr, inet->dport);
 	struct tcp_ehash_bucket *head = &tcp_ehash[hash];
 	struct sock *sk2;
-	struct hlist_node *node;
+	struct hlist_nulls_node *node;
 	struct tcp_tw_bucket *tw;
 
 	write_lock(&head->lock);
 
 	/* Check TIME-WAIT sockets first. */
-	sk_for_each(sk2, node, &(head + tcp_ehash_size)->chain) {
+	sk_nulls_for_each(sk2, node, &(head + tcp_ehash_size)->chain) {
 		tw = (struct tcp_tw_bucket *)sk2;
 
 		if (TCP_IPV4_TW_MATCH(sk2, acookie, saddr, daddr, ports, dif)) {
@@ -620,7 +671,7 @@ static int __tcp_v4_check_established(struct sock *sk, __u16 lport,
 	tw = NULL;
 
 	/* And established part... */
-	sk_for_each(sk2, node, &head->chain) {
+	sk_nulls_for_each(sk2, node, &head->chain) {
 		if (TCP_IPV4_MATCH(sk2, acookie, saddr, daddr, ports, dif))
 			goto not_unique;
 	}
@@ -632,7 +683,7 @@ unique:
 	inet->sport = htons(lport);
 	sk->sk_hashent = hash;
 	BUG_TRAP(sk_unhashed(sk));
-	__sk_add_node(sk, &head->chain);
+	__sk_nulls_add_node_rcu(sk, &head->chain);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(&head->lock);
 
@@ -1667,6 +1718,8 @@ struct sock *tcp_v4_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 	/* 延时发送ACK段控制数据块中的rcv_mss */
 	tcp_initialize_rcv_mss(newsk);
 
+	/* 子传输控制块已初始化完毕，设置引用计数后才能被无锁查找到 */
+	tcp_publish_child(newsk);
 	/* 将子传输控制块国响应到ebash散列表中，这样可以正常接收TCP段了 */
 	__tcp_v4_hash(newsk, 0);
 	/* 将子传输控制块与本地端口进行绑定 */
@@ -1881,6 +1934,7 @@ process:/* 运行到这里，说明找到相应的传输套接口 */
 	if (sk_filter(sk, skb, 0))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;/* 马上要将报文传递到传输层，该层不关心接收报文的dev，将其设置为空 */
 
 	bh_lock_sock(sk);/* 在软中断中对套接口加锁 */
@@ -1932,7 +1986,9 @@ do_time_wait:/* 处理传输控制块为TIME_WAIT状态时接收到的报文 */
 					   skb, th, skb->len)) {
 	case TCP_TW_SYN: {/* 接收到连接请求，且可接受该请求 */
 		/* 根据目的地址和端口，在bhask散列表中查找对应的传输控制块 */
-		struct sock *sk2 = tcp_v4_lookup_listener(skb->nh.iph->daddr,
+		struct sock *sk2 = tcp_v4_lookup_listener(skb->nh.iph->saddr,
+							  th->source,
+							  skb->nh.iph->daddr,
 							  ntohs(th->dest),
 							  tcp_v4_iif(skb));
 		if (sk2) {/* 找到控制块 */
@@ -2174,6 +2230,7 @@ static int tcp_v4_init_sock(struct sock *sk)
 	tp->mss_cache_std = tp->mss_cache = 536;
 
 	tp->reordering = sysctl_tcp_reordering;
+	tp->ca_ops = &tcp_init_congestion_ops;
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -2196,6 +2253,8 @@ int tcp_v4_destroy_sock(struct sock *sk)
 
 	tcp_clear_xmit_timers(sk);
 
+	tcp_cleanup_congestion_control(tp);
+
 	/* Cleanup up the write buffer. */
   	sk_stream_writequeue_purge(sk);
 
@@ -2227,16 +2286,18 @@ EXPORT_SYMBOL(tcp_v4_destroy_sock);
 #ifdef CONFIG_PROC_FS
 /* Proc filesystem TCP sock list dumping. */
 
-static inline struct tcp_tw_bucket *tw_head(struct hlist_head *head)
+static inline struct tcp_tw_bucket *tw_head(struct hlist_nulls_head *head)
 {
-	return hlist_empty(head) ? NULL :
-		list_entry(head->first, struct tcp_tw_bucket, tw_node);
+	return hlist_nulls_empty(head) ? NULL :
+		hlist_nulls_entry(head->first, struct tcp_tw_bucket,
+				  tw_nulls_node);
 }
 
 static inline struct tcp_tw_bucket *tw_next(struct tcp_tw_bucket *tw)
 {
-	return tw->tw_node.next ?
-		hlist_entry(tw->tw_node.next, typeof(*tw), tw_node) : NULL;
+	return !is_a_nulls(tw->tw_nulls_node.next) ?
+		hlist_nulls_entry(tw->tw_nulls_node.next, typeof(*tw),
+				  tw_nulls_node) : NULL;
 }
 
 static void *listening_get_next(struct seq_file *seq, void *cur)
@@ -2328,14 +2389,14 @@ static void *established_get_first(struct seq_file *seq)
 
 	for (st->bucket = 0; st->bucket < tcp_ehash_size; ++st->bucket) {
 		struct sock *sk;
-		struct hlist_node *node;
+		struct hlist_nulls_node *node;
 		struct tcp_tw_bucket *tw;
 
 		/* We can reschedule _before_ having picked the target: */
 		cond_resched_softirq();
 
 		read_lock(&tcp_ehash[st->bucket].lock);
-		sk_for_each(sk, node, &tcp_ehash[st->bucket].chain) {
+		sk_nulls_for_each(sk, node, &tcp_ehash[st->bucket].chain) {
 			if (sk->sk_family != st->family) {
 				continue;
 			}
@@ -2362,7 +2423,6 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 {
 	struct sock *sk = cur;
 	struct tcp_tw_bucket *tw;
-	struct hlist_node *node;
 	struct tcp_iter_state* st = seq->private;
 
 	++st->num;
@@ -2386,18 +2446,18 @@ get_tw:
 
 		if (++st->bucket < tcp_ehash_size) {
 			read_lock(&tcp_ehash[st->bucket].lock);
-			sk = sk_head(&tcp_ehash[st->bucket].chain);
+			sk = sk_nulls_head(&tcp_ehash[st->bucket].chain);
 		} else {
 			cur = NULL;
 			goto out;
 		}
 	} else
-		sk = sk_next(sk);
+		sk = sk_nulls_next(sk);
 
-	sk_for_each_from(sk, node) {
-		if (sk->sk_family == st->family)
-			goto found;
-	}
+	while (sk && sk->sk_family != st->family)
+		sk = sk_nulls_next(sk);
+	if (sk)
+		goto found;
 
 	st->state = TCP_SEQ_STATE_TIME_WAIT;
 	tw = tw_head(&tcp_ehash[st->bucket + tcp_ehash_size].chain);
@@ -2729,6 +2789,7 @@ struct proto tcp_prot = {
 	.sysctl_rmem		= sysctl_tcp_rmem,
 	.max_header		= MAX_TCP_HEADER,
 	.slab_obj_size		= sizeof(struct tcp_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 };
 
 
@@ -79,12 +79,11 @@ static void tcp_timewait_kill(struct tcp_tw_bucket *tw)
 	/* Unlink from established hashes. */
 	ehead = &tcp_ehash[tw->tw_hashent];
 	write_lock(&ehead->lock);
-	if (hlist_unhashed(&tw->tw_node)) {
+	if (hlist_nulls_unhashed(&tw->tw_nulls_node)) {
 		write_unlock(&ehead->lock);
 		return;
 	}
-	__hlist_del(&tw->tw_node);
-	sk_node_init(&tw->tw_node);
+	hlist_nulls_del_init_rcu(&tw->tw_nulls_node);
 	write_unlock(&ehead->lock);
 
 	/* Disassociate with bind bucket. */
@@ -329,13 +328,17 @@ static void __tcp_tw_hashdance(struct sock *sk, struct tcp_tw_bucket *tw)
 
 	write_lock(&ehead->lock);
 
-	/* Step 2: Remove SK from established hash. */
-	if (__sk_del_node_init(sk))
-		sock_prot_dec_use(sk->sk_prot);
-
-	/* Step 3: Hash TW into TIMEWAIT half of established hash table. */
-	tw_add_node(tw, &(ehead + tcp_ehash_size)->chain);
+	/*
+	 * Step 2: Hash TW into TIMEWAIT half of established hash table.
+	 * Lookups don't take the bucket lock, so TW goes in before SK
+	 * goes away: a segment must always find one of the two.
+	 */
 	atomic_inc(&tw->tw_refcnt);
+	tw_add_node(tw, &(ehead + tcp_ehash_size)->chain);
+
+	/* Step 3: Remove SK from established hash. */
+	if (__sk_nulls_del_node_init_rcu(sk))
+		sock_prot_dec_use(sk->sk_prot);
 
 	write_unlock(&ehead->lock);
 }
@@ -373,7 +376,14 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 		tw->tw_dport		= inet->dport;
 		tw->tw_family		= sk->sk_family;
 		tw->tw_reuse		= sk->sk_reuse;
+		tw->tw_reuseport	= sk->sk_reuseport;
 		tw->tw_rcv_wscale	= tp->rx_opt.rcv_wscale;
+		/*
+		 * Lockless lookups may still be walking a previous life of
+		 * this bucket; they must not get a reference on it before
+		 * its new identity is in place.
+		 */
+		smp_wmb();
 		atomic_set(&tw->tw_refcnt, 1);
 
 		tw->tw_hashent		= sk->sk_hashent;
@@ -741,7 +751,7 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		struct tcp_sock *newtp;
 		struct sk_filter *filter;
 
-		memcpy(newsk, sk, sizeof(struct tcp_sock));
+		sock_copy(newsk, sk, sizeof(struct tcp_sock));
 		newsk->sk_state = TCP_SYN_RECV;
 
 		/* SANITY */
@@ -818,6 +828,12 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		newtp->frto_counter = 0;
 		newtp->frto_highmark = 0;
 
+		/* Inherit the listener's choice of congestion control,
+		 * the child needs its own reference on the module.
+		 */
+		if (!try_module_get(newtp->ca_ops->owner))
+			newtp->ca_ops = &tcp_init_congestion_ops;
+
 		tcp_set_ca_state(newtp, TCP_CA_Open);
 		tcp_init_xmit_timers(newsk);
 		skb_queue_head_init(&newtp->out_of_order_queue);
@@ -842,15 +858,14 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		/* Back to base struct sock members. */
 		newsk->sk_err = 0;
 		newsk->sk_priority = 0;
-		atomic_set(&newsk->sk_refcnt, 2);
+		/* sk_refcnt is left alone (0 on a recycled socket) until
+		 * tcp_publish_child().
+		 */
 #ifdef INET_REFCNT_DEBUG
 		atomic_inc(&inet_sock_nr);
 #endif
 		atomic_inc(&tcp_sockets_allocated);
 
-		if (sock_flag(newsk, SOCK_KEEPOPEN))
-			tcp_reset_keepalive_timer(newsk,
-						  keepalive_time_when(newtp));
 		newsk->sk_socket = NULL;
 		newsk->sk_sleep = NULL;
 		newsk->sk_owner = NULL;
@@ -886,16 +901,31 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 			newtp->ack.last_seg_size = skb->len-newtp->tcp_header_len;
 		newtp->rx_opt.mss_clamp = req->mss;
 		TCP_ECN_openreq_child(newtp, req);
-		if (newtp->ecn_flags&TCP_ECN_OK)
-			newsk->sk_no_largesend = 1;
 
-		tcp_ca_init(newtp);
+		tcp_init_congestion_control(newtp);
 
 		TCP_INC_STATS_BH(TCP_MIB_PASSIVEOPENS);
 	}
 	return newsk;
 }
 
+/*
+ * Give a child from tcp_create_openreq_child() its references, just
+ * before it is hashed. Its memory may be a recycled socket that a
+ * lockless ehash reader still walks through; the reader only takes a
+ * socket whose refcount is not zero, so the keys and state written
+ * above must be visible first.
+ */
+void tcp_publish_child(struct sock *newsk)
+{
+	smp_wmb();
+	atomic_set(&newsk->sk_refcnt, 2);
+
+	if (sock_flag(newsk, SOCK_KEEPOPEN))
+		tcp_reset_keepalive_timer(newsk,
+					  keepalive_time_when(tcp_sk(newsk)));
+}
+
 /* 
  *	Process an incoming packet for SYN_RECV sockets represented
  *	as an open_request.
@@ -1131,5 +1161,6 @@ int tcp_child_process(struct sock *parent, struct sock *child,
 EXPORT_SYMBOL(tcp_check_req);
 EXPORT_SYMBOL(tcp_child_process);
 EXPORT_SYMBOL(tcp_create_openreq_child);
+EXPORT_SYMBOL(tcp_publish_child);
 EXPORT_SYMBOL(tcp_timewait_state_process);
 EXPORT_SYMBOL(tcp_tw_deschedule);
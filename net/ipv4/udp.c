@@ -107,6 +107,7 @@
 #include <net/inet_common.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 
 /*
  *	Snmp MIB for the UDP layer
@@ -114,65 +115,152 @@
 
 DEFINE_SNMP_STAT(struct udp_mib, udp_statistics);
 
-struct hlist_head udp_hash[UDP_HTABLE_SIZE];
-DEFINE_RWLOCK(udp_hash_lock);
+struct udp_hslot udp_hash[UDP_HTABLE_SIZE];
+struct udp_hslot udp_hash2[UDP_HTABLE_SIZE];
 
 /* Shared by v4/v6 udp. */
 int udp_port_rover;
+
+/*
+ * Choose a local port for an autobind: the least crowded udp_hash slot
+ * starting at the rover, then the first free port that maps to it.
+ * Slot sizes are only sampled without the lock, which is fine for a
+ * heuristic.  On success the slot comes back write locked with BHs
+ * off and the port in *snum; NULL means the range is exhausted.
+ */
+struct udp_hslot *udp_pick_port(unsigned short *snum)
+{
+	struct udp_hslot *hslot;
+	int best_size_so_far, best, result, i;
+	int low = sysctl_local_port_range[0];
+	int high = sysctl_local_port_range[1];
+
+	result = udp_port_rover;
+	if (result > high || result < low)/* 用户可能修改了可用端口范围，则修改udp_port_rover */
+		result = low;
+	best_size_so_far = 32767;
+	best = result;
+	/* 查找所有桶中，链表数量最小的桶 */
+	for (i = 0; i < UDP_HTABLE_SIZE; i++, result++) {
+		int size = udp_hashslot(result)->count;
+
+		if (size == 0) {
+			best = result;
+			break;
+		}
+		if (size < best_size_so_far) {
+			best_size_so_far = size;
+			best = result;
+		}
+	}
+	result = best;
+	hslot = udp_hashslot(result);
+	write_lock_bh(&hslot->lock);
+	/* 在该桶中查找一个最小的未用端口号 */
+	for (i = 0; i < (1 << 16) / UDP_HTABLE_SIZE; i++, result += UDP_HTABLE_SIZE) {
+		if (result > high)
+			result = low + ((result - low) & (UDP_HTABLE_SIZE - 1));
+		if (!udp_lport_inuse(result))
+			break;
+	}
+	if (i >= (1 << 16) / UDP_HTABLE_SIZE) {
+		write_unlock_bh(&hslot->lock);
+		return NULL;
+	}
+	udp_port_rover = *snum = result;
+	return hslot;
+}
+
+static void udp_hash2_add(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct udp_hslot *hslot2;
+
+	up->udp_portaddr_hash = udp_portaddr_hash(inet_sk(sk)->rcv_saddr,
+						  inet_sk(sk)->num);
+	hslot2 = udp_hashslot2(up->udp_portaddr_hash);
+	write_lock(&hslot2->lock);
+	hlist_add_head(&sk->sk_bind_node, &hslot2->head);
+	hslot2->count++;
+	write_unlock(&hslot2->lock);
+}
+
+static void udp_hash2_del(struct sock *sk)
+{
+	struct udp_hslot *hslot2;
+
+	hslot2 = udp_hashslot2(udp_sk(sk)->udp_portaddr_hash);
+	write_lock(&hslot2->lock);
+	__sk_del_bind_node(sk);
+	hslot2->count--;
+	write_unlock(&hslot2->lock);
+}
+
+/* Hash a bound socket; caller holds hslot->lock with BHs off. */
+void __udp_hash_add(struct sock *sk, struct udp_hslot *hslot)
+{
+	sk_add_node(sk, &hslot->head);
+	hslot->count++;
+	udp_hash2_add(sk);
+	sock_prot_inc_use(sk->sk_prot);
+}
+
+/* Unhash a socket; caller holds hslot->lock with BHs off. */
+int __udp_hash_del(struct sock *sk, struct udp_hslot *hslot)
+{
+	if (!sk_del_node_init(sk))
+		return 0;
+	hslot->count--;
+	udp_hash2_del(sk);
+	sock_prot_dec_use(sk->sk_prot);
+	return 1;
+}
+
+/*
+ * The local address of a bound socket changed (connect picked a source
+ * address for a wildcard bind, or disconnect dropped it again): move it
+ * to its new udp_hash2 chain.
+ */
+void udp_rehash(struct sock *sk)
+{
+	struct udp_hslot *hslot = udp_hashslot(inet_sk(sk)->num);
+
+	write_lock_bh(&hslot->lock);
+	if (sk_hashed(sk)) {
+		udp_hash2_del(sk);
+		udp_hash2_add(sk);
+	}
+	write_unlock_bh(&hslot->lock);
+}
+
+void __init udp_init(void)
+{
+	int i;
+
+	for (i = 0; i < UDP_HTABLE_SIZE; i++) {
+		INIT_HLIST_HEAD(&udp_hash[i].head);
+		rwlock_init(&udp_hash[i].lock);
+		INIT_HLIST_HEAD(&udp_hash2[i].head);
+		rwlock_init(&udp_hash2[i].lock);
+	}
+}
+
 /* 为UDP绑定合适的端口 */
 static int udp_v4_get_port(struct sock *sk, unsigned short snum)
 {
 	struct hlist_node *node;
 	struct sock *sk2;
 	struct inet_sock *inet = inet_sk(sk);
+	struct udp_hslot *hslot;
 
-	write_lock_bh(&udp_hash_lock);
 	if (snum == 0) {
-		int best_size_so_far, best, result, i;
-
-		if (udp_port_rover > sysctl_local_port_range[1] ||/* 用户可能修改了可用端口范围，则修改udp_port_rover */
-		    udp_port_rover < sysctl_local_port_range[0])
-			udp_port_rover = sysctl_local_port_range[0];
-		best_size_so_far = 32767;
-		best = result = udp_port_rover;
-		/* 查找所有桶中，链表数量最小的桶 */
-		for (i = 0; i < UDP_HTABLE_SIZE; i++, result++) {
-			struct hlist_head *list;
-			int size;
-
-			list = &udp_hash[result & (UDP_HTABLE_SIZE - 1)];
-			if (hlist_empty(list)) {
-				if (result > sysctl_local_port_range[1])
-					result = sysctl_local_port_range[0] +
-						((result - sysctl_local_port_range[0]) &
-						 (UDP_HTABLE_SIZE - 1));
-				goto gotit;
-			}
-			size = 0;
-			sk_for_each(sk2, node, list)
-				if (++size >= best_size_so_far)
-					goto next;
-			best_size_so_far = size;
-			best = result;
-		next:;
-		}
-		result = best;
-		/* 在该桶中查找一个最小的未用端口号 */
-		for(i = 0; i < (1 << 16) / UDP_HTABLE_SIZE; i++, result += UDP_HTABLE_SIZE) {
-			if (result > sysctl_local_port_range[1])
-				result = sysctl_local_port_range[0]
-					+ ((result - sysctl_local_port_range[0]) &
-					   (UDP_HTABLE_SIZE - 1));
-			if (!udp_lport_inuse(result))
-				break;
-		}
-		if (i >= (1 << 16) / UDP_HTABLE_SIZE)
-			goto fail;
-gotit:
-		udp_port_rover = snum = result;
+		hslot = udp_pick_port(&snum);
+		if (!hslot)
+			return 1;
 	} else {/* 用户指定了端口号 */
-		sk_for_each(sk2, node,
-			    &udp_hash[snum & (UDP_HTABLE_SIZE - 1)]) {/* 遍历指定端口所在的桶 */
+		hslot = udp_hashslot(snum);
+		write_lock_bh(&hslot->lock);
+		sk_for_each(sk2, node, &hslot->head) {/* 遍历指定端口所在的桶 */
 			struct inet_sock *inet2 = inet_sk(sk2);
 
 			if (inet2->num == snum &&
@@ -184,24 +272,21 @@ gotit:
 			    (!inet2->rcv_saddr ||
 			     !inet->rcv_saddr ||
 			     inet2->rcv_saddr == inet->rcv_saddr) &&
-			    (!sk2->sk_reuse || !sk->sk_reuse))/* 如果冲突则退出 */
+			    (!sk2->sk_reuse || !sk->sk_reuse) &&
+			    (!sk2->sk_reuseport || !sk->sk_reuseport ||
+			     sock_i_uid(sk2) != sock_i_uid(sk)))/* 如果冲突则退出 */
 				goto fail;
 		}
 	}
 	/* 指定端口号 */
 	inet->num = snum;
-	if (sk_unhashed(sk)) {/* 如果套接口没有添加到哈希表中 */
-		/* 添加到哈希表 */
-		struct hlist_head *h = &udp_hash[snum & (UDP_HTABLE_SIZE - 1)];
-
-		sk_add_node(sk, h);
-		sock_prot_inc_use(sk->sk_prot);
-	}
-	write_unlock_bh(&udp_hash_lock);
+	if (sk_unhashed(sk))/* 如果套接口没有添加到哈希表中，则添加 */
+		__udp_hash_add(sk, hslot);
+	write_unlock_bh(&hslot->lock);
 	return 0;
 
 fail:
-	write_unlock_bh(&udp_hash_lock);
+	write_unlock_bh(&hslot->lock);
 	return 1;
 }
 
@@ -212,72 +297,144 @@ static void udp_v4_hash(struct sock *sk)
 
 static void udp_v4_unhash(struct sock *sk)
 {
-	write_lock_bh(&udp_hash_lock);
-	if (sk_del_node_init(sk)) {
+	struct udp_hslot *hslot = udp_hashslot(inet_sk(sk)->num);
+
+	write_lock_bh(&hslot->lock);
+	if (__udp_hash_del(sk, hslot))
 		inet_sk(sk)->num = 0;
-		sock_prot_dec_use(sk->sk_prot);
+	write_unlock_bh(&hslot->lock);
+}
+
+/*
+ * How well does sk match the segment?  -1 if not at all, higher is
+ * more specific.
+ */
+static inline int udp_v4_compute_score(struct sock *sk, u32 saddr, u16 sport,
+				       u32 daddr, unsigned short hnum, int dif)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	int score;
+
+	if (inet->num != hnum || ipv6_only_sock(sk))
+		return -1;
+	score = (sk->sk_family == PF_INET ? 1 : 0);
+	if (inet->rcv_saddr) {
+		if (inet->rcv_saddr != daddr)
+			return -1;
+		score += 2;
+	}
+	if (inet->daddr) {
+		if (inet->daddr != saddr)
+			return -1;
+		score += 2;
 	}
-	write_unlock_bh(&udp_hash_lock);
+	if (inet->dport) {
+		if (inet->dport != sport)
+			return -1;
+		score += 2;
+	}
+	if (sk->sk_bound_dev_if) {
+		if (sk->sk_bound_dev_if != dif)
+			return -1;
+		score += 2;
+	}
+	return score;
 }
 
-/* UDP is nearly always wildcards out the wazoo, it makes no sense to try
- * harder than this. -DaveM
+/*
+ * Pick the best scoring socket on a chain.  Sockets of a SO_REUSEPORT
+ * group that tie for the best score share the flows between them.
+ * @by_addr means @head is a udp_hash2 chain: it is linked through
+ * sk_bind_node and may hold sockets bound to other addresses than
+ * @bound, which are skipped.
  */
-static struct sock *udp_v4_lookup_longway(u32 saddr, u16 sport,
-					  u32 daddr, u16 dport, int dif)
+static struct sock *udp_v4_lookup_chain(struct hlist_head *head, int by_addr,
+					u32 bound, u32 saddr, u16 sport,
+					u32 daddr, u16 dport, int dif)
 {
 	struct sock *sk, *result = NULL;
 	struct hlist_node *node;
 	unsigned short hnum = ntohs(dport);
-	int badness = -1;
-
-	sk_for_each(sk, node, &udp_hash[hnum & (UDP_HTABLE_SIZE - 1)]) {
-		struct inet_sock *inet = inet_sk(sk);
+	int score, badness = -1, matches = 0;
+	u32 phash = 0;
+
+	hlist_for_each(node, head) {
+		if (by_addr) {
+			sk = hlist_entry(node, struct sock, sk_bind_node);
+			if (inet_sk(sk)->rcv_saddr != bound)
+				continue;
+		} else
+			sk = hlist_entry(node, struct sock, sk_node);
 
-		if (inet->num == hnum && !ipv6_only_sock(sk)) {
-			int score = (sk->sk_family == PF_INET ? 1 : 0);
-			if (inet->rcv_saddr) {
-				if (inet->rcv_saddr != daddr)
-					continue;
-				score+=2;
-			}
-			if (inet->daddr) {
-				if (inet->daddr != saddr)
-					continue;
-				score+=2;
-			}
-			if (inet->dport) {
-				if (inet->dport != sport)
-					continue;
-				score+=2;
-			}
-			if (sk->sk_bound_dev_if) {
-				if (sk->sk_bound_dev_if != dif)
-					continue;
-				score+=2;
+		score = udp_v4_compute_score(sk, saddr, sport, daddr, hnum, dif);
+		if (score < 0)
+			continue;
+		if (score == 9 && !sk->sk_reuseport) {
+			result = sk;
+			break;
+		} else if (score > badness) {
+			result = sk;
+			badness = score;
+			matches = 0;
+			if (sk->sk_reuseport) {
+				phash = sk_reuseport_hash(saddr, sport,
+							  daddr, dport);
+				matches = 1;
 			}
-			if(score == 9) {
-				result = sk;
-				break;
-			} else if(score > badness) {
+		} else if (score == badness && matches &&
+			   sk->sk_reuseport) {
+			/* Spread flows over the SO_REUSEPORT group */
+			if (sk_reuseport_pick(&phash, ++matches))
 				result = sk;
-				badness = score;
-			}
 		}
 	}
 	return result;
 }
 
+/* Look for sockets bound to exactly @bound on the secondary hash. */
+static struct sock *udp_v4_lookup2(u32 bound, u32 saddr, u16 sport,
+				   u32 daddr, u16 dport, int dif)
+{
+	struct udp_hslot *hslot2;
+	struct sock *sk;
+
+	hslot2 = udp_hashslot2(udp_portaddr_hash(bound, ntohs(dport)));
+	read_lock(&hslot2->lock);
+	sk = udp_v4_lookup_chain(&hslot2->head, 1, bound, saddr, sport,
+				 daddr, dport, dif);
+	if (sk)
+		sock_hold(sk);
+	read_unlock(&hslot2->lock);
+	return sk;
+}
+
+/* UDP is nearly always wildcards out the wazoo, it makes no sense to try
+ * harder than this. -DaveM
+ *
+ * Only the slot of the destination port is locked.  When many sockets
+ * share a port (one per local address, as DNS servers do), go by the
+ * (address, port) hash instead: sockets bound to the destination
+ * address first, wildcard ones after.
+ */
 static __inline__ struct sock *udp_v4_lookup(u32 saddr, u16 sport,
 					     u32 daddr, u16 dport, int dif)
 {
+	struct udp_hslot *hslot = udp_hashslot(ntohs(dport));
 	struct sock *sk;
 
-	read_lock(&udp_hash_lock);
-	sk = udp_v4_lookup_longway(saddr, sport, daddr, dport, dif);
+	if (hslot->count > UDP_HSLOT_LONGWAY) {
+		sk = udp_v4_lookup2(daddr, saddr, sport, daddr, dport, dif);
+		if (!sk)
+			sk = udp_v4_lookup2(0, saddr, sport, daddr, dport, dif);
+		return sk;
+	}
+
+	read_lock(&hslot->lock);
+	sk = udp_v4_lookup_chain(&hslot->head, 0, 0, saddr, sport,
+				 daddr, dport, dif);
 	if (sk)
 		sock_hold(sk);
-	read_unlock(&udp_hash_lock);
+	read_unlock(&hslot->lock);
 	return sk;
 }
 
@@ -499,6 +656,25 @@ out:
 	return err;
 }
 
+/*
+ * Software fallback for UDP fragmentation offload: ip_append_data() built
+ * the whole datagram, checksum included, as one skb, and it goes out as
+ * ordinary IP fragments of tso_size bytes.  The UDP header is just part
+ * of the first fragment's payload, so nothing here needs fixing up;
+ * inet_gso_segment() sets the fragment offsets.
+ */
+struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+
+	if (unlikely(skb->ip_summed == CHECKSUM_HW))
+		goto out;
+
+	segs = skb_segment(skb, features);
+out:
+	return segs;
+}
+
 
 static unsigned short udp_check(struct udphdr *uh, int len, unsigned long saddr, unsigned long daddr, unsigned long base)
 {
@@ -931,7 +1107,9 @@ int udp_disconnect(struct sock *sk, int flags)
 	if (!(sk->sk_userlocks & SOCK_BINDPORT_LOCK)) {
 		sk->sk_prot->unhash(sk);
 		inet->sport = 0;
-	}
+	} else if (!(sk->sk_userlocks & SOCK_BINDADDR_LOCK) &&
+		   sk->sk_prot->rehash)
+		sk->sk_prot->rehash(sk);
 	/* 复位传输控制块的目的路由缓存 */
 	sk_dst_reset(sk);
 	return 0;
@@ -1087,6 +1265,9 @@ static int udp_queue_rcv_skb(struct sock * sk, struct sk_buff *skb)
 		skb->ip_summed = CHECKSUM_UNNECESSARY;/* 设置成功校验的标志 */
 	}
 
+	/* 记录送来报文的设备，供忙轮询使用 */
+	sk_mark_napi_id(sk, skb);
+
 	/* 将接收到的数据报添加到传输控制块的接收队列中 */
 	if (sock_queue_rcv_skb(sk,skb)<0) {
 		UDP_INC_STATS_BH(UDP_MIB_INERRORS);
@@ -1107,12 +1288,13 @@ static int udp_queue_rcv_skb(struct sock * sk, struct sk_buff *skb)
 static int udp_v4_mcast_deliver(struct sk_buff *skb, struct udphdr *uh,
 				 u32 saddr, u32 daddr)
 {
+	struct udp_hslot *hslot = udp_hashslot(ntohs(uh->dest));
 	struct sock *sk;
 	int dif;
 
-	read_lock(&udp_hash_lock);/* 获取哈希表的锁 */
+	read_lock(&hslot->lock);/* 获取桶的锁 */
 	/* 根据目的端口找到桶的入口 */
-	sk = sk_head(&udp_hash[ntohs(uh->dest) & (UDP_HTABLE_SIZE - 1)]);
+	sk = sk_head(&hslot->head);
 	dif = skb->dev->ifindex;
 	/* 根据数据报的端口、地址、源端口、源地址及输入设备索引，查找接收该数据报的第一个传输控制块 */
 	sk = udp_v4_mcast_next(sk, uh->dest, daddr, uh->source, saddr, dif);
@@ -1139,7 +1321,7 @@ static int udp_v4_mcast_deliver(struct sk_buff *skb, struct udphdr *uh,
 		} while(sknext);
 	} else/* 没有匹配的控制块，释放报文后退出 */
 		kfree_skb(skb);
-	read_unlock(&udp_hash_lock);/* 释放哈希表的锁 */
+	read_unlock(&hslot->lock);/* 释放桶的锁 */
 	return 0;
 }
 
@@ -1438,6 +1620,7 @@ struct proto udp_prot = {
 	.backlog_rcv =	udp_queue_rcv_skb,
 	.hash =		udp_v4_hash,
 	.unhash =	udp_v4_unhash,
+	.rehash =	udp_rehash,
 	.get_port =	udp_v4_get_port,
 	.slab_obj_size = sizeof(struct udp_sock),
 };
@@ -1452,10 +1635,13 @@ static struct sock *udp_get_first(struct seq_file *seq)
 
 	for (state->bucket = 0; state->bucket < UDP_HTABLE_SIZE; ++state->bucket) {
 		struct hlist_node *node;
-		sk_for_each(sk, node, &udp_hash[state->bucket]) {
+
+		read_lock(&udp_hash[state->bucket].lock);
+		sk_for_each(sk, node, &udp_hash[state->bucket].head) {
 			if (sk->sk_family == state->family)
 				goto found;
 		}
+		read_unlock(&udp_hash[state->bucket].lock);
 	}
 	sk = NULL;
 found:
@@ -1472,9 +1658,13 @@ try_again:
 		;
 	} while (sk && sk->sk_family != state->family);
 
-	if (!sk && ++state->bucket < UDP_HTABLE_SIZE) {
-		sk = sk_head(&udp_hash[state->bucket]);
-		goto try_again;
+	if (!sk) {
+		read_unlock(&udp_hash[state->bucket].lock);
+		if (++state->bucket < UDP_HTABLE_SIZE) {
+			read_lock(&udp_hash[state->bucket].lock);
+			sk = sk_head(&udp_hash[state->bucket].head);
+			goto try_again;
+		}
 	}
 	return sk;
 }
@@ -1489,9 +1679,15 @@ static struct sock *udp_get_idx(struct seq_file *seq, loff_t pos)
 	return pos ? NULL : sk;
 }
 
+/*
+ * The bucket the iterator stands on is read locked between calls;
+ * state->bucket == UDP_HTABLE_SIZE means none is.
+ */
 static void *udp_seq_start(struct seq_file *seq, loff_t *pos)
 {
-	read_lock(&udp_hash_lock);
+	struct udp_iter_state *state = seq->private;
+
+	state->bucket = UDP_HTABLE_SIZE;
 	return *pos ? udp_get_idx(seq, *pos-1) : (void *)1;
 }
 
@@ -1510,7 +1706,10 @@ static void *udp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 
 static void udp_seq_stop(struct seq_file *seq, void *v)
 {
-	read_unlock(&udp_hash_lock);
+	struct udp_iter_state *state = seq->private;
+
+	if (state->bucket < UDP_HTABLE_SIZE)
+		read_unlock(&udp_hash[state->bucket].lock);
 }
 
 static int udp_seq_open(struct inode *inode, struct file *file)
@@ -1630,12 +1829,17 @@ void udp4_proc_exit(void)
 
 EXPORT_SYMBOL(udp_disconnect);
 EXPORT_SYMBOL(udp_hash);
-EXPORT_SYMBOL(udp_hash_lock);
+EXPORT_SYMBOL(udp_hash2);
+EXPORT_SYMBOL(udp_pick_port);
+EXPORT_SYMBOL(__udp_hash_add);
+EXPORT_SYMBOL(__udp_hash_del);
+EXPORT_SYMBOL(udp_rehash);
 EXPORT_SYMBOL(udp_ioctl);
 EXPORT_SYMBOL(udp_port_rover);
 EXPORT_SYMBOL(udp_prot);
 EXPORT_SYMBOL(udp_sendmsg);
 EXPORT_SYMBOL(udp_poll);
+EXPORT_SYMBOL(udp4_ufo_fragment);
 
 #ifdef CONFIG_PROC_FS
 EXPORT_SYMBOL(udp_proc_register);
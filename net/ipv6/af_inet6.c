@@ -487,7 +487,8 @@ struct proto_ops inet6_stream_ops = {
 	.sendmsg =	inet_sendmsg,			/* ok		*/
 	.recvmsg =	sock_common_recvmsg,		/* ok		*/
 	.mmap =		sock_no_mmap,
-	.sendpage =	tcp_sendpage
+	.sendpage =	tcp_sendpage,
+	.sendpages =	tcp_sendpages
 };
 
 struct proto_ops inet6_dgram_ops = {
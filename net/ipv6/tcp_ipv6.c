@@ -58,6 +58,7 @@
 #include <net/addrconf.h>
 #include <net/snmp.h>
 #include <net/dsfield.h>
+#include <net/busy_poll.h>
 
 #include <asm/uaccess.h>
 
@@ -210,23 +211,22 @@ fail:
 
 static __inline__ void __tcp_v6_hash(struct sock *sk)
 {
-	struct hlist_head *list;
 	rwlock_t *lock;
 
 	BUG_TRAP(sk_unhashed(sk));
 
 	if (sk->sk_state == TCP_LISTEN) {
-		list = &tcp_listening_hash[tcp_sk_listen_hashfn(sk)];
 		lock = &tcp_lhash_lock;
 		tcp_listen_wlock();
+		__sk_add_node(sk,
+			      &tcp_listening_hash[tcp_sk_listen_hashfn(sk)]);
 	} else {
 		sk->sk_hashent = tcp_v6_sk_hashfn(sk);
-		list = &tcp_ehash[sk->sk_hashent].chain;
 		lock = &tcp_ehash[sk->sk_hashent].lock;
 		write_lock(lock);
+		__sk_nulls_add_node_rcu(sk, &tcp_ehash[sk->sk_hashent].chain);
 	}
 
-	__sk_add_node(sk, list);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(lock);
 }
@@ -290,16 +290,24 @@ static struct sock *tcp_v6_lookup_listener(struct in6_addr *daddr, unsigned shor
 /* Sockets in TCP_CLOSE state are _always_ taken out of the hash, so
  * we need not check it for TCP lookups anymore, thanks Alexey. -DaveM
  *
- * The sockhash lock must be held as a reader here.
+ * No lock is taken here, see tcp_ehash_read_lock().
  */
 
+/* FIXME: acme: check this... */
+#define TCP_IPV6_TW_MATCH(__sk, __saddr, __daddr, __ports, __dif)	   \
+	((*((__u32 *)&(tcptw_sk(__sk)->tw_dport)) == (__ports))	&& \
+	 ((__sk)->sk_family == PF_INET6)				&& \
+	 ipv6_addr_equal(&tcptw_sk(__sk)->tw_v6_daddr, (__saddr))	&& \
+	 ipv6_addr_equal(&tcptw_sk(__sk)->tw_v6_rcv_saddr, (__daddr))	&& \
+	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
+
 static inline struct sock *__tcp_v6_lookup_established(struct in6_addr *saddr, u16 sport,
 						       struct in6_addr *daddr, u16 hnum,
 						       int dif)
 {
 	struct tcp_ehash_bucket *head;
 	struct sock *sk;
-	struct hlist_node *node;
+	struct hlist_nulls_node *node;
 	__u32 ports = TCP_COMBINED_PORTS(sport, hnum);
 	int hash;
 
@@ -308,31 +316,43 @@ static inline struct sock *__tcp_v6_lookup_established(struct in6_addr *saddr, u
 	 */
 	hash = tcp_v6_hashfn(daddr, hnum, saddr, sport);
 	head = &tcp_ehash[hash];
-	read_lock(&head->lock);
-	sk_for_each(sk, node, &head->chain) {
+	tcp_ehash_read_lock(head);
+begin:
+	sk_nulls_for_each_rcu(sk, node, &head->chain) {
 		/* For IPV6 do the cheaper port and family tests first. */
-		if(TCP_IPV6_MATCH(sk, saddr, daddr, ports, dif))
-			goto hit; /* You sunk my battleship! */
+		if (TCP_IPV6_MATCH(sk, saddr, daddr, ports, dif)) {
+			if (unlikely(!tcp_ehash_hold(sk)))
+				goto begin;
+			if (unlikely(!TCP_IPV6_MATCH(sk, saddr, daddr,
+						     ports, dif))) {
+				sock_put(sk);
+				goto begin;
+			}
+			goto out; /* You sunk my battleship! */
+		}
 	}
-	/* Must check for a TIME_WAIT'er before going to listener hash. */
-	sk_for_each(sk, node, &(head + tcp_ehash_size)->chain) {
-		/* FIXME: acme: check this... */
-		struct tcp_tw_bucket *tw = (struct tcp_tw_bucket *)sk;
+	if (get_nulls_value(node) != hash)
+		goto begin;
 
-		if(*((__u32 *)&(tw->tw_dport))	== ports	&&
-		   sk->sk_family		== PF_INET6) {
-			if(ipv6_addr_equal(&tw->tw_v6_daddr, saddr)	&&
-			   ipv6_addr_equal(&tw->tw_v6_rcv_saddr, daddr)	&&
-			   (!sk->sk_bound_dev_if || sk->sk_bound_dev_if == dif))
-				goto hit;
+	/* Must check for a TIME_WAIT'er before going to listener hash. */
+begin_tw:
+	sk_nulls_for_each_rcu(sk, node, &(head + tcp_ehash_size)->chain) {
+		if (TCP_IPV6_TW_MATCH(sk, saddr, daddr, ports, dif)) {
+			if (unlikely(!tcp_ehash_hold(sk)))
+				goto begin_tw;
+			if (unlikely(!TCP_IPV6_TW_MATCH(sk, saddr, daddr,
+							ports, dif))) {
+				tcp_tw_put(tcptw_sk(sk));
+				goto begin_tw;
+			}
+			goto out;
 		}
 	}
-	read_unlock(&head->lock);
-	return NULL;
-
-hit:
-	sock_hold(sk);
-	read_unlock(&head->lock);
+	if (get_nulls_value(node) != hash + tcp_ehash_size)
+		goto begin_tw;
+	sk = NULL;
+out:
+	tcp_ehash_read_unlock(head);
 	return sk;
 }
 
@@ -452,13 +472,13 @@ static int tcp_v6_check_established(struct sock *sk)
 	int hash = tcp_v6_hashfn(daddr, inet->num, saddr, inet->dport);
 	struct tcp_ehash_bucket *head = &tcp_ehash[hash];
 	struct sock *sk2;
-	struct hlist_node *node;
+	struct hlist_nulls_node *node;
 	struct tcp_tw_bucket *tw;
 
 	write_lock_bh(&head->lock);
 
 	/* Check TIME-WAIT sockets first. */
-	sk_for_each(sk2, node, &(head + tcp_ehash_size)->chain) {
+	sk_nulls_for_each(sk2, node, &(head + tcp_ehash_size)->chain) {
 		tw = (struct tcp_tw_bucket*)sk2;
 
 		if(*((__u32 *)&(tw->tw_dport))	== ports	&&
@@ -484,14 +504,14 @@ static int tcp_v6_check_established(struct sock *sk)
 	tw = NULL;
 
 	/* And established part... */
-	sk_for_each(sk2, node, &head->chain) {
+	sk_nulls_for_each(sk2, node, &head->chain) {
 		if(TCP_IPV6_MATCH(sk2, saddr, daddr, ports, dif))
 			goto not_unique;
 	}
 
 unique:
 	BUG_TRAP(sk_unhashed(sk));
-	__sk_add_node(sk, &head->chain);
+	__sk_nulls_add_node_rcu(sk, &head->chain);
 	sk->sk_hashent = hash;
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock_bh(&head->lock);
@@ -1451,6 +1471,7 @@ static struct sock * tcp_v6_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 
 	newinet->daddr = newinet->saddr = newinet->rcv_saddr = LOOPBACK4_IPV6;
 
+	tcp_publish_child(newsk);
 	__tcp_v6_hash(newsk);
 	tcp_inherit_port(sk, newsk);
 
@@ -1671,6 +1692,7 @@ process:
 	if (sk_filter(sk, skb, 0))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
 	bh_lock_sock(sk);
@@ -1944,6 +1966,7 @@ static int tcp_v6_init_sock(struct sock *sk)
 	tp->mss_cache_std = tp->mss_cache = 536;
 
 	tp->reordering = sysctl_tcp_reordering;
+	tp->ca_ops = &tcp_init_congestion_ops;
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -2159,6 +2182,7 @@ struct proto tcpv6_prot = {
 	.sysctl_rmem		= sysctl_tcp_rmem,
 	.max_header		= MAX_TCP_HEADER,
 	.slab_obj_size		= sizeof(struct tcp6_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 };
 
 static struct inet6_protocol tcpv6_protocol = {
@@ -54,6 +54,7 @@
 
 #include <net/ip6_checksum.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
@@ -67,50 +68,16 @@ static int udp_v6_get_port(struct sock *sk, unsigned short snum)
 {
 	struct sock *sk2;
 	struct hlist_node *node;
+	struct udp_hslot *hslot;
 
-	write_lock_bh(&udp_hash_lock);
 	if (snum == 0) {
-		int best_size_so_far, best, result, i;
-
-		if (udp_port_rover > sysctl_local_port_range[1] ||
-		    udp_port_rover < sysctl_local_port_range[0])
-			udp_port_rover = sysctl_local_port_range[0];
-		best_size_so_far = 32767;
-		best = result = udp_port_rover;
-		for (i = 0; i < UDP_HTABLE_SIZE; i++, result++) {
-			int size;
-			struct hlist_head *list;
-
-			list = &udp_hash[result & (UDP_HTABLE_SIZE - 1)];
-			if (hlist_empty(list)) {
-				if (result > sysctl_local_port_range[1])
-					result = sysctl_local_port_range[0] +
-						((result - sysctl_local_port_range[0]) &
-						 (UDP_HTABLE_SIZE - 1));
-				goto gotit;
-			}
-			size = 0;
-			sk_for_each(sk2, node, list)
-				if (++size >= best_size_so_far)
-					goto next;
-			best_size_so_far = size;
-			best = result;
-		next:;
-		}
-		result = best;
-		for(;; result += UDP_HTABLE_SIZE) {
-			if (result > sysctl_local_port_range[1])
-				result = sysctl_local_port_range[0]
-					+ ((result - sysctl_local_port_range[0]) &
-					   (UDP_HTABLE_SIZE - 1));
-			if (!udp_lport_inuse(result))
-				break;
-		}
-gotit:
-		udp_port_rover = snum = result;
+		hslot = udp_pick_port(&snum);
+		if (!hslot)
+			return 1;
 	} else {
-		sk_for_each(sk2, node,
-			    &udp_hash[snum & (UDP_HTABLE_SIZE - 1)]) {
+		hslot = udp_hashslot(snum);
+		write_lock_bh(&hslot->lock);
+		sk_for_each(sk2, node, &hslot->head) {
 			if (inet_sk(sk2)->num == snum &&
 			    sk2 != sk &&
 			    (!sk2->sk_bound_dev_if ||
@@ -123,15 +90,13 @@ gotit:
 	}
 
 	inet_sk(sk)->num = snum;
-	if (sk_unhashed(sk)) {
-		sk_add_node(sk, &udp_hash[snum & (UDP_HTABLE_SIZE - 1)]);
-		sock_prot_inc_use(sk->sk_prot);
-	}
-	write_unlock_bh(&udp_hash_lock);
+	if (sk_unhashed(sk))
+		__udp_hash_add(sk, hslot);
+	write_unlock_bh(&hslot->lock);
 	return 0;
 
 fail:
-	write_unlock_bh(&udp_hash_lock);
+	write_unlock_bh(&hslot->lock);
 	return 1;
 }
 
@@ -142,12 +107,12 @@ static void udp_v6_hash(struct sock *sk)
 
 static void udp_v6_unhash(struct sock *sk)
 {
- 	write_lock_bh(&udp_hash_lock);
-	if (sk_del_node_init(sk)) {
+	struct udp_hslot *hslot = udp_hashslot(inet_sk(sk)->num);
+
+ 	write_lock_bh(&hslot->lock);
+	if (__udp_hash_del(sk, hslot))
 		inet_sk(sk)->num = 0;
-		sock_prot_dec_use(sk->sk_prot);
-	}
-	write_unlock_bh(&udp_hash_lock);
+	write_unlock_bh(&hslot->lock);
 }
 
 static struct sock *udp_v6_lookup(struct in6_addr *saddr, u16 sport,
@@ -156,10 +121,11 @@ static struct sock *udp_v6_lookup(struct in6_addr *saddr, u16 sport,
 	struct sock *sk, *result = NULL;
 	struct hlist_node *node;
 	unsigned short hnum = ntohs(dport);
+	struct udp_hslot *hslot = udp_hashslot(hnum);
 	int badness = -1;
 
- 	read_lock(&udp_hash_lock);
-	sk_for_each(sk, node, &udp_hash[hnum & (UDP_HTABLE_SIZE - 1)]) {
+ 	read_lock(&hslot->lock);
+	sk_for_each(sk, node, &hslot->head) {
 		struct inet_sock *inet = inet_sk(sk);
 
 		if (inet->num == hnum && sk->sk_family == PF_INET6) {
@@ -196,7 +162,7 @@ static struct sock *udp_v6_lookup(struct in6_addr *saddr, u16 sport,
 	}
 	if (result)
 		sock_hold(result);
- 	read_unlock(&udp_hash_lock);
+ 	read_unlock(&hslot->lock);
 	return result;
 }
 
@@ -369,6 +335,8 @@ static inline int udpv6_queue_rcv_skb(struct sock * sk, struct sk_buff *skb)
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 	}
 
+	sk_mark_napi_id(sk, skb);
+
 	if (sock_queue_rcv_skb(sk,skb)<0) {
 		UDP6_INC_STATS_BH(UDP_MIB_INERRORS);
 		kfree_skb(skb);
@@ -424,11 +392,12 @@ static void udpv6_mcast_deliver(struct udphdr *uh,
 				struct in6_addr *saddr, struct in6_addr *daddr,
 				struct sk_buff *skb)
 {
+	struct udp_hslot *hslot = udp_hashslot(ntohs(uh->dest));
 	struct sock *sk, *sk2;
 	int dif;
 
-	read_lock(&udp_hash_lock);
-	sk = sk_head(&udp_hash[ntohs(uh->dest) & (UDP_HTABLE_SIZE - 1)]);
+	read_lock(&hslot->lock);
+	sk = sk_head(&hslot->head);
 	dif = skb->dev->ifindex;
 	sk = udp_v6_mcast_next(sk, uh->dest, daddr, uh->source, saddr, dif);
 	if (!sk) {
@@ -445,7 +414,7 @@ static void udpv6_mcast_deliver(struct udphdr *uh,
 	}
 	udpv6_queue_rcv_skb(sk, skb);
 out:
-	read_unlock(&udp_hash_lock);
+	read_unlock(&hslot->lock);
 }
 
 static int udpv6_rcv(struct sk_buff **pskb, unsigned int *nhoffp)
@@ -1048,6 +1017,7 @@ struct proto udpv6_prot = {
 	.backlog_rcv =	udpv6_queue_rcv_skb,
 	.hash =		udp_v6_hash,
 	.unhash =	udp_v6_unhash,
+	.rehash =	udp_rehash,
 	.get_port =	udp_v6_get_port,
 	.slab_obj_size = sizeof(struct udp6_sock),
 };
@@ -72,6 +72,9 @@
 #include <linux/poll.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/jhash.h>
+#include <linux/ipv6.h>
+#include <linux/random.h>
 
 #ifdef CONFIG_INET
 #include <net/inet_common.h>
@@ -165,52 +168,103 @@ struct packet_mclist
 };
 #endif
 #ifdef CONFIG_PACKET_MMAP
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing);
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u, int closing, int tx_ring);
 #endif
 
 static void packet_flush_mclist(struct sock *sk);
 
-struct packet_opt
-{
-	struct tpacket_stats	stats;
 #ifdef CONFIG_PACKET_MMAP
+/* Fill state of a TPACKET_V3 rx ring, under sk_receive_queue.lock */
+struct packet_block_core
+{
+	unsigned int		kactive_blk_num;	/* block being filled	*/
+	unsigned int		last_kactive_blk_num;	/* when timer was armed	*/
+	unsigned int		blk_size;
+	unsigned int		blk_sizeof_priv;
+	char			*nxt_offset;		/* next packet goes here */
+	char			*prev;			/* last packet stored	*/
+	char			*blk_end;
+	u64			seq_num;
+	int			frozen;			/* user owns next block	*/
+	atomic_t		fill_in_prog;		/* copies outside lock	*/
+	unsigned long		tov;			/* retire timeout, jiffies */
+	struct timer_list	retire_blk_timer;
+	int			delete_blk_timer;
+};
+
+struct packet_ring
+{
 	char *			*pg_vec;
 	unsigned int		head;
 	unsigned int            frames_per_block;
 	unsigned int		frame_size;
 	unsigned int		frame_max;
+	unsigned int            pg_vec_order;
+	unsigned int		pg_vec_pages;
+	unsigned int		pg_vec_len;
+	atomic_t		pending;	/* tx frames in flight	*/
+	struct packet_block_core prb;		/* rx ring, TPACKET_V3	*/
+};
+#endif
+
+/* Sockets sharing the packets of one protocol hook */
+#define PACKET_FANOUT_MAX	256
+
+struct packet_fanout
+{
+	struct list_head	list;		/* under fanout_sem	*/
+	unsigned short		id;
+	unsigned char		type;
+	atomic_t		rr_cur;
+	unsigned int		num_members;	/* running sockets	*/
+	struct sock		*arr[PACKET_FANOUT_MAX];
+	spinlock_t		lock;		/* for arr		*/
+	unsigned int		sk_ref;		/* all sockets, under fanout_sem */
+	struct packet_type	prot_hook;
+};
+
+struct packet_opt
+{
+	struct tpacket_stats	stats;
+#ifdef CONFIG_PACKET_MMAP
+	struct packet_ring	rx_ring;
+	struct packet_ring	tx_ring;
 	int			copy_thresh;
+	int			tp_version;	/* rx ring layout	*/
 #endif
 	struct packet_type	prot_hook;
 	spinlock_t		bind_lock;
 	char			running;	/* prot_hook is attached*/
 	int			ifindex;	/* bound device		*/
 	unsigned short		num;
+	struct packet_fanout	*fanout;
 #ifdef CONFIG_PACKET_MULTICAST
 	struct packet_mclist	*mclist;
 #endif
 #ifdef CONFIG_PACKET_MMAP
 	atomic_t		mapped;
-	unsigned int            pg_vec_order;
-	unsigned int		pg_vec_pages;
-	unsigned int		pg_vec_len;
 #endif
 };
 
 #ifdef CONFIG_PACKET_MMAP
 
-static inline char *packet_lookup_frame(struct packet_opt *po, unsigned int position)
+static inline char *packet_lookup_frame(struct packet_ring *rb, unsigned int position)
 {
 	unsigned int pg_vec_pos, frame_offset;
 	char *frame;
 
-	pg_vec_pos = position / po->frames_per_block;
-	frame_offset = position % po->frames_per_block;
+	pg_vec_pos = position / rb->frames_per_block;
+	frame_offset = position % rb->frames_per_block;
 
-	frame = po->pg_vec[pg_vec_pos] + (frame_offset * po->frame_size);
+	frame = rb->pg_vec[pg_vec_pos] + (frame_offset * rb->frame_size);
 	
 	return frame;
 }
+
+static inline void packet_increment_head(struct packet_ring *rb)
+{
+	rb->head = rb->head != rb->frame_max ? rb->head+1 : 0;
+}
 #endif
 
 #define pkt_sk(__sk) ((struct packet_opt *)(__sk)->sk_protinfo)
@@ -234,6 +288,279 @@ static void packet_sock_destruct(struct sock *sk)
 }
 
 
+/*
+   Fanout groups.
+
+   Sockets bound to the same protocol and device can join a group with
+   PACKET_FANOUT.  The group then has the only protocol hook; it passes
+   each packet to the handler of one of its running members, chosen by
+   flow, round robin or receiving CPU, so one stream of packets can be
+   taken in by as many sockets (and CPUs) as there are members.
+ */
+
+static LIST_HEAD(fanout_list);
+static DECLARE_MUTEX(fanout_sem);
+static u32 fanout_hashrnd;
+
+static void __fanout_link(struct sock *sk, struct packet_opt *po)
+{
+	struct packet_fanout *f = po->fanout;
+
+	spin_lock(&f->lock);
+	f->arr[f->num_members] = sk;
+	smp_wmb();
+	f->num_members++;
+	spin_unlock(&f->lock);
+}
+
+/* Readers may still see sk until the next synchronize_net() */
+static void __fanout_unlink(struct sock *sk, struct packet_opt *po)
+{
+	struct packet_fanout *f = po->fanout;
+	int i;
+
+	spin_lock(&f->lock);
+	for (i = 0; i < f->num_members; i++) {
+		if (f->arr[i] == sk)
+			break;
+	}
+	BUG_ON(i >= f->num_members);
+	f->arr[i] = f->arr[f->num_members - 1];
+	f->num_members--;
+	spin_unlock(&f->lock);
+}
+
+/*
+ *	Attach the socket to the network, through its fanout group if it
+ *	is in one.  Called with po->bind_lock held, or before the socket
+ *	is visible.
+ */
+
+static void register_prot_hook(struct sock *sk)
+{
+	struct packet_opt *po = pkt_sk(sk);
+
+	if (!po->running) {
+		if (po->fanout)
+			__fanout_link(sk, po);
+		else
+			dev_add_pack(&po->prot_hook);
+		sock_hold(sk);
+		po->running = 1;
+	}
+}
+
+/*
+ *	Detach it again.  Called with po->bind_lock held; packets may
+ *	still be delivered to the socket until synchronize_net().
+ */
+
+static void __unregister_prot_hook(struct sock *sk)
+{
+	struct packet_opt *po = pkt_sk(sk);
+
+	po->running = 0;
+	if (po->fanout)
+		__fanout_unlink(sk, po);
+	else
+		__dev_remove_pack(&po->prot_hook);
+	__sock_put(sk);
+}
+
+/* The same for both directions of a flow, so that each member sees
+   whole conversations.  Packets of other protocols all hash alike. */
+static u32 fanout_flow_hash(struct sk_buff *skb)
+{
+	int nhoff = skb->nh.raw - skb->data;
+	int poff = -1;
+	u32 a, b, ports = 0;
+	u16 pa = 0, pb = 0;
+	u8 proto;
+
+	if (nhoff < 0)
+		return 0;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+	{
+		struct iphdr _iph, *iph;
+
+		iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+		if (iph == NULL || iph->ihl < 5)
+			return 0;
+		a = iph->saddr;
+		b = iph->daddr;
+		proto = iph->protocol;
+		if (!(iph->frag_off & htons(IP_MF|IP_OFFSET)))
+			poff = nhoff + iph->ihl * 4;
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6):
+	{
+		struct ipv6hdr _ip6h, *ip6h;
+		u32 *s, *d;
+
+		ip6h = skb_header_pointer(skb, nhoff, sizeof(_ip6h), &_ip6h);
+		if (ip6h == NULL)
+			return 0;
+		s = ip6h->saddr.s6_addr32;
+		d = ip6h->daddr.s6_addr32;
+		a = s[0] ^ s[1] ^ s[2] ^ s[3];
+		b = d[0] ^ d[1] ^ d[2] ^ d[3];
+		proto = ip6h->nexthdr;
+		poff = nhoff + sizeof(*ip6h);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	if (poff >= 0 && (proto == IPPROTO_TCP || proto == IPPROTO_UDP)) {
+		u16 _ports[2], *pp;
+
+		pp = skb_header_pointer(skb, poff, sizeof(_ports), _ports);
+		if (pp != NULL) {
+			pa = pp[0];
+			pb = pp[1];
+		}
+	}
+
+	if (a > b || (a == b && pa > pb)) {
+		u32 t = a;
+		u16 pt = pa;
+
+		a = b;
+		b = t;
+		pa = pb;
+		pb = pt;
+	}
+	ports = ((u32)pa << 16) | pb;
+
+	return jhash_3words(a, b, ports, fanout_hashrnd ^ proto);
+}
+
+static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt)
+{
+	struct packet_fanout *f = pt->af_packet_priv;
+	unsigned int num = f->num_members;
+	struct packet_opt *po;
+	unsigned int idx;
+
+	if (!num) {
+		kfree_skb(skb);
+		return 0;
+	}
+
+	switch (f->type) {
+	case PACKET_FANOUT_LB:
+		idx = (unsigned int)atomic_inc_return(&f->rr_cur) % num;
+		break;
+	case PACKET_FANOUT_CPU:
+		idx = smp_processor_id() % num;
+		break;
+	case PACKET_FANOUT_HASH:
+	default:
+		idx = fanout_flow_hash(skb) % num;
+		break;
+	}
+
+	smp_rmb();
+	po = pkt_sk(f->arr[idx]);
+	return po->prot_hook.func(skb, dev, &po->prot_hook);
+}
+
+static int fanout_add(struct sock *sk, unsigned short id, unsigned int type)
+{
+	struct packet_opt *po = pkt_sk(sk);
+	struct packet_fanout *f, *match = NULL;
+	int err;
+
+	switch (type) {
+	case PACKET_FANOUT_HASH:
+	case PACKET_FANOUT_LB:
+	case PACKET_FANOUT_CPU:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (po->fanout)
+		return -EALREADY;
+
+	down(&fanout_sem);
+	list_for_each_entry(f, &fanout_list, list) {
+		if (f->id == id) {
+			match = f;
+			break;
+		}
+	}
+
+	err = -ENOMEM;
+	if (match == NULL) {
+		match = kmalloc(sizeof(*match), GFP_KERNEL);
+		if (match == NULL)
+			goto out;
+		memset(match, 0, sizeof(*match));
+		match->id = id;
+		match->type = type;
+		atomic_set(&match->rr_cur, 0);
+		spin_lock_init(&match->lock);
+		match->prot_hook.type = po->prot_hook.type;
+		match->prot_hook.dev = po->prot_hook.dev;
+		match->prot_hook.func = packet_rcv_fanout;
+		match->prot_hook.af_packet_priv = match;
+		dev_add_pack(&match->prot_hook);
+		list_add(&match->list, &fanout_list);
+	}
+
+	err = -EINVAL;
+	if (match->type == type &&
+	    match->prot_hook.type == po->prot_hook.type &&
+	    match->prot_hook.dev == po->prot_hook.dev) {
+		err = -ENOSPC;
+		if (match->sk_ref < PACKET_FANOUT_MAX) {
+			err = -EINVAL;
+			spin_lock(&po->bind_lock);
+			if (po->running) {
+				__dev_remove_pack(&po->prot_hook);
+				po->fanout = match;
+				match->sk_ref++;
+				__fanout_link(sk, po);
+				err = 0;
+			}
+			spin_unlock(&po->bind_lock);
+		}
+	}
+
+	if (match->sk_ref == 0) {
+		list_del(&match->list);
+		dev_remove_pack(&match->prot_hook);
+		kfree(match);
+	}
+out:
+	up(&fanout_sem);
+	return err;
+}
+
+/* The socket must already be unlinked from the group */
+static void fanout_release(struct sock *sk)
+{
+	struct packet_opt *po = pkt_sk(sk);
+	struct packet_fanout *f = po->fanout;
+
+	if (f == NULL)
+		return;
+
+	down(&fanout_sem);
+	po->fanout = NULL;
+	if (--f->sk_ref == 0) {
+		list_del(&f->list);
+		dev_remove_pack(&f->prot_hook);
+		kfree(f);
+	}
+	up(&fanout_sem);
+}
+
 static struct proto_ops packet_ops;
 
 #ifdef CONFIG_SOCK_PACKET
@@ -418,7 +745,7 @@ static inline unsigned run_filter(struct sk_buff *skb, struct sock *sk, unsigned
 	 * verify that under bh_lock_sock() to be safe
 	 */
 	if (likely(filter != NULL))
-		res = sk_run_filter(skb, filter->insns, filter->len);
+		res = sk_filter_run(filter, skb);
 	bh_unlock_sock(sk);
 
 	return res;
@@ -538,15 +865,207 @@ drop:
 }
 
 #ifdef CONFIG_PACKET_MMAP
+/*
+ *	TPACKET_V3 rx ring: packets are packed into one block until it is
+ *	full or has been open for a timeout, then the whole block goes to
+ *	the user with a single wakeup.
+ */
+
+#define BLK_HDR_LEN		TPACKET_ALIGN(sizeof(struct tpacket_block_desc))
+#define BLK_PLUS_PRIV(sz)	(BLK_HDR_LEN + TPACKET_ALIGN(sz))
+#define PRB_DEF_RETIRE_TOV	8	/* msecs */
+
+static inline struct tpacket_block_desc *prb_block(struct packet_ring *rb, unsigned int n)
+{
+	return (struct tpacket_block_desc *)rb->pg_vec[n];
+}
+
+static void prb_open_block(struct packet_block_core *bq, struct tpacket_block_desc *pbd)
+{
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+
+	pbd->version = TPACKET_V3;
+	pbd->offset_to_priv = BLK_HDR_LEN;
+	h1->num_pkts = 0;
+	h1->offset_to_first_pkt = BLK_PLUS_PRIV(bq->blk_sizeof_priv);
+	h1->blk_len = h1->offset_to_first_pkt;
+	h1->seq_num = bq->seq_num++;
+	memset(&h1->ts_first_pkt, 0, sizeof(h1->ts_first_pkt));
+	memset(&h1->ts_last_pkt, 0, sizeof(h1->ts_last_pkt));
+
+	bq->nxt_offset = (char *)pbd + h1->offset_to_first_pkt;
+	bq->prev = NULL;
+	bq->blk_end = (char *)pbd + bq->blk_size;
+	bq->frozen = 0;
+
+	bq->last_kactive_blk_num = bq->kactive_blk_num;
+	mod_timer(&bq->retire_blk_timer, jiffies + bq->tov);
+}
+
+/* Hand the block being filled over to the user and step to the next one */
+static void prb_close_block(struct sock *sk, unsigned int status)
+{
+	struct packet_opt *po = pkt_sk(sk);
+	struct packet_block_core *bq = &po->rx_ring.prb;
+	struct tpacket_block_desc *pbd = prb_block(&po->rx_ring, bq->kactive_blk_num);
+	struct page *page, *pend;
+
+	/* Packets already placed may still be being copied in */
+	while (atomic_read(&bq->fill_in_prog))
+		cpu_relax();
+	smp_mb();
+
+	if (po->stats.tp_drops)
+		status |= TP_STATUS_LOSING;
+	pbd->hdr.bh1.blk_len = bq->nxt_offset - (char *)pbd;
+
+	pend = virt_to_page(bq->nxt_offset - 1);
+	for (page = virt_to_page(pbd); page <= pend; page++)
+		flush_dcache_page(page);
+	smp_wmb();
+	pbd->hdr.bh1.block_status = TP_STATUS_USER | status;
+	flush_dcache_page(virt_to_page(pbd));
+
+	if (++bq->kactive_blk_num == po->rx_ring.pg_vec_len)
+		bq->kactive_blk_num = 0;
+	sk->sk_data_ready(sk, 0);
+}
+
+/* Open the next block, unless the user still has it */
+static struct tpacket_block_desc *prb_dispatch_next_block(struct packet_opt *po)
+{
+	struct packet_block_core *bq = &po->rx_ring.prb;
+	struct tpacket_block_desc *pbd = prb_block(&po->rx_ring, bq->kactive_blk_num);
+
+	if (pbd->hdr.bh1.block_status & TP_STATUS_USER) {
+		bq->frozen = 1;
+		return NULL;
+	}
+	prb_open_block(bq, pbd);
+	return pbd;
+}
+
+/*
+ *	Reserve room for a len byte packet, closing the current block if it
+ *	is too full.  The caller copies the packet in after dropping the
+ *	queue lock and then drops fill_in_prog.
+ */
+
+static char *prb_next_packet(struct sock *sk, unsigned int len, struct timeval *stamp)
+{
+	struct packet_opt *po = pkt_sk(sk);
+	struct packet_block_core *bq = &po->rx_ring.prb;
+	struct tpacket_block_desc *pbd = prb_block(&po->rx_ring, bq->kactive_blk_num);
+	struct tpacket_hdr_v1 *h1;
+	struct tpacket3_hdr *h3;
+
+	if (len > bq->blk_size - BLK_PLUS_PRIV(bq->blk_sizeof_priv))
+		return NULL;
+
+	if (bq->frozen) {
+		pbd = prb_dispatch_next_block(po);
+		if (pbd == NULL)
+			return NULL;
+	} else if (bq->nxt_offset + len > bq->blk_end) {
+		prb_close_block(sk, 0);
+		pbd = prb_dispatch_next_block(po);
+		if (pbd == NULL)
+			return NULL;
+	}
+
+	h1 = &pbd->hdr.bh1;
+	h3 = (struct tpacket3_hdr *)bq->nxt_offset;
+	h3->tp_next_offset = 0;
+	if (bq->prev) {
+		((struct tpacket3_hdr *)bq->prev)->tp_next_offset = (char *)h3 - bq->prev;
+	} else {
+		h1->ts_first_pkt.ts_sec = stamp->tv_sec;
+		h1->ts_first_pkt.ts_usec = stamp->tv_usec;
+	}
+	h1->ts_last_pkt.ts_sec = stamp->tv_sec;
+	h1->ts_last_pkt.ts_usec = stamp->tv_usec;
+	h1->num_pkts++;
+
+	bq->prev = (char *)h3;
+	bq->nxt_offset += TPACKET_ALIGN(len);
+	atomic_inc(&bq->fill_in_prog);
+	return (char *)h3;
+}
+
+/* Retire a block that has been open a whole timeout with packets in it */
+static void prb_retire_blk_timer_expired(unsigned long data)
+{
+	struct sock *sk = (struct sock *)data;
+	struct packet_opt *po = pkt_sk(sk);
+	struct packet_block_core *bq = &po->rx_ring.prb;
+	struct tpacket_block_desc *pbd;
+
+	spin_lock(&sk->sk_receive_queue.lock);
+	if (bq->delete_blk_timer)
+		goto out;
+
+	/* Opening a block rearms the timer */
+	if (bq->frozen) {
+		if (prb_dispatch_next_block(po))
+			goto out;
+	} else if (bq->kactive_blk_num == bq->last_kactive_blk_num) {
+		pbd = prb_block(&po->rx_ring, bq->kactive_blk_num);
+		if (pbd->hdr.bh1.num_pkts) {
+			prb_close_block(sk, TP_STATUS_BLK_TMO);
+			if (prb_dispatch_next_block(po))
+				goto out;
+		}
+	}
+	bq->last_kactive_blk_num = bq->kactive_blk_num;
+	mod_timer(&bq->retire_blk_timer, jiffies + bq->tov);
+out:
+	spin_unlock(&sk->sk_receive_queue.lock);
+}
+
+/* Called with sk_receive_queue.lock held, before the ring is in use */
+static void prb_init(struct sock *sk, struct tpacket_req3 *req3)
+{
+	struct packet_ring *rb = &pkt_sk(sk)->rx_ring;
+	struct packet_block_core *bq = &rb->prb;
+	unsigned int i;
+
+	for (i = 0; i < rb->pg_vec_len; i++)
+		prb_block(rb, i)->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+	memset(bq, 0, sizeof(*bq));
+	bq->blk_size = req3->tp_block_size;
+	bq->blk_sizeof_priv = req3->tp_sizeof_priv;
+	bq->tov = msecs_to_jiffies(req3->tp_retire_blk_tov ? : PRB_DEF_RETIRE_TOV);
+	bq->seq_num = 1;
+	atomic_set(&bq->fill_in_prog, 0);
+	init_timer(&bq->retire_blk_timer);
+	bq->retire_blk_timer.data = (unsigned long)sk;
+	bq->retire_blk_timer.function = prb_retire_blk_timer_expired;
+
+	prb_open_block(bq, prb_block(rb, 0));
+}
+
+static void prb_shutdown(struct sock *sk)
+{
+	struct packet_block_core *bq = &pkt_sk(sk)->rx_ring.prb;
+
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	bq->delete_blk_timer = 1;
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	del_timer_sync(&bq->retire_blk_timer);
+}
+
 static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct packet_type *pt)
 {
 	struct sock *sk;
 	struct packet_opt *po;
 	struct sockaddr_ll *sll;
 	struct tpacket_hdr *h;
+	struct tpacket3_hdr *h3;
+	char *frame;
 	u8 * skb_head = skb->data;
 	int skb_len = skb->len;
-	unsigned snaplen;
+	unsigned snaplen, hdrlen;
 	unsigned long status = TP_STATUS_LOSING|TP_STATUS_USER;
 	unsigned short macoff, netoff;
 	struct sk_buff *copy_skb = NULL;
@@ -578,15 +1097,16 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct pack
 			snaplen = res;
 	}
 
+	hdrlen = po->tp_version == TPACKET_V3 ? TPACKET3_HDRLEN : TPACKET_HDRLEN;
 	if (sk->sk_type == SOCK_DGRAM) {
-		macoff = netoff = TPACKET_ALIGN(TPACKET_HDRLEN) + 16;
+		macoff = netoff = TPACKET_ALIGN(hdrlen) + 16;
 	} else {
 		unsigned maclen = skb->nh.raw - skb->data;
-		netoff = TPACKET_ALIGN(TPACKET_HDRLEN + (maclen < 16 ? 16 : maclen));
+		netoff = TPACKET_ALIGN(hdrlen + (maclen < 16 ? 16 : maclen));
 		macoff = netoff - maclen;
 	}
 
-	if (macoff + snaplen > po->frame_size) {
+	if (macoff + snaplen > po->rx_ring.frame_size) {
 		if (po->copy_thresh &&
 		    atomic_read(&sk->sk_rmem_alloc) + skb->truesize <
 		    (unsigned)sk->sk_rcvbuf) {
@@ -599,19 +1119,29 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct pack
 			if (copy_skb)
 				skb_set_owner_r(copy_skb, sk);
 		}
-		snaplen = po->frame_size - macoff;
+		snaplen = po->rx_ring.frame_size - macoff;
 		if ((int)snaplen < 0)
 			snaplen = 0;
 	}
 	if (snaplen > skb->len-skb->data_len)
 		snaplen = skb->len-skb->data_len;
 
+	if (skb->stamp.tv_sec == 0) { 
+		do_gettimeofday(&skb->stamp);
+		sock_enable_timestamp(sk);
+	}
+
 	spin_lock(&sk->sk_receive_queue.lock);
-	h = (struct tpacket_hdr *)packet_lookup_frame(po, po->head);
-	
-	if (h->tp_status)
-		goto ring_is_full;
-	po->head = po->head != po->frame_max ? po->head+1 : 0;
+	if (po->tp_version == TPACKET_V3) {
+		frame = prb_next_packet(sk, macoff + snaplen, &skb->stamp);
+		if (frame == NULL)
+			goto ring_is_full;
+	} else {
+		frame = packet_lookup_frame(&po->rx_ring, po->rx_ring.head);
+		if (((struct tpacket_hdr *)frame)->tp_status)
+			goto ring_is_full;
+		packet_increment_head(&po->rx_ring);
+	}
 	po->stats.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
@@ -621,20 +1151,27 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct pack
 		status &= ~TP_STATUS_LOSING;
 	spin_unlock(&sk->sk_receive_queue.lock);
 
-	memcpy((u8*)h + macoff, skb->data, snaplen);
-
-	h->tp_len = skb->len;
-	h->tp_snaplen = snaplen;
-	h->tp_mac = macoff;
-	h->tp_net = netoff;
-	if (skb->stamp.tv_sec == 0) { 
-		do_gettimeofday(&skb->stamp);
-		sock_enable_timestamp(sk);
+	memcpy((u8*)frame + macoff, skb->data, snaplen);
+
+	if (po->tp_version == TPACKET_V3) {
+		h3 = (struct tpacket3_hdr *)frame;
+		h3->tp_len = skb->len;
+		h3->tp_snaplen = snaplen;
+		h3->tp_mac = macoff;
+		h3->tp_net = netoff;
+		h3->tp_sec = skb->stamp.tv_sec;
+		h3->tp_usec = skb->stamp.tv_usec;
+		sll = (struct sockaddr_ll*)((u8*)h3 + TPACKET_ALIGN(sizeof(*h3)));
+	} else {
+		h = (struct tpacket_hdr *)frame;
+		h->tp_len = skb->len;
+		h->tp_snaplen = snaplen;
+		h->tp_mac = macoff;
+		h->tp_net = netoff;
+		h->tp_sec = skb->stamp.tv_sec;
+		h->tp_usec = skb->stamp.tv_usec;
+		sll = (struct sockaddr_ll*)((u8*)h + TPACKET_ALIGN(sizeof(*h)));
 	}
-	h->tp_sec = skb->stamp.tv_sec;
-	h->tp_usec = skb->stamp.tv_usec;
-
-	sll = (struct sockaddr_ll*)((u8*)h + TPACKET_ALIGN(sizeof(*h)));
 	sll->sll_halen = 0;
 	if (dev->hard_header_parse)
 		sll->sll_halen = dev->hard_header_parse(skb, sll->sll_addr);
@@ -644,6 +1181,14 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct pack
 	sll->sll_pkttype = skb->pkt_type;
 	sll->sll_ifindex = dev->ifindex;
 
+	/* The block is flushed and the reader woken when it is closed */
+	if (po->tp_version == TPACKET_V3) {
+		h3->tp_status = status;
+		smp_wmb();
+		atomic_dec(&po->rx_ring.prb.fill_in_prog);
+		goto drop_n_restore;
+	}
+
 	h->tp_status = status;
 	mb();
 
@@ -680,6 +1225,180 @@ ring_is_full:
 	goto drop_n_restore;
 }
 
+/* The device is done with a tx ring frame; give it back to the user */
+static void tpacket_destruct_skb(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+	struct packet_opt *po = pkt_sk(sk);
+	struct tpacket_hdr *h = skb_shinfo(skb)->destructor_arg;
+
+	h->tp_status = TP_STATUS_AVAILABLE;
+	flush_dcache_page(virt_to_page(h));
+
+	if (atomic_dec_and_test(&po->tx_ring.pending) && sk->sk_sleep)
+		wake_up_interruptible(sk->sk_sleep);
+
+	sock_wfree(skb);
+}
+
+/*
+ *	Build an skb around the packet in a tx ring frame.  Only the MAC
+ *	header goes into the linear part; the rest is left in the ring and
+ *	sent from there, the frame's pages standing in for skb pages.
+ *	Returns the packet length, or an error if the frame can't be sent.
+ */
+
+static int tpacket_fill_skb(struct sock *sk, struct sk_buff *skb,
+			    struct tpacket_hdr *h, struct net_device *dev,
+			    unsigned short proto, unsigned char *addr,
+			    int size_max, int reserve)
+{
+	unsigned int tp_len = h->tp_len;
+	int to_write, len, offset;
+	struct page *page;
+	u8 *data;
+
+	/* tp_len comes from user memory: compare it unsigned. */
+	if (tp_len > (unsigned int)size_max)
+		return -EMSGSIZE;
+	to_write = tp_len;
+
+	skb_reserve(skb, LL_RESERVED_SPACE(dev));
+	skb->nh.raw = skb->data;
+	skb->protocol = proto;
+	skb->dev = dev;
+	skb->priority = sk->sk_priority;
+	skb_shinfo(skb)->destructor_arg = h;
+
+	data = (u8 *)h + TPACKET_ALIGN(sizeof(struct tpacket_hdr));
+
+	if (sk->sk_type == SOCK_DGRAM) {
+		if (dev->hard_header &&
+		    dev->hard_header(skb, dev, ntohs(proto), addr, NULL, tp_len) < 0)
+			return -EINVAL;
+	} else if (reserve) {
+		len = min(to_write, reserve);
+		memcpy(skb_put(skb, len), data, len);
+		data += len;
+		to_write -= len;
+		/* As in packet_sendmsg(): the network header follows the
+		 * hard_header_len bytes of link header the user supplied. */
+		skb->nh.raw = skb->data + reserve;
+	}
+
+	while (to_write) {
+		if (skb_shinfo(skb)->nr_frags == MAX_SKB_FRAGS)
+			return -EMSGSIZE;
+
+		page = virt_to_page(data);
+		offset = offset_in_page(data);
+		len = min_t(int, PAGE_SIZE - offset, to_write);
+
+		get_page(page);
+		skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags, page, offset, len);
+		skb->len += len;
+		skb->data_len += len;
+		skb->truesize += len;
+		atomic_add(len, &sk->sk_wmem_alloc);
+
+		data += len;
+		to_write -= len;
+	}
+
+	return tp_len;
+}
+
+/*
+ *	Send every frame of the tx ring the user has marked, starting at
+ *	the ring's head.  Without MSG_DONTWAIT, also wait until the device
+ *	has given all of them back.
+ */
+
+static int tpacket_snd(struct sock *sk, struct msghdr *msg)
+{
+	struct packet_opt *po = pkt_sk(sk);
+	struct sockaddr_ll *saddr=(struct sockaddr_ll *)msg->msg_name;
+	struct net_device *dev = NULL;
+	struct tpacket_hdr *h;
+	struct sk_buff *skb;
+	unsigned short proto;
+	unsigned char *addr;
+	int ifindex, err, reserve = 0;
+	int size_max, len_sum = 0;
+
+	lock_sock(sk);
+
+	if (saddr == NULL) {
+		ifindex	= po->ifindex;
+		proto	= po->num;
+		addr	= NULL;
+	} else {
+		err = -EINVAL;
+		if (msg->msg_namelen < sizeof(struct sockaddr_ll))
+			goto out;
+		ifindex	= saddr->sll_ifindex;
+		proto	= saddr->sll_protocol;
+		addr	= saddr->sll_addr;
+	}
+
+	dev = dev_get_by_index(ifindex);
+	err = -ENXIO;
+	if (dev == NULL)
+		goto out;
+	if (sk->sk_type == SOCK_RAW)
+		reserve = dev->hard_header_len;
+
+	err = -ENETDOWN;
+	if (!(dev->flags & IFF_UP))
+		goto out;
+
+	size_max = po->tx_ring.frame_size - TPACKET_ALIGN(sizeof(struct tpacket_hdr));
+	if (size_max > dev->mtu + reserve)
+		size_max = dev->mtu + reserve;
+
+	err = 0;
+	for (;;) {
+		h = (struct tpacket_hdr *)packet_lookup_frame(&po->tx_ring, po->tx_ring.head);
+		if (h->tp_status != TP_STATUS_SEND_REQUEST)
+			break;
+		smp_rmb();
+
+		skb = sock_alloc_send_skb(sk, LL_RESERVED_SPACE(dev) + reserve,
+					  msg->msg_flags & MSG_DONTWAIT, &err);
+		if (skb == NULL)
+			break;
+
+		err = tpacket_fill_skb(sk, skb, h, dev, proto, addr, size_max, reserve);
+		if (err < 0) {
+			kfree_skb(skb);
+			h->tp_status = TP_STATUS_WRONG_FORMAT;
+			packet_increment_head(&po->tx_ring);
+			continue;
+		}
+		len_sum += err;
+
+		skb->destructor = tpacket_destruct_skb;
+		h->tp_status = TP_STATUS_SENDING;
+		atomic_inc(&po->tx_ring.pending);
+		packet_increment_head(&po->tx_ring);
+
+		err = dev_queue_xmit(skb);
+		if (err > 0 && (err = net_xmit_errno(err)) != 0)
+			break;
+	}
+
+out:
+	if (dev)
+		dev_put(dev);
+	release_sock(sk);
+
+	if (!(msg->msg_flags & MSG_DONTWAIT) && len_sum)
+		wait_event_interruptible(*sk->sk_sleep,
+					 !atomic_read(&po->tx_ring.pending));
+
+	return len_sum ? len_sum : err;
+}
+
 #endif
 
 
@@ -694,6 +1413,11 @@ static int packet_sendmsg(struct kiocb *iocb, struct socket *sock,
 	unsigned char *addr;
 	int ifindex, err, reserve = 0;
 
+#ifdef CONFIG_PACKET_MMAP
+	if (pkt_sk(sk)->tx_ring.pg_vec)
+		return tpacket_snd(sk, msg);
+#endif
+
 	/*
 	 *	Get and verify the address. 
 	 */
@@ -801,25 +1525,33 @@ static int packet_release(struct socket *sock)
 	 *	Unhook packet receive handler.
 	 */
 
+	spin_lock(&po->bind_lock);
 	if (po->running) {
 		/*
 		 *	Remove the protocol hook
 		 */
-		dev_remove_pack(&po->prot_hook);
-		po->running = 0;
+		__unregister_prot_hook(sk);
 		po->num = 0;
-		__sock_put(sk);
-	}
+		spin_unlock(&po->bind_lock);
+		synchronize_net();
+	} else
+		spin_unlock(&po->bind_lock);
+
+	fanout_release(sk);
 
 #ifdef CONFIG_PACKET_MULTICAST
 	packet_flush_mclist(sk);
 #endif
 
 #ifdef CONFIG_PACKET_MMAP
-	if (po->pg_vec) {
-		struct tpacket_req req;
-		memset(&req, 0, sizeof(req));
-		packet_set_ring(sk, &req, 1);
+	{
+		union tpacket_req_u req_u;
+		memset(&req_u, 0, sizeof(req_u));
+
+		if (po->rx_ring.pg_vec)
+			packet_set_ring(sk, &req_u, 1, 0);
+		if (po->tx_ring.pg_vec)
+			packet_set_ring(sk, &req_u, 1, 1);
 	}
 #endif
 
@@ -845,6 +1577,11 @@ static int packet_release(struct socket *sock)
 static int packet_do_bind(struct sock *sk, struct net_device *dev, int protocol)
 {
 	struct packet_opt *po = pkt_sk(sk);
+
+	/* A fanout group's members must keep its device and protocol */
+	if (po->fanout)
+		return -EINVAL;
+
 	/*
 	 *	Detach an existing hook if present.
 	 */
@@ -853,11 +1590,10 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, int protocol)
 
 	spin_lock(&po->bind_lock);
 	if (po->running) {
-		__sock_put(sk);
-		po->running = 0;
+		__unregister_prot_hook(sk);
 		po->num = 0;
 		spin_unlock(&po->bind_lock);
-		dev_remove_pack(&po->prot_hook);
+		synchronize_net();
 		spin_lock(&po->bind_lock);
 	}
 
@@ -872,18 +1608,14 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, int protocol)
 
 	if (dev) {
 		if (dev->flags&IFF_UP) {
-			dev_add_pack(&po->prot_hook);
-			sock_hold(sk);
-			po->running = 1;
+			register_prot_hook(sk);
 		} else {
 			sk->sk_err = ENETDOWN;
 			if (!sock_flag(sk, SOCK_DEAD))
 				sk->sk_error_report(sk);
 		}
 	} else {
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	}
 
 out_unlock:
@@ -1012,9 +1744,7 @@ static int packet_create(struct socket *sock, int protocol)
 
 	if (protocol) {
 		po->prot_hook.type = protocol;
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	}
 
 	write_lock_bh(&packet_sklist_lock);
@@ -1323,14 +2053,35 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 #endif
 #ifdef CONFIG_PACKET_MMAP
 	case PACKET_RX_RING:
+	case PACKET_TX_RING:
 	{
-		struct tpacket_req req;
+		union tpacket_req_u req_u;
+		int len = sizeof(req_u.req);
 
-		if (optlen<sizeof(req))
+		if (pkt_sk(sk)->tp_version == TPACKET_V3 && optname == PACKET_RX_RING)
+			len = sizeof(req_u.req3);
+		if (optlen<len)
 			return -EINVAL;
-		if (copy_from_user(&req,optval,sizeof(req)))
+		if (copy_from_user(&req_u,optval,len))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0);
+		return packet_set_ring(sk, &req_u, 0, optname == PACKET_TX_RING);
+	}
+	case PACKET_VERSION:
+	{
+		struct packet_opt *po = pkt_sk(sk);
+		int val;
+
+		if (optlen!=sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val,optval,sizeof(val)))
+			return -EFAULT;
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
+			return -EBUSY;
+		if (val != TPACKET_V1 && val != TPACKET_V3)
+			return -EINVAL;
+
+		po->tp_version = val;
+		return 0;
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -1345,6 +2096,17 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		return 0;
 	}
 #endif
+	case PACKET_FANOUT:
+	{
+		int val;
+
+		if (optlen!=sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val,optval,sizeof(val)))
+			return -EFAULT;
+
+		return fanout_add(sk, val & 0xffff, val >> 16);
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1383,6 +2145,30 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		break;
 	}
+	case PACKET_FANOUT:
+	{
+		int val = 0;
+
+		if (len > sizeof(int))
+			len = sizeof(int);
+		if (po->fanout)
+			val = po->fanout->id | (po->fanout->type << 16);
+		if (copy_to_user(optval, &val, len))
+			return -EFAULT;
+		break;
+	}
+#ifdef CONFIG_PACKET_MMAP
+	case PACKET_VERSION:
+	{
+		int val = po->tp_version;
+
+		if (len > sizeof(int))
+			len = sizeof(int);
+		if (copy_to_user(optval, &val, len))
+			return -EFAULT;
+		break;
+	}
+#endif
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1414,9 +2200,7 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 			if (dev->ifindex == po->ifindex) {
 				spin_lock(&po->bind_lock);
 				if (po->running) {
-					__dev_remove_pack(&po->prot_hook);
-					__sock_put(sk);
-					po->running = 0;
+					__unregister_prot_hook(sk);
 					sk->sk_err = ENETDOWN;
 					if (!sock_flag(sk, SOCK_DEAD))
 						sk->sk_error_report(sk);
@@ -1430,12 +2214,8 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 			break;
 		case NETDEV_UP:
 			spin_lock(&po->bind_lock);
-			if (dev->ifindex == po->ifindex && po->num &&
-			    !po->running) {
-				dev_add_pack(&po->prot_hook);
-				sock_hold(sk);
-				po->running = 1;
-			}
+			if (dev->ifindex == po->ifindex && po->num)
+				register_prot_hook(sk);
 			spin_unlock(&po->bind_lock);
 			break;
 		}
@@ -1508,16 +2288,31 @@ static unsigned int packet_poll(struct file * file, struct socket *sock,
 	unsigned int mask = datagram_poll(file, sock, wait);
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
-	if (po->pg_vec) {
-		unsigned last = po->head ? po->head-1 : po->frame_max;
+	if (po->rx_ring.pg_vec && po->tp_version == TPACKET_V3) {
+		struct packet_block_core *bq = &po->rx_ring.prb;
+		unsigned last = bq->kactive_blk_num ? bq->kactive_blk_num-1 : po->rx_ring.pg_vec_len-1;
+
+		if (bq->frozen ||
+		    prb_block(&po->rx_ring, last)->hdr.bh1.block_status & TP_STATUS_USER)
+			mask |= POLLIN | POLLRDNORM;
+	} else if (po->rx_ring.pg_vec) {
+		unsigned last = po->rx_ring.head ? po->rx_ring.head-1 : po->rx_ring.frame_max;
 		struct tpacket_hdr *h;
 
-		h = (struct tpacket_hdr *)packet_lookup_frame(po, last);
+		h = (struct tpacket_hdr *)packet_lookup_frame(&po->rx_ring, last);
 
 		if (h->tp_status)
 			mask |= POLLIN | POLLRDNORM;
 	}
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	if (po->tx_ring.pg_vec) {
+		struct tpacket_hdr *h;
+
+		h = (struct tpacket_hdr *)packet_lookup_frame(&po->tx_ring, po->tx_ring.head);
+
+		if (h->tp_status == TP_STATUS_AVAILABLE)
+			mask |= POLLOUT | POLLWRNORM;
+	}
 	return mask;
 }
 
@@ -1576,10 +2371,13 @@ static void free_pg_vec(char **pg_vec, unsigned order, unsigned len)
 }
 
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing)
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u, int closing,
+			   int tx_ring)
 {
+	struct tpacket_req *req = &req_u->req;
 	char **pg_vec = NULL;
 	struct packet_opt *po = pkt_sk(sk);
+	struct packet_ring *rb = tx_ring ? &po->tx_ring : &po->rx_ring;
 	int was_running, num, order = 0;
 	int err = 0;
 	
@@ -1588,7 +2386,7 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 
 		/* Sanity tests and some calculations */
 
-		if (po->pg_vec)
+		if (rb->pg_vec)
 			return -EBUSY;
 
 		if ((int)req->tp_block_size <= 0)
@@ -1600,11 +2398,21 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		if (req->tp_frame_size&(TPACKET_ALIGNMENT-1))
 			return -EINVAL;
 
-		po->frames_per_block = req->tp_block_size/req->tp_frame_size;
-		if (po->frames_per_block <= 0)
+		rb->frames_per_block = req->tp_block_size/req->tp_frame_size;
+		if (rb->frames_per_block <= 0)
 			return -EINVAL;
-		if (po->frames_per_block*req->tp_block_nr != req->tp_frame_nr)
+		if (rb->frames_per_block*req->tp_block_nr != req->tp_frame_nr)
 			return -EINVAL;
+		if (po->tp_version == TPACKET_V3 && !tx_ring) {
+			struct tpacket_req3 *req3 = &req_u->req3;
+
+			if (req3->tp_feature_req_word)
+				return -EINVAL;
+			if (req3->tp_sizeof_priv >= req->tp_block_size ||
+			    BLK_PLUS_PRIV(req3->tp_sizeof_priv) + req->tp_frame_size >
+			    req->tp_block_size)
+				return -EINVAL;
+		}
 		/* OK! */
 
 		/* Allocate page vector */
@@ -1636,7 +2444,7 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 			struct tpacket_hdr *header;
 			int k;
 
-			for (k=0; k<po->frames_per_block; k++) {
+			for (k=0; k<rb->frames_per_block; k++) {
 				
 				header = (struct tpacket_hdr*)ptr;
 				header->tp_status = TP_STATUS_KERNEL;
@@ -1656,33 +2464,52 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 	was_running = po->running;
 	num = po->num;
 	if (was_running) {
-		__dev_remove_pack(&po->prot_hook);
+		__unregister_prot_hook(sk);
 		po->num = 0;
-		po->running = 0;
-		__sock_put(sk);
 	}
 	spin_unlock(&po->bind_lock);
 		
 	synchronize_net();
 
+	/* Frames still queued to a device point into the tx ring.  On close
+	 * wait for the device to hand them back; otherwise refuse to pull
+	 * the ring from under them.
+	 */
+	if (closing) {
+		while (atomic_read(&rb->pending)) {
+			set_current_state(TASK_UNINTERRUPTIBLE);
+			schedule_timeout(1);
+		}
+	}
+
 	err = -EBUSY;
-	if (closing || atomic_read(&po->mapped) == 0) {
+	if (closing || (atomic_read(&po->mapped) == 0 &&
+			atomic_read(&rb->pending) == 0)) {
 		err = 0;
+		if (!tx_ring && po->tp_version == TPACKET_V3 && rb->pg_vec)
+			prb_shutdown(sk);
 #define XC(a, b) ({ __typeof__ ((a)) __t; __t = (a); (a) = (b); __t; })
 
 		spin_lock_bh(&sk->sk_receive_queue.lock);
-		pg_vec = XC(po->pg_vec, pg_vec);
-		po->frame_max = req->tp_frame_nr-1;
-		po->head = 0;
-		po->frame_size = req->tp_frame_size;
+		pg_vec = XC(rb->pg_vec, pg_vec);
+		rb->frame_max = req->tp_frame_nr-1;
+		rb->head = 0;
+		rb->frame_size = req->tp_frame_size;
 		spin_unlock_bh(&sk->sk_receive_queue.lock);
 
-		order = XC(po->pg_vec_order, order);
-		req->tp_block_nr = XC(po->pg_vec_len, req->tp_block_nr);
+		order = XC(rb->pg_vec_order, order);
+		req->tp_block_nr = XC(rb->pg_vec_len, req->tp_block_nr);
 
-		po->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
-		po->prot_hook.func = po->pg_vec ? tpacket_rcv : packet_rcv;
-		skb_queue_purge(&sk->sk_receive_queue);
+		rb->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
+		if (!tx_ring && po->tp_version == TPACKET_V3 && rb->pg_vec) {
+			spin_lock_bh(&sk->sk_receive_queue.lock);
+			prb_init(sk, &req_u->req3);
+			spin_unlock_bh(&sk->sk_receive_queue.lock);
+		}
+		if (!tx_ring) {
+			po->prot_hook.func = po->rx_ring.pg_vec ? tpacket_rcv : packet_rcv;
+			skb_queue_purge(&sk->sk_receive_queue);
+		}
 #undef XC
 		if (atomic_read(&po->mapped))
 			printk(KERN_DEBUG "packet_mmap: vma is busy: %d\n", atomic_read(&po->mapped));
@@ -1690,10 +2517,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 
 	spin_lock(&po->bind_lock);
 	if (was_running && !po->running) {
-		sock_hold(sk);
-		po->running = 1;
 		po->num = num;
-		dev_add_pack(&po->prot_hook);
+		register_prot_hook(sk);
 	}
 	spin_unlock(&po->bind_lock);
 
@@ -1710,7 +2535,8 @@ static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_st
 {
 	struct sock *sk = sock->sk;
 	struct packet_opt *po = pkt_sk(sk);
-	unsigned long size;
+	struct packet_ring *rb;
+	unsigned long size, expected_size;
 	unsigned long start;
 	int err = -EINVAL;
 	int i;
@@ -1720,22 +2546,32 @@ static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_st
 
 	size = vma->vm_end - vma->vm_start;
 
+	/* The rx ring, if any, is mapped first and the tx ring after it */
 	lock_sock(sk);
-	if (po->pg_vec == NULL)
+	expected_size = 0;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec)
+			expected_size += rb->pg_vec_len*rb->pg_vec_pages*PAGE_SIZE;
+	}
+	if (expected_size == 0)
 		goto out;
-	if (size != po->pg_vec_len*po->pg_vec_pages*PAGE_SIZE)
+	if (size != expected_size)
 		goto out;
 
 	atomic_inc(&po->mapped);
 	start = vma->vm_start;
 	err = -EAGAIN;
-	for (i=0; i<po->pg_vec_len; i++) {
-		if (remap_pfn_range(vma, start,
-				     __pa(po->pg_vec[i]) >> PAGE_SHIFT,
-				     po->pg_vec_pages*PAGE_SIZE,
-				     vma->vm_page_prot))
-			goto out;
-		start += po->pg_vec_pages*PAGE_SIZE;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec == NULL)
+			continue;
+		for (i=0; i<rb->pg_vec_len; i++) {
+			if (remap_pfn_range(vma, start,
+					     __pa(rb->pg_vec[i]) >> PAGE_SHIFT,
+					     rb->pg_vec_pages*PAGE_SIZE,
+					     vma->vm_page_prot))
+				goto out;
+			start += rb->pg_vec_pages*PAGE_SIZE;
+		}
 	}
 	vma->vm_ops = &packet_mmap_ops;
 	err = 0;
@@ -1889,6 +2725,7 @@ static void __exit packet_exit(void)
 
 static int __init packet_init(void)
 {
+	get_random_bytes(&fanout_hashrnd, sizeof(fanout_hashrnd));
 	sock_register(&packet_family_ops);
 	register_netdevice_notifier(&packet_netdev_notifier);
 	proc_net_fops_create("packet", 0, &packet_seq_fops);
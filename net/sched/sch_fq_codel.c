@@ -0,0 +1,639 @@
+/*
+ * net/sched/sch_fq_codel.c	Fair Queue CoDel discipline.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <linux/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/jiffies.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/in.h>
+#include <linux/errno.h>
+#include <linux/interrupt.h>
+#include <linux/if_ether.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/notifier.h>
+#include <linux/init.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <net/ip.h>
+#include <linux/ipv6.h>
+#include <net/route.h>
+#include <linux/skbuff.h>
+#include <net/sock.h>
+#include <net/pkt_sched.h>
+#include <net/inet_ecn.h>
+#include <net/dsfield.h>
+
+
+/*	Fair Queue CoDel.
+	=================
+
+	Source:
+	Kathleen Nichols and Van Jacobson, "Controlling Queue Delay",
+	ACM Queue, vol. 10, no. 5, May 2012.
+
+	Packets are hashed by flow into one of `flows' queues, which are
+	served deficit round robin as in SFQ, but with no per-flow depth
+	limit and no periodic rehashing.  A flow that has just become
+	active is served ahead of the backlogged ones, so sparse traffic
+	(DNS, interactive sessions, TCP handshakes) sees almost no queue.
+
+	Every flow queue runs CoDel.  Packets are timestamped on enqueue
+	and their sojourn time is measured on dequeue.  Once the sojourn
+	time has stayed above `target' for a whole `interval', packets are
+	dropped (or ECN marked) at the head, with the gap between drops
+	shrinking as interval/sqrt(count) until the delay falls below
+	target again.  Nothing depends on queue length or link rate, so
+	the defaults of 5ms and 100ms need no tuning.
+
+	IMPLEMENTATION:
+	Times are psched ticks, taken as microseconds; target and interval
+	are limited to one second.  Packets CoDel drops while dequeueing
+	are not reported to a parent qdisc, so a classful parent may count
+	more packets than are really queued.  The flow table is one kmalloc
+	block, which caps `flows' at what fits in 128KB (about a thousand
+	on 64-bit); the table is freed from an RCU callback, where vfree()
+	may not be used.
+ */
+
+#define FQ_CODEL_DEF_FLOWS	1024
+#define FQ_CODEL_DEF_LIMIT	10240
+#define FQ_CODEL_DEF_TARGET	5000	/* us */
+#define FQ_CODEL_DEF_INTERVAL	100000	/* us */
+#define FQ_CODEL_MAX_TIME	1000000	/* us */
+#define FQ_CODEL_MIN_QUANTUM	256
+#define FQ_CODEL_MAX_QUANTUM	(1 << 20)
+
+struct fq_codel_skb_cb {
+	psched_time_t	enqueue_time;
+};
+
+#define FQ_CODEL_CB(skb)	((struct fq_codel_skb_cb *)(skb)->cb)
+
+/* 1/sqrt(count) is kept as a 0.16 fixed point number */
+#define REC_INV_SQRT_BITS	(8 * sizeof(u16))
+#define REC_INV_SQRT_SHIFT	(32 - REC_INV_SQRT_BITS)
+
+struct codel_vars
+{
+	u32		count;		/* drops since entering drop state */
+	u32		lastcount;	/* count when drop state was last entered */
+	int		dropping;
+	u16		rec_inv_sqrt;
+	psched_time_t	first_above_time; /* when sojourn time went over target,
+					     plus interval */
+	psched_time_t	drop_next;	/* time of the next drop */
+};
+
+struct fq_codel_flow
+{
+	struct sk_buff_head	q;
+	struct list_head	flowchain;	/* on new_flows or old_flows */
+	int			deficit;
+	u32			backlog;	/* bytes */
+	struct codel_vars	cvars;
+};
+
+/* Largest flow table a single kmalloc() can hold */
+#define FQ_CODEL_MAX_FLOWS	(131072 / sizeof(struct fq_codel_flow))
+
+struct fq_codel_sched_data
+{
+/* Parameters */
+	u32		flows_cnt;
+	u32		quantum;	/* Allotment per round */
+	u32		limit;		/* Total packets */
+	u32		target;
+	u32		interval;
+	int		ecn;
+
+/* Variables */
+	struct fq_codel_flow	*flows;
+	u32		perturbation;
+	struct list_head new_flows;
+	struct list_head old_flows;
+	struct tc_fq_codel_qd_stats st;
+};
+
+static unsigned int fq_codel_hash(struct fq_codel_sched_data *q, struct sk_buff *skb)
+{
+	u32 h, h2;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+	{
+		struct iphdr *iph = skb->nh.iph;
+		h = iph->daddr;
+		h2 = iph->saddr^iph->protocol;
+		if (!(iph->frag_off&htons(IP_MF|IP_OFFSET)) &&
+		    (iph->protocol == IPPROTO_TCP ||
+		     iph->protocol == IPPROTO_UDP ||
+		     iph->protocol == IPPROTO_ESP))
+			h2 ^= *(((u32*)iph) + iph->ihl);
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6):
+	{
+		struct ipv6hdr *iph = skb->nh.ipv6h;
+		h = iph->daddr.s6_addr32[3];
+		h2 = iph->saddr.s6_addr32[3]^iph->nexthdr;
+		if (iph->nexthdr == IPPROTO_TCP ||
+		    iph->nexthdr == IPPROTO_UDP ||
+		    iph->nexthdr == IPPROTO_ESP)
+			h2 ^= *(u32*)&iph[1];
+		break;
+	}
+	default:
+		h = (u32)(unsigned long)skb->dst^skb->protocol;
+		h2 = (u32)(unsigned long)skb->sk;
+	}
+	return ((u64)jhash_2words(h, h2, q->perturbation) * q->flows_cnt) >> 32;
+}
+
+static int fq_codel_ecn_mark(struct sk_buff *skb)
+{
+	if (skb->nh.raw + 20 > skb->tail)
+		return 0;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (INET_ECN_is_not_ect(skb->nh.iph->tos))
+			return 0;
+		IP_ECN_set_ce(skb->nh.iph);
+		return 1;
+	case __constant_htons(ETH_P_IPV6):
+		if (INET_ECN_is_not_ect(ipv6_get_dsfield(skb->nh.ipv6h)))
+			return 0;
+		IP6_ECN_set_ce(skb->nh.ipv6h);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static struct sk_buff *fq_codel_dequeue_head(struct Qdisc *sch, struct fq_codel_flow *flow)
+{
+	struct sk_buff *skb = __skb_dequeue(&flow->q);
+
+	if (skb) {
+		flow->backlog -= skb->len;
+		sch->qstats.backlog -= skb->len;
+		sch->q.qlen--;
+	}
+	return skb;
+}
+
+/* Newton's method for 1/sqrt(count), one step per change of count */
+static void codel_newton_step(struct codel_vars *vars)
+{
+	u32 invsqrt = ((u32)vars->rec_inv_sqrt) << REC_INV_SQRT_SHIFT;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3ULL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2;	/* keep the next multiply from overflowing */
+	val = (val * invsqrt) >> (32 - 2 + 1);
+
+	vars->rec_inv_sqrt = val >> REC_INV_SQRT_SHIFT;
+}
+
+/* drop_next = t + interval/sqrt(count) */
+static void codel_control_law(struct fq_codel_sched_data *q,
+			      struct codel_vars *vars, psched_time_t t)
+{
+	u32 delta = ((u64)q->interval *
+		     ((u32)vars->rec_inv_sqrt << REC_INV_SQRT_SHIFT)) >> 32;
+
+	PSCHED_TADD2(t, delta, vars->drop_next);
+}
+
+static int codel_should_drop(struct Qdisc *sch, struct codel_vars *vars,
+			     struct sk_buff *skb, psched_time_t now)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	long sojourn;
+
+	if (skb == NULL) {
+		PSCHED_SET_PASTPERFECT(vars->first_above_time);
+		return 0;
+	}
+
+	sojourn = PSCHED_TDIFF_SAFE(now, FQ_CODEL_CB(skb)->enqueue_time,
+				    2*FQ_CODEL_MAX_TIME);
+	if (skb->len > q->st.maxpacket)
+		q->st.maxpacket = skb->len;
+
+	/* Below target, or too little queued to fill a packet: all is well */
+	if (sojourn < (long)q->target || sch->qstats.backlog <= q->st.maxpacket) {
+		PSCHED_SET_PASTPERFECT(vars->first_above_time);
+		return 0;
+	}
+
+	if (PSCHED_IS_PASTPERFECT(vars->first_above_time)) {
+		PSCHED_TADD2(now, q->interval, vars->first_above_time);
+		return 0;
+	}
+	return !PSCHED_TLESS(now, vars->first_above_time);
+}
+
+static void fq_codel_drop_skb(struct Qdisc *sch, struct sk_buff *skb)
+{
+	sch->qstats.drops++;
+	kfree_skb(skb);
+}
+
+/* The CoDel state machine, run on one flow's queue */
+static struct sk_buff *codel_dequeue(struct Qdisc *sch, struct fq_codel_flow *flow)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct codel_vars *vars = &flow->cvars;
+	struct sk_buff *skb;
+	psched_time_t now;
+	int drop;
+
+	skb = fq_codel_dequeue_head(sch, flow);
+	if (skb == NULL) {
+		vars->dropping = 0;
+		return NULL;
+	}
+
+	PSCHED_GET_TIME(now);
+	drop = codel_should_drop(sch, vars, skb, now);
+	if (vars->dropping) {
+		if (!drop) {
+			/* Sojourn time back below target */
+			vars->dropping = 0;
+		} else if (!PSCHED_TLESS(now, vars->drop_next)) {
+			/* Drop until the next drop is in the future, each
+			   one sooner after the last while delay stays high */
+			while (vars->dropping &&
+			       !PSCHED_TLESS(now, vars->drop_next)) {
+				vars->count++;
+				codel_newton_step(vars);
+				if (q->ecn && fq_codel_ecn_mark(skb)) {
+					q->st.ecn_mark++;
+					codel_control_law(q, vars, vars->drop_next);
+					return skb;
+				}
+				fq_codel_drop_skb(sch, skb);
+				skb = fq_codel_dequeue_head(sch, flow);
+				if (!codel_should_drop(sch, vars, skb, now))
+					vars->dropping = 0;
+				else
+					codel_control_law(q, vars, vars->drop_next);
+			}
+		}
+	} else if (drop) {
+		u32 delta;
+
+		if (q->ecn && fq_codel_ecn_mark(skb)) {
+			q->st.ecn_mark++;
+		} else {
+			fq_codel_drop_skb(sch, skb);
+			skb = fq_codel_dequeue_head(sch, flow);
+			codel_should_drop(sch, vars, skb, now);
+		}
+		vars->dropping = 1;
+
+		/* If we were dropping recently, pick up near the old drop
+		   rate rather than starting over from one */
+		delta = vars->count - vars->lastcount;
+		if (delta > 1 &&
+		    PSCHED_TDIFF_SAFE(now, vars->drop_next, 2*FQ_CODEL_MAX_TIME) <
+		    16 * (long)q->interval) {
+			vars->count = delta;
+			codel_newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt = ~0U >> REC_INV_SQRT_SHIFT;
+		}
+		vars->lastcount = vars->count;
+		codel_control_law(q, vars, now);
+	}
+	return skb;
+}
+
+/* Queue is full: drop from the head of the flow with the largest backlog */
+static unsigned int __fq_codel_drop(struct Qdisc *sch, unsigned int *idx)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	struct sk_buff *skb;
+	unsigned int i, maxbacklog = 0, len;
+
+	for (i = 0; i < q->flows_cnt; i++) {
+		if (q->flows[i].backlog > maxbacklog) {
+			maxbacklog = q->flows[i].backlog;
+			*idx = i;
+		}
+	}
+	if (maxbacklog == 0)
+		return 0;
+
+	flow = &q->flows[*idx];
+	skb = fq_codel_dequeue_head(sch, flow);
+	len = skb->len;
+	fq_codel_drop_skb(sch, skb);
+	return len;
+}
+
+static unsigned int fq_codel_drop(struct Qdisc *sch)
+{
+	unsigned int idx;
+
+	return __fq_codel_drop(sch, &idx);
+}
+
+static int
+fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int idx = fq_codel_hash(q, skb);
+	struct fq_codel_flow *flow = &q->flows[idx];
+	unsigned int dropped_idx = idx;
+
+	PSCHED_GET_TIME(FQ_CODEL_CB(skb)->enqueue_time);
+	__skb_queue_tail(&flow->q, skb);
+	flow->backlog += skb->len;
+	sch->qstats.backlog += skb->len;
+
+	if (list_empty(&flow->flowchain)) {
+		list_add_tail(&flow->flowchain, &q->new_flows);
+		q->st.new_flow_count++;
+		flow->deficit = q->quantum;
+	}
+	if (++sch->q.qlen <= q->limit) {
+		sch->bstats.bytes += skb->len;
+		sch->bstats.packets++;
+		return 0;
+	}
+
+	q->st.drop_overlimit++;
+	__fq_codel_drop(sch, &dropped_idx);
+	if (dropped_idx == idx)
+		return NET_XMIT_CN;
+	sch->bstats.bytes += skb->len;
+	sch->bstats.packets++;
+	return 0;
+}
+
+static int
+fq_codel_requeue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow = &q->flows[fq_codel_hash(q, skb)];
+
+	__skb_queue_head(&flow->q, skb);
+	flow->backlog += skb->len;
+	sch->qstats.backlog += skb->len;
+	sch->q.qlen++;
+	sch->qstats.requeues++;
+
+	/* Send it again first */
+	if (list_empty(&flow->flowchain)) {
+		list_add(&flow->flowchain, &q->new_flows);
+		flow->deficit = q->quantum;
+	}
+	return 0;
+}
+
+static struct sk_buff *
+fq_codel_dequeue(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	struct list_head *head;
+	struct sk_buff *skb;
+
+begin:
+	head = &q->new_flows;
+	if (list_empty(head)) {
+		head = &q->old_flows;
+		if (list_empty(head))
+			return NULL;
+	}
+	flow = list_entry(head->next, struct fq_codel_flow, flowchain);
+
+	if (flow->deficit <= 0) {
+		flow->deficit += q->quantum;
+		list_move_tail(&flow->flowchain, &q->old_flows);
+		goto begin;
+	}
+
+	skb = codel_dequeue(sch, flow);
+	if (skb == NULL) {
+		/* A new flow that empties goes round the old list once,
+		   so it can't starve the old flows by coming back new */
+		if (head == &q->new_flows && !list_empty(&q->old_flows))
+			list_move_tail(&flow->flowchain, &q->old_flows);
+		else
+			list_del_init(&flow->flowchain);
+		goto begin;
+	}
+	flow->deficit -= skb->len;
+	return skb;
+}
+
+static void
+fq_codel_reset(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	INIT_LIST_HEAD(&q->new_flows);
+	INIT_LIST_HEAD(&q->old_flows);
+	for (i = 0; i < q->flows_cnt; i++) {
+		struct fq_codel_flow *flow = &q->flows[i];
+
+		__skb_queue_purge(&flow->q);
+		INIT_LIST_HEAD(&flow->flowchain);
+		flow->backlog = 0;
+		memset(&flow->cvars, 0, sizeof(flow->cvars));
+	}
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+}
+
+static int fq_codel_change(struct Qdisc *sch, struct rtattr *opt)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct rtattr *tb[TCA_FQ_CODEL_MAX];
+	u32 val[TCA_FQ_CODEL_MAX];
+	int i;
+
+	if (opt == NULL || rtattr_parse_nested(tb, TCA_FQ_CODEL_MAX, opt))
+		return -EINVAL;
+
+	for (i = 0; i < TCA_FQ_CODEL_MAX; i++) {
+		if (tb[i] == NULL)
+			continue;
+		if (RTA_PAYLOAD(tb[i]) < sizeof(u32))
+			return -EINVAL;
+		val[i] = *(u32*)RTA_DATA(tb[i]);
+	}
+
+	if (tb[TCA_FQ_CODEL_FLOWS-1]) {
+		/* The flow table is sized once, when the qdisc is created */
+		if (q->flows)
+			return -EINVAL;
+		if (val[TCA_FQ_CODEL_FLOWS-1] == 0 ||
+		    val[TCA_FQ_CODEL_FLOWS-1] > FQ_CODEL_MAX_FLOWS)
+			return -EINVAL;
+	}
+	if ((tb[TCA_FQ_CODEL_TARGET-1] &&
+	     val[TCA_FQ_CODEL_TARGET-1] > FQ_CODEL_MAX_TIME) ||
+	    (tb[TCA_FQ_CODEL_INTERVAL-1] &&
+	     (val[TCA_FQ_CODEL_INTERVAL-1] == 0 ||
+	      val[TCA_FQ_CODEL_INTERVAL-1] > FQ_CODEL_MAX_TIME)) ||
+	    (tb[TCA_FQ_CODEL_LIMIT-1] && val[TCA_FQ_CODEL_LIMIT-1] == 0) ||
+	    (tb[TCA_FQ_CODEL_QUANTUM-1] &&
+	     (val[TCA_FQ_CODEL_QUANTUM-1] < FQ_CODEL_MIN_QUANTUM ||
+	      val[TCA_FQ_CODEL_QUANTUM-1] > FQ_CODEL_MAX_QUANTUM)))
+		return -EINVAL;
+
+	sch_tree_lock(sch);
+	if (tb[TCA_FQ_CODEL_FLOWS-1])
+		q->flows_cnt = val[TCA_FQ_CODEL_FLOWS-1];
+	if (tb[TCA_FQ_CODEL_TARGET-1])
+		q->target = val[TCA_FQ_CODEL_TARGET-1];
+	if (tb[TCA_FQ_CODEL_INTERVAL-1])
+		q->interval = val[TCA_FQ_CODEL_INTERVAL-1];
+	if (tb[TCA_FQ_CODEL_LIMIT-1])
+		q->limit = val[TCA_FQ_CODEL_LIMIT-1];
+	if (tb[TCA_FQ_CODEL_ECN-1])
+		q->ecn = !!val[TCA_FQ_CODEL_ECN-1];
+	if (tb[TCA_FQ_CODEL_QUANTUM-1])
+		q->quantum = val[TCA_FQ_CODEL_QUANTUM-1];
+
+	while (sch->q.qlen > q->limit)
+		fq_codel_drop(sch);
+	sch_tree_unlock(sch);
+	return 0;
+}
+
+static int fq_codel_init(struct Qdisc *sch, struct rtattr *opt)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	q->flows_cnt = FQ_CODEL_DEF_FLOWS;
+	q->quantum = psched_mtu(sch->dev);
+	q->limit = FQ_CODEL_DEF_LIMIT;
+	q->target = FQ_CODEL_DEF_TARGET;
+	q->interval = FQ_CODEL_DEF_INTERVAL;
+	q->ecn = 1;
+	INIT_LIST_HEAD(&q->new_flows);
+	INIT_LIST_HEAD(&q->old_flows);
+	get_random_bytes(&q->perturbation, sizeof(q->perturbation));
+
+	if (opt) {
+		int err = fq_codel_change(sch, opt);
+		if (err)
+			return err;
+	}
+
+	q->flows = kmalloc(q->flows_cnt * sizeof(struct fq_codel_flow), GFP_KERNEL);
+	if (q->flows == NULL)
+		return -ENOMEM;
+	memset(q->flows, 0, q->flows_cnt * sizeof(struct fq_codel_flow));
+	for (i = 0; i < q->flows_cnt; i++) {
+		skb_queue_head_init(&q->flows[i].q);
+		INIT_LIST_HEAD(&q->flows[i].flowchain);
+	}
+	return 0;
+}
+
+static void fq_codel_destroy(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+
+	kfree(q->flows);
+}
+
+static int fq_codel_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned char	 *b = skb->tail;
+	struct rtattr *rta;
+	u32 ecn = q->ecn;
+
+	rta = (struct rtattr*)b;
+	RTA_PUT(skb, TCA_OPTIONS, 0, NULL);
+	RTA_PUT(skb, TCA_FQ_CODEL_TARGET, sizeof(q->target), &q->target);
+	RTA_PUT(skb, TCA_FQ_CODEL_LIMIT, sizeof(q->limit), &q->limit);
+	RTA_PUT(skb, TCA_FQ_CODEL_INTERVAL, sizeof(q->interval), &q->interval);
+	RTA_PUT(skb, TCA_FQ_CODEL_ECN, sizeof(ecn), &ecn);
+	RTA_PUT(skb, TCA_FQ_CODEL_FLOWS, sizeof(q->flows_cnt), &q->flows_cnt);
+	RTA_PUT(skb, TCA_FQ_CODEL_QUANTUM, sizeof(q->quantum), &q->quantum);
+	rta->rta_len = skb->tail - b;
+
+	return skb->len;
+
+rtattr_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+static int fq_codel_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct tc_fq_codel_xstats st;
+	struct list_head *pos;
+
+	st.type = TCA_FQ_CODEL_XSTATS_QDISC;
+	st.qdisc_stats = q->st;
+	st.qdisc_stats.new_flows_len = 0;
+	st.qdisc_stats.old_flows_len = 0;
+
+	/* Called with the queue's stats_lock held */
+	list_for_each(pos, &q->new_flows)
+		st.qdisc_stats.new_flows_len++;
+	list_for_each(pos, &q->old_flows)
+		st.qdisc_stats.old_flows_len++;
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops fq_codel_qdisc_ops = {
+	.next		=	NULL,
+	.cl_ops		=	NULL,
+	.id		=	"fq_codel",
+	.priv_size	=	sizeof(struct fq_codel_sched_data),
+	.enqueue	=	fq_codel_enqueue,
+	.dequeue	=	fq_codel_dequeue,
+	.requeue	=	fq_codel_requeue,
+	.drop		=	fq_codel_drop,
+	.init		=	fq_codel_init,
+	.reset		=	fq_codel_reset,
+	.destroy	=	fq_codel_destroy,
+	.change		=	fq_codel_change,
+	.dump		=	fq_codel_dump,
+	.dump_stats	=	fq_codel_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init fq_codel_module_init(void)
+{
+	return register_qdisc(&fq_codel_qdisc_ops);
+}
+static void __exit fq_codel_module_exit(void)
+{
+	unregister_qdisc(&fq_codel_qdisc_ops);
+}
+module_init(fq_codel_module_init)
+module_exit(fq_codel_module_exit)
+MODULE_LICENSE("GPL");
@@ -76,6 +76,10 @@ void qdisc_unlock_tree(struct net_device *dev)
 
    dev->queue_lock and dev->xmit_lock are mutually exclusive,
    if one is grabbed, another must be free.
+
+   On a multiqueue device txq->lock and txq->xmit_lock play the same
+   roles for one transmit queue.  dev->queue_lock nests outside
+   txq->lock, dev->xmit_lock outside txq->xmit_lock.
  */
 
 
@@ -102,7 +106,10 @@ int qdisc_restart(struct net_device *dev)
 	 * 如果实际上没有数据在等待发送，调用dequeue方法会失败。
 	 * 即使有等待发送的包，调用也可能失败。这是因为队列惩罚算法认为不能再发送任何数据
 	 */
-	if ((skb = q->dequeue(q)) != NULL) {
+	/**
+	 * 上次只发送了一部分的GSO大包优先发送，它的剩余分段挂在skb->next上。
+	 */
+	if ((skb = dev->gso_skb) != NULL || (skb = q->dequeue(q)) != NULL) {
 		/**
 		 * 发送一个帧需要获得两个锁：
 		 *		一个锁保护队列（dev->queue_lock），这由调用qdisc_restart的函数获得的（dev_queue_xmit）。
@@ -110,6 +117,8 @@ int qdisc_restart(struct net_device *dev)
  		 * 当设备驱动已经实现它的自己锁，它通过设置NETIF_F_LLTX标志来表明这一点。
 		 */
 		unsigned nolock = (dev->features & NETIF_F_LLTX);
+
+		dev->gso_skb = NULL;
 		/*
 		 * When the driver has LLTX set it does its own locking
 		 * in start_xmit. No need to add additional overhead by
@@ -164,19 +173,14 @@ int qdisc_restart(struct net_device *dev)
 			 * 当qdisc_run调用netif_queue_stopped时，驱动锁还没有被获得，当锁被获得时，另外一个CPU已经发送了一些包，网卡可能已经没有空间了.
 			 * 因此，之前的netif_queue_stopped可能会返回FALSE，但是现在返回TRUE。
 			 */
-			if (!netif_queue_stopped(dev)) {
+			if (!netif_subqueue_stopped(dev, skb->queue_mapping)) {
 				int ret;
-				/**
-				 * netdev_nit表示注册的协议数量。
-				 * 如果有注册的协议，dev_queue_xmit_nit被用来分发帧的拷贝给每一个注册的协议。
-				 */
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
-
 				/**
 				 * 调用hard_start_xmit在网卡上实际的发送包。
+				 * 如果有注册的协议（netdev_nit），dev_hard_start_xmit先用dev_queue_xmit_nit分发帧的拷贝。
+				 * 需要软件GSO的大包在dev_hard_start_xmit中切分后逐个发送。
 				 */
-				ret = dev->hard_start_xmit(skb, dev);
+				ret = dev_hard_start_xmit(skb, dev);
 				/**
 				 * 发送成功，此时缓冲区还没有释放。
 				 */
@@ -226,13 +230,120 @@ int qdisc_restart(struct net_device *dev)
  * 重新新包放回队列，然后重新调度发送。
  */
 requeue:
-		q->ops->requeue(skb, q);
+		/**
+		 * 已经切分的GSO大包不能放回排队规则，留在dev->gso_skb中等待下次发送。
+		 */
+		if (skb->next)
+			dev->gso_skb = skb;
+		else
+			q->ops->requeue(skb, q);
 		netif_schedule(dev);
 		return 1;
 	}
 	return q->q.qlen;
 }
 
+/*
+ * qdisc_restart() for one transmit queue of a multiqueue device.  The
+ * same dance, with txq->lock and txq->xmit_lock standing in for
+ * dev->queue_lock and dev->xmit_lock, so CPUs sending on different
+ * queues don't serialize on the device.
+ *
+ * NOTE: Called under txq->lock with locally disabled BH.
+ */
+int qdisc_restart_queue(struct netdev_queue *txq)
+{
+	struct net_device *dev = txq->dev;
+	struct Qdisc *q = txq->qdisc;
+	unsigned nolock = (dev->features & NETIF_F_LLTX);
+	struct sk_buff *skb;
+	int ret;
+
+	if ((skb = txq->gso_skb) == NULL && (skb = q->dequeue(q)) == NULL)
+		return q->q.qlen;
+	txq->gso_skb = NULL;
+
+	if (!nolock) {
+		if (!spin_trylock(&txq->xmit_lock)) {
+		collision:
+			if (txq->xmit_lock_owner == smp_processor_id()) {
+				kfree_skb(skb);
+				if (net_ratelimit())
+					printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
+				return -1;
+			}
+			__get_cpu_var(netdev_rx_stat).cpu_collision++;
+			goto requeue;
+		}
+		txq->xmit_lock_owner = smp_processor_id();
+	}
+
+	spin_unlock(&txq->lock);
+
+	ret = NETDEV_TX_BUSY;
+	if (!netif_subqueue_stopped(dev, txq->index))
+		ret = dev_hard_start_xmit(skb, dev);
+
+	if (!nolock) {
+		txq->xmit_lock_owner = -1;
+		spin_unlock(&txq->xmit_lock);
+	}
+	spin_lock(&txq->lock);
+
+	if (ret == NETDEV_TX_OK)
+		return -1;
+	if (ret == NETDEV_TX_LOCKED && nolock)
+		goto collision;
+	q = txq->qdisc;
+
+requeue:
+	if (skb->next)
+		txq->gso_skb = skb;
+	else
+		q->ops->requeue(skb, q);
+	netif_schedule_queue(txq);
+	return 1;
+}
+
+/* Lock out every transmit queue of a multiqueue device, after dev->xmit_lock. */
+static void dev_lock_tx_queues(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (!dev->tx_queues)
+		return;
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		spin_lock(&dev->tx_queues[i].xmit_lock);
+		dev->tx_queues[i].xmit_lock_owner = smp_processor_id();
+	}
+}
+
+static void dev_unlock_tx_queues(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (!dev->tx_queues)
+		return;
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		dev->tx_queues[i].xmit_lock_owner = -1;
+		spin_unlock(&dev->tx_queues[i].xmit_lock);
+	}
+}
+
+static int dev_tx_stopped(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (netif_queue_stopped(dev))
+		return 1;
+	if (dev->tx_queues) {
+		for (i = 0; i < dev->num_tx_queues; i++)
+			if (test_bit(__QUEUE_STATE_XOFF, &dev->tx_queues[i].state))
+				return 1;
+	}
+	return 0;
+}
+
 static void dev_watchdog(unsigned long arg)
 {
 	struct net_device *dev = (struct net_device *)arg;
@@ -242,10 +353,12 @@ static void dev_watchdog(unsigned long arg)
 		if (netif_device_present(dev) &&
 		    netif_running(dev) &&
 		    netif_carrier_ok(dev)) {
-			if (netif_queue_stopped(dev) &&
+			if (dev_tx_stopped(dev) &&
 			    (jiffies - dev->trans_start) > dev->watchdog_timeo) {
 				printk(KERN_INFO "NETDEV WATCHDOG: %s: transmit timed out\n", dev->name);
+				dev_lock_tx_queues(dev);
 				dev->tx_timeout(dev);
+				dev_unlock_tx_queues(dev);
 			}
 			if (!mod_timer(&dev->watchdog_timer, jiffies + dev->watchdog_timeo))
 				dev_hold(dev);
@@ -357,6 +470,29 @@ static struct Qdisc noqueue_qdisc = {
 	.list		=	LIST_HEAD_INIT(noqueue_qdisc.list),
 };
 
+/* Root of a multiqueue device that runs the default per-queue qdiscs.
+   Nothing is ever queued here: dev_queue_xmit() sees TCQ_F_MQ and
+   uses the qdisc of the chosen transmit queue instead.
+ */
+static struct Qdisc_ops mq_qdisc_ops = {
+	.next		=	NULL,
+	.cl_ops		=	NULL,
+	.id		=	"mq",
+	.priv_size	=	0,
+	.enqueue	=	noop_enqueue,
+	.dequeue	=	noop_dequeue,
+	.requeue	=	noop_requeue,
+	.owner		=	THIS_MODULE,
+};
+
+static struct Qdisc mq_qdisc = {
+	.enqueue	=	noop_enqueue,
+	.dequeue	=	noop_dequeue,
+	.flags		=	TCQ_F_BUILTIN | TCQ_F_MQ,
+	.ops		=	&mq_qdisc_ops,
+	.list		=	LIST_HEAD_INIT(mq_qdisc.list),
+};
+
 
 static const u8 prio2band[TC_PRIO_MAX+1] =
 	{ 1, 2, 2, 2, 1, 2, 0, 0 , 1, 1, 1, 1, 1, 1, 1, 1 };
@@ -567,6 +703,30 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	call_rcu(&qdisc->q_rcu, __qdisc_destroy);
 }
 
+/* Give every transmit queue of a multiqueue device its default qdisc. */
+static int dev_init_tx_queue_qdiscs(struct net_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = &dev->tx_queues[i];
+		struct Qdisc *qdisc;
+
+		if (txq->qdisc_sleeping != &noop_qdisc)
+			continue;
+		if (dev->tx_queue_len) {
+			qdisc = qdisc_create_dflt(dev, &pfifo_fast_ops);
+			if (qdisc == NULL)
+				return -ENOMEM;
+			qdisc->stats_lock = &txq->lock;
+		} else {
+			qdisc = &noqueue_qdisc;
+		}
+		txq->qdisc_sleeping = qdisc;
+	}
+	return 0;
+}
+
 void dev_activate(struct net_device *dev)
 {
 	/* No queueing discipline is attached to device;
@@ -577,7 +737,13 @@ void dev_activate(struct net_device *dev)
 
 	if (dev->qdisc_sleeping == &noop_qdisc) {
 		struct Qdisc *qdisc;
-		if (dev->tx_queue_len) {
+		if (dev->tx_queues) {
+			if (dev_init_tx_queue_qdiscs(dev)) {
+				printk(KERN_INFO "%s: activation failed\n", dev->name);
+				return;
+			}
+			qdisc = &mq_qdisc;
+		} else if (dev->tx_queue_len) {
 			qdisc = qdisc_create_dflt(dev, &pfifo_fast_ops);
 			if (qdisc == NULL) {
 				printk(KERN_INFO "%s: activation failed\n", dev->name);
@@ -595,6 +761,17 @@ void dev_activate(struct net_device *dev)
 	}
 
 	spin_lock_bh(&dev->queue_lock);
+	if (dev->qdisc_sleeping->flags & TCQ_F_MQ) {
+		unsigned int i;
+
+		for (i = 0; i < dev->num_tx_queues; i++) {
+			struct netdev_queue *txq = &dev->tx_queues[i];
+
+			spin_lock(&txq->lock);
+			rcu_assign_pointer(txq->qdisc, txq->qdisc_sleeping);
+			spin_unlock(&txq->lock);
+		}
+	}
 	rcu_assign_pointer(dev->qdisc, dev->qdisc_sleeping);
 	if (dev->qdisc != &noqueue_qdisc) {
 		dev->trans_start = jiffies;
@@ -603,9 +780,37 @@ void dev_activate(struct net_device *dev)
 	spin_unlock_bh(&dev->queue_lock);
 }
 
+static void dev_deactivate_tx_queues(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (!dev->tx_queues)
+		return;
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = &dev->tx_queues[i];
+		struct Qdisc *qdisc;
+		struct sk_buff *skb;
+
+		spin_lock_bh(&txq->lock);
+		qdisc = txq->qdisc;
+		txq->qdisc = &noop_qdisc;
+
+		qdisc_reset(qdisc);
+
+		skb = txq->gso_skb;
+		txq->gso_skb = NULL;
+		spin_unlock_bh(&txq->lock);
+
+		if (skb)
+			kfree_skb(skb);
+	}
+}
+
 void dev_deactivate(struct net_device *dev)
 {
 	struct Qdisc *qdisc;
+	struct sk_buff *skb;
 
 	spin_lock_bh(&dev->queue_lock);
 	qdisc = dev->qdisc;
@@ -613,14 +818,33 @@ void dev_deactivate(struct net_device *dev)
 
 	qdisc_reset(qdisc);
 
+	skb = dev->gso_skb;
+	dev->gso_skb = NULL;
 	spin_unlock_bh(&dev->queue_lock);
 
+	if (skb)
+		kfree_skb(skb);
+
+	dev_deactivate_tx_queues(dev);
+
 	dev_watchdog_down(dev);
 
 	while (test_bit(__LINK_STATE_SCHED, &dev->state))
 		yield();
 
 	spin_unlock_wait(&dev->xmit_lock);
+
+	if (dev->tx_queues) {
+		unsigned int i;
+
+		for (i = 0; i < dev->num_tx_queues; i++) {
+			struct netdev_queue *txq = &dev->tx_queues[i];
+
+			while (test_bit(__QUEUE_STATE_SCHED, &txq->state))
+				yield();
+			spin_unlock_wait(&txq->xmit_lock);
+		}
+	}
 }
 
 void dev_init_scheduler(struct net_device *dev)
@@ -629,6 +853,14 @@ void dev_init_scheduler(struct net_device *dev)
 	dev->qdisc = &noop_qdisc;
 	dev->qdisc_sleeping = &noop_qdisc;
 	INIT_LIST_HEAD(&dev->qdisc_list);
+	if (dev->tx_queues) {
+		unsigned int i;
+
+		for (i = 0; i < dev->num_tx_queues; i++) {
+			dev->tx_queues[i].qdisc = &noop_qdisc;
+			dev->tx_queues[i].qdisc_sleeping = &noop_qdisc;
+		}
+	}
 	qdisc_unlock_tree(dev);
 
 	dev_watchdog_init(dev);
@@ -643,6 +875,18 @@ void dev_shutdown(struct net_device *dev)
 	dev->qdisc = &noop_qdisc;
 	dev->qdisc_sleeping = &noop_qdisc;
 	qdisc_destroy(qdisc);
+	if (dev->tx_queues) {
+		unsigned int i;
+
+		for (i = 0; i < dev->num_tx_queues; i++) {
+			struct netdev_queue *txq = &dev->tx_queues[i];
+
+			qdisc = txq->qdisc_sleeping;
+			txq->qdisc = &noop_qdisc;
+			txq->qdisc_sleeping = &noop_qdisc;
+			qdisc_destroy(qdisc);
+		}
+	}
 #if defined(CONFIG_NET_SCH_INGRESS) || defined(CONFIG_NET_SCH_INGRESS_MODULE)
         if ((qdisc = dev->qdisc_ingress) != NULL) {
 		dev->qdisc_ingress = NULL;
@@ -660,5 +904,6 @@ EXPORT_SYMBOL(qdisc_create_dflt);
 EXPORT_SYMBOL(qdisc_destroy);
 EXPORT_SYMBOL(qdisc_reset);
 EXPORT_SYMBOL(qdisc_restart);
+EXPORT_SYMBOL(qdisc_restart_queue);
 EXPORT_SYMBOL(qdisc_lock_tree);
 EXPORT_SYMBOL(qdisc_unlock_tree);
@@ -113,6 +113,8 @@ static ssize_t sock_writev(struct file *file, const struct iovec *vector,
 			  unsigned long count, loff_t *ppos);
 static ssize_t sock_sendpage(struct file *file, struct page *page,
 			     int offset, size_t size, loff_t *ppos, int more);
+static ssize_t sock_splice_write(struct inode *pipe, struct file *out,
+				 loff_t *ppos, size_t len, unsigned int flags);
 
 
 /*
@@ -136,7 +138,8 @@ static struct file_operations socket_file_ops = {
 	.fasync =	sock_fasync,
 	.readv =	sock_readv,
 	.writev =	sock_writev,
-	.sendpage =	sock_sendpage
+	.sendpage =	sock_sendpage,
+	.splice_write =	sock_splice_write,
 };
 
 /*
@@ -385,6 +388,8 @@ static struct dentry_operations sockfs_dentry_operations = {
  *	from this function. We use the fact that now we do not refer
  *	to socket after mapping. If one day we will need it, this
  *	function will increment ref. count on file by 1.
+ *	@flags may hold SOCK_NONBLOCK and SOCK_CLOEXEC, which are applied
+ *	before the descriptor becomes visible to other threads.
  *
  *	In any case returned fd MAY BE not valid!
  *	This race condition is unavoidable
@@ -395,7 +400,7 @@ static struct dentry_operations sockfs_dentry_operations = {
 /**
  * 将套接口与文件描述符绑定。
  */
-int sock_map_fd(struct socket *sock)
+int sock_map_fd(struct socket *sock, int flags)
 {
 	int fd;
 	struct qstr this;
@@ -441,7 +446,11 @@ int sock_map_fd(struct socket *sock)
 		file->f_op = SOCK_INODE(sock)->i_fop = &socket_file_ops;
 		file->f_mode = FMODE_READ | FMODE_WRITE;
 		file->f_flags = O_RDWR;
+		if (flags & SOCK_NONBLOCK)
+			file->f_flags |= O_NONBLOCK;
 		file->f_pos = 0;
+		if (flags & SOCK_CLOEXEC)
+			set_close_on_exec(fd, 1);
 		/* 将文件描述符实例增加到已经打开的文件列表中，完成文件与进程的绑定 */
 		fd_install(fd, file);
 	}
@@ -677,6 +686,28 @@ static void sock_aio_dtor(struct kiocb *iocb)
 	kfree(iocb->private);
 }
 
+/*
+ * An async iocb keeps its sock_iocb across retries, a sync one lives on
+ * the caller's stack.
+ */
+static struct sock_iocb *alloc_sock_iocb(struct kiocb *iocb,
+					 struct sock_iocb *siocb)
+{
+	if (!is_sync_kiocb(iocb)) {
+		siocb = iocb->private;
+		if (!siocb) {
+			siocb = kmalloc(sizeof(*siocb), GFP_KERNEL);
+			if (!siocb)
+				return NULL;
+			iocb->ki_dtor = sock_aio_dtor;
+		}
+	}
+
+	siocb->kiocb = iocb;
+	iocb->private = siocb;
+	return siocb;
+}
+
 /*
  *	Read data from a socket. ubuf is a user mode pointer. We make sure the user
  *	area ubuf...ubuf+size-1 is writable before asking the protocol.
@@ -694,16 +725,9 @@ static ssize_t sock_aio_read(struct kiocb *iocb, char __user *ubuf,
 	if (size==0)		/* Match SYS5 behaviour */
 		return 0;
 
-	if (is_sync_kiocb(iocb))
-		x = &siocb;
-	else {
-		x = kmalloc(sizeof(struct sock_iocb), GFP_KERNEL);
-		if (!x)
-			return -ENOMEM;
-		iocb->ki_dtor = sock_aio_dtor;
-	}
-	iocb->private = x;
-	x->kiocb = iocb;
+	x = alloc_sock_iocb(iocb, &siocb);
+	if (!x)
+		return -ENOMEM;
 	sock = SOCKET_I(iocb->ki_filp->f_dentry->d_inode); 
 
 	x->async_msg.msg_name = NULL;
@@ -714,7 +738,12 @@ static ssize_t sock_aio_read(struct kiocb *iocb, char __user *ubuf,
 	x->async_msg.msg_controllen = 0;
 	x->async_iov.iov_base = ubuf;
 	x->async_iov.iov_len = size;
-	flags = !(iocb->ki_filp->f_flags & O_NONBLOCK) ? 0 : MSG_DONTWAIT;
+	/*
+	 * Async iocbs never sleep in the protocol; on -EAGAIN fs/aio.c
+	 * waits for the socket through ->poll and retries.
+	 */
+	flags = !(iocb->ki_filp->f_flags & O_NONBLOCK) && is_sync_kiocb(iocb) ?
+		0 : MSG_DONTWAIT;
 
 	return __sock_recvmsg(iocb, sock, &x->async_msg, size, flags);
 }
@@ -736,16 +765,9 @@ static ssize_t sock_aio_write(struct kiocb *iocb, const char __user *ubuf,
 	if(size==0)		/* Match SYS5 behaviour */
 		return 0;
 
-	if (is_sync_kiocb(iocb))
-		x = &siocb;
-	else {
-		x = kmalloc(sizeof(struct sock_iocb), GFP_KERNEL);
-		if (!x)
-			return -ENOMEM;
-		iocb->ki_dtor = sock_aio_dtor;
-	}
-	iocb->private = x;
-	x->kiocb = iocb;
+	x = alloc_sock_iocb(iocb, &siocb);
+	if (!x)
+		return -ENOMEM;
 	sock = SOCKET_I(iocb->ki_filp->f_dentry->d_inode); 
 
 	x->async_msg.msg_name = NULL;
@@ -754,7 +776,8 @@ static ssize_t sock_aio_write(struct kiocb *iocb, const char __user *ubuf,
 	x->async_msg.msg_iovlen = 1;
 	x->async_msg.msg_control = NULL;
 	x->async_msg.msg_controllen = 0;
-	x->async_msg.msg_flags = !(iocb->ki_filp->f_flags & O_NONBLOCK) ? 0 : MSG_DONTWAIT;
+	x->async_msg.msg_flags = !(iocb->ki_filp->f_flags & O_NONBLOCK) &&
+				 is_sync_kiocb(iocb) ? 0 : MSG_DONTWAIT;
 	if (sock->type == SOCK_SEQPACKET)
 		x->async_msg.msg_flags |= MSG_EOR;
 	x->async_iov.iov_base = (void __user *)ubuf;
@@ -778,6 +801,37 @@ ssize_t sock_sendpage(struct file *file, struct page *page,
 	return sock->ops->sendpage(sock, page, offset, size, flags);
 }
 
+static int sock_sendpages(struct file *file, struct page **pages,
+			  unsigned int offset, size_t size, int more)
+{
+	struct socket *sock;
+	int flags;
+
+	sock = SOCKET_I(file->f_dentry->d_inode);
+
+	flags = !(file->f_flags & O_NONBLOCK) ? 0 : MSG_DONTWAIT;
+	if (more)
+		flags |= MSG_MORE;
+
+	return sock->ops->sendpages(sock, pages, offset, size, flags);
+}
+
+/*
+ * Protocols that can take a whole page vector get the pipe contents in
+ * batches, everybody else gets one ->sendpage() call per pipe buffer.
+ */
+static ssize_t sock_splice_write(struct inode *pipe, struct file *out,
+				 loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct socket *sock = SOCKET_I(out->f_dentry->d_inode);
+
+	if (sock->ops->sendpages)
+		return splice_from_pipe_pages(pipe, out, ppos, len, flags,
+					      sock_sendpages);
+
+	return generic_splice_sendpage(pipe, out, ppos, len, flags);
+}
+
 static int sock_readv_writev(int type, struct inode * inode,
 			     struct file * file, const struct iovec * iov,
 			     long count, size_t size)
@@ -1258,6 +1312,13 @@ asmlinkage long sys_socket(int family, int type, int protocol)
 {
 	int retval;
 	struct socket *sock;
+	int flags;
+
+	/* type的高位是新文件描述符的标志，如SOCK_NONBLOCK */
+	flags = type & ~SOCK_TYPE_MASK;
+	if (flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+	type &= SOCK_TYPE_MASK;
 
 	/* 根据协议族、套口类型、传输层协议创建套口 */
 	retval = sock_create(family, type, protocol, &sock);
@@ -1265,7 +1326,7 @@ asmlinkage long sys_socket(int family, int type, int protocol)
 		goto out;
 
 	/* 为创建的套接口分配一个文件描述符并进行绑定 */
-	retval = sock_map_fd(sock);
+	retval = sock_map_fd(sock, flags);
 	if (retval < 0)
 		goto out_release;
 
@@ -1286,6 +1347,12 @@ asmlinkage long sys_socketpair(int family, int type, int protocol, int __user *u
 {
 	struct socket *sock1, *sock2;
 	int fd1, fd2, err;
+	int flags;
+
+	flags = type & ~SOCK_TYPE_MASK;
+	if (flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+	type &= SOCK_TYPE_MASK;
 
 	/*
 	 * Obtain the first socket and check if the underlying protocol
@@ -1306,12 +1373,12 @@ asmlinkage long sys_socketpair(int family, int type, int protocol, int __user *u
 
 	fd1 = fd2 = -1;
 
-	err = sock_map_fd(sock1);
+	err = sock_map_fd(sock1, flags);
 	if (err < 0)
 		goto out_release_both;
 	fd1 = err;
 
-	err = sock_map_fd(sock2);
+	err = sock_map_fd(sock2, flags);
 	if (err < 0)
 		goto out_close_1;
 	fd2 = err;
@@ -1424,19 +1491,22 @@ asmlinkage long sys_listen(int fd, int backlog)
  *	clean when we restucture accept also.
  */
 
-asmlinkage long sys_accept(int fd, struct sockaddr __user *upeer_sockaddr, int __user *upeer_addrlen)
+/*
+ * Accept one connection on @sock and map it to a new descriptor set up
+ * with @flags.  @file_flags are handed to the protocol and decide
+ * whether to wait for a connection.
+ */
+static int sock_accept_one(struct socket *sock,
+			   struct sockaddr __user *upeer_sockaddr,
+			   int __user *upeer_addrlen, int file_flags, int flags)
 {
-	struct socket *sock, *newsock;
+	struct socket *newsock;
 	int err, len;
 	char address[MAX_SOCK_ADDR];
 
-	sock = sockfd_lookup(fd, &err);/* 获得侦听端口的socket */
-	if (!sock)
-		goto out;
-
 	err = -ENFILE;
 	if (!(newsock = sock_alloc()))/* 分配一个新的套接口，用来处理与客户端的连接 */ 
-		goto out_put;
+		goto out;
 
 	/* 根据侦听套接口来初始化新连接的类型和回调表 */
 	newsock->type = sock->type;
@@ -1453,7 +1523,7 @@ asmlinkage long sys_accept(int fd, struct sockaddr __user *upeer_sockaddr, int _
 	__module_get(newsock->ops->owner);/* 增加模块引用计数 */
 
 	/* 调用传输层的accept，对TCP来说，是inet_accept */
-	err = sock->ops->accept(sock, newsock, sock->file->f_flags);
+	err = sock->ops->accept(sock, newsock, file_flags);
 	if (err < 0)
 		goto out_release;
 
@@ -1471,18 +1541,100 @@ asmlinkage long sys_accept(int fd, struct sockaddr __user *upeer_sockaddr, int _
 
 	/* File flags are not inherited via accept() unlike another OSes. */
 
-	if ((err = sock_map_fd(newsock)) < 0)/* 为新连接分配文件描述符 */
+	if ((err = sock_map_fd(newsock, flags)) < 0)/* 为新连接分配文件描述符 */
 		goto out_release;
 
 	security_socket_post_accept(sock, newsock);/* 安全审计 */
 
-out_put:
-	sockfd_put(sock);
 out:
 	return err;
 out_release:
 	sock_release(newsock);
-	goto out_put;
+	goto out;
+}
+
+asmlinkage long sys_accept4(int fd, struct sockaddr __user *upeer_sockaddr,
+			    int __user *upeer_addrlen, int flags)
+{
+	struct socket *sock;
+	int err;
+
+	if (flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+
+	sock = sockfd_lookup(fd, &err);/* 获得侦听端口的socket */
+	if (!sock)
+		return err;
+
+	err = sock_accept_one(sock, upeer_sockaddr, upeer_addrlen,
+			      sock->file->f_flags, flags);
+	sockfd_put(sock);
+	return err;
+}
+
+asmlinkage long sys_accept(int fd, struct sockaddr __user *upeer_sockaddr, int __user *upeer_addrlen)
+{
+	return sys_accept4(fd, upeer_sockaddr, upeer_addrlen, 0);
+}
+
+/*
+ *	Accept up to @vlen connections in one call.  Only the first one is
+ *	waited for (unless the listener is non-blocking); after that we take
+ *	whatever is already queued and stop when the queue is empty.
+ *	Returns the number of connections accepted, or an error if there
+ *	were none.
+ */
+asmlinkage long sys_acceptv(int fd, struct acceptvec __user *vec,
+			    unsigned int vlen, int flags)
+{
+	struct socket *sock;
+	struct acceptvec __user *entry;
+	struct sockaddr __user *uaddr;
+	int file_flags;
+	int accepted = 0;
+	int err;
+
+	if (flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+	if (vlen == 0)
+		return -EINVAL;
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	file_flags = sock->file->f_flags;
+	for (entry = vec; accepted < vlen; entry++) {
+		if (get_user(uaddr, &entry->av_addr)) {
+			err = -EFAULT;
+			break;
+		}
+
+		err = sock_accept_one(sock, uaddr,
+				      uaddr ? &entry->av_addrlen : NULL,
+				      file_flags, flags);
+		if (err < 0)
+			break;
+
+		/* nobody would ever learn this fd, so don't leave it open */
+		if (put_user(err, &entry->av_fd)) {
+			sys_close(err);
+			err = -EFAULT;
+			break;
+		}
+		accepted++;
+
+		/* Don't wait for more than the first one */
+		file_flags |= O_NONBLOCK;
+	}
+
+	sockfd_put(sock);
+
+	if (accepted)
+		return accepted;
+	return err;
 }
 
 
@@ -1799,63 +1951,59 @@ asmlinkage long sys_shutdown(int fd, int how)
  *	BSD sendmsg interface
  */
 /**
- * sendmsg系统调用
+ * 发送一个msghdr描述的报文，由sendmsg和sendmmsg共用。
+ * msg_sys用于保存从用户态复制的msghdr。
  */
-asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
+static int __sys_sendmsg(struct socket *sock, struct msghdr __user *msg,
+			 struct msghdr *msg_sys, unsigned flags)
 {
 	struct compat_msghdr __user *msg_compat = (struct compat_msghdr __user *)msg;
-	struct socket *sock;
 	char address[MAX_SOCK_ADDR];
 	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
 	unsigned char ctl[sizeof(struct cmsghdr) + 20];	/* 20 is size of ipv6_pktinfo */
 	unsigned char *ctl_buf = ctl;
-	struct msghdr msg_sys;
 	int err, ctl_len, iov_size, total_len;
 	
 	err = -EFAULT;
 	if (MSG_CMSG_COMPAT & flags) {/* 兼容模式 */
-		if (get_compat_msghdr(&msg_sys, msg_compat))/* 以兼容模式复制用户态参数 */
+		if (get_compat_msghdr(msg_sys, msg_compat))/* 以兼容模式复制用户态参数 */
 			return -EFAULT;
-	} else if (copy_from_user(&msg_sys, msg, sizeof(struct msghdr)))/* 正常复制msghdr */
+	} else if (copy_from_user(msg_sys, msg, sizeof(struct msghdr)))/* 正常复制msghdr */
 		return -EFAULT;
 
-	sock = sockfd_lookup(fd, &err);/* 查找文件描述符对应的套接口 */
-	if (!sock) 
-		goto out;
-
 	/* do not move before msg_sys is valid */
 	err = -EMSGSIZE;
-	if (msg_sys.msg_iovlen > UIO_MAXIOV)/* 数据块数量超过上限 */
-		goto out_put;
+	if (msg_sys->msg_iovlen > UIO_MAXIOV)/* 数据块数量超过上限 */
+		goto out;
 
 	/* Check whether to allocate the iovec area*/
 	err = -ENOMEM;
-	iov_size = msg_sys.msg_iovlen * sizeof(struct iovec);/* 计数iovec缓存大小 */
-	if (msg_sys.msg_iovlen > UIO_FASTIOV) {/* iovec缓存较大，不能使用栈中的缓存 */
+	iov_size = msg_sys->msg_iovlen * sizeof(struct iovec);/* 计数iovec缓存大小 */
+	if (msg_sys->msg_iovlen > UIO_FASTIOV) {/* iovec缓存较大，不能使用栈中的缓存 */
 		iov = sock_kmalloc(sock->sk, iov_size, GFP_KERNEL);/* 分配iovec缓存 */
 		if (!iov)
-			goto out_put;
+			goto out;
 	}
 
 	/* This will also move the address data into kernel space */
 	if (MSG_CMSG_COMPAT & flags) {/* 初步验证iovec的有效性 */
-		err = verify_compat_iovec(&msg_sys, iov, address, VERIFY_READ);
+		err = verify_compat_iovec(msg_sys, iov, address, VERIFY_READ);
 	} else
-		err = verify_iovec(&msg_sys, iov, address, VERIFY_READ);
+		err = verify_iovec(msg_sys, iov, address, VERIFY_READ);
 	if (err < 0) 
 		goto out_freeiov;
 	total_len = err;/* 如果iovec验证通过，则返回值是所有iovec缓存长度和 */
 
 	err = -ENOBUFS;
 
-	if (msg_sys.msg_controllen > INT_MAX)/* 检查控制信息长度 */
+	if (msg_sys->msg_controllen > INT_MAX)/* 检查控制信息长度 */
 		goto out_freeiov;
-	ctl_len = msg_sys.msg_controllen; 
+	ctl_len = msg_sys->msg_controllen; 
 	if ((MSG_CMSG_COMPAT & flags) && ctl_len) {/* 复制控制信息到内存 */
-		err = cmsghdr_from_user_compat_to_kern(&msg_sys, ctl, sizeof(ctl));
+		err = cmsghdr_from_user_compat_to_kern(msg_sys, ctl, sizeof(ctl));
 		if (err)
 			goto out_freeiov;
-		ctl_buf = msg_sys.msg_control;
+		ctl_buf = msg_sys->msg_control;
 	} else if (ctl_len) {
 		if (ctl_len > sizeof(ctl))
 		{
@@ -1865,19 +2013,19 @@ asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
 		}
 		err = -EFAULT;
 		/*
-		 * Careful! Before this, msg_sys.msg_control contains a user pointer.
+		 * Careful! Before this, msg_sys->msg_control contains a user pointer.
 		 * Afterwards, it will be a kernel pointer. Thus the compiler-assisted
 		 * checking falls down on this.
 		 */
-		if (copy_from_user(ctl_buf, (void __user *) msg_sys.msg_control, ctl_len))
+		if (copy_from_user(ctl_buf, (void __user *) msg_sys->msg_control, ctl_len))
 			goto out_freectl;
-		msg_sys.msg_control = ctl_buf;
+		msg_sys->msg_control = ctl_buf;
 	}
-	msg_sys.msg_flags = flags;
+	msg_sys->msg_flags = flags;
 
 	if (sock->file->f_flags & O_NONBLOCK)/* 如果文件系统是非阻塞方式，则发送也是非阻塞方式 */
-		msg_sys.msg_flags |= MSG_DONTWAIT;
-	err = sock_sendmsg(sock, &msg_sys, total_len);/* 发送报文 */
+		msg_sys->msg_flags |= MSG_DONTWAIT;
+	err = sock_sendmsg(sock, msg_sys, total_len);/* 发送报文 */
 
 out_freectl:
 	if (ctl_buf != ctl)    /* 如果临时申请了缓冲区，则释放 */
@@ -1885,23 +2033,87 @@ out_freectl:
 out_freeiov:
 	if (iov != iovstack)
 		sock_kfree_s(sock->sk, iov, iov_size);
-out_put:
-	sockfd_put(sock);
 out:       
 	return err;
 }
 
+/**
+ * sendmsg系统调用
+ */
+asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
+{
+	struct socket *sock;
+	struct msghdr msg_sys;
+	int err;
+
+	sock = sockfd_lookup(fd, &err);/* 查找文件描述符对应的套接口 */
+	if (!sock) 
+		goto out;
+
+	err = __sys_sendmsg(sock, msg, &msg_sys, flags);
+
+	sockfd_put(sock);
+out:
+	return err;
+}
+
 /*
- *	BSD recvmsg interface
+ *	Linux sendmmsg interface
+ *
+ *	Send up to vlen datagrams with one socket lookup.  msg_len of each
+ *	entry is set to the bytes sent.  Returns the number of entries
+ *	sent; an error only if not even the first one went out.
  */
+asmlinkage long sys_sendmmsg(int fd, struct mmsghdr __user *mmsg,
+			     unsigned int vlen, unsigned int flags)
+{
+	struct mmsghdr __user *entry = mmsg;
+	struct socket *sock;
+	struct msghdr msg_sys;
+	int err, datagrams = 0;
 
-asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flags)
+	/* The 32 bit mmsghdr layout isn't handled here. */
+	flags &= ~MSG_CMSG_COMPAT;
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	err = 0;
+	while (datagrams < vlen) {
+		err = __sys_sendmsg(sock, (struct msghdr __user *)entry,
+				    &msg_sys, flags);
+		if (err < 0)
+			break;
+		err = put_user(err, &entry->msg_len);
+		if (err)
+			break;
+		++entry;
+		++datagrams;
+		cond_resched();
+	}
+
+	sockfd_put(sock);
+
+	if (datagrams != 0)
+		return datagrams;
+	return err;
+}
+
+/*
+ *	BSD recvmsg interface
+ */
+/**
+ * 接收一个报文到msghdr描述的缓冲区，由recvmsg和recvmmsg共用。
+ */
+static int __sys_recvmsg(struct socket *sock, struct msghdr __user *msg,
+			 struct msghdr *msg_sys, unsigned int flags)
 {
 	struct compat_msghdr __user *msg_compat = (struct compat_msghdr __user *)msg;
-	struct socket *sock;
 	struct iovec iovstack[UIO_FASTIOV];
 	struct iovec *iov=iovstack;
-	struct msghdr msg_sys;
 	unsigned long cmsg_ptr;
 	int err, iov_size, total_len, len;
 
@@ -1913,27 +2125,23 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 	int __user *uaddr_len;
 	
 	if (MSG_CMSG_COMPAT & flags) {
-		if (get_compat_msghdr(&msg_sys, msg_compat))
+		if (get_compat_msghdr(msg_sys, msg_compat))
 			return -EFAULT;
 	} else
-		if (copy_from_user(&msg_sys,msg,sizeof(struct msghdr)))
+		if (copy_from_user(msg_sys,msg,sizeof(struct msghdr)))
 			return -EFAULT;
 
-	sock = sockfd_lookup(fd, &err);
-	if (!sock)
-		goto out;
-
 	err = -EMSGSIZE;
-	if (msg_sys.msg_iovlen > UIO_MAXIOV)
-		goto out_put;
+	if (msg_sys->msg_iovlen > UIO_MAXIOV)
+		goto out;
 	
 	/* Check whether to allocate the iovec area*/
 	err = -ENOMEM;
-	iov_size = msg_sys.msg_iovlen * sizeof(struct iovec);
-	if (msg_sys.msg_iovlen > UIO_FASTIOV) {
+	iov_size = msg_sys->msg_iovlen * sizeof(struct iovec);
+	if (msg_sys->msg_iovlen > UIO_FASTIOV) {
 		iov = sock_kmalloc(sock->sk, iov_size, GFP_KERNEL);
 		if (!iov)
-			goto out_put;
+			goto out;
 	}
 
 	/*
@@ -1941,41 +2149,41 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 	 *	kernel msghdr to use the kernel address space)
 	 */
 	 
-	uaddr = (void __user *) msg_sys.msg_name;
+	uaddr = (void __user *) msg_sys->msg_name;
 	uaddr_len = COMPAT_NAMELEN(msg);
 	if (MSG_CMSG_COMPAT & flags) {
-		err = verify_compat_iovec(&msg_sys, iov, addr, VERIFY_WRITE);
+		err = verify_compat_iovec(msg_sys, iov, addr, VERIFY_WRITE);
 	} else
-		err = verify_iovec(&msg_sys, iov, addr, VERIFY_WRITE);
+		err = verify_iovec(msg_sys, iov, addr, VERIFY_WRITE);
 	if (err < 0)
 		goto out_freeiov;
 	total_len=err;
 
-	cmsg_ptr = (unsigned long)msg_sys.msg_control;
-	msg_sys.msg_flags = 0;
+	cmsg_ptr = (unsigned long)msg_sys->msg_control;
+	msg_sys->msg_flags = 0;
 	if (MSG_CMSG_COMPAT & flags)
-		msg_sys.msg_flags = MSG_CMSG_COMPAT;
+		msg_sys->msg_flags = MSG_CMSG_COMPAT;
 	
 	if (sock->file->f_flags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
-	err = sock_recvmsg(sock, &msg_sys, total_len, flags);
+	err = sock_recvmsg(sock, msg_sys, total_len, flags);
 	if (err < 0)
 		goto out_freeiov;
 	len = err;
 
 	if (uaddr != NULL) {
-		err = move_addr_to_user(addr, msg_sys.msg_namelen, uaddr, uaddr_len);
+		err = move_addr_to_user(addr, msg_sys->msg_namelen, uaddr, uaddr_len);
 		if (err < 0)
 			goto out_freeiov;
 	}
-	err = __put_user(msg_sys.msg_flags, COMPAT_FLAGS(msg));
+	err = __put_user(msg_sys->msg_flags, COMPAT_FLAGS(msg));
 	if (err)
 		goto out_freeiov;
 	if (MSG_CMSG_COMPAT & flags)
-		err = __put_user((unsigned long)msg_sys.msg_control-cmsg_ptr, 
+		err = __put_user((unsigned long)msg_sys->msg_control-cmsg_ptr, 
 				 &msg_compat->msg_controllen);
 	else
-		err = __put_user((unsigned long)msg_sys.msg_control-cmsg_ptr, 
+		err = __put_user((unsigned long)msg_sys->msg_control-cmsg_ptr, 
 				 &msg->msg_controllen);
 	if (err)
 		goto out_freeiov;
@@ -1984,19 +2192,122 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 out_freeiov:
 	if (iov != iovstack)
 		sock_kfree_s(sock->sk, iov, iov_size);
-out_put:
+out:
+	return err;
+}
+
+asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flags)
+{
+	struct socket *sock;
+	struct msghdr msg_sys;
+	int err;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		goto out;
+
+	err = __sys_recvmsg(sock, msg, &msg_sys, flags);
+
 	sockfd_put(sock);
 out:
 	return err;
 }
 
+/*
+ *	Linux recvmmsg interface
+ *
+ *	Receive up to vlen datagrams with one socket lookup.  MSG_WAITFORONE
+ *	only blocks for the first one.  The timeout is checked after each
+ *	datagram, and what is left of it is written back.  An error after
+ *	some datagrams were received is left on the socket for the next call.
+ */
+asmlinkage long sys_recvmmsg(int fd, struct mmsghdr __user *mmsg,
+			     unsigned int vlen, unsigned int flags,
+			     struct timespec __user *timeout)
+{
+	struct mmsghdr __user *entry = mmsg;
+	struct socket *sock;
+	struct msghdr msg_sys;
+	struct timespec ts;
+	unsigned long end_time = 0;
+	int err, datagrams = 0;
+
+	/* The 32 bit mmsghdr layout isn't handled here. */
+	flags &= ~MSG_CMSG_COMPAT;
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+
+	if (timeout) {
+		if (copy_from_user(&ts, timeout, sizeof(ts)))
+			return -EFAULT;
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 ||
+		    ts.tv_nsec >= NSEC_PER_SEC)
+			return -EINVAL;
+		end_time = jiffies + timespec_to_jiffies(&ts);
+	}
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	err = sock_error(sock->sk);
+	if (err)
+		goto out_put;
+
+	while (datagrams < vlen) {
+		err = __sys_recvmsg(sock, (struct msghdr __user *)entry,
+				    &msg_sys, flags & ~MSG_WAITFORONE);
+		if (err < 0)
+			break;
+		err = put_user(err, &entry->msg_len);
+		if (err)
+			break;
+		++entry;
+		++datagrams;
+
+		/* MSG_WAITFORONE turns on MSG_DONTWAIT after one packet */
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+
+		if (timeout && time_after_eq(jiffies, end_time))
+			break;
+
+		/* Out of band data, return right away */
+		if (msg_sys.msg_flags & MSG_OOB)
+			break;
+		cond_resched();
+	}
+
+	if (timeout) {
+		long left = (long)(end_time - jiffies);
+
+		jiffies_to_timespec(left > 0 ? left : 0, &ts);
+		if (copy_to_user(timeout, &ts, sizeof(ts)) && !datagrams)
+			err = -EFAULT;
+	}
+
+	if (datagrams != 0) {
+		/*
+		 * Report a real error on the next call, the datagrams we
+		 * have must reach the user first.
+		 */
+		if (err < 0 && err != -EAGAIN)
+			sock->sk->sk_err = -err;
+		err = datagrams;
+	}
+out_put:
+	sockfd_put(sock);
+	return err;
+}
+
 #ifdef __ARCH_WANT_SYS_SOCKETCALL
 
 /* Argument list sizes for sys_socketcall */
 #define AL(x) ((x) * sizeof(unsigned long))
-static unsigned char nargs[18]={AL(0),AL(3),AL(3),AL(3),AL(2),AL(3),
+static unsigned char nargs[22]={AL(0),AL(3),AL(3),AL(3),AL(2),AL(3),
 				AL(3),AL(3),AL(4),AL(4),AL(4),AL(6),
-				AL(6),AL(2),AL(5),AL(5),AL(3),AL(3)};
+				AL(6),AL(2),AL(5),AL(5),AL(3),AL(3),
+				AL(4),AL(5),AL(4),AL(4)};
 #undef AL
 
 /*
@@ -2016,7 +2327,7 @@ asmlinkage long sys_socketcall(int call, unsigned long __user *args)
 	unsigned long a0,a1;
 	int err;
 
-	if(call<1||call>SYS_RECVMSG)
+	if(call<1||call>SYS_ACCEPTV)
 		return -EINVAL;
 
 	/* copy_from_user should be SMP safe. */
@@ -2081,6 +2392,22 @@ asmlinkage long sys_socketcall(int call, unsigned long __user *args)
 		case SYS_RECVMSG:
 			err = sys_recvmsg(a0, (struct msghdr __user *) a1, a[2]);
 			break;
+		case SYS_RECVMMSG:
+			err = sys_recvmmsg(a0, (struct mmsghdr __user *) a1, a[2],
+					   a[3], (struct timespec __user *) a[4]);
+			break;
+		case SYS_SENDMMSG:
+			err = sys_sendmmsg(a0, (struct mmsghdr __user *) a1, a[2],
+					   a[3]);
+			break;
+		case SYS_ACCEPT4:
+			err = sys_accept4(a0, (struct sockaddr __user *) a1,
+					  (int __user *) a[2], a[3]);
+			break;
+		case SYS_ACCEPTV:
+			err = sys_acceptv(a0, (struct acceptvec __user *) a1,
+					  a[2], a[3]);
+			break;
 		default:
 			err = -EINVAL;
 			break;
@@ -2143,6 +2470,11 @@ extern void sk_init(void);
  */
 void __init sock_init(void)
 {
+	/* 新文件描述符的标志不能与套接口类型重叠 */
+	BUILD_BUG_ON(SOCK_NONBLOCK & SOCK_TYPE_MASK);
+	BUILD_BUG_ON(SOCK_CLOEXEC & SOCK_TYPE_MASK);
+	BUILD_BUG_ON(SOCK_CLOEXEC & SOCK_NONBLOCK);
+
 	/*
 	 *	Initialize sock SLAB cache.
 	 */